@@ -0,0 +1,270 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#include "compiler/dependency_database.h"
+
+#include <asset/asset_cache.h>
+
+#include <core/yaml.h>
+
+namespace era_engine
+{
+	static constexpr uint32 DEPENDENCY_DATABASE_VERSION = 3;
+
+	bool dependency_database::load(const fs::path& path)
+	{
+		std::lock_guard lock{ mutex };
+
+		sources.clear();
+		models.clear();
+		textures.clear();
+
+		if (!fs::exists(path))
+		{
+			return false;
+		}
+
+		try
+		{
+			std::ifstream stream(path);
+			YAML::Node n = YAML::Load(stream);
+
+			uint32 version = 0;
+			YAML_LOAD(n, version, "Version");
+			if (version != DEPENDENCY_DATABASE_VERSION)
+			{
+				return false;
+			}
+
+			for (auto sourceNode : n["Sources"])
+			{
+				fs::path sourcePath;
+				source_stamp stamp;
+				YAML_LOAD(sourceNode, sourcePath, "Path");
+				YAML_LOAD(sourceNode, stamp.size, "Size");
+				YAML_LOAD(sourceNode, stamp.write_time, "WriteTime");
+				YAML_LOAD(sourceNode, stamp.content_hash, "Hash");
+				sources[sourcePath] = stamp;
+			}
+
+			for (auto modelNode : n["Models"])
+			{
+				fs::path modelPath;
+				model_record record;
+				YAML_LOAD(modelNode, modelPath, "Path");
+				YAML_LOAD(modelNode, record.content_hash, "Hash");
+				YAML_LOAD(modelNode, record.cache_key, "CacheKey");
+				YAML_LOAD(modelNode, record.compressed, "Compressed");
+				YAML_LOAD(modelNode, record.outputs, "Outputs");
+
+				for (auto textureNode : modelNode["Textures"])
+				{
+					texture_dependency dependency;
+					YAML_LOAD(textureNode, dependency.material, "Material");
+					YAML_LOAD(textureNode, dependency.path, "Path");
+					YAML_LOAD(textureNode, dependency.flags, "Flags");
+					record.textures.push_back(dependency);
+				}
+
+				models[modelPath] = std::move(record);
+			}
+
+			for (auto textureNode : n["Textures"])
+			{
+				fs::path texturePath;
+				texture_record record;
+				YAML_LOAD(textureNode, texturePath, "Path");
+				YAML_LOAD(textureNode, record.flags, "Flags");
+				YAML_LOAD(textureNode, record.content_hash, "Hash");
+				uint32 quality = (uint32)texture_cook_quality::NORMAL;
+				YAML_LOAD(textureNode, quality, "Quality");
+				record.quality = (texture_cook_quality)min(quality, (uint32)texture_cook_quality::COUNT - 1);
+				YAML_LOAD(textureNode, record.output, "Output");
+				textures[texturePath].push_back(record);
+			}
+		}
+		catch (const YAML::Exception&)
+		{
+			sources.clear();
+			models.clear();
+			textures.clear();
+			return false;
+		}
+
+		return true;
+	}
+
+	bool dependency_database::save(const fs::path& path) const
+	{
+		YAML::Node out;
+
+		{
+			std::lock_guard lock{ mutex };
+
+			out["Version"] = DEPENDENCY_DATABASE_VERSION;
+
+			for (const auto& [sourcePath, stamp] : sources)
+			{
+				YAML::Node n;
+				n["Path"] = sourcePath;
+				n["Size"] = stamp.size;
+				n["WriteTime"] = stamp.write_time;
+				n["Hash"] = stamp.content_hash;
+				out["Sources"].push_back(n);
+			}
+
+			for (const auto& [modelPath, record] : models)
+			{
+				YAML::Node n;
+				n["Path"] = modelPath;
+				n["Hash"] = record.content_hash;
+				n["CacheKey"] = record.cache_key;
+				n["Compressed"] = record.compressed;
+				for (const fs::path& output : record.outputs)
+				{
+					n["Outputs"].push_back(output);
+				}
+				for (const texture_dependency& dependency : record.textures)
+				{
+					YAML::Node t;
+					t["Material"] = dependency.material;
+					t["Path"] = dependency.path;
+					t["Flags"] = dependency.flags;
+					n["Textures"].push_back(t);
+				}
+				out["Models"].push_back(n);
+			}
+
+			for (const auto& [texturePath, records] : textures)
+			{
+				for (const texture_record& record : records)
+				{
+					YAML::Node n;
+					n["Path"] = texturePath;
+					n["Flags"] = record.flags;
+					n["Hash"] = record.content_hash;
+					n["Quality"] = (uint32)record.quality;
+					n["Output"] = record.output;
+					out["Textures"].push_back(n);
+				}
+			}
+		}
+
+		// Written to a temporary file first, so an interrupted run never leaves a truncated database behind.
+		std::error_code ec;
+		fs::create_directories(path.parent_path(), ec);
+
+		fs::path tempPath = path;
+		tempPath += ".tmp";
+		{
+			std::ofstream fout(tempPath);
+			if (!fout)
+			{
+				return false;
+			}
+			fout << out;
+		}
+
+		fs::rename(tempPath, path, ec);
+		return !ec;
+	}
+
+	uint64 dependency_database::get_content_hash(const fs::path& path)
+	{
+		std::error_code ec;
+		uint64 size = fs::file_size(path, ec);
+		if (ec)
+		{
+			return 0;
+		}
+		int64 writeTime = (int64)fs::last_write_time(path, ec).time_since_epoch().count();
+
+		{
+			std::lock_guard lock{ mutex };
+			auto it = sources.find(path);
+			if (it != sources.end() && it->second.size == size && it->second.write_time == writeTime && it->second.content_hash)
+			{
+				++reused_hashes;
+				return it->second.content_hash;
+			}
+		}
+
+		uint64 hash = hash_file_content(path);
+		if (hash)
+		{
+			std::lock_guard lock{ mutex };
+			sources[path] = { size, writeTime, hash };
+		}
+		return hash;
+	}
+
+	bool dependency_database::find_model(const fs::path& path, model_record& out) const
+	{
+		std::lock_guard lock{ mutex };
+		auto it = models.find(path);
+		if (it == models.end())
+		{
+			return false;
+		}
+		out = it->second;
+		return true;
+	}
+
+	void dependency_database::set_model(const fs::path& path, const model_record& record)
+	{
+		std::lock_guard lock{ mutex };
+		models[path] = record;
+	}
+
+	bool dependency_database::find_texture(const fs::path& path, uint32 flags, texture_record& out) const
+	{
+		std::lock_guard lock{ mutex };
+		auto it = textures.find(path);
+		if (it == textures.end())
+		{
+			return false;
+		}
+		for (const texture_record& record : it->second)
+		{
+			if (record.flags == flags)
+			{
+				out = record;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void dependency_database::set_texture(const fs::path& path, const texture_record& record)
+	{
+		std::lock_guard lock{ mutex };
+		std::vector<texture_record>& records = textures[path];
+		for (texture_record& existing : records)
+		{
+			if (existing.flags == record.flags)
+			{
+				existing = record;
+				return;
+			}
+		}
+		records.push_back(record);
+	}
+
+	std::vector<fs::path> dependency_database::get_models_using_texture(const fs::path& texture) const
+	{
+		std::vector<fs::path> result;
+
+		std::lock_guard lock{ mutex };
+		for (const auto& [modelPath, record] : models)
+		{
+			for (const texture_dependency& dependency : record.textures)
+			{
+				if (dependency.path == texture)
+				{
+					result.push_back(modelPath);
+					break;
+				}
+			}
+		}
+		return result;
+	}
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#pragma once
+
+#include <asset/texture_cooker.h>
+
+namespace era_engine
+{
+	// Size and write time of a source file at the time its content hash was computed.
+	struct source_stamp
+	{
+		uint64 size = 0;
+		int64 write_time = 0;
+		uint64 content_hash = 0;
+	};
+
+	// Material -> texture edge of a model.
+	struct texture_dependency
+	{
+		uint32 material = 0;
+		fs::path path;
+		uint32 flags = 0;
+	};
+
+	struct model_record
+	{
+		uint64 content_hash = 0;
+		uint64 cache_key = 0;
+		bool compressed = false;
+		std::vector<fs::path> outputs;
+		std::vector<texture_dependency> textures;
+	};
+
+	struct texture_record
+	{
+		uint32 flags = 0;
+		uint64 content_hash = 0;
+		// Not part of the cache key, since the runtime looks cooked textures up by their load flags only.
+		texture_cook_quality quality = texture_cook_quality::NORMAL;
+		fs::path output;
+	};
+
+	// Persistent record of what the last compiler runs produced: source hash -> outputs for every model and texture,
+	// plus the textures each model's materials reference. Lets batch builds skip unchanged assets without re-importing
+	// or even re-hashing them. Stored as YAML next to the asset cache. All functions are thread safe.
+	struct dependency_database
+	{
+		// Returns false if the file does not exist or cannot be parsed. The database is empty in that case.
+		bool load(const fs::path& path);
+		bool save(const fs::path& path) const;
+
+		// Content hash of the file. The recorded hash is reused if size and write time are unchanged since it was computed.
+		// Returns 0 if the file cannot be read.
+		NODISCARD uint64 get_content_hash(const fs::path& path);
+
+		bool find_model(const fs::path& path, model_record& out) const;
+		void set_model(const fs::path& path, const model_record& record);
+
+		bool find_texture(const fs::path& path, uint32 flags, texture_record& out) const;
+		void set_texture(const fs::path& path, const texture_record& record);
+
+		// Reverse edges: models whose materials reference this texture.
+		NODISCARD std::vector<fs::path> get_models_using_texture(const fs::path& texture) const;
+
+		NODISCARD uint64 get_reused_hash_count() const { return reused_hashes; }
+
+	private:
+		std::unordered_map<fs::path, source_stamp> sources;
+		std::unordered_map<fs::path, model_record> models;
+		std::unordered_map<fs::path, std::vector<texture_record>> textures;
+
+		std::atomic<uint64> reused_hashes = 0;
+		mutable std::mutex mutex;
+	};
+}
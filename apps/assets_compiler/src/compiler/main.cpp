@@ -1,15 +1,580 @@
 // Copyright (c) 2023-present Eldar Muradov. All rights reserved.
 #include <fstream>
 #include <iostream>
+#include <sstream>
 
 #include <clara/clapa.hpp>
 
+#include <DirectXTex/DirectXTex.h>
+
+#include <asset/asset_cache.h>
 #include <asset/bin.h>
+#include <asset/image.h>
+#include <asset/mesh_optimization.h>
+#include <asset/mesh_simplification.h>
+#include <asset/meshlet_builder.h>
 #include <asset/model_asset.h>
+#include <asset/pbr_material_desc.h>
+#include <asset/texture_cooker.h>
 
+#include <core/hash.h>
+#include <core/job_system.h>
 #include <core/log.h>
 #include <core/string.h>
 
+#include "compiler/dependency_database.h"
+
+namespace era_engine
+{
+	struct compiler_options
+	{
+		bool verbose = false;
+		bool force = false;
+		bool compress = false;
+		bool optimize_overdraw = false;
+		bool no_lods = false;
+		float lod_error = lod_generation_options{}.max_error;
+		texture_cook_quality texture_quality = texture_cook_quality::NORMAL;
+	};
+
+	enum asset_status
+	{
+		asset_status_up_to_date,
+		asset_status_built,
+		asset_status_failed,
+	};
+
+	struct asset_result
+	{
+		fs::path path;
+		bool texture = false;
+		asset_status status = asset_status_failed;
+		float milliseconds = 0.f;
+		std::string message;
+	};
+
+	struct texture_job
+	{
+		fs::path path;
+		uint32 flags;
+	};
+
+	static std::mutex outputMutex;
+
+	static void print(const std::string& text)
+	{
+		std::lock_guard lock{ outputMutex };
+		std::cout << text;
+	}
+
+	static bool isModelExtension(const fs::path& path)
+	{
+		std::string extension = path.extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(),
+			[](char c) { return std::tolower(c); });
+		return extension == ".fbx" || extension == ".obj";
+	}
+
+	// Material paths are stored relative to the working directory of the importer (see relative_filepath).
+	static fs::path resolveTexturePath(const fs::path& path)
+	{
+		return fs::absolute(path).lexically_normal();
+	}
+
+	static void addTextureDependencies(const ModelAsset& model, model_record& record)
+	{
+		for (uint32 i = 0; i < (uint32)model.materials.size(); ++i)
+		{
+			const PbrMaterialDesc& material = model.materials[i];
+
+			auto add = [&](const fs::path& path, uint32 flags)
+			{
+				if (!path.empty() && (flags & image_load_flags_cache_to_dds))
+				{
+					record.textures.push_back({ i, resolveTexturePath(path), flags });
+				}
+			};
+
+			add(material.albedo, material.albedo_flags);
+			add(material.normal, material.normal_flags);
+			add(material.roughness, material.roughness_flags);
+			add(material.metallic, material.metallic_flags);
+		}
+	}
+
+	static void buildModel(ModelAsset& model, const compiler_options& options, std::ostringstream& log)
+	{
+		if (!options.no_lods)
+		{
+			lod_generation_options lod_options;
+			lod_options.max_error = options.lod_error;
+			lod_generation_report lod_report = generateModelLods(model, lod_options);
+
+			if (options.verbose)
+			{
+				log << "  Generated " << lod_report.levels.size() << " LOD levels in " << lod_report.milliseconds << " ms.\n";
+				log << "    LOD  triangles  reduction  max error\n";
+				for (uint32 l = 0; l < (uint32)lod_report.levels.size(); ++l)
+				{
+					const lod_report_level& level = lod_report.levels[l];
+					float reduction = level.source_triangles ? 1.f - (float)level.triangles / level.source_triangles : 0.f;
+					log << "    " << (l + 1) << "    " << level.triangles << "    "
+						<< reduction * 100.f << "%    " << level.max_relative_error * 100.f << "%\n";
+				}
+			}
+		}
+
+		mesh_optimization_options optimization_options;
+		optimization_options.optimize_overdraw = options.optimize_overdraw;
+		mesh_optimization_report optimization_report = optimizeModel(model, optimization_options);
+
+		meshlet_build_report meshlet_report = buildModelMeshlets(model);
+
+		if (options.verbose)
+		{
+			log << "  Optimized " << optimization_report.num_submeshes << " submeshes in " << optimization_report.milliseconds << " ms. "
+				<< "ACMR: " << optimization_report.before.acmr() << " -> " << optimization_report.after.acmr() << ", "
+				<< "ATVR: " << optimization_report.before.atvr() << " -> " << optimization_report.after.atvr() << "\n";
+			log << "  Built " << meshlet_report.num_meshlets << " meshlets in " << meshlet_report.milliseconds << " ms ("
+				<< (meshlet_report.num_meshlets ? (float)meshlet_report.num_triangles / meshlet_report.num_meshlets : 0.f) << " triangles per meshlet, "
+				<< meshlet_report.num_culling_cones << " with normal cones)\n";
+		}
+	}
+
+	// LOD and overdraw options change the geometry in the BIN, so builds with non-default options get their own cache
+	// entries. Default builds keep the key of the runtime loader, which builds with the same defaults (see import_and_cache
+	// in model_asset.cpp). Compression only changes how the same geometry is stored and is recorded in the dependency
+	// database instead.
+	static uint64 getModelCacheKey(uint64 contentHash, const compiler_options& options)
+	{
+		uint64 key = get_model_cache_key_for_content(contentHash, mesh_flag_default);
+
+		const compiler_options defaults;
+		bool defaultGeometry = options.no_lods == defaults.no_lods
+			&& options.optimize_overdraw == defaults.optimize_overdraw
+			&& (options.no_lods || options.lod_error == defaults.lod_error);
+		if (!key || defaultGeometry)
+		{
+			return key;
+		}
+
+		struct
+		{
+			uint32 no_lods;
+			uint32 optimize_overdraw;
+			float lod_error;
+		} geometry = { options.no_lods, options.optimize_overdraw, options.no_lods ? 0.f : options.lod_error };
+
+		return hash_bytes(&geometry, sizeof(geometry), key);
+	}
+
+	static asset_result compileModel(const fs::path& path, const compiler_options& options, dependency_database& database)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		asset_result result;
+		result.path = path;
+
+		std::ostringstream log;
+
+		uint64 contentHash = database.get_content_hash(path);
+		uint64 cacheKey = getModelCacheKey(contentHash, options);
+		if (!cacheKey)
+		{
+			result.message = "could not read file";
+		}
+		else
+		{
+			model_record previous;
+			bool known = database.find_model(path, previous);
+
+			fs::path cacheFilepath;
+			bool cached = !options.force && find_asset_cache_entry(cacheKey, model_cache_extension, cacheFilepath);
+
+			bool recorded = known && previous.cache_key == cacheKey;
+
+			if (cached && recorded && previous.compressed == options.compress)
+			{
+				result.status = asset_status_up_to_date;
+			}
+			else
+			{
+				model_record record;
+				record.content_hash = contentHash;
+				record.cache_key = cacheKey;
+				record.compressed = options.compress;
+				record.outputs.push_back(get_asset_cache_path(cacheKey, model_cache_extension));
+
+				if (cached && !recorded)
+				{
+					// Built by another checkout or machine sharing the cache. Only the texture edges are missing. Its
+					// compression is unknown, but the geometry is the same either way.
+					addTextureDependencies(loadBIN(cacheFilepath), record);
+					result.status = asset_status_up_to_date;
+				}
+				else
+				{
+					ModelAsset model = import_model_asset(path, mesh_flag_default);
+					buildModel(model, options, log);
+
+					bin_write_options write_options;
+					write_options.compression = options.compress ? bin_compression_lz4 : bin_compression_none;
+
+					fs::path tempFilepath = begin_asset_cache_entry(cacheKey, model_cache_extension);
+					writeBIN(model, tempFilepath, write_options);
+
+					if (commit_asset_cache_entry(tempFilepath, cacheKey, model_cache_extension))
+					{
+						addTextureDependencies(model, record);
+						result.status = asset_status_built;
+					}
+					else
+					{
+						result.message = "could not write cache entry";
+					}
+				}
+
+				if (result.status != asset_status_failed)
+				{
+					database.set_model(path, record);
+				}
+			}
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+		result.milliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+		if (options.verbose || result.status != asset_status_up_to_date)
+		{
+			std::ostringstream line;
+			line << (result.status == asset_status_built ? "Built " : result.status == asset_status_failed ? "FAILED " : "Up to date ")
+				<< path.string() << " (" << result.milliseconds << " ms)";
+			if (!result.message.empty())
+			{
+				line << ": " << result.message;
+			}
+			line << "\n" << log.str();
+			print(line.str());
+		}
+
+		return result;
+	}
+
+	static asset_result cookTexture(const texture_job& job, const compiler_options& options, dependency_database& database)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		asset_result result;
+		result.path = job.path;
+		result.texture = true;
+
+		uint64 contentHash = database.get_content_hash(job.path);
+
+		if (!contentHash)
+		{
+			result.message = "could not read file";
+		}
+		else
+		{
+			texture_record previous;
+			bool known = database.find_texture(job.path, job.flags, previous);
+
+			// The quality is not part of the cache key, so a texture cooked with a different quality must be overwritten.
+			bool qualityChanged = known && previous.quality != options.texture_quality;
+
+			if (!options.force && known && previous.content_hash == contentHash && !qualityChanged && fs::exists(previous.output))
+			{
+				result.status = asset_status_up_to_date;
+			}
+			else
+			{
+				fs::path output;
+				if (cookTextureToCache(job.path, job.flags, options.texture_quality, options.force || qualityChanged, output))
+				{
+					database.set_texture(job.path, { job.flags, contentHash, options.texture_quality, output });
+					result.status = asset_status_built;
+				}
+				else
+				{
+					// HDR, DDS and SVG sources go through the image loader and its own DDS cache. The loader reuses a DDS
+					// which is newer than the source, so remove it to force a rebuild.
+					output = getImageCachePath(job.path, job.flags);
+					std::error_code ec;
+					fs::remove(output, ec);
+
+					DirectX::ScratchImage image;
+					D3D12_RESOURCE_DESC desc;
+					if (loadImageFromFile(job.path, job.flags, image, desc))
+					{
+						database.set_texture(job.path, { job.flags, contentHash, options.texture_quality, output });
+						result.status = asset_status_built;
+					}
+					else
+					{
+						result.message = "could not load image";
+					}
+				}
+			}
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+		result.milliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+		if (options.verbose || result.status != asset_status_up_to_date)
+		{
+			std::ostringstream line;
+			line << (result.status == asset_status_built ? "Cooked " : result.status == asset_status_failed ? "FAILED " : "Up to date ")
+				<< job.path.string() << " (" << result.milliseconds << " ms)";
+			if (!result.message.empty())
+			{
+				line << ": " << result.message;
+			}
+			line << "\n";
+			print(line.str());
+		}
+
+		return result;
+	}
+
+	static std::string readWholeFile(const fs::path& path)
+	{
+		std::ifstream stream(path, std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+	}
+
+	// Parses an OBJ file with the serial and the parallel parser, reports the throughput of both and checks that they
+	// produce byte-identical BIN files.
+	static bool benchmarkOBJ(const fs::path& path, uint32 iterations)
+	{
+		double megabytes = (double)fs::file_size(path) / (1024.0 * 1024.0);
+		iterations = max(iterations, 1u);
+
+		ModelAsset models[2];
+		for (uint32 parallel = 0; parallel < 2; ++parallel)
+		{
+			double bestSeconds = DBL_MAX;
+			for (uint32 i = 0; i < iterations; ++i)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				models[parallel] = loadOBJ(path, mesh_flag_default, parallel != 0);
+				auto end = std::chrono::high_resolution_clock::now();
+				bestSeconds = min(bestSeconds, std::chrono::duration<double>(end - start).count());
+			}
+
+			std::cout << (parallel ? "Parallel" : "Serial  ") << " OBJ parser: " << megabytes / bestSeconds << " MB/s ("
+				<< bestSeconds * 1000.0 << " ms for " << megabytes << " MB, best of " << iterations << ")\n";
+		}
+
+		fs::path outputs[2] = { fs::temp_directory_path() / "era_obj_serial.bin", fs::temp_directory_path() / "era_obj_parallel.bin" };
+		writeBIN(models[0], outputs[0]);
+		writeBIN(models[1], outputs[1]);
+
+		bool identical = readWholeFile(outputs[0]) == readWholeFile(outputs[1]);
+		std::cout << "Output is " << (identical ? "byte-identical" : "DIFFERENT") << ".\n";
+
+		fs::remove(outputs[0]);
+		fs::remove(outputs[1]);
+		return identical;
+	}
+
+	// Cooks the image at 'path' into every block compressed format and reports the throughput and the error of each,
+	// plus the throughput of mip generation alone. The image is cropped to a multiple of 4.
+	static bool benchmarkTextures(const fs::path& path, uint32 iterations, texture_cook_quality quality)
+	{
+		std::vector<uint8> source;
+		uint32 width, height, numChannels;
+		if (!loadTextureSource(path, source, width, height, numChannels))
+		{
+			std::cerr << "Could not load image '" << path << "'.\n";
+			return false;
+		}
+
+		uint32 croppedWidth = width & ~3u;
+		uint32 croppedHeight = height & ~3u;
+		if (croppedWidth == 0 || croppedHeight == 0)
+		{
+			std::cerr << "Image is smaller than one block.\n";
+			return false;
+		}
+
+		std::vector<uint8> rgba((uint64)croppedWidth * croppedHeight * 4);
+		for (uint32 y = 0; y < croppedHeight; ++y)
+		{
+			memcpy(rgba.data() + (uint64)y * croppedWidth * 4, source.data() + (uint64)y * width * 4, croppedWidth * 4);
+		}
+
+		double megapixels = (double)croppedWidth * croppedHeight / 1e6;
+		iterations = max(iterations, 1u);
+
+		std::cout << croppedWidth << "x" << croppedHeight << ", " << texture_cook_quality_names[(uint32)quality] << " quality, best of " << iterations << "\n";
+
+		struct benchmark_case
+		{
+			texture_cook_format format;
+			bool mips;
+			uint32 channels; // Compared channels, one bit each.
+		};
+
+		const benchmark_case cases[] =
+		{
+			{ texture_cook_format::BC1, false, 0x7 },
+			{ texture_cook_format::BC3, false, 0xF },
+			{ texture_cook_format::BC4, false, 0x1 },
+			{ texture_cook_format::BC5, false, 0x3 },
+			{ texture_cook_format::BC7, false, 0xF },
+			{ texture_cook_format::RGBA8, true, 0xF },
+		};
+
+		for (const benchmark_case& c : cases)
+		{
+			texture_cook_options cookOptions;
+			cookOptions.format = c.format;
+			cookOptions.quality = quality;
+			cookOptions.generate_mips = c.mips;
+
+			cooked_texture texture;
+			double bestSeconds = DBL_MAX;
+			for (uint32 i = 0; i < iterations; ++i)
+			{
+				auto start = std::chrono::high_resolution_clock::now();
+				cookTexture(rgba.data(), croppedWidth, croppedHeight, numChannels, cookOptions, texture);
+				auto end = std::chrono::high_resolution_clock::now();
+				bestSeconds = min(bestSeconds, std::chrono::duration<double>(end - start).count());
+			}
+
+			std::cout << (c.mips ? "Mips " : texture_cook_format_names[(uint32)c.format]) << ": " << megapixels / bestSeconds
+				<< " MPix/s (" << bestSeconds * 1000.0 << " ms)";
+
+			std::vector<uint8> decoded;
+			if (!c.mips && decodeCookedTexture(texture, 0, decoded))
+			{
+				double squaredError = 0.0;
+				uint64 count = 0;
+				for (uint64 i = 0; i < decoded.size(); ++i)
+				{
+					if (c.channels & (1 << (i % 4)))
+					{
+						double d = (double)decoded[i] - (double)rgba[i];
+						squaredError += d * d;
+						++count;
+					}
+				}
+
+				double mse = squaredError / (double)count;
+				std::cout << ", RMSE " << sqrt(mse);
+				if (mse > 0.0)
+				{
+					std::cout << ", PSNR " << 10.0 * log10(255.0 * 255.0 / mse) << " dB";
+				}
+			}
+			std::cout << "\n";
+		}
+
+		return true;
+	}
+
+	static void collectDirectory(const fs::path& directory, std::vector<fs::path>& models)
+	{
+		for (const auto& entry : fs::recursive_directory_iterator(directory, fs::directory_options::skip_permission_denied))
+		{
+			if (entry.is_regular_file() && isModelExtension(entry.path()))
+			{
+				models.push_back(entry.path().lexically_normal());
+			}
+		}
+	}
+
+	// One path per line, relative to the manifest. Empty lines and lines starting with '#' are ignored.
+	static bool collectManifest(const fs::path& manifest, std::vector<fs::path>& models, std::vector<texture_job>& textures)
+	{
+		std::ifstream stream(manifest);
+		if (!stream)
+		{
+			return false;
+		}
+
+		std::string line;
+		while (std::getline(stream, line))
+		{
+			line.erase(line.find_last_not_of(" \t\r") + 1);
+			line.erase(0, line.find_first_not_of(" \t"));
+			if (line.empty() || line[0] == '#')
+			{
+				continue;
+			}
+
+			fs::path path = fs::path(line).is_absolute() ? fs::path(line) : manifest.parent_path() / line;
+			path = fs::absolute(path).lexically_normal();
+
+			if (isModelExtension(path))
+			{
+				models.push_back(path);
+			}
+			else if (isImageExtension(path.extension()))
+			{
+				textures.push_back({ path, image_load_flags_default });
+			}
+			else
+			{
+				std::cerr << "Skipping '" << path << "': unknown asset type.\n";
+			}
+		}
+		return true;
+	}
+
+	static void printSummary(const std::vector<asset_result>& results, float wallMilliseconds, const dependency_database& database, bool verbose)
+	{
+		uint32 counts[2][3] = {};
+		float totalMilliseconds = 0.f;
+		for (const asset_result& result : results)
+		{
+			++counts[result.texture][result.status];
+			totalMilliseconds += result.milliseconds;
+		}
+
+		std::cout << "\nModels:   " << counts[0][asset_status_built] << " built, " << counts[0][asset_status_up_to_date] << " up to date, "
+			<< counts[0][asset_status_failed] << " failed\n";
+		std::cout << "Textures: " << counts[1][asset_status_built] << " cooked, " << counts[1][asset_status_up_to_date] << " up to date, "
+			<< counts[1][asset_status_failed] << " failed\n";
+		std::cout << "Finished in " << wallMilliseconds << " ms (" << totalMilliseconds << " ms of asset work).\n";
+
+		std::vector<const asset_result*> slowest;
+		for (const asset_result& result : results)
+		{
+			if (result.status == asset_status_built)
+			{
+				slowest.push_back(&result);
+			}
+		}
+		std::sort(slowest.begin(), slowest.end(), [](const asset_result* a, const asset_result* b) { return a->milliseconds > b->milliseconds; });
+		if (!slowest.empty())
+		{
+			std::cout << "Slowest:\n";
+			for (uint32 i = 0; i < min((uint32)slowest.size(), 5u); ++i)
+			{
+				std::cout << "  " << slowest[i]->milliseconds << " ms  " << slowest[i]->path.string() << "\n";
+			}
+		}
+
+		for (const asset_result& result : results)
+		{
+			if (verbose && result.texture && result.status == asset_status_built)
+			{
+				uint32 numModels = (uint32)database.get_models_using_texture(result.path).size();
+				if (numModels)
+				{
+					std::cout << "Texture " << result.path.string() << " is used by " << numModels << " model(s).\n";
+				}
+			}
+		}
+
+		AssetCacheStats stats = get_asset_cache_stats();
+		std::cout << "Cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.writes << " writes. "
+			<< "Hashed " << stats.hashed_files << " files (" << stats.hashed_bytes << " bytes) in " << stats.hashing_ms << " ms, "
+			<< database.get_reused_hash_count() << " hashes reused from the dependency database.\n";
+	}
+}
+
 int main(int argc, char** argv)
 {
 	using namespace era_engine;
@@ -18,11 +583,32 @@ int main(int argc, char** argv)
 	try
 	{
 		fs::path path;
-		bool verbose = false;
+		fs::path directory;
+		fs::path manifest;
+		fs::path cache_directory;
+		fs::path database_path;
+		compiler_options options;
+		bool benchmark_obj = false;
+		bool benchmark_textures = false;
+		uint32 benchmark_iterations = 3;
+		std::string texture_quality = "normal";
 
 		Parser cli;
-		cli += Opt(verbose, "verbose")["-v"]["--verbose"]("Enable verbose logging");
+		cli += Opt(options.verbose, "verbose")["-v"]["--verbose"]("Enable verbose logging");
 		cli += Opt(path, "path")["-p"]["--path"]("Path to asset");
+		cli += Opt(directory, "dir")["-d"]["--dir"]("Compile all models in this directory and its subdirectories");
+		cli += Opt(manifest, "manifest")["-m"]["--manifest"]("Compile all assets listed in this file, one path per line");
+		cli += Opt(cache_directory, "cache")["--cache"]("Asset cache directory (may be shared between machines)");
+		cli += Opt(database_path, "db")["--db"]("Dependency database (default: <cache>/dependencies.yaml)");
+		cli += Opt(options.force, "force")["-f"]["--force"]("Rebuild all assets, even if they are up to date");
+		cli += Opt(options.compress, "compress")["-c"]["--compress"]("Store geometry LZ4-compressed in the cache");
+		cli += Opt(options.optimize_overdraw, "overdraw")["--overdraw"]("Sort triangle clusters to reduce overdraw");
+		cli += Opt(options.no_lods, "no-lods")["--no-lods"]("Do not generate LODs");
+		cli += Opt(options.lod_error, "lod-error")["--lod-error"]("Maximum LOD error, relative to the submesh extent");
+		cli += Opt(texture_quality, "fast|normal|high")["--texture-quality"]("Block compression quality of cooked textures");
+		cli += Opt(benchmark_obj, "benchmark-obj")["--benchmark-obj"]("Measure the serial and parallel OBJ parsers on --path and compare their output");
+		cli += Opt(benchmark_textures, "benchmark-textures")["--benchmark-textures"]("Measure mip generation and block compression of the image passed with --path");
+		cli += Opt(benchmark_iterations, "iterations")["--iterations"]("Benchmark iterations");
 
 		auto result = cli.parse(Args(argc, argv));
 		if (!result)
@@ -30,49 +616,162 @@ int main(int argc, char** argv)
 			std::cerr << "Error in command line: " << result.errorMessage() << std::endl;
 		}
 
-		path = get_full_path(path);
+		if (texture_quality == "fast")
+		{
+			options.texture_quality = texture_cook_quality::FAST;
+		}
+		else if (texture_quality == "high")
+		{
+			options.texture_quality = texture_cook_quality::HIGH;
+		}
+		else if (texture_quality != "normal")
+		{
+			std::cerr << "Unknown texture quality '" << texture_quality << "'. Use fast, normal or high.\n";
+			return EXIT_FAILURE;
+		}
+
+		if (!cache_directory.empty())
+		{
+			set_asset_cache_directory(cache_directory);
+		}
+		if (database_path.empty())
+		{
+			database_path = get_asset_cache_directory() / "dependencies.yaml";
+		}
+
+		std::vector<fs::path> models;
+		std::vector<texture_job> textures;
 
-		if (!fs::exists(path))
+		if (!path.empty())
+		{
+			path = get_full_path(path);
+			if (!fs::exists(path))
+			{
+				std::cerr << "Could not find file '" << path << "'.\n";
+				return EXIT_FAILURE;
+			}
+			models.push_back(path.lexically_normal());
+		}
+		if (!directory.empty())
+		{
+			if (!fs::is_directory(directory))
+			{
+				std::cerr << "Could not find directory '" << directory << "'.\n";
+				return EXIT_FAILURE;
+			}
+			collectDirectory(fs::absolute(directory), models);
+		}
+		if (!manifest.empty() && !collectManifest(fs::absolute(manifest), models, textures))
 		{
-			std::cerr << "Could not find file '" << path << "'.\n";
+			std::cerr << "Could not read manifest '" << manifest << "'.\n";
 			return EXIT_FAILURE;
 		}
 
-		std::string extension = path.extension().string();
+		if (models.empty() && textures.empty())
+		{
+			std::cerr << "Nothing to compile. Use --path, --dir or --manifest.\n";
+			return EXIT_FAILURE;
+		}
 
-		fs::path cached_filename = path;
-		cached_filename.replace_extension("." + std::to_string(mesh_flag_default) + ".cache.bin");
-		fs::path cache_filepath = L"asset_cache" / cached_filename;
+		// WIC decoders are created on the worker threads.
+		CoInitializeEx(NULL, COINIT_MULTITHREADED);
+		initialize_job_system();
 
-		if (fs::exists(cache_filepath))
+		if (benchmark_obj)
 		{
-			auto last_cache_write_time = fs::last_write_time(cache_filepath);
-			auto last_original_write_time = fs::last_write_time(path);
+			if (path.empty() || path.extension() != ".obj")
+			{
+				std::cerr << "--benchmark-obj needs an OBJ file passed with --path.\n";
+				return EXIT_FAILURE;
+			}
+			return benchmarkOBJ(path, benchmark_iterations) ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
 
-			if (last_cache_write_time > last_original_write_time)
+		if (benchmark_textures)
+		{
+			if (path.empty())
 			{
-				std::cout << "Asset is already compiled! \n";
-				return EXIT_SUCCESS;
+				std::cerr << "--benchmark-textures needs an image passed with --path.\n";
+				return EXIT_FAILURE;
 			}
+			return benchmarkTextures(path, benchmark_iterations, options.texture_quality) ? EXIT_SUCCESS : EXIT_FAILURE;
 		}
 
-		std::cout << "Preprocessing asset '" << path << "' for faster loading next time.\n";
+		std::sort(models.begin(), models.end());
+		models.erase(std::unique(models.begin(), models.end()), models.end());
 
-		ModelAsset result_mesh;
+		auto start = std::chrono::high_resolution_clock::now();
 
-		std::transform(extension.begin(), extension.end(), extension.begin(),
-			[](char c) { return std::tolower(c); });
-		if (extension == ".fbx")
+		dependency_database database;
+		database.load(database_path);
+
+		std::vector<asset_result> results(models.size());
+		// Importer errors fail the asset, not the whole run.
+		auto guarded = [](const fs::path& path, bool texture, auto&& compile)
 		{
-			result_mesh = loadFBX(path, mesh_flag_default);
+			try
+			{
+				return compile();
+			}
+			catch (const std::exception& ex)
+			{
+				asset_result failed;
+				failed.path = path;
+				failed.texture = texture;
+				failed.message = ex.what();
+				print("FAILED " + path.string() + ": " + failed.message + "\n");
+				return failed;
+			}
+		};
+
+		parallel_for(low_priority_job_queue, (uint32)models.size(), 1, [&](uint32 i)
+		{
+			results[i] = guarded(models[i], false, [&]() { return compileModel(models[i], options, database); });
+		});
+
+		// Textures referenced by several models or materials are cooked once.
+		for (const fs::path& model : models)
+		{
+			model_record record;
+			if (database.find_model(model, record))
+			{
+				for (const texture_dependency& dependency : record.textures)
+				{
+					textures.push_back({ dependency.path, dependency.flags });
+				}
+			}
 		}
-		else if (extension == ".obj")
+		std::sort(textures.begin(), textures.end(), [](const texture_job& a, const texture_job& b)
+		{
+			return (a.path != b.path) ? (a.path < b.path) : (a.flags < b.flags);
+		});
+		textures.erase(std::unique(textures.begin(), textures.end(), [](const texture_job& a, const texture_job& b)
+		{
+			return a.path == b.path && a.flags == b.flags;
+		}), textures.end());
+
+		uint32 firstTexture = (uint32)results.size();
+		results.resize(results.size() + textures.size());
+		parallel_for(low_priority_job_queue, (uint32)textures.size(), 1, [&](uint32 i)
 		{
-			result_mesh = loadOBJ(path, mesh_flag_default);
+			results[firstTexture + i] = guarded(textures[i].path, true, [&]() { return cookTexture(textures[i], options, database); });
+		});
+
+		if (!database.save(database_path))
+		{
+			std::cerr << "Could not write dependency database '" << database_path << "'.\n";
 		}
 
-		fs::create_directories(cache_filepath.parent_path());
-		writeBIN(result_mesh, cache_filepath);
+		auto end = std::chrono::high_resolution_clock::now();
+		printSummary(results, std::chrono::duration<float, std::milli>(end - start).count(), database, options.verbose);
+
+		for (const asset_result& r : results)
+		{
+			if (r.status == asset_status_failed)
+			{
+				return EXIT_FAILURE;
+			}
+		}
 	}
 	catch (const std::exception& ex)
 	{
@@ -87,4 +786,4 @@ int main(int argc, char** argv)
 	}
 
 	return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,26 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+
+namespace era_engine
+{
+	// Benchmark tests print their timings and are named DISABLED_Benchmark*, so they stay out of the default run. Run
+	// them with --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*.
+
+	// Best of 'iterations' runs, in milliseconds.
+	template <typename func_t>
+	inline double measureMilliseconds(uint32 iterations, const func_t& func)
+	{
+		double best = DBL_MAX;
+		for (uint32 i = 0; i < iterations; ++i)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			func();
+			auto end = std::chrono::high_resolution_clock::now();
+			best = min(best, std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		return best;
+	}
+}
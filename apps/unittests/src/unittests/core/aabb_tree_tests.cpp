@@ -0,0 +1,392 @@
+#include <gtest/gtest.h>
+
+#include <core/aabb_tree.h>
+#include <core/random.h>
+
+#include "unittests/benchmark_utils.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+	using namespace era_engine;
+
+	struct tree_scene
+	{
+		dynamic_aabb_tree tree;
+		std::vector<bounding_box> aabbs;
+		std::vector<uint32> proxies;
+		std::vector<bool> alive;
+	};
+
+	static bounding_box randomBox(RandomNumberGenerator& rng)
+	{
+		return bounding_box::fromCenterRadius(rng.random_vec3_between(-200.f, 200.f), rng.random_vec3_between(0.1f, 3.f));
+	}
+
+	static void moveBox(tree_scene& scene, uint32 i, vec3 displacement)
+	{
+		scene.aabbs[i].minCorner += displacement;
+		scene.aabbs[i].maxCorner += displacement;
+		scene.tree.move(scene.proxies[i], scene.aabbs[i], displacement);
+	}
+
+	// Inserts 'count' boxes, then moves, removes and reinserts some of them, so that every tree operation is covered.
+	static void createTreeScene(tree_scene& scene, uint32 count, uint32 numUpdates)
+	{
+		RandomNumberGenerator rng(9127);
+
+		for (uint32 i = 0; i < count; ++i)
+		{
+			scene.aabbs.push_back(randomBox(rng));
+			scene.proxies.push_back(scene.tree.insert(scene.aabbs.back(), i));
+			scene.alive.push_back(true);
+		}
+
+		for (uint32 update = 0; update < numUpdates; ++update)
+		{
+			for (uint32 i = 0; i < count; ++i)
+			{
+				if (!scene.alive[i])
+				{
+					if (rng.random_uint32_between(0, 3) == 0)
+					{
+						scene.aabbs[i] = randomBox(rng);
+						scene.proxies[i] = scene.tree.insert(scene.aabbs[i], i);
+						scene.alive[i] = true;
+					}
+					continue;
+				}
+
+				uint32 action = rng.random_uint32_between(0, 100);
+				if (action < 20)
+				{
+					moveBox(scene, i, rng.random_vec3_between(-1.f, 1.f));
+				}
+				else if (action < 22)
+				{
+					moveBox(scene, i, rng.random_vec3_between(-150.f, 150.f));
+				}
+				else if (action < 25)
+				{
+					scene.tree.remove(scene.proxies[i]);
+					scene.alive[i] = false;
+				}
+			}
+		}
+	}
+
+	static bool rayVsBox(const ray& r, const bounding_box& aabb, float& outDistance)
+	{
+		float tmin = 0.f;
+		float tmax = FLT_MAX;
+		for (uint32 axis = 0; axis < 3; ++axis)
+		{
+			float o = r.origin.data[axis];
+			float d = r.direction.data[axis];
+			float lo = aabb.minCorner.data[axis];
+			float hi = aabb.maxCorner.data[axis];
+
+			if (d == 0.f)
+			{
+				if (o < lo || o > hi)
+				{
+					return false;
+				}
+				continue;
+			}
+
+			float t1 = (lo - o) / d;
+			float t2 = (hi - o) / d;
+			tmin = max(tmin, min(t1, t2));
+			tmax = min(tmax, max(t1, t2));
+		}
+
+		outDistance = tmin;
+		return tmin <= tmax;
+	}
+
+	static camera_frustum_planes createFrustum(vec3 eye, vec3 target, float farPlane)
+	{
+		mat4 view = look_at(eye, target, vec3(0.f, 1.f, 0.f));
+		mat4 proj = create_perspective_projection_matrix(deg2rad(70.f), 16.f / 9.f, 0.1f, farPlane);
+		return getWorldSpaceFrustumPlanes(proj * view);
+	}
+
+	template <typename test_t>
+	static std::vector<uint32> bruteForce(const tree_scene& scene, const test_t& test)
+	{
+		std::vector<uint32> result;
+		for (uint32 i = 0; i < (uint32)scene.aabbs.size(); ++i)
+		{
+			if (scene.alive[i] && test(scene.aabbs[i]))
+			{
+				result.push_back(i);
+			}
+		}
+		return result;
+	}
+
+	// Object indices of the hits, sorted, since the tree reports them in traversal order.
+	static std::vector<uint32> toSortedIndices(const dynamic_aabb_tree& tree, const uint32* proxies, uint32 count)
+	{
+		std::vector<uint32> result;
+		for (uint32 i = 0; i < count; ++i)
+		{
+			result.push_back((uint32)tree.getUserData(proxies[i]));
+		}
+		std::sort(result.begin(), result.end());
+		return result;
+	}
+
+	template <typename query_t>
+	static std::vector<uint32> collect(const dynamic_aabb_tree& tree, const query_t& query)
+	{
+		std::vector<uint32> proxies;
+		query([&proxies](uint32 proxy) { proxies.push_back(proxy); return true; });
+		return toSortedIndices(tree, proxies.data(), (uint32)proxies.size());
+	}
+}
+
+TEST(Core_AABBTree, StaysValidUnderUpdates) {
+
+	using namespace era_engine;
+
+	tree_scene scene;
+	createTreeScene(scene, 5000, 0);
+
+	EXPECT_TRUE(scene.tree.validate());
+	EXPECT_EQ(scene.tree.size(), 5000u);
+
+	for (uint32 update = 0; update < 4; ++update)
+	{
+		RandomNumberGenerator rng(update);
+		for (uint32 i = 0; i < 5000; ++i)
+		{
+			if (scene.alive[i])
+			{
+				moveBox(scene, i, rng.random_vec3_between(-2.f, 2.f));
+			}
+		}
+		EXPECT_TRUE(scene.tree.validate());
+	}
+
+	tree_scene churned;
+	createTreeScene(churned, 5000, 8);
+	EXPECT_TRUE(churned.tree.validate());
+	EXPECT_EQ(churned.tree.size(), (uint32)std::count(churned.alive.begin(), churned.alive.end(), true));
+
+	// Rotations keep the tree far from degenerate, even though boxes were inserted in random order.
+	EXPECT_LT(churned.tree.getHeight(), 40u);
+
+	for (uint32 i = 0; i < 5000; ++i)
+	{
+		if (churned.alive[i])
+		{
+			churned.tree.remove(churned.proxies[i]);
+		}
+	}
+	EXPECT_EQ(churned.tree.size(), 0u);
+	EXPECT_TRUE(churned.tree.validate());
+}
+
+TEST(Core_AABBTree, QueriesMatchBruteForce) {
+
+	using namespace era_engine;
+
+	tree_scene scene;
+	createTreeScene(scene, 10000, 4);
+	ASSERT_TRUE(scene.tree.validate());
+
+	RandomNumberGenerator rng(31);
+	uint32 numHits = 0;
+
+	for (uint32 q = 0; q < 200; ++q)
+	{
+		bounding_box aabb = bounding_box::fromCenterRadius(rng.random_vec3_between(-200.f, 200.f), rng.random_vec3_between(1.f, 20.f));
+		std::vector<uint32> expected = bruteForce(scene, [&](const bounding_box& b) { return aabbVsAABB(b, aabb); });
+		EXPECT_EQ(collect(scene.tree, [&](auto callback) { scene.tree.queryAABB(aabb, callback); }), expected);
+		numHits += (uint32)expected.size();
+
+		bounding_sphere sphere = { rng.random_vec3_between(-200.f, 200.f), rng.random_float_between(1.f, 30.f) };
+		expected = bruteForce(scene, [&](const bounding_box& b) { return sphereVsAABB(sphere, b); });
+		EXPECT_EQ(collect(scene.tree, [&](auto callback) { scene.tree.querySphere(sphere, callback); }), expected);
+		numHits += (uint32)expected.size();
+
+		camera_frustum_planes frustum = createFrustum(rng.random_vec3_between(-200.f, 200.f), rng.random_vec3_between(-200.f, 200.f), rng.random_float_between(20.f, 300.f));
+		expected = bruteForce(scene, [&](const bounding_box& b) { return !frustum.cullWorldSpaceAABB(b); });
+		EXPECT_EQ(collect(scene.tree, [&](auto callback) { scene.tree.queryFrustum(frustum, callback); }), expected);
+		numHits += (uint32)expected.size();
+
+		// Every tenth ray is axis aligned.
+		ray r = { rng.random_vec3_between(-200.f, 200.f), (q % 10 == 0) ? vec3(0.f, 0.f, 1.f) : normalize(rng.random_vec3_between(-1.f, 1.f)) };
+		float closest = FLT_MAX;
+		for (uint32 i = 0; i < (uint32)scene.aabbs.size(); ++i)
+		{
+			float distance;
+			if (scene.alive[i] && rayVsBox(r, scene.aabbs[i], distance))
+			{
+				closest = min(closest, distance);
+			}
+		}
+
+		aabb_tree_ray_hit hit = scene.tree.raycastClosest(r);
+		if (closest == FLT_MAX)
+		{
+			EXPECT_EQ(hit.proxy, AABB_TREE_NULL_NODE);
+		}
+		else
+		{
+			ASSERT_NE(hit.proxy, AABB_TREE_NULL_NODE);
+			EXPECT_NEAR(hit.distance, closest, 1e-3f * max(1.f, closest));
+		}
+	}
+
+	EXPECT_GT(numHits, 0u);
+}
+
+TEST(Core_AABBTree, BatchQueriesMatchSingleQueries) {
+
+	using namespace era_engine;
+
+	tree_scene scene;
+	createTreeScene(scene, 10000, 2);
+
+	RandomNumberGenerator rng(77);
+
+	const uint32 numQueries = 1000;
+	std::vector<bounding_box> aabbs(numQueries);
+	std::vector<bounding_sphere> spheres(numQueries);
+	std::vector<camera_frustum_planes> frustums(64);
+	std::vector<ray> rays(numQueries);
+	for (uint32 q = 0; q < numQueries; ++q)
+	{
+		aabbs[q] = bounding_box::fromCenterRadius(rng.random_vec3_between(-200.f, 200.f), rng.random_vec3_between(1.f, 10.f));
+		spheres[q] = { rng.random_vec3_between(-200.f, 200.f), rng.random_float_between(1.f, 10.f) };
+		rays[q] = { rng.random_vec3_between(-200.f, 200.f), normalize(rng.random_vec3_between(-1.f, 1.f)) };
+	}
+	for (camera_frustum_planes& frustum : frustums)
+	{
+		frustum = createFrustum(rng.random_vec3_between(-200.f, 200.f), rng.random_vec3_between(-200.f, 200.f), 100.f);
+	}
+
+	// Batches keep the order of the single queries.
+	aabb_tree_batch_result result;
+	scene.tree.batchQueryAABBs(aabbs.data(), numQueries, result);
+	for (uint32 q = 0; q < numQueries; ++q)
+	{
+		std::vector<uint32> expected;
+		scene.tree.queryAABB(aabbs[q], [&](uint32 proxy) { expected.push_back(proxy); return true; });
+		ASSERT_EQ(result.numHits(q), (uint32)expected.size());
+		EXPECT_TRUE(std::equal(expected.begin(), expected.end(), result.hits(q)));
+	}
+
+	scene.tree.batchQuerySpheres(spheres.data(), numQueries, result);
+	for (uint32 q = 0; q < numQueries; ++q)
+	{
+		std::vector<uint32> expected;
+		scene.tree.querySphere(spheres[q], [&](uint32 proxy) { expected.push_back(proxy); return true; });
+		ASSERT_EQ(result.numHits(q), (uint32)expected.size());
+		EXPECT_TRUE(std::equal(expected.begin(), expected.end(), result.hits(q)));
+	}
+
+	scene.tree.batchQueryFrustums(frustums.data(), (uint32)frustums.size(), result);
+	for (uint32 q = 0; q < (uint32)frustums.size(); ++q)
+	{
+		std::vector<uint32> expected;
+		scene.tree.queryFrustum(frustums[q], [&](uint32 proxy) { expected.push_back(proxy); return true; });
+		ASSERT_EQ(result.numHits(q), (uint32)expected.size());
+		EXPECT_TRUE(std::equal(expected.begin(), expected.end(), result.hits(q)));
+	}
+
+	std::vector<aabb_tree_ray_hit> hits(numQueries);
+	scene.tree.batchRaycastClosest(rays.data(), numQueries, 100.f, hits.data());
+	for (uint32 q = 0; q < numQueries; ++q)
+	{
+		aabb_tree_ray_hit expected = scene.tree.raycastClosest(rays[q], 100.f);
+		EXPECT_EQ(hits[q].proxy, expected.proxy);
+		EXPECT_EQ(hits[q].distance, expected.distance);
+	}
+}
+
+TEST(Core_AABBTree, DISABLED_Benchmark100k) {
+
+	using namespace era_engine;
+
+	const uint32 count = 100000;
+	const uint32 numQueries = 10000;
+	const uint32 iterations = 5;
+
+	tree_scene scene;
+	double buildMs = measureMilliseconds(1, [&]() { createTreeScene(scene, count, 0); });
+
+	double updateMs = measureMilliseconds(1, [&]()
+	{
+		RandomNumberGenerator rng(3);
+		for (uint32 i = 0; i < count; ++i)
+		{
+			moveBox(scene, i, rng.random_vec3_between(-0.5f, 0.5f));
+		}
+	});
+
+	RandomNumberGenerator rng(11);
+	std::vector<bounding_box> aabbs(numQueries);
+	std::vector<ray> rays(numQueries);
+	for (uint32 q = 0; q < numQueries; ++q)
+	{
+		aabbs[q] = bounding_box::fromCenterRadius(rng.random_vec3_between(-200.f, 200.f), rng.random_vec3_between(1.f, 5.f));
+		rays[q] = { rng.random_vec3_between(-200.f, 200.f), normalize(rng.random_vec3_between(-1.f, 1.f)) };
+	}
+
+	// Brute force over a tenth of the queries, it is too slow for all of them.
+	uint32 numBruteForceHits = 0;
+	double bruteForceMs = measureMilliseconds(1, [&]()
+	{
+		numBruteForceHits = 0;
+		for (uint32 q = 0; q < numQueries / 10; ++q)
+		{
+			for (uint32 i = 0; i < count; ++i)
+			{
+				numBruteForceHits += aabbVsAABB(scene.aabbs[i], aabbs[q]);
+			}
+		}
+	}) * 10.0;
+
+	uint32 numTreeHits = 0;
+	double treeMs = measureMilliseconds(iterations, [&]()
+	{
+		numTreeHits = 0;
+		for (uint32 q = 0; q < numQueries; ++q)
+		{
+			scene.tree.queryAABB(aabbs[q], [&numTreeHits](uint32) { ++numTreeHits; return true; });
+		}
+	});
+
+	aabb_tree_batch_result result;
+	double batchMs = measureMilliseconds(iterations, [&]() { scene.tree.batchQueryAABBs(aabbs.data(), numQueries, result); });
+
+	double rayMs = measureMilliseconds(iterations, [&]()
+	{
+		for (uint32 q = 0; q < numQueries; ++q)
+		{
+			aabb_tree_ray_hit hit = scene.tree.raycastClosest(rays[q]);
+			(void)hit;
+		}
+	});
+
+	std::vector<aabb_tree_ray_hit> hits(numQueries);
+	double rayBatchMs = measureMilliseconds(iterations, [&]() { scene.tree.batchRaycastClosest(rays.data(), numQueries, FLT_MAX, hits.data()); });
+
+	std::cout << count << " boxes, " << numQueries << " queries, best of " << iterations << "\n"
+		<< "Build: " << buildMs << " ms, height " << scene.tree.getHeight() << ", area ratio " << scene.tree.getAreaRatio() << "\n"
+		<< "Move all: " << updateMs << " ms\n"
+		<< "AABB, brute force (extrapolated): " << bruteForceMs << " ms\n"
+		<< "AABB, tree: " << treeMs << " ms (" << numTreeHits << " hits)\n"
+		<< "AABB, tree batched: " << batchMs << " ms\n"
+		<< "Closest ray, tree: " << rayMs << " ms\n"
+		<< "Closest ray, tree batched: " << rayBatchMs << " ms\n";
+
+	EXPECT_EQ((uint32)result.proxies.size(), numTreeHits);
+	EXPECT_TRUE(scene.tree.validate());
+}
@@ -0,0 +1,204 @@
+#include <gtest/gtest.h>
+
+#include <asset/bin.h>
+#include <core/random.h>
+
+namespace
+{
+	using namespace era_engine;
+
+	template <typename T>
+	static bool sameContent(const std::vector<T>& a, const std::vector<T>& b)
+	{
+		return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+	}
+
+	static SubmeshAsset createSubmesh(RandomNumberGenerator& rng, uint32 numVertices, uint32 numTriangles, bool withAttributes)
+	{
+		SubmeshAsset result;
+		result.material_index = -1;
+
+		// Few distinct positions, so that the blobs compress.
+		result.positions.resize(numVertices);
+		for (uint32 i = 0; i < numVertices; ++i)
+		{
+			result.positions[i] = vec3((float)(i % 16), (float)(i / 16 % 16), 0.f);
+		}
+
+		if (withAttributes)
+		{
+			result.uvs.resize(numVertices);
+			result.normals.resize(numVertices, vec3(0.f, 0.f, 1.f));
+			result.colors.resize(numVertices);
+			for (uint32 i = 0; i < numVertices; ++i)
+			{
+				result.uvs[i] = vec2((float)(i % 16) / 16.f, (float)(i / 16 % 16) / 16.f);
+				result.colors[i] = rng.random_uint32();
+			}
+		}
+
+		// Indices cover the whole vertex range, including the last vertex.
+		result.triangles.resize(numTriangles);
+		for (uint32 i = 0; i < numTriangles; ++i)
+		{
+			result.triangles[i] = { rng.random_uint32() % numVertices, rng.random_uint32() % numVertices, numVertices - 1 - (i % numVertices) };
+		}
+
+		SubmeshLodAsset lod;
+		lod.triangles.assign(result.triangles.begin(), result.triangles.begin() + numTriangles / 2);
+		lod.error = 0.25f;
+		result.lods.push_back(lod);
+
+		return result;
+	}
+
+	// One submesh with 16 bit and one with 32 bit indices.
+	static ModelAsset createModel()
+	{
+		RandomNumberGenerator rng(11);
+
+		MeshAsset mesh;
+		mesh.name = "Mesh";
+		mesh.skeleton_index = -1;
+		mesh.submeshes.push_back(createSubmesh(rng, 1000, 1500, true));
+		mesh.submeshes.push_back(createSubmesh(rng, 70000, 5000, false));
+
+		ModelAsset result;
+		result.flags = 0;
+		result.meshes.push_back(mesh);
+		return result;
+	}
+
+	static fs::path getTestPath(const char* name)
+	{
+		fs::path directory = fs::temp_directory_path() / "era_bin_tests";
+		fs::create_directories(directory);
+		return directory / name;
+	}
+
+	static void expectSameModel(const ModelAsset& a, const ModelAsset& b)
+	{
+		ASSERT_EQ(a.meshes.size(), b.meshes.size());
+		for (uint32 m = 0; m < (uint32)a.meshes.size(); ++m)
+		{
+			EXPECT_EQ(a.meshes[m].name, b.meshes[m].name);
+			EXPECT_EQ(a.meshes[m].skeleton_index, b.meshes[m].skeleton_index);
+
+			ASSERT_EQ(a.meshes[m].submeshes.size(), b.meshes[m].submeshes.size());
+			for (uint32 s = 0; s < (uint32)a.meshes[m].submeshes.size(); ++s)
+			{
+				const SubmeshAsset& x = a.meshes[m].submeshes[s];
+				const SubmeshAsset& y = b.meshes[m].submeshes[s];
+
+				EXPECT_EQ(x.material_index, y.material_index);
+				EXPECT_TRUE(sameContent(x.positions, y.positions));
+				EXPECT_TRUE(sameContent(x.uvs, y.uvs));
+				EXPECT_TRUE(sameContent(x.normals, y.normals));
+				EXPECT_TRUE(sameContent(x.colors, y.colors));
+				EXPECT_TRUE(sameContent(x.triangles, y.triangles));
+
+				ASSERT_EQ(x.lods.size(), y.lods.size());
+				for (uint32 l = 0; l < (uint32)x.lods.size(); ++l)
+				{
+					EXPECT_TRUE(sameContent(x.lods[l].triangles, y.lods[l].triangles));
+					EXPECT_EQ(x.lods[l].error, y.lods[l].error);
+				}
+			}
+		}
+	}
+
+	static void expectMappedModel(const ModelAsset& model, const BinModelView& view)
+	{
+		ASSERT_EQ(view.meshes.size(), 1u);
+		ASSERT_EQ(view.meshes[0].submeshes.size(), 2u);
+
+		const BinSubmeshView& small = view.meshes[0].submeshes[0];
+		const BinSubmeshView& large = view.meshes[0].submeshes[1];
+
+		EXPECT_EQ(small.index_type, mesh_index_uint16);
+		EXPECT_EQ(large.index_type, mesh_index_uint32);
+		EXPECT_EQ(large.attribute_flags & bin_submesh_flag_index32, (uint32)bin_submesh_flag_index32);
+		EXPECT_NE(small.colors, nullptr);
+		EXPECT_EQ(large.colors, nullptr);
+
+		for (uint32 s = 0; s < 2; ++s)
+		{
+			const SubmeshAsset& in = model.meshes[0].submeshes[s];
+			const BinSubmeshView& sub = view.meshes[0].submeshes[s];
+
+			ASSERT_EQ(sub.num_vertices, (uint32)in.positions.size());
+			ASSERT_EQ(sub.num_triangles, (uint32)in.triangles.size());
+			EXPECT_EQ(memcmp(sub.positions, in.positions.data(), in.positions.size() * sizeof(vec3)), 0);
+
+			for (uint32 i = 0; i < sub.num_triangles; ++i)
+			{
+				const indexed_triangle32& expected = in.triangles[i];
+				if (sub.index_type == mesh_index_uint16)
+				{
+					const indexed_triangle16& tri = ((const indexed_triangle16*)sub.triangles)[i];
+					ASSERT_TRUE(tri.a == expected.a && tri.b == expected.b && tri.c == expected.c);
+				}
+				else
+				{
+					const indexed_triangle32& tri = ((const indexed_triangle32*)sub.triangles)[i];
+					ASSERT_TRUE(tri.a == expected.a && tri.b == expected.b && tri.c == expected.c);
+				}
+			}
+		}
+
+		expectSameModel(model, view.to_model_asset());
+	}
+}
+
+TEST(Core_BIN, RoundTripsUncompressed) {
+
+	ModelAsset model = createModel();
+	fs::path path = getTestPath("uncompressed.bin");
+
+	writeBIN(model, path);
+
+	BinModelView view;
+	ASSERT_TRUE(mapBIN(path, view));
+	EXPECT_TRUE(view.decompressed_blobs.empty());
+	expectMappedModel(model, view);
+
+	expectSameModel(model, loadBIN(path));
+}
+
+TEST(Core_BIN, RoundTripsCompressed) {
+
+	ModelAsset model = createModel();
+	fs::path uncompressedPath = getTestPath("reference.bin");
+	fs::path path = getTestPath("compressed.bin");
+
+	bin_write_options options;
+	options.compression = bin_compression_lz4;
+
+	writeBIN(model, uncompressedPath);
+	writeBIN(model, path, options);
+	EXPECT_LT(fs::file_size(path), fs::file_size(uncompressedPath));
+
+	BinModelView view;
+	ASSERT_TRUE(mapBIN(path, view));
+	EXPECT_FALSE(view.decompressed_blobs.empty());
+	expectMappedModel(model, view);
+
+	expectSameModel(model, loadBIN(path));
+}
+
+TEST(Core_BIN, RejectsTruncatedFile) {
+
+	ModelAsset model = createModel();
+	fs::path path = getTestPath("truncated.bin");
+
+	bin_write_options options;
+	options.compression = bin_compression_lz4;
+	writeBIN(model, path, options);
+
+	// Cuts into the blob table at the end of the file.
+	fs::resize_file(path, fs::file_size(path) - 8);
+
+	BinModelView view;
+	EXPECT_FALSE(mapBIN(path, view));
+	EXPECT_TRUE(view.meshes.empty());
+}
@@ -0,0 +1,271 @@
+#include <gtest/gtest.h>
+
+#include <core/collision_gjk.h>
+#include <core/random.h>
+
+#include "unittests/benchmark_utils.h"
+
+#include <iostream>
+
+namespace
+{
+	using namespace era_engine;
+
+	static bounding_sphere randomSphere(RandomNumberGenerator& rng)
+	{
+		return bounding_sphere{ rng.random_vec3_between(-2.f, 2.f), rng.random_float_between(0.2f, 1.5f) };
+	}
+
+	static bounding_capsule randomCapsule(RandomNumberGenerator& rng)
+	{
+		vec3 center = rng.random_vec3_between(-2.f, 2.f);
+		vec3 halfAxis = rng.random_point_on_unit_sphere() * rng.random_float_between(0.2f, 1.5f);
+		return bounding_capsule{ center - halfAxis, center + halfAxis, rng.random_float_between(0.1f, 0.8f) };
+	}
+
+	static bounding_box randomAABB(RandomNumberGenerator& rng)
+	{
+		return bounding_box::fromCenterRadius(rng.random_vec3_between(-2.f, 2.f), rng.random_vec3_between(0.2f, 1.5f));
+	}
+
+	static bounding_oriented_box randomOBB(RandomNumberGenerator& rng)
+	{
+		bounding_oriented_box result;
+		result.center = rng.random_vec3_between(-2.f, 2.f);
+		result.radius = rng.random_vec3_between(0.2f, 1.5f);
+		result.rotation = rng.randomRotation();
+		return result;
+	}
+
+	template <typename shapeA_t, typename shapeB_t>
+	static void randomPairs(RandomNumberGenerator& rng, uint32 count, std::vector<shapeA_t>& outA, std::vector<shapeB_t>& outB,
+		shapeA_t (*randomA)(RandomNumberGenerator&), shapeB_t (*randomB)(RandomNumberGenerator&))
+	{
+		outA.resize(count);
+		outB.resize(count);
+		for (uint32 i = 0; i < count; ++i)
+		{
+			outA[i] = randomA(rng);
+			outB[i] = randomB(rng);
+		}
+	}
+
+	// Returns the number of pairs on which the batched and the scalar test disagree.
+	template <typename shapeA_t, typename shapeB_t>
+	static uint32 countBatchMismatches(const std::vector<shapeA_t>& a, const std::vector<shapeB_t>& b, uint32& outNumIntersecting)
+	{
+		typedef typename gjk_shape_traits<shapeA_t>::support_fn support_a;
+		typedef typename gjk_shape_traits<shapeB_t>::support_fn support_b;
+
+		uint32 count = (uint32)a.size();
+
+		std::unique_ptr<bool[]> batch(new bool[count]);
+		gjkIntersectionTestBatch(a.data(), b.data(), count, batch.get());
+
+		uint32 numMismatches = 0;
+		outNumIntersecting = 0;
+		for (uint32 i = 0; i < count; ++i)
+		{
+			gjk_simplex simplex;
+			bool scalar = gjkIntersectionTest(support_a{ a[i] }, support_b{ b[i] }, simplex);
+			numMismatches += (scalar != batch[i]);
+			outNumIntersecting += batch[i];
+		}
+		return numMismatches;
+	}
+}
+
+TEST(Core_GJK, BatchMatchesScalar) {
+
+	using namespace era_engine;
+
+	RandomNumberGenerator rng(1234);
+
+	// Not a multiple of the SIMD width, so the last batch is partially filled.
+	const uint32 count = 2003;
+
+	uint32 numIntersecting;
+
+	{
+		std::vector<bounding_sphere> a, b;
+		randomPairs(rng, count, a, b, randomSphere, randomSphere);
+		EXPECT_EQ(countBatchMismatches(a, b, numIntersecting), 0u);
+		EXPECT_GT(numIntersecting, count / 10);
+		EXPECT_LT(numIntersecting, count - count / 10);
+
+		// Against the exact answer. Like the scalar version, this may miss shallow contacts, but never reports separated
+		// spheres as intersecting.
+		std::unique_ptr<bool[]> batch(new bool[count]);
+		gjkIntersectionTestBatch(a.data(), b.data(), count, batch.get());
+		for (uint32 i = 0; i < count; ++i)
+		{
+			if (batch[i])
+			{
+				EXPECT_LT(length(a[i].center - b[i].center) - a[i].radius - b[i].radius, 1e-3f) << i;
+			}
+		}
+	}
+
+	{
+		std::vector<bounding_sphere> a;
+		std::vector<bounding_box> b;
+		randomPairs(rng, count, a, b, randomSphere, randomAABB);
+		EXPECT_EQ(countBatchMismatches(a, b, numIntersecting), 0u);
+		EXPECT_GT(numIntersecting, count / 10);
+	}
+
+	{
+		std::vector<bounding_capsule> a;
+		std::vector<bounding_box> b;
+		randomPairs(rng, count, a, b, randomCapsule, randomAABB);
+		EXPECT_EQ(countBatchMismatches(a, b, numIntersecting), 0u);
+		EXPECT_GT(numIntersecting, count / 10);
+	}
+
+	{
+		std::vector<bounding_capsule> a;
+		std::vector<bounding_oriented_box> b;
+		randomPairs(rng, count, a, b, randomCapsule, randomOBB);
+		EXPECT_EQ(countBatchMismatches(a, b, numIntersecting), 0u);
+		EXPECT_GT(numIntersecting, count / 10);
+	}
+
+	{
+		std::vector<bounding_oriented_box> a, b;
+		randomPairs(rng, count, a, b, randomOBB, randomOBB);
+		EXPECT_EQ(countBatchMismatches(a, b, numIntersecting), 0u);
+		EXPECT_GT(numIntersecting, count / 10);
+	}
+}
+
+TEST(Core_GJK, PenetrationDepth) {
+
+	using namespace era_engine;
+
+	RandomNumberGenerator rng(42);
+
+	const uint32 count = 1000;
+
+	std::vector<bounding_sphere> spheresA, spheresB;
+	randomPairs(rng, count, spheresA, spheresB, randomSphere, randomSphere);
+
+	std::vector<bounding_box> boxesA, boxesB;
+	randomPairs(rng, count, boxesA, boxesB, randomAABB, randomAABB);
+
+	std::unique_ptr<bool[]> intersects(new bool[count]);
+	std::vector<gjk_penetration> penetrations(count);
+
+	uint32 numTested = 0;
+
+	gjkIntersectionTestBatch(spheresA.data(), spheresB.data(), count, intersects.get(), penetrations.data());
+	for (uint32 i = 0; i < count; ++i)
+	{
+		vec3 d = spheresB[i].center - spheresA[i].center;
+		float depth = spheresA[i].radius + spheresB[i].radius - length(d);
+		if (!intersects[i] || depth < 0.01f || length(d) < 0.1f)
+		{
+			continue;
+		}
+
+		// The polytope only approximates the curved Minkowski sum.
+		EXPECT_NEAR(penetrations[i].penetrationDepth, depth, 0.01f) << i;
+		EXPECT_GT(dot(penetrations[i].normal, normalize(d)), 0.999f) << i;
+		++numTested;
+	}
+
+	gjkIntersectionTestBatch(boxesA.data(), boxesB.data(), count, intersects.get(), penetrations.data());
+	for (uint32 i = 0; i < count; ++i)
+	{
+		if (!intersects[i])
+		{
+			continue;
+		}
+
+		// Smallest overlap along the axes, positive towards B.
+		const bounding_box& a = boxesA[i];
+		const bounding_box& b = boxesB[i];
+		float depth = FLT_MAX;
+		for (uint32 axis = 0; axis < 3; ++axis)
+		{
+			depth = min(depth, min(a.maxCorner.data[axis] - b.minCorner.data[axis], b.maxCorner.data[axis] - a.minCorner.data[axis]));
+		}
+
+		EXPECT_NEAR(penetrations[i].penetrationDepth, depth, 1e-3f) << i;
+
+		// Moving B along the normal by the depth separates the boxes.
+		vec3 offset = penetrations[i].normal * (penetrations[i].penetrationDepth + 0.01f);
+		bounding_box moved = bounding_box::fromMinMax(b.minCorner + offset, b.maxCorner + offset);
+		gjk_simplex simplex;
+		EXPECT_FALSE(gjkIntersectionTest(aabb_support_fn{ a }, aabb_support_fn{ moved }, simplex)) << i;
+		++numTested;
+	}
+
+	EXPECT_GT(numTested, count / 3);
+}
+
+TEST(Core_GJK, DISABLED_Benchmark100k) {
+
+	using namespace era_engine;
+
+	const uint32 count = 100000;
+	const uint32 iterations = 10;
+
+	RandomNumberGenerator rng(99);
+
+	std::vector<bounding_capsule> capsules;
+	std::vector<bounding_oriented_box> boxes;
+	randomPairs(rng, count, capsules, boxes, randomCapsule, randomOBB);
+
+	std::unique_ptr<bool[]> scalar(new bool[count]);
+	std::unique_ptr<bool[]> batch(new bool[count]);
+	std::vector<gjk_penetration> penetrations(count);
+
+	double scalarMs = measureMilliseconds(iterations, [&]()
+	{
+		for (uint32 i = 0; i < count; ++i)
+		{
+			gjk_simplex simplex;
+			scalar[i] = gjkIntersectionTest(capsule_support_fn{ capsules[i] }, obb_support_fn{ boxes[i] }, simplex);
+		}
+	});
+
+	double scalarEPAMs = measureMilliseconds(iterations, [&]()
+	{
+		for (uint32 i = 0; i < count; ++i)
+		{
+			gjk_simplex simplex;
+			capsule_support_fn capsuleSupport{ capsules[i] };
+			obb_support_fn boxSupport{ boxes[i] };
+			if (gjkIntersectionTest(capsuleSupport, boxSupport, simplex))
+			{
+				epaPenetration(capsuleSupport, boxSupport, simplex, penetrations[i]);
+			}
+		}
+	});
+
+	double batchMs = measureMilliseconds(iterations, [&]()
+	{
+		gjkIntersectionTestBatch(capsules.data(), boxes.data(), count, batch.get());
+	});
+
+	double batchEPAMs = measureMilliseconds(iterations, [&]()
+	{
+		gjkIntersectionTestBatch(capsules.data(), boxes.data(), count, batch.get(), penetrations.data());
+	});
+
+	uint32 numIntersecting = 0;
+	uint32 numMismatches = 0;
+	for (uint32 i = 0; i < count; ++i)
+	{
+		numIntersecting += batch[i];
+		numMismatches += (batch[i] != scalar[i]);
+	}
+
+	std::cout << count << " capsule vs OBB pairs, " << numIntersecting << " intersecting, best of " << iterations << "\n"
+		<< "GJK, scalar: " << scalarMs << " ms\n"
+		<< "GJK, batched: " << batchMs << " ms (" << scalarMs / batchMs << "x)\n"
+		<< "GJK + EPA, scalar: " << scalarEPAMs << " ms\n"
+		<< "GJK + EPA, batched: " << batchEPAMs << " ms (" << scalarEPAMs / batchEPAMs << "x)\n";
+
+	EXPECT_EQ(numMismatches, 0u);
+}
@@ -0,0 +1,268 @@
+#include <gtest/gtest.h>
+
+#include <asset/file_registry_storage.h>
+#include <core/random.h>
+
+#include <map>
+
+namespace
+{
+	using namespace era_engine;
+
+	struct registry_files
+	{
+		fs::path directory;
+		fs::path snapshot;
+		fs::path journal;
+	};
+
+	// Fresh files per test.
+	static registry_files createRegistryFiles(const char* name)
+	{
+		registry_files result;
+		result.directory = fs::temp_directory_path() / "era_file_registry_tests" / name;
+		fs::remove_all(result.directory);
+		fs::create_directories(result.directory);
+		result.snapshot = result.directory / "files.bin";
+		result.journal = result.directory / "files.journal";
+		return result;
+	}
+
+	using reference_registry = std::map<uint64, fs::path>;
+
+	static void expectMatches(const file_registry_storage& storage, const reference_registry& reference)
+	{
+		EXPECT_EQ(storage.size(), reference.size());
+
+		for (const auto& [handle, path] : reference)
+		{
+			EXPECT_EQ(storage.find_path(handle), path);
+			EXPECT_EQ(storage.find_handle(path).value, handle);
+		}
+
+		uint64 count = 0;
+		storage.for_each([&](AssetHandle handle, const fs::path& path)
+		{
+			auto it = reference.find(handle.value);
+			ASSERT_NE(it, reference.end());
+			EXPECT_EQ(it->second, path);
+			++count;
+		});
+		EXPECT_EQ(count, reference.size());
+	}
+
+	static fs::path getAssetPath(uint32 index)
+	{
+		return fs::path("assets") / ("file" + std::to_string(index) + ".png");
+	}
+}
+
+TEST(Core_FileRegistryStorage, PersistsChangesAcrossReopen) {
+
+	registry_files files = createRegistryFiles("reopen");
+	reference_registry reference;
+
+	{
+		file_registry_storage storage;
+		EXPECT_FALSE(storage.open(files.snapshot, files.journal));
+
+		storage.set(1, getAssetPath(1));
+		storage.set(2, getAssetPath(2));
+		storage.set(3, getAssetPath(3));
+
+		// Rename and remove.
+		storage.set(2, getAssetPath(20));
+		storage.remove(3);
+
+		reference[1] = getAssetPath(1);
+		reference[2] = getAssetPath(20);
+		expectMatches(storage, reference);
+	}
+
+	file_registry_storage storage;
+	storage.open(files.snapshot, files.journal);
+	EXPECT_EQ(storage.get_journal_record_count(), 5u);
+	expectMatches(storage, reference);
+
+	EXPECT_EQ(storage.find_handle(getAssetPath(2)).value, 0u);
+	EXPECT_EQ(storage.find_handle(getAssetPath(3)).value, 0u);
+	EXPECT_TRUE(storage.find_path(3).empty());
+}
+
+TEST(Core_FileRegistryStorage, JournalOverridesSnapshot) {
+
+	registry_files files = createRegistryFiles("overlay");
+	reference_registry reference;
+
+	{
+		file_registry_storage storage;
+		storage.open(files.snapshot, files.journal);
+		for (uint32 i = 1; i <= 10; ++i)
+		{
+			storage.set(i, getAssetPath(i));
+			reference[i] = getAssetPath(i);
+		}
+		EXPECT_TRUE(storage.compact());
+	}
+
+	{
+		file_registry_storage storage;
+		EXPECT_TRUE(storage.open(files.snapshot, files.journal));
+		EXPECT_EQ(storage.get_journal_record_count(), 0u);
+
+		// Snapshot entries which are renamed, removed, or whose path is taken over by another handle.
+		storage.set(1, getAssetPath(100));
+		storage.remove(2);
+		storage.remove(3);
+		storage.set(30, getAssetPath(3));
+		storage.remove(4);
+		storage.set(4, getAssetPath(4));
+
+		reference[1] = getAssetPath(100);
+		reference.erase(2);
+		reference.erase(3);
+		reference[30] = getAssetPath(3);
+		expectMatches(storage, reference);
+
+		EXPECT_EQ(storage.find_handle(getAssetPath(1)).value, 0u);
+		EXPECT_EQ(storage.find_handle(getAssetPath(2)).value, 0u);
+		EXPECT_TRUE(storage.find_path(2).empty());
+	}
+
+	file_registry_storage storage;
+	EXPECT_TRUE(storage.open(files.snapshot, files.journal));
+	expectMatches(storage, reference);
+	EXPECT_EQ(storage.find_handle(getAssetPath(1)).value, 0u);
+}
+
+TEST(Core_FileRegistryStorage, DropsTruncatedJournalRecord) {
+
+	registry_files files = createRegistryFiles("truncated");
+	reference_registry reference;
+
+	{
+		file_registry_storage storage;
+		storage.open(files.snapshot, files.journal);
+		storage.set(1, getAssetPath(1));
+		storage.set(2, getAssetPath(2));
+	}
+
+	// A crash in the middle of writing the last record.
+	fs::resize_file(files.journal, fs::file_size(files.journal) - 3);
+
+	{
+		file_registry_storage storage;
+		storage.open(files.snapshot, files.journal);
+		EXPECT_EQ(storage.get_journal_record_count(), 1u);
+
+		reference[1] = getAssetPath(1);
+		expectMatches(storage, reference);
+
+		// New records must not end up behind the damaged tail.
+		storage.set(3, getAssetPath(3));
+		reference[3] = getAssetPath(3);
+	}
+
+	file_registry_storage storage;
+	storage.open(files.snapshot, files.journal);
+	EXPECT_EQ(storage.get_journal_record_count(), 2u);
+	expectMatches(storage, reference);
+}
+
+TEST(Core_FileRegistryStorage, CompactionKeepsLiveEntries) {
+
+	registry_files files = createRegistryFiles("compaction");
+	reference_registry reference;
+
+	RandomNumberGenerator rng(17);
+
+	file_registry_storage storage;
+	storage.open(files.snapshot, files.journal);
+
+	uint32 nextPath = 0;
+	for (uint32 i = 0; i < 5000; ++i)
+	{
+		uint32 op = rng.random_uint32() % 10;
+		if (op < 6 || reference.empty())
+		{
+			uint64 handle = rng.random_uint32() + 1;
+			if (!reference.contains(handle))
+			{
+				fs::path path = getAssetPath(nextPath++);
+				storage.set(handle, path);
+				reference[handle] = path;
+			}
+		}
+		else
+		{
+			auto it = reference.begin();
+			std::advance(it, rng.random_uint32() % reference.size());
+			if (op < 8)
+			{
+				storage.remove(it->first);
+				reference.erase(it);
+			}
+			else
+			{
+				fs::path path = getAssetPath(nextPath++);
+				storage.set(it->first, path);
+				it->second = path;
+			}
+		}
+
+		// Compacts several times, so that later changes go on top of an existing snapshot.
+		if (storage.needs_compaction())
+		{
+			ASSERT_TRUE(storage.compact());
+			EXPECT_EQ(storage.get_journal_record_count(), 0u);
+			expectMatches(storage, reference);
+		}
+	}
+	expectMatches(storage, reference);
+
+	ASSERT_TRUE(storage.compact());
+	EXPECT_EQ(storage.get_journal_record_count(), 0u);
+	expectMatches(storage, reference);
+
+	storage.close();
+	EXPECT_TRUE(storage.open(files.snapshot, files.journal));
+	expectMatches(storage, reference);
+}
+
+TEST(Core_FileRegistryStorage, RoundTripsYAML) {
+
+	registry_files files = createRegistryFiles("yaml");
+	reference_registry reference;
+
+	fs::path yamlPath = files.directory / "files.yaml";
+
+	{
+		file_registry_storage storage;
+		storage.open(files.snapshot, files.journal);
+		for (uint32 i = 1; i <= 100; ++i)
+		{
+			storage.set(i * 7919, getAssetPath(i));
+			reference[i * 7919] = getAssetPath(i);
+		}
+		storage.compact();
+
+		// Exported from the snapshot and the journal.
+		storage.set(1, getAssetPath(1000));
+		storage.remove(7919);
+		reference[1] = getAssetPath(1000);
+		reference.erase(7919);
+
+		EXPECT_TRUE(storage.export_yaml(yamlPath));
+	}
+
+	registry_files imported = createRegistryFiles("yaml_imported");
+
+	file_registry_storage storage;
+	EXPECT_FALSE(storage.open(imported.snapshot, imported.journal));
+	EXPECT_TRUE(storage.import_yaml(yamlPath));
+	expectMatches(storage, reference);
+
+	storage.close();
+	storage.open(imported.snapshot, imported.journal);
+	expectMatches(storage, reference);
+}
@@ -0,0 +1,128 @@
+#include <gtest/gtest.h>
+
+#include <core/frustum_culling.h>
+#include <core/random.h>
+
+#include "unittests/benchmark_utils.h"
+
+#include <iostream>
+
+namespace
+{
+	using namespace era_engine;
+
+	struct culling_scene
+	{
+		std::vector<bounding_box> aabbs;
+		std::vector<trs> transforms;
+		world_space_bounds bounds;
+		camera_frustum_planes frustum;
+	};
+
+	static culling_scene createCullingScene(uint32 count)
+	{
+		culling_scene scene;
+		scene.aabbs.resize(count);
+		scene.transforms.resize(count);
+		scene.bounds.resize(count);
+
+		RandomNumberGenerator rng(5123);
+		for (uint32 i = 0; i < count; ++i)
+		{
+			scene.aabbs[i] = bounding_box::fromCenterRadius(rng.random_vec3_between(-1.f, 1.f), rng.random_vec3_between(0.1f, 4.f));
+
+			trs& transform = scene.transforms[i];
+			transform.position = rng.random_vec3_between(-500.f, 500.f);
+			transform.rotation = quat(normalize(rng.random_vec3_between(-1.f, 1.f)), rng.random_float_between(-M_PI, M_PI));
+			transform.scale = rng.random_vec3_between(0.25f, 3.f);
+
+			scene.bounds.set(i, getWorldSpaceAABB(scene.aabbs[i], transform));
+		}
+
+		mat4 view = look_at(vec3(0.f, 20.f, 0.f), vec3(100.f, 0.f, 100.f), vec3(0.f, 1.f, 0.f));
+		mat4 proj = create_perspective_projection_matrix(deg2rad(70.f), 16.f / 9.f, 0.1f, 400.f);
+		scene.frustum = getWorldSpaceFrustumPlanes(proj * view);
+		return scene;
+	}
+}
+
+TEST(Core_FrustumCulling, MatchesScalarCulling) {
+
+	using namespace era_engine;
+
+	// Not a multiple of the SIMD width, so the last batch is partial.
+	culling_scene scene = createCullingScene(10007);
+
+	std::vector<uint32> visible(scene.bounds.size());
+	uint32 numVisible = cullWorldSpaceAABBs(scene.frustum, scene.bounds, visible.data());
+
+	std::vector<uint32> expected;
+	for (uint32 i = 0; i < scene.bounds.size(); ++i)
+	{
+		if (!scene.frustum.cullWorldSpaceAABB(scene.bounds.get(i)))
+		{
+			expected.push_back(i);
+		}
+
+		// World space AABBs are conservative, they must never cull what the exact model space test keeps.
+		if (!scene.frustum.cullModelSpaceAABB(scene.aabbs[i], scene.transforms[i]))
+		{
+			EXPECT_FALSE(scene.frustum.cullWorldSpaceAABB(scene.bounds.get(i)));
+		}
+	}
+
+	ASSERT_EQ(numVisible, (uint32)expected.size());
+	EXPECT_TRUE(std::equal(expected.begin(), expected.end(), visible.begin()));
+	EXPECT_GT(numVisible, 0u);
+	EXPECT_LT(numVisible, scene.bounds.size());
+
+	std::vector<uint32> visibleParallel(scene.bounds.size());
+	uint32 numVisibleParallel = cullWorldSpaceAABBsParallel(scene.frustum, scene.bounds, visibleParallel.data(), 64);
+
+	ASSERT_EQ(numVisibleParallel, numVisible);
+	EXPECT_TRUE(std::equal(visible.begin(), visible.begin() + numVisible, visibleParallel.begin()));
+}
+
+TEST(Core_FrustumCulling, DISABLED_Benchmark100k) {
+
+	using namespace era_engine;
+
+	const uint32 count = 100000;
+	const uint32 iterations = 10;
+
+	culling_scene scene = createCullingScene(count);
+	std::vector<uint32> visible(count);
+
+	uint32 numScalar = 0;
+	double scalarMs = measureMilliseconds(iterations, [&]()
+	{
+		numScalar = 0;
+		for (uint32 i = 0; i < count; ++i)
+		{
+			numScalar += !scene.frustum.cullModelSpaceAABB(scene.aabbs[i], scene.transforms[i]);
+		}
+	});
+
+	double boundsMs = measureMilliseconds(iterations, [&]()
+	{
+		for (uint32 i = 0; i < count; ++i)
+		{
+			scene.bounds.set(i, getWorldSpaceAABB(scene.aabbs[i], scene.transforms[i]));
+		}
+	});
+
+	uint32 numBatched = 0;
+	double batchedMs = measureMilliseconds(iterations, [&]() { numBatched = cullWorldSpaceAABBs(scene.frustum, scene.bounds, visible.data()); });
+
+	uint32 numParallel = 0;
+	double parallelMs = measureMilliseconds(iterations, [&]() { numParallel = cullWorldSpaceAABBsParallel(scene.frustum, scene.bounds, visible.data()); });
+
+	std::cout << count << " objects, " << FRUSTUM_CULLING_SIMD_WIDTH << " per iteration, best of " << iterations << "\n"
+		<< "Scalar model space: " << scalarMs << " ms (" << numScalar << " visible)\n"
+		<< "World space bounds update: " << boundsMs << " ms\n"
+		<< "Batched: " << batchedMs << " ms (" << numBatched << " visible)\n"
+		<< "Batched, parallel: " << parallelMs << " ms (" << numParallel << " visible)\n";
+
+	EXPECT_EQ(numBatched, numParallel);
+	EXPECT_GE(numBatched, numScalar);
+}
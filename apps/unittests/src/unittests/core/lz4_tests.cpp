@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+
+#include <asset/lz4.h>
+#include <core/random.h>
+
+namespace
+{
+	using namespace era_engine;
+
+	static std::vector<uint8> compress(const std::vector<uint8>& data)
+	{
+		std::vector<uint8> result(lz4_compress_bound(data.size()));
+		uint64 size = lz4_compress(data.data(), data.size(), result.data());
+		EXPECT_LE(size, result.size());
+		result.resize(size);
+		return result;
+	}
+
+	static void expectRoundTrip(const std::vector<uint8>& data)
+	{
+		std::vector<uint8> compressed = compress(data);
+
+		// One spare byte, so that a decoder writing too much would be noticed.
+		std::vector<uint8> decompressed(data.size() + 1, 0xCD);
+		uint64 size = lz4_decompress(compressed.data(), compressed.size(), decompressed.data(), data.size());
+		ASSERT_EQ(size, data.size());
+		EXPECT_EQ(memcmp(decompressed.data(), data.data(), data.size()), 0);
+		EXPECT_EQ(decompressed[data.size()], 0xCD);
+	}
+}
+
+TEST(Core_LZ4, RoundTripsEmptyInput) {
+
+	expectRoundTrip({});
+}
+
+TEST(Core_LZ4, RoundTripsInputsTooShortForMatches) {
+
+	// Blocks of up to 12 bytes are stored as literals only.
+	for (uint32 size = 1; size <= 13; ++size)
+	{
+		std::vector<uint8> data(size, 'a');
+		expectRoundTrip(data);
+	}
+}
+
+TEST(Core_LZ4, RoundTripsIncompressibleInput) {
+
+	RandomNumberGenerator rng(3);
+
+	std::vector<uint8> data(100000);
+	for (uint8& b : data)
+	{
+		b = (uint8)rng.random_uint32();
+	}
+
+	std::vector<uint8> compressed = compress(data);
+	EXPECT_LE(compressed.size(), lz4_compress_bound(data.size()));
+	expectRoundTrip(data);
+}
+
+TEST(Core_LZ4, RoundTripsRepetitiveInput) {
+
+	// Offsets of 1 and 2 produce matches which overlap the bytes they copy.
+	std::vector<uint8> zeros(70000, 0);
+	std::vector<uint8> pattern(70000);
+	for (uint32 i = 0; i < (uint32)pattern.size(); ++i)
+	{
+		pattern[i] = (i % 2) ? 'a' : 'b';
+	}
+
+	EXPECT_LT(compress(zeros).size(), zeros.size() / 100);
+	EXPECT_LT(compress(pattern).size(), pattern.size() / 100);
+	expectRoundTrip(zeros);
+	expectRoundTrip(pattern);
+
+	// Matches further back than the maximum offset of 65535 bytes.
+	RandomNumberGenerator rng(5);
+	std::vector<uint8> block(70000);
+	for (uint8& b : block)
+	{
+		b = (uint8)rng.random_uint32();
+	}
+	std::vector<uint8> repeated = block;
+	repeated.insert(repeated.end(), block.begin(), block.end());
+	expectRoundTrip(repeated);
+
+	// Mixed literal and match runs, with long length extensions.
+	std::vector<uint8> mixed;
+	for (uint32 i = 0; i < 2000; ++i)
+	{
+		uint32 runLength = rng.random_uint32_between(1, 600);
+		uint8 value = (uint8)rng.random_uint32_between(0, 4);
+		mixed.insert(mixed.end(), runLength, value);
+		mixed.push_back((uint8)rng.random_uint32());
+	}
+	expectRoundTrip(mixed);
+}
+
+TEST(Core_LZ4, RejectsTruncatedInput) {
+
+	std::vector<uint8> data(1000);
+	for (uint32 i = 0; i < (uint32)data.size(); ++i)
+	{
+		data[i] = (uint8)(i % 7);
+	}
+
+	std::vector<uint8> compressed = compress(data);
+	std::vector<uint8> decompressed(data.size());
+
+	// The last sequence always ends with at least 5 literals, so every shortened block ends inside a sequence.
+	for (uint64 size = 1; size < compressed.size(); ++size)
+	{
+		EXPECT_NE(lz4_decompress(compressed.data(), size, decompressed.data(), decompressed.size()), data.size());
+	}
+	EXPECT_EQ(lz4_decompress(compressed.data(), compressed.size() - 1, decompressed.data(), decompressed.size()), 0u);
+}
+
+TEST(Core_LZ4, RejectsCorruptInput) {
+
+	uint8 output[64];
+
+	// One literal, then a match 5 bytes back, before the start of the output.
+	const uint8 offsetBeforeStart[] = { 0x10, 'a', 5, 0 };
+	EXPECT_EQ(lz4_decompress(offsetBeforeStart, sizeof(offsetBeforeStart), output, sizeof(output)), 0u);
+
+	// Offset 0 is invalid.
+	const uint8 zeroOffset[] = { 0x10, 'a', 0, 0 };
+	EXPECT_EQ(lz4_decompress(zeroOffset, sizeof(zeroOffset), output, sizeof(output)), 0u);
+
+	// Literal length extension without its bytes.
+	const uint8 missingLength[] = { 0xF0 };
+	EXPECT_EQ(lz4_decompress(missingLength, sizeof(missingLength), output, sizeof(output)), 0u);
+
+	// More literals than there is input.
+	const uint8 missingLiterals[] = { 0x40, 'a', 'b' };
+	EXPECT_EQ(lz4_decompress(missingLiterals, sizeof(missingLiterals), output, sizeof(output)), 0u);
+
+	// Match without its offset.
+	const uint8 missingOffset[] = { 0x14, 'a', 1 };
+	EXPECT_EQ(lz4_decompress(missingOffset, sizeof(missingOffset), output, sizeof(output)), 0u);
+}
+
+TEST(Core_LZ4, RejectsTooSmallOutput) {
+
+	std::vector<uint8> data(5000, 'x');
+	data[0] = 'y';
+	std::vector<uint8> compressed = compress(data);
+
+	std::vector<uint8> decompressed(data.size());
+	EXPECT_EQ(lz4_decompress(compressed.data(), compressed.size(), decompressed.data(), data.size() - 1), 0u);
+}
@@ -0,0 +1,254 @@
+#include <gtest/gtest.h>
+
+#include <core/nearest_neighbor.h>
+#include <core/random.h>
+
+#include "unittests/benchmark_utils.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+	using namespace era_engine;
+
+	static std::vector<vec3> randomPoints(RandomNumberGenerator& rng, uint32 count)
+	{
+		std::vector<vec3> result(count);
+		for (vec3& p : result)
+		{
+			p = rng.random_vec3_between(-100.f, 100.f);
+		}
+		return result;
+	}
+
+	static std::vector<NearestNeighborQueryResult> bruteForce(const std::vector<vec3>& points, vec3 query)
+	{
+		std::vector<NearestNeighborQueryResult> result(points.size());
+		for (uint32 i = 0; i < (uint32)points.size(); ++i)
+		{
+			result[i] = { i, squared_length(points[i] - query) };
+		}
+		std::sort(result.begin(), result.end(), [](const NearestNeighborQueryResult& a, const NearestNeighborQueryResult& b)
+		{
+			return (a.squared_distance != b.squared_distance) ? (a.squared_distance < b.squared_distance) : (a.index < b.index);
+		});
+		return result;
+	}
+
+	static void expectMatchesBruteForce(const PointCloud& cloud, const std::vector<vec3>& points, RandomNumberGenerator& rng, uint32 numQueries)
+	{
+		const uint32 k = 16;
+		const float radius = 12.f;
+
+		ASSERT_EQ(cloud.size(), (uint32)points.size());
+
+		NearestNeighborQueryResult knn[k];
+		std::vector<NearestNeighborQueryResult> inRadius;
+
+		for (uint32 q = 0; q < numQueries; ++q)
+		{
+			vec3 query = rng.random_vec3_between(-110.f, 110.f);
+			std::vector<NearestNeighborQueryResult> expected = bruteForce(points, query);
+
+			NearestNeighborQueryResult nearest = cloud.nearest_neighbor_index(query);
+			EXPECT_FLOAT_EQ(nearest.squared_distance, expected[0].squared_distance);
+
+			uint32 numFound = cloud.k_nearest_neighbors(query, k, knn);
+			ASSERT_EQ(numFound, min(k, cloud.size()));
+			for (uint32 i = 0; i < numFound; ++i)
+			{
+				// Indices may differ between points at the same distance.
+				EXPECT_FLOAT_EQ(knn[i].squared_distance, expected[i].squared_distance) << q << ", " << i;
+				EXPECT_FLOAT_EQ(squared_length(points[knn[i].index] - query), knn[i].squared_distance);
+			}
+
+			uint32 numExpected = 0;
+			while (numExpected < expected.size() && expected[numExpected].squared_distance < radius * radius)
+			{
+				++numExpected;
+			}
+
+			ASSERT_EQ(cloud.radius_neighbors(query, radius, inRadius), numExpected);
+			for (uint32 i = 0; i < numExpected; ++i)
+			{
+				EXPECT_EQ(inRadius[i].index, expected[i].index);
+				EXPECT_FLOAT_EQ(inRadius[i].squared_distance, expected[i].squared_distance);
+			}
+		}
+	}
+}
+
+TEST(Core_NearestNeighbor, QueriesMatchBruteForce) {
+
+	using namespace era_engine;
+
+	RandomNumberGenerator rng(1234);
+
+	// Small enough for one shard, and large enough for several.
+	for (uint32 count : { 1u, 500u, POINT_CLOUD_SHARD_SIZE * 3 + 17 })
+	{
+		std::vector<vec3> points = randomPoints(rng, count);
+		PointCloud cloud(points.data(), count);
+		expectMatchesBruteForce(cloud, points, rng, 100);
+	}
+
+	PointCloud empty;
+	NearestNeighborQueryResult nearest = empty.nearest_neighbor_index(vec3(0.f));
+	EXPECT_EQ(nearest.index, (uint32)-1);
+	EXPECT_EQ(nearest.squared_distance, FLT_MAX);
+}
+
+TEST(Core_NearestNeighbor, IncrementalInsert) {
+
+	using namespace era_engine;
+
+	RandomNumberGenerator rng(42);
+
+	std::vector<vec3> points = randomPoints(rng, 5000);
+
+	PointCloud cloud;
+	cloud.build(points.data(), 3000);
+
+	// Fills the pending list past the insert batch size a few times, and leaves some points pending.
+	for (uint32 i = 3000; i < 4500; i += 100)
+	{
+		cloud.insert(points.data() + i, 100);
+	}
+	for (uint32 i = 4500; i < 5000; ++i)
+	{
+		cloud.insert(points[i]);
+	}
+
+	for (uint32 i = 0; i < cloud.size(); ++i)
+	{
+		ASSERT_EQ(cloud.get_position(i).x, points[i].x);
+	}
+
+	expectMatchesBruteForce(cloud, points, rng, 100);
+
+	cloud.rebuild();
+	expectMatchesBruteForce(cloud, points, rng, 100);
+}
+
+TEST(Core_NearestNeighbor, BatchQueriesMatchSingleQueries) {
+
+	using namespace era_engine;
+
+	RandomNumberGenerator rng(7);
+
+	std::vector<vec3> points = randomPoints(rng, 50000);
+	std::vector<vec3> queries = randomPoints(rng, 1000);
+	uint32 numQueries = (uint32)queries.size();
+
+	PointCloud cloud(points.data(), (uint32)points.size());
+
+	std::vector<NearestNeighborQueryResult> nearest(numQueries);
+	cloud.nearest_neighbor_batch(queries.data(), numQueries, nearest.data());
+
+	const uint32 k = 8;
+	std::vector<NearestNeighborQueryResult> knn(numQueries * k);
+	EXPECT_EQ(cloud.k_nearest_neighbors_batch(queries.data(), numQueries, k, knn.data()), k);
+
+	NearestNeighborBatchResult inRadius;
+	cloud.radius_neighbors_batch(queries.data(), numQueries, 10.f, inRadius);
+	ASSERT_EQ(inRadius.offsets.size(), numQueries + 1);
+
+	NearestNeighborQueryResult singleKnn[k];
+	std::vector<NearestNeighborQueryResult> singleInRadius;
+	for (uint32 q = 0; q < numQueries; ++q)
+	{
+		NearestNeighborQueryResult single = cloud.nearest_neighbor_index(queries[q]);
+		EXPECT_EQ(nearest[q].index, single.index);
+
+		cloud.k_nearest_neighbors(queries[q], k, singleKnn);
+		for (uint32 i = 0; i < k; ++i)
+		{
+			EXPECT_EQ(knn[q * k + i].index, singleKnn[i].index);
+		}
+
+		cloud.radius_neighbors(queries[q], 10.f, singleInRadius);
+		ASSERT_EQ(inRadius.num_results(q), (uint32)singleInRadius.size());
+		for (uint32 i = 0; i < inRadius.num_results(q); ++i)
+		{
+			EXPECT_EQ(inRadius.get_results(q)[i].index, singleInRadius[i].index);
+		}
+	}
+}
+
+TEST(Core_NearestNeighbor, DISABLED_Benchmark1M) {
+
+	using namespace era_engine;
+
+	const uint32 numPoints = 1000000;
+	const uint32 numQueries = 100000;
+	const uint32 numBruteForceQueries = 100;
+	const uint32 k = 16;
+	const float radius = 2.f;
+	const uint32 iterations = 5;
+
+	RandomNumberGenerator rng(99);
+	std::vector<vec3> points = randomPoints(rng, numPoints);
+	std::vector<vec3> queries = randomPoints(rng, numQueries);
+
+	PointCloud cloud;
+	double buildMs = measureMilliseconds(iterations, [&]() { cloud.build(points.data(), numPoints); });
+
+	// Brute force, a single nearest neighbor per query.
+	std::vector<NearestNeighborQueryResult> bruteForceNearest(numBruteForceQueries);
+	double bruteForceMs = measureMilliseconds(1, [&]()
+	{
+		for (uint32 q = 0; q < numBruteForceQueries; ++q)
+		{
+			NearestNeighborQueryResult best = { 0, FLT_MAX };
+			for (uint32 i = 0; i < numPoints; ++i)
+			{
+				float d = squared_length(points[i] - queries[q]);
+				if (d < best.squared_distance)
+				{
+					best = { i, d };
+				}
+			}
+			bruteForceNearest[q] = best;
+		}
+	});
+
+	std::vector<NearestNeighborQueryResult> nearest(numQueries);
+	double serialMs = measureMilliseconds(iterations, [&]()
+	{
+		for (uint32 q = 0; q < numQueries; ++q)
+		{
+			nearest[q] = cloud.nearest_neighbor_index(queries[q]);
+		}
+	});
+
+	double batchMs = measureMilliseconds(iterations, [&]()
+	{
+		cloud.nearest_neighbor_batch(queries.data(), numQueries, nearest.data());
+	});
+
+	std::vector<NearestNeighborQueryResult> knn((size_t)numQueries * k);
+	double knnMs = measureMilliseconds(iterations, [&]()
+	{
+		cloud.k_nearest_neighbors_batch(queries.data(), numQueries, k, knn.data());
+	});
+
+	NearestNeighborBatchResult inRadius;
+	double radiusMs = measureMilliseconds(iterations, [&]()
+	{
+		cloud.radius_neighbors_batch(queries.data(), numQueries, radius, inRadius);
+	});
+
+	std::cout << numPoints << " points, " << numQueries << " queries, best of " << iterations << "\n"
+		<< "Build: " << buildMs << " ms\n"
+		<< "Nearest, brute force: " << bruteForceMs * 1000.0 / numBruteForceQueries << " us per query\n"
+		<< "Nearest, serial: " << serialMs * 1000.0 / numQueries << " us per query\n"
+		<< "Nearest, batch: " << batchMs << " ms (" << batchMs * 1000.0 / numQueries << " us per query)\n"
+		<< k << " nearest, batch: " << knnMs << " ms\n"
+		<< "Radius " << radius << ", batch: " << radiusMs << " ms (" << inRadius.results.size() << " results)\n";
+
+	for (uint32 q = 0; q < numBruteForceQueries; ++q)
+	{
+		EXPECT_FLOAT_EQ(nearest[q].squared_distance, bruteForceNearest[q].squared_distance);
+	}
+}
@@ -0,0 +1,294 @@
+#include <gtest/gtest.h>
+
+#include <core/occlusion_culling.h>
+#include <core/random.h>
+
+#include "unittests/benchmark_utils.h"
+
+#include <iostream>
+
+namespace
+{
+	using namespace era_engine;
+
+	static constexpr float NEAR_PLANE = 0.1f;
+
+	// Camera at the origin, looking down -Z, with an infinite projection.
+	static mat4 createViewProj()
+	{
+		mat4 view = look_at(vec3(0.f), vec3(0.f, 0.f, -1.f), vec3(0.f, 1.f, 0.f));
+		mat4 proj = create_perspective_projection_matrix(deg2rad(70.f), 16.f / 9.f, NEAR_PLANE, -1.f);
+		return proj * view;
+	}
+
+	static bool rayVsBox(vec3 origin, vec3 direction, const bounding_box& aabb, float& outDistance)
+	{
+		float tmin = 0.f;
+		float tmax = FLT_MAX;
+		for (uint32 axis = 0; axis < 3; ++axis)
+		{
+			float o = origin.data[axis];
+			float d = direction.data[axis];
+			float lo = aabb.minCorner.data[axis];
+			float hi = aabb.maxCorner.data[axis];
+
+			if (d == 0.f)
+			{
+				if (o < lo || o > hi)
+				{
+					return false;
+				}
+				continue;
+			}
+
+			float t1 = (lo - o) / d;
+			float t2 = (hi - o) / d;
+			tmin = max(tmin, min(t1, t2));
+			tmax = min(tmax, max(t1, t2));
+		}
+
+		outDistance = tmin;
+		return tmin <= tmax;
+	}
+
+	struct occlusion_scene
+	{
+		std::vector<bounding_box> occluderAABBs;
+		std::vector<ref<occluder_mesh>> occluders;
+		world_space_bounds occludees;
+	};
+
+	static occlusion_scene createOcclusionScene(RandomNumberGenerator& rng, uint32 numOccluders, uint32 numOccludees)
+	{
+		occlusion_scene scene;
+		for (uint32 i = 0; i < numOccluders; ++i)
+		{
+			bounding_box aabb = bounding_box::fromCenterRadius(
+				vec3(rng.random_float_between(-40.f, 40.f), rng.random_float_between(-10.f, 10.f), rng.random_float_between(-80.f, -12.f)),
+				rng.random_vec3_between(1.f, 8.f));
+			scene.occluderAABBs.push_back(aabb);
+			scene.occluders.push_back(createBoxOccluderMesh(aabb));
+		}
+
+		scene.occludees.resize(numOccludees);
+		for (uint32 i = 0; i < numOccludees; ++i)
+		{
+			scene.occludees.set(i, bounding_box::fromCenterRadius(
+				vec3(rng.random_float_between(-60.f, 60.f), rng.random_float_between(-20.f, 20.f), rng.random_float_between(-120.f, -5.f)),
+				rng.random_vec3_between(0.2f, 3.f)));
+		}
+		return scene;
+	}
+
+	static void rasterizeScene(software_occlusion_buffer& buffer, const occlusion_scene& scene, const mat4& viewProj)
+	{
+		buffer.beginFrame(viewProj, NEAR_PLANE);
+		for (const ref<occluder_mesh>& occluder : scene.occluders)
+		{
+			buffer.addOccluder(*occluder, mat4::identity);
+		}
+		buffer.rasterizeOccluders();
+	}
+}
+
+TEST(Core_OcclusionCulling, RasterizesDepth) {
+
+	using namespace era_engine;
+
+	software_occlusion_buffer buffer;
+	buffer.initialize(320, 180);
+
+	// Covers the whole screen. The front face is at a distance of 9.5.
+	ref<occluder_mesh> wall = createBoxOccluderMesh(bounding_box::fromCenterRadius(vec3(0.f, 0.f, -10.f), vec3(100.f, 100.f, 0.5f)));
+
+	buffer.beginFrame(createViewProj(), NEAR_PLANE);
+	buffer.addOccluder(*wall, mat4::identity);
+	buffer.rasterizeOccluders();
+
+	EXPECT_EQ(buffer.getStats().numOccluders, 1u);
+	EXPECT_GT(buffer.getStats().numTriangles, 0u);
+
+	for (uint32 y = 0; y < buffer.getHeight(); ++y)
+	{
+		for (uint32 x = 0; x < buffer.getWidth(); ++x)
+		{
+			ASSERT_NEAR(buffer.getDepth(x, y), 1.f / 9.5f, 1e-5f) << x << ", " << y;
+		}
+	}
+
+	// The camera is inside this one, so its triangles are clipped at the near plane.
+	ref<occluder_mesh> room = createBoxOccluderMesh(bounding_box::fromCenterRadius(vec3(0.f), vec3(5.f)));
+
+	buffer.beginFrame(createViewProj(), NEAR_PLANE);
+	buffer.addOccluder(*room, mat4::identity);
+	buffer.rasterizeOccluders();
+
+	// Center of the screen sees the far wall at a distance of 5.
+	EXPECT_NEAR(buffer.getDepth(buffer.getWidth() / 2, buffer.getHeight() / 2), 1.f / 5.f, 1e-4f);
+	for (uint32 y = 0; y < buffer.getHeight(); ++y)
+	{
+		for (uint32 x = 0; x < buffer.getWidth(); ++x)
+		{
+			ASSERT_GE(buffer.getDepth(x, y), 1.f / (5.f * sqrt(3.f)) - 1e-4f) << x << ", " << y;
+		}
+	}
+}
+
+TEST(Core_OcclusionCulling, CullsBoxesBehindOccluders) {
+
+	using namespace era_engine;
+
+	software_occlusion_buffer buffer;
+	buffer.initialize(320, 180);
+
+	bounding_box wallAABB = bounding_box::fromCenterRadius(vec3(0.f, 0.f, -20.f), vec3(10.f, 5.f, 0.5f));
+	ref<occluder_mesh> wall = createBoxOccluderMesh(wallAABB);
+
+	buffer.beginFrame(createViewProj(), NEAR_PLANE);
+	EXPECT_TRUE(buffer.isVisible(bounding_box::fromCenterRadius(vec3(0.f, 0.f, -40.f), vec3(1.f))));
+
+	buffer.addOccluder(*wall, mat4::identity);
+	buffer.rasterizeOccluders();
+
+	EXPECT_FALSE(buffer.isVisible(bounding_box::fromCenterRadius(vec3(0.f, 0.f, -40.f), vec3(1.f))));
+	EXPECT_FALSE(buffer.isVisible(bounding_box::fromCenterRadius(vec3(5.f, 2.f, -200.f), vec3(3.f))));
+
+	// Beside, in front of, sticking out behind, crossing the near plane.
+	EXPECT_TRUE(buffer.isVisible(bounding_box::fromCenterRadius(vec3(30.f, 0.f, -40.f), vec3(1.f))));
+	EXPECT_TRUE(buffer.isVisible(bounding_box::fromCenterRadius(vec3(0.f, 0.f, -10.f), vec3(1.f))));
+	EXPECT_TRUE(buffer.isVisible(bounding_box::fromCenterRadius(vec3(21.5f, 0.f, -40.f), vec3(1.2f))));
+	EXPECT_TRUE(buffer.isVisible(bounding_box::fromCenterRadius(vec3(0.f), vec3(1.f))));
+
+	// Occluders must not cull the objects they stand for.
+	EXPECT_TRUE(buffer.isVisible(wallAABB));
+}
+
+TEST(Core_OcclusionCulling, IsConservative) {
+
+	using namespace era_engine;
+
+	RandomNumberGenerator rng(1234);
+	mat4 viewProj = createViewProj();
+
+	software_occlusion_buffer buffer;
+	buffer.initialize(320, 180);
+
+	uint32 numCulled = 0;
+	uint32 numWrong = 0;
+
+	for (uint32 s = 0; s < 10; ++s)
+	{
+		occlusion_scene scene = createOcclusionScene(rng, 30, 2000);
+		rasterizeScene(buffer, scene, viewProj);
+
+		std::vector<uint32> indices(scene.occludees.size());
+		for (uint32 i = 0; i < scene.occludees.size(); ++i)
+		{
+			indices[i] = i;
+		}
+
+		// In place, and split into chunks.
+		std::vector<uint32> visible = indices;
+		uint32 numVisible = buffer.cullAABBs(scene.occludees, visible.data(), (uint32)visible.size(), visible.data());
+
+		uint32 v = 0;
+		for (uint32 i = 0; i < scene.occludees.size(); ++i)
+		{
+			bounding_box aabb = scene.occludees.get(i);
+			bool isVisible = buffer.isVisible(aabb);
+			if (isVisible)
+			{
+				ASSERT_LT(v, numVisible);
+				EXPECT_EQ(visible[v++], i);
+				continue;
+			}
+
+			++numCulled;
+
+			// Culled boxes must not have any point on screen which the camera can see.
+			bool wrong = false;
+			for (uint32 sample = 0; sample < 64 && !wrong; ++sample)
+			{
+				vec3 p(
+					rng.random_float_between(aabb.minCorner.x, aabb.maxCorner.x),
+					rng.random_float_between(aabb.minCorner.y, aabb.maxCorner.y),
+					rng.random_float_between(aabb.minCorner.z, aabb.maxCorner.z));
+
+				vec4 clip = viewProj * vec4(p, 1.f);
+				if (clip.w < NEAR_PLANE || abs(clip.x) > clip.w || abs(clip.y) > clip.w)
+				{
+					continue;
+				}
+
+				float distance = length(p);
+				bool blocked = false;
+				for (const bounding_box& occluder : scene.occluderAABBs)
+				{
+					float hit;
+					if (rayVsBox(vec3(0.f), p / distance, occluder, hit) && hit < distance * 0.999f)
+					{
+						blocked = true;
+						break;
+					}
+				}
+				wrong = !blocked;
+			}
+			numWrong += wrong;
+		}
+		EXPECT_EQ(v, numVisible);
+	}
+
+	// Only sub pixel gaps between occluders are missed.
+	EXPECT_GT(numCulled, 1000u);
+	EXPECT_LE(numWrong, numCulled / 200);
+}
+
+TEST(Core_OcclusionCulling, DISABLED_Benchmark100k) {
+
+	using namespace era_engine;
+
+	const uint32 numOccluders = 64;
+	const uint32 numOccludees = 100000;
+	const uint32 iterations = 10;
+
+	RandomNumberGenerator rng(99);
+	occlusion_scene scene = createOcclusionScene(rng, numOccluders, numOccludees);
+	mat4 viewProj = createViewProj();
+
+	software_occlusion_buffer buffer;
+	buffer.initialize(320, 180);
+
+	double rasterizeMs = measureMilliseconds(iterations, [&]() { rasterizeScene(buffer, scene, viewProj); });
+
+	std::vector<uint32> indices(numOccludees);
+	std::vector<uint32> visible(numOccludees);
+	for (uint32 i = 0; i < numOccludees; ++i)
+	{
+		indices[i] = i;
+	}
+
+	uint32 numVisible = 0;
+	double cullMs = measureMilliseconds(iterations, [&]()
+	{
+		numVisible = buffer.cullAABBs(scene.occludees, indices.data(), numOccludees, visible.data());
+	});
+
+	uint32 numSerialVisible = 0;
+	double serialCullMs = measureMilliseconds(iterations, [&]()
+	{
+		numSerialVisible = 0;
+		for (uint32 i = 0; i < numOccludees; ++i)
+		{
+			numSerialVisible += buffer.isVisible(scene.occludees.get(i));
+		}
+	});
+
+	std::cout << numOccluders << " occluders (" << buffer.getStats().numTriangles << " triangles), " << numOccludees << " boxes, "
+		<< buffer.getWidth() << "x" << buffer.getHeight() << ", best of " << iterations << "\n"
+		<< "Rasterize: " << rasterizeMs << " ms\n"
+		<< "Test, serial: " << serialCullMs << " ms\n"
+		<< "Test, parallel: " << cullMs << " ms (" << numVisible << " visible)\n";
+
+	EXPECT_EQ(numVisible, numSerialVisible);
+	EXPECT_LT(numVisible, numOccludees);
+}
@@ -0,0 +1,230 @@
+#include <gtest/gtest.h>
+
+#include <core/spatial_hash_grid.h>
+#include <core/random.h>
+
+#include "unittests/benchmark_utils.h"
+
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+	using namespace era_engine;
+
+	// Half uniform, half in tight clusters, so that some cells hold many objects.
+	static std::vector<vec3> randomPoints(RandomNumberGenerator& rng, uint32 count, float extent)
+	{
+		std::vector<vec3> result(count);
+		for (uint32 i = 0; i < count; ++i)
+		{
+			if (i % 2 == 0 || i < 16)
+			{
+				result[i] = rng.random_vec3_between(-extent, extent);
+			}
+			else
+			{
+				result[i] = result[rng.random_uint32() % 16] + rng.random_vec3_between(-1.f, 1.f);
+			}
+		}
+		return result;
+	}
+
+	// The grid's SIMD distance may round differently, so points right on the sphere may go either way.
+	static void expectMatchesBruteForce(const std::vector<vec3>& points, vec3 center, float radius, uint32 exclude, std::vector<uint32> found)
+	{
+		float squaredRadius = radius * radius;
+
+		std::sort(found.begin(), found.end());
+		EXPECT_TRUE(std::adjacent_find(found.begin(), found.end()) == found.end());
+
+		uint32 f = 0;
+		for (uint32 i = 0; i < (uint32)points.size(); ++i)
+		{
+			bool isFound = (f < found.size() && found[f] == i);
+			f += isFound;
+
+			float d = squared_length(points[i] - center);
+			if (i == exclude)
+			{
+				EXPECT_FALSE(isFound);
+			}
+			else if (d < squaredRadius * 0.9999f)
+			{
+				EXPECT_TRUE(isFound) << i;
+			}
+			else if (d > squaredRadius * 1.0001f)
+			{
+				EXPECT_FALSE(isFound) << i;
+			}
+		}
+		EXPECT_EQ(f, (uint32)found.size());
+	}
+}
+
+TEST(Core_SpatialHashGrid, QueriesMatchBruteForce) {
+
+	using namespace era_engine;
+
+	RandomNumberGenerator rng(1234);
+
+	std::vector<uint32> found;
+
+	for (uint32 count : { 1u, 100u, 20000u })
+	{
+		std::vector<vec3> points = randomPoints(rng, count, 50.f);
+
+		// Cells smaller than, equal to and larger than the radius, and so small that the query covers every bucket.
+		for (float cellSize : { 0.5f, 2.f, 7.f, 0.01f })
+		{
+			spatial_hash_grid grid;
+			grid.setCellSize(cellSize);
+			grid.rebuild(points.data(), count);
+			ASSERT_EQ(grid.size(), count);
+
+			for (uint32 q = 0; q < 50; ++q)
+			{
+				float radius = rng.random_float_between(0.1f, 4.f);
+
+				vec3 center = rng.random_vec3_between(-55.f, 55.f);
+				found.clear();
+				grid.queryRadius(center, radius, found);
+				expectMatchesBruteForce(points, center, radius, (uint32)-1, found);
+
+				uint32 object = rng.random_uint32() % count;
+				found.clear();
+				grid.queryNeighbors(object, radius, found);
+				expectMatchesBruteForce(points, points[object], radius, object, found);
+			}
+		}
+	}
+
+	spatial_hash_grid empty;
+	empty.rebuild(nullptr, 0);
+	found.clear();
+	empty.queryRadius(vec3(0.f), 10.f, found);
+	EXPECT_TRUE(found.empty());
+}
+
+TEST(Core_SpatialHashGrid, BatchQueriesMatchSingleQueries) {
+
+	using namespace era_engine;
+
+	RandomNumberGenerator rng(7);
+
+	std::vector<vec3> points = randomPoints(rng, 50000, 100.f);
+	std::vector<vec3> centers = randomPoints(rng, 1000, 100.f);
+	uint32 count = (uint32)points.size();
+	uint32 numCenters = (uint32)centers.size();
+	const float radius = 3.f;
+
+	spatial_hash_grid grid;
+	grid.setCellSize(radius);
+	grid.rebuild(points.data(), count);
+
+	spatial_hash_grid_batch_result inRadius;
+	grid.batchQueryRadius(centers.data(), numCenters, radius, inRadius);
+	ASSERT_EQ(inRadius.offsets.size(), numCenters + 1);
+
+	spatial_hash_grid_batch_result neighbors;
+	grid.batchQueryNeighbors(radius, neighbors);
+	ASSERT_EQ(neighbors.offsets.size(), count + 1);
+
+	std::vector<uint32> single;
+	for (uint32 q = 0; q < numCenters; ++q)
+	{
+		single.clear();
+		grid.queryRadius(centers[q], radius, single);
+		ASSERT_EQ(inRadius.numResults(q), (uint32)single.size());
+		for (uint32 i = 0; i < (uint32)single.size(); ++i)
+		{
+			EXPECT_EQ(inRadius.results(q)[i], single[i]);
+		}
+	}
+
+	// Neighborhood is symmetric.
+	uint64 numPairs = 0;
+	for (uint32 object = 0; object < count; ++object)
+	{
+		single.clear();
+		grid.queryNeighbors(object, radius, single);
+		ASSERT_EQ(neighbors.numResults(object), (uint32)single.size());
+		for (uint32 i = 0; i < (uint32)single.size(); ++i)
+		{
+			ASSERT_EQ(neighbors.results(object)[i], single[i]);
+		}
+		numPairs += single.size();
+	}
+	EXPECT_EQ(numPairs % 2, 0u);
+	EXPECT_GT(numPairs, (uint64)count);
+
+	// Rebuilding from the same positions gives the same order, however the jobs were scheduled.
+	spatial_hash_grid_batch_result rebuilt;
+	grid.rebuild(points.data(), count);
+	grid.batchQueryNeighbors(radius, rebuilt);
+	EXPECT_TRUE(rebuilt.offsets == neighbors.offsets);
+	EXPECT_TRUE(rebuilt.objects == neighbors.objects);
+}
+
+TEST(Core_SpatialHashGrid, DISABLED_Benchmark1M) {
+
+	using namespace era_engine;
+
+	const float radius = 1.f;
+	const uint32 numQueries = 100000;
+	const uint32 numBruteForceQueries = 100;
+	const uint32 iterations = 5;
+
+	RandomNumberGenerator rng(99);
+
+	// Same density at every size, about 4 objects per cell, like a swarm spreading out as it grows.
+	for (uint32 count : { 10000u, 100000u, 1000000u })
+	{
+		float extent = 0.5f * cbrt(count / 4.f);
+		std::vector<vec3> points(count);
+		for (vec3& p : points)
+		{
+			p = rng.random_vec3_between(-extent, extent);
+		}
+
+		spatial_hash_grid grid;
+		grid.setCellSize(radius);
+		double rebuildMs = measureMilliseconds(iterations, [&]() { grid.rebuild(points.data(), count); });
+
+		uint32 numQueried = min(count, numQueries);
+		spatial_hash_grid_batch_result neighbors;
+		double serialMs = measureMilliseconds(iterations, [&]()
+		{
+			std::vector<uint32> found;
+			for (uint32 i = 0; i < numQueried; ++i)
+			{
+				found.clear();
+				grid.queryNeighbors(i, radius, found);
+			}
+		});
+
+		double batchMs = measureMilliseconds(iterations, [&]() { grid.batchQueryNeighbors(radius, neighbors); });
+
+		uint32 numBruteForceMismatches = 0;
+		double bruteForceMs = measureMilliseconds(1, [&]()
+		{
+			for (uint32 q = 0; q < numBruteForceQueries; ++q)
+			{
+				uint32 numFound = 0;
+				for (uint32 i = 0; i < count; ++i)
+				{
+					numFound += (i != q) && (squared_length(points[i] - points[q]) < radius * radius);
+				}
+				numBruteForceMismatches += (numFound != neighbors.numResults(q));
+			}
+		});
+
+		std::cout << count << " objects, radius " << radius << ", best of " << iterations << "\n"
+			<< "Rebuild: " << rebuildMs << " ms\n"
+			<< "Neighbors, brute force: " << bruteForceMs * 1000.0 / numBruteForceQueries << " us per query\n"
+			<< "Neighbors, serial: " << serialMs * 1000.0 / numQueried << " us per query\n"
+			<< "Neighbors of all, batch: " << batchMs << " ms (" << neighbors.objects.size() << " results)\n";
+
+		EXPECT_EQ(numBruteForceMismatches, 0u);
+	}
+}
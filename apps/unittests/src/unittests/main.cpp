@@ -2,9 +2,14 @@
 
 #include <gtest/gtest.h>
 
+#include <core/job_system.h>
+
 int main(int argc, char** argv)
 {
 	::testing::InitGoogleTest(&argc, argv);
 
+	// Some systems under test split their work into jobs.
+	era_engine::initialize_job_system();
+
 	return RUN_ALL_TESTS();
-}
\ No newline at end of file
+}
@@ -0,0 +1,204 @@
+#include <gtest/gtest.h>
+
+#include <rendering/render_pass.h>
+#include <core/random.h>
+
+#include <chrono>
+#include <iostream>
+
+namespace
+{
+	using namespace era_engine;
+
+	struct test_command_header
+	{
+		template <typename pipeline_t, typename command_wrapper>
+		void initialize() {}
+	};
+
+	struct test_pipeline {};
+
+	struct test_command
+	{
+		uint64 key;
+		uint32 index;
+	};
+
+	using test_command_buffer = render_command_buffer<uint64, test_command_header>;
+
+	// Declared like the buffer's own wrappers, so the command is at the same offset.
+	struct test_command_wrapper_base
+	{
+		test_command_header header;
+
+		virtual ~test_command_wrapper_base() {}
+	};
+
+	struct test_command_wrapper : test_command_wrapper_base
+	{
+		test_command command;
+	};
+
+	static const test_command& getCommand(const test_command_buffer::iterator_return& it)
+	{
+		return ((const test_command_wrapper*)it.data)->command;
+	}
+
+	// Like a scene's opaque pass: few pipelines, more materials, recorded in no particular order.
+	static std::vector<uint64> createOpaqueKeys(uint32 count, uint32 numPipelines, uint32 numMaterials, uint32 seed)
+	{
+		RandomNumberGenerator rng(seed);
+
+		std::vector<uint64> keys(count);
+		for (uint64& key : keys)
+		{
+			uint32 pipeline = rng.random_uint32_between(0, numPipelines - 1);
+			uint32 material = rng.random_uint32_between(0, numMaterials - 1);
+			key = render_sort_key::opaque(0, pipeline, render_sort_key::materialID((const void*)(uint64)((material + 1) * 256)),
+				rng.random_float_between(0.1f, 1000.f));
+		}
+		return keys;
+	}
+
+	static void record(test_command_buffer& buffer, const std::vector<uint64>& keys)
+	{
+		for (uint32 i = 0; i < (uint32)keys.size(); ++i)
+		{
+			buffer.emplace_back<test_pipeline, test_command>(keys[i], test_command{ keys[i], i });
+		}
+	}
+
+	static void expectSortedAndStable(const test_command_buffer& buffer, uint64 count)
+	{
+		ASSERT_EQ(buffer.size(), count);
+
+		const test_command* last = nullptr;
+		for (const auto& it : buffer)
+		{
+			const test_command& command = getCommand(it);
+			if (last)
+			{
+				ASSERT_LE(last->key, command.key);
+				if (last->key == command.key)
+				{
+					ASSERT_LT(last->index, command.index);
+				}
+			}
+			last = &command;
+		}
+	}
+}
+
+TEST(Rendering_RenderCommandBuffer, RadixSortIsStable) {
+
+	using namespace era_engine;
+
+	// Below and above the insertion sort threshold. Few distinct keys, so many are equal.
+	for (uint32 count : { 0u, 1u, 7u, 31u, 32u, 1000u, 10007u })
+	{
+		RandomNumberGenerator rng(count + 17);
+
+		std::vector<uint64> keys(count);
+		for (uint64& key : keys)
+		{
+			key = ((uint64)rng.random_uint32_between(0, 7) << 56) | rng.random_uint32_between(0, 15);
+		}
+
+		test_command_buffer buffer;
+		record(buffer, keys);
+		buffer.sort();
+
+		expectSortedAndStable(buffer, count);
+	}
+}
+
+TEST(Rendering_RenderCommandBuffer, OpaqueKeysSortFrontToBackPerState) {
+
+	using namespace era_engine;
+
+	uint64 nearKey = render_sort_key::opaque(0, 3, 5, 1.f);
+	uint64 farKey = render_sort_key::opaque(0, 3, 5, 100.f);
+	uint64 otherMaterial = render_sort_key::opaque(0, 3, 6, 0.5f);
+	uint64 otherPipeline = render_sort_key::opaque(0, 4, 0, 0.1f);
+	uint64 laterLayer = render_sort_key::opaque(1, 0, 0, 0.f);
+
+	EXPECT_LT(nearKey, farKey);
+	EXPECT_LT(farKey, otherMaterial);
+	EXPECT_LT(otherMaterial, otherPipeline);
+	EXPECT_LT(otherPipeline, laterLayer);
+
+	// Negative and out of range depths must not spill into the other fields.
+	EXPECT_EQ(render_sort_key::opaque(0, 3, 5, -10.f), render_sort_key::opaque(0, 3, 5, 0.f));
+	EXPECT_LT(render_sort_key::opaque(0, 3, 5, FLT_MAX), otherMaterial);
+}
+
+TEST(Rendering_RenderCommandBuffer, TransparentKeysSortBackToFront) {
+
+	using namespace era_engine;
+
+	uint64 farKey = render_sort_key::transparent(0, 7, 9, 100.f);
+	uint64 nearKey = render_sort_key::transparent(0, 1, 1, 1.f);
+	uint64 nearestKey = render_sort_key::transparent(0, 0, 0, 0.f);
+
+	EXPECT_LT(farKey, nearKey);
+	EXPECT_LT(nearKey, nearestKey);
+	EXPECT_LT(nearestKey, render_sort_key::transparent(1, 0, 0, 1000.f));
+}
+
+TEST(Rendering_RenderCommandBuffer, LargeBufferAvoidsStateChanges) {
+
+	using namespace era_engine;
+
+	const uint32 count = 50000;
+	std::vector<uint64> keys = createOpaqueKeys(count, 24, 400, 4211);
+
+	test_command_buffer buffer;
+	record(buffer, keys);
+	buffer.sort(render_sort_key::OPAQUE_PIPELINE_STATE_MASK);
+	expectSortedAndStable(buffer, count);
+
+	// 24 pipelines, so sorted commands need at most 23 changes.
+	EXPECT_GT(buffer.getNumStateChangesAvoided(), (int32)count / 2);
+}
+
+TEST(Rendering_RenderCommandBuffer, DISABLED_Benchmark50k) {
+
+	using namespace era_engine;
+
+	const uint32 count = 50000;
+	std::vector<uint64> keys = createOpaqueKeys(count, 24, 400, 4211);
+
+	test_command_buffer buffer;
+	record(buffer, keys);
+	buffer.sort(render_sort_key::OPAQUE_PIPELINE_STATE_MASK);
+	int32 avoided = buffer.getNumStateChangesAvoided();
+
+	double radixMs = DBL_MAX;
+	double stdSortMs = DBL_MAX;
+
+	for (uint32 iteration = 0; iteration < 10; ++iteration)
+	{
+		buffer.clear();
+		record(buffer, keys);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		buffer.sort(render_sort_key::OPAQUE_PIPELINE_STATE_MASK);
+		auto end = std::chrono::high_resolution_clock::now();
+		radixMs = min(radixMs, std::chrono::duration<double, std::milli>(end - start).count());
+
+		// What the buffer did before: std::sort over {key, pointer} pairs.
+		std::vector<std::pair<uint64, void*>> pairs(count);
+		for (uint32 i = 0; i < count; ++i)
+		{
+			pairs[i] = { keys[i], (void*)(uint64)i };
+		}
+
+		start = std::chrono::high_resolution_clock::now();
+		std::sort(pairs.begin(), pairs.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+		end = std::chrono::high_resolution_clock::now();
+		stdSortMs = min(stdSortMs, std::chrono::duration<double, std::milli>(end - start).count());
+	}
+
+	std::cout << "Sorting " << count << " render commands: radix sort " << radixMs << " ms (including state change counting), std::sort "
+		<< stdSortMs << " ms. Pipeline state changes avoided: " << avoided << "\n";
+}
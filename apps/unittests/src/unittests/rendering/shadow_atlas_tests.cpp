@@ -0,0 +1,425 @@
+#include <gtest/gtest.h>
+
+#include <rendering/shadow_atlas.h>
+#include <core/random.h>
+
+namespace
+{
+	using namespace era_engine;
+
+	// Like the engine's shadow map: 3x3 tiles of the maximum size.
+	static constexpr uint32 ATLAS_SIZE = 6144;
+	static constexpr uint32 MAXIMUM_SIZE = 2048;
+	static constexpr uint32 MINIMUM_SIZE = 128;
+
+	static constexpr uint32 CELLS_PER_ROW = ATLAS_SIZE / MINIMUM_SIZE;
+
+	// Free and allocated viewports must tile the atlas exactly, and allocations must be aligned to their size.
+	static void expectConsistent(const shadow_atlas& atlas)
+	{
+		std::vector<shadow_map_viewport> freeViewports;
+		std::vector<shadow_map_viewport> allocatedViewports;
+		atlas.getViewports(freeViewports, allocatedViewports);
+
+		std::vector<uint32> coverage(CELLS_PER_ROW * CELLS_PER_ROW, 0);
+		uint64 allocatedTexels = 0;
+
+		auto cover = [&](shadow_map_viewport vp)
+		{
+			ASSERT_EQ(vp.x % vp.size, 0u);
+			ASSERT_EQ(vp.y % vp.size, 0u);
+			ASSERT_LE(vp.x + vp.size, ATLAS_SIZE);
+			ASSERT_LE(vp.y + vp.size, ATLAS_SIZE);
+			for (uint32 y = vp.y / MINIMUM_SIZE; y < (vp.y + vp.size) / MINIMUM_SIZE; ++y)
+			{
+				for (uint32 x = vp.x / MINIMUM_SIZE; x < (vp.x + vp.size) / MINIMUM_SIZE; ++x)
+				{
+					++coverage[y * CELLS_PER_ROW + x];
+				}
+			}
+		};
+
+		for (shadow_map_viewport vp : freeViewports)
+		{
+			cover(vp);
+		}
+		for (shadow_map_viewport vp : allocatedViewports)
+		{
+			cover(vp);
+			allocatedTexels += (uint64)vp.size * vp.size;
+		}
+
+		for (uint32 c : coverage)
+		{
+			ASSERT_EQ(c, 1u);
+		}
+
+		shadow_atlas_stats stats = atlas.getStats();
+		EXPECT_EQ(stats.numAllocations, (uint32)allocatedViewports.size());
+		EXPECT_EQ(stats.allocatedTexels, allocatedTexels);
+		EXPECT_EQ(stats.totalTexels, (uint64)ATLAS_SIZE * ATLAS_SIZE);
+	}
+
+	static bool overlaps(shadow_map_viewport a, shadow_map_viewport b)
+	{
+		return a.x < b.x + b.size && b.x < a.x + a.size && a.y < b.y + b.size && b.y < a.y + a.size;
+	}
+
+	static shadow_atlas createAtlas()
+	{
+		shadow_atlas atlas;
+		atlas.initialize(ATLAS_SIZE, ATLAS_SIZE, MAXIMUM_SIZE, MINIMUM_SIZE);
+		return atlas;
+	}
+}
+
+TEST(Rendering_ShadowAtlas, AllocatesDisjointViewports) {
+
+	using namespace era_engine;
+
+	shadow_atlas atlas = createAtlas();
+	RandomNumberGenerator rng(1234);
+
+	atlas.beginFrame();
+
+	std::vector<shadow_map_viewport> viewports;
+	uint64 requestedTexels = 0;
+	for (uint64 light = 0; requestedTexels < (uint64)ATLAS_SIZE * ATLAS_SIZE / 2; ++light)
+	{
+		uint32 size = MINIMUM_SIZE << rng.random_uint32_between(0, 5);
+		shadow_atlas_allocation allocation = atlas.request(light, 0, size, 1.f);
+		ASSERT_EQ(allocation.viewport.size, size);
+		EXPECT_FALSE(allocation.cacheHit);
+
+		for (shadow_map_viewport other : viewports)
+		{
+			ASSERT_FALSE(overlaps(allocation.viewport, other));
+		}
+		viewports.push_back(allocation.viewport);
+		requestedTexels += (uint64)size * size;
+	}
+
+	expectConsistent(atlas);
+	EXPECT_FLOAT_EQ(atlas.getStats().occupancy(), (float)requestedTexels / ((float)ATLAS_SIZE * ATLAS_SIZE));
+
+	// Sizes are rounded up to a power of two and clamped.
+	EXPECT_EQ(atlas.request(1000000, 0, 300, 1.f).viewport.size, 512u);
+	EXPECT_EQ(atlas.request(1000001, 0, 16, 1.f).viewport.size, MINIMUM_SIZE);
+	EXPECT_EQ(atlas.request(1000002, 0, 8192, 1.f).viewport.size, MAXIMUM_SIZE);
+
+	// Freed space merges back into whole tiles.
+	for (uint64 light = 0; light < viewports.size(); ++light)
+	{
+		atlas.release(light);
+	}
+	atlas.release(1000000);
+	atlas.release(1000001);
+	atlas.release(1000002);
+
+	expectConsistent(atlas);
+	EXPECT_EQ(atlas.getStats().numAllocations, 0u);
+	EXPECT_EQ(atlas.getStats().largestFreeSize, MAXIMUM_SIZE);
+
+	std::vector<shadow_map_viewport> freeViewports, allocatedViewports;
+	atlas.getViewports(freeViewports, allocatedViewports);
+	EXPECT_EQ(freeViewports.size(), (size_t)(ATLAS_SIZE / MAXIMUM_SIZE) * (ATLAS_SIZE / MAXIMUM_SIZE));
+}
+
+TEST(Rendering_ShadowAtlas, CachesAcrossFrames) {
+
+	using namespace era_engine;
+
+	shadow_atlas atlas = createAtlas();
+
+	atlas.beginFrame();
+	shadow_atlas_allocation first = atlas.request(1, 42, 512, 1.f);
+	EXPECT_FALSE(first.cacheHit);
+
+	atlas.beginFrame();
+	shadow_atlas_allocation second = atlas.request(1, 42, 512, 1.f);
+	EXPECT_TRUE(second.cacheHit);
+	EXPECT_EQ(second.viewport.x, first.viewport.x);
+	EXPECT_EQ(second.viewport.y, first.viewport.y);
+
+	// Moved.
+	atlas.beginFrame();
+	EXPECT_FALSE(atlas.request(1, 43, 512, 1.f).cacheHit);
+	atlas.beginFrame();
+	EXPECT_TRUE(atlas.request(1, 43, 512, 1.f).cacheHit);
+
+	// Resized.
+	atlas.beginFrame();
+	shadow_atlas_allocation resized = atlas.request(1, 43, 1024, 1.f);
+	EXPECT_FALSE(resized.cacheHit);
+	EXPECT_EQ(resized.viewport.size, 1024u);
+
+	// Unused for a while, but not evicted since there was no need to.
+	for (uint32 i = 0; i < 100; ++i)
+	{
+		atlas.beginFrame();
+	}
+	EXPECT_TRUE(atlas.request(1, 43, 1024, 1.f).cacheHit);
+
+	shadow_atlas_stats stats = atlas.getStats();
+	EXPECT_EQ(stats.numRequests, 6u);
+	EXPECT_EQ(stats.numCacheHits, 3u);
+	EXPECT_FLOAT_EQ(stats.cacheHitRate(), 0.5f);
+	EXPECT_EQ(stats.numAllocations, 1u);
+	EXPECT_EQ(stats.numEvictions, 0u);
+
+	atlas.resetStats();
+	EXPECT_EQ(atlas.getStats().numRequests, 0u);
+	EXPECT_EQ(atlas.getStats().numAllocations, 1u);
+}
+
+TEST(Rendering_ShadowAtlas, EvictsByPriorityAndAge) {
+
+	using namespace era_engine;
+
+	shadow_atlas atlas = createAtlas();
+	const uint32 numColumns = ATLAS_SIZE / MAXIMUM_SIZE;
+	const uint32 numTiles = numColumns * numColumns;
+
+	// One light per tile, the first ones with a higher priority. Tiles are handed out in order.
+	atlas.beginFrame();
+	for (uint64 light = 0; light < numTiles; ++light)
+	{
+		float priority = (light < 4) ? 10.f : 1.f;
+		ASSERT_EQ(atlas.request(light, 0, MAXIMUM_SIZE, priority).viewport.size, MAXIMUM_SIZE);
+	}
+	EXPECT_EQ(atlas.getStats().largestFreeSize, 0u);
+
+	// Light 4 is used in every frame, light 5 more recently than the others.
+	atlas.beginFrame();
+	atlas.request(4, 0, MAXIMUM_SIZE, 1.f);
+	atlas.request(5, 0, MAXIMUM_SIZE, 1.f);
+	atlas.beginFrame();
+	atlas.request(4, 0, MAXIMUM_SIZE, 1.f);
+
+	// Least recently used low priority lights first, then light 5, then the high priority ones. The evicted light is
+	// identified by the tile the new one gets.
+	const uint64 expectedOrder[] = { 6, 7, 8, 5, 0, 1, 2, 3 };
+	for (uint32 i = 0; i < arraysize(expectedOrder); ++i)
+	{
+		shadow_atlas_allocation allocation = atlas.request(100 + i, 0, MAXIMUM_SIZE, 100.f);
+		ASSERT_EQ(allocation.viewport.size, MAXIMUM_SIZE);
+
+		uint64 evicted = (allocation.viewport.y / MAXIMUM_SIZE) * numColumns + allocation.viewport.x / MAXIMUM_SIZE;
+		EXPECT_EQ(evicted, expectedOrder[i]);
+		expectConsistent(atlas);
+	}
+	EXPECT_EQ(atlas.getStats().numEvictions, (uint64)arraysize(expectedOrder));
+
+	// Light 4 was used in this frame, so it kept its tile.
+	EXPECT_TRUE(atlas.request(4, 0, MAXIMUM_SIZE, 1.f).cacheHit);
+
+	// Everything is in use now, so nothing can be evicted, whatever the priority.
+	EXPECT_EQ(atlas.request(1000, 0, MINIMUM_SIZE, FLT_MAX).viewport.size, 0u);
+	EXPECT_EQ(atlas.getStats().numFailed, 1u);
+
+	// An evicted light starts over.
+	atlas.beginFrame();
+	EXPECT_FALSE(atlas.request(6, 0, MAXIMUM_SIZE, 1.f).cacheHit);
+}
+
+TEST(Rendering_ShadowAtlas, DownsizesWhenEvictionIsTooExpensive) {
+
+	using namespace era_engine;
+
+	shadow_atlas atlas = createAtlas();
+	const uint32 numTiles = (ATLAS_SIZE / MAXIMUM_SIZE) * (ATLAS_SIZE / MAXIMUM_SIZE);
+
+	atlas.beginFrame();
+	for (uint64 light = 0; light < numTiles; ++light)
+	{
+		atlas.request(light, 0, MAXIMUM_SIZE, 100.f);
+	}
+
+	// Evicting anything costs more than the new light's priority. It still gets the minimum size, so that it casts a
+	// shadow at all.
+	atlas.beginFrame();
+	shadow_atlas_allocation small = atlas.request(1000, 0, MAXIMUM_SIZE, 1.f);
+	EXPECT_EQ(small.viewport.size, MINIMUM_SIZE);
+	EXPECT_EQ(atlas.getStats().numDownsized, 1u);
+	EXPECT_EQ(atlas.getStats().numEvictions, 1u);
+	expectConsistent(atlas);
+
+	// Stays small as long as that would need more evictions.
+	atlas.beginFrame();
+	shadow_atlas_allocation same = atlas.request(1000, 0, MAXIMUM_SIZE, 1.f);
+	EXPECT_TRUE(same.cacheHit);
+	EXPECT_EQ(same.viewport.size, MINIMUM_SIZE);
+
+	// Grows back once a tile is free.
+	atlas.release(1);
+	atlas.beginFrame();
+	shadow_atlas_allocation grown = atlas.request(1000, 0, MAXIMUM_SIZE, 1.f);
+	EXPECT_FALSE(grown.cacheHit);
+	EXPECT_EQ(grown.viewport.size, MAXIMUM_SIZE);
+	EXPECT_EQ(atlas.getStats().numEvictions, 1u);
+	expectConsistent(atlas);
+
+	// The first tile is free again. After that, a more important light evicts a less important one of its size.
+	atlas.beginFrame();
+	EXPECT_EQ(atlas.request(1001, 0, MAXIMUM_SIZE, 1000.f).viewport.size, MAXIMUM_SIZE);
+	EXPECT_EQ(atlas.getStats().numEvictions, 1u);
+	EXPECT_EQ(atlas.request(1002, 0, MAXIMUM_SIZE, 1000.f).viewport.size, MAXIMUM_SIZE);
+	EXPECT_EQ(atlas.getStats().numEvictions, 2u);
+}
+
+TEST(Rendering_ShadowAtlas, DefragmentsOverFrames) {
+
+	using namespace era_engine;
+
+	RandomNumberGenerator rng(42);
+
+	shadow_atlas atlas = createAtlas();
+	atlas.maxRelocationsPerFrame = 2;
+
+	// Fills the atlas with small lights and keeps a random few of them, at least one in every tile.
+	const uint32 smallSize = 256;
+	const uint32 numSmall = (ATLAS_SIZE / smallSize) * (ATLAS_SIZE / smallSize);
+
+	atlas.beginFrame();
+	for (uint64 light = 0; light < numSmall; ++light)
+	{
+		ASSERT_EQ(atlas.request(light, 0, smallSize, 1.f).viewport.size, smallSize);
+	}
+
+	std::vector<uint64> kept;
+	std::vector<bool> tileUsed((ATLAS_SIZE / MAXIMUM_SIZE) * (ATLAS_SIZE / MAXIMUM_SIZE), false);
+	for (uint64 light = 0; light < numSmall; ++light)
+	{
+		shadow_map_viewport vp = atlas.request(light, 0, smallSize, 1.f).viewport;
+		uint32 tile = (vp.y / MAXIMUM_SIZE) * (ATLAS_SIZE / MAXIMUM_SIZE) + vp.x / MAXIMUM_SIZE;
+
+		if (!tileUsed[tile] || rng.random_uint32() % 4 == 0)
+		{
+			tileUsed[tile] = true;
+			kept.push_back(light);
+		}
+		else
+		{
+			atlas.release(light);
+		}
+	}
+	expectConsistent(atlas);
+	EXPECT_LT(atlas.getStats().occupancy(), 0.5f);
+	EXPECT_LT(atlas.getStats().largestFreeSize, MAXIMUM_SIZE);
+
+	// All small lights stay visible. The large one does not fit although there are enough free texels, and there is
+	// nothing to evict.
+	const uint64 largeLight = 100000;
+	shadow_atlas_allocation large = atlas.request(largeLight, 0, MAXIMUM_SIZE, 1.f);
+	EXPECT_LT(large.viewport.size, MAXIMUM_SIZE);
+	EXPECT_EQ(atlas.getStats().numEvictions, 0u);
+
+	uint32 frames = 0;
+	for (; frames < 1000 && large.viewport.size != MAXIMUM_SIZE; ++frames)
+	{
+		uint64 relocationsBefore = atlas.getStats().numRelocations;
+		uint64 hitsBefore = atlas.getStats().numCacheHits;
+
+		atlas.beginFrame();
+
+		uint64 relocations = atlas.getStats().numRelocations - relocationsBefore;
+		EXPECT_LE(relocations, (uint64)atlas.maxRelocationsPerFrame);
+
+		for (uint64 light : kept)
+		{
+			ASSERT_EQ(atlas.request(light, 0, smallSize, 1.f).viewport.size, smallSize);
+		}
+
+		// Only moved lights miss. The large one may have been moved, too.
+		uint64 misses = kept.size() - (atlas.getStats().numCacheHits - hitsBefore);
+		EXPECT_LE(misses, relocations);
+
+		large = atlas.request(largeLight, 0, MAXIMUM_SIZE, 1.f);
+		expectConsistent(atlas);
+	}
+
+	EXPECT_EQ(large.viewport.size, MAXIMUM_SIZE);
+	EXPECT_GT(atlas.getStats().numRelocations, 0u);
+	EXPECT_EQ(atlas.getStats().numEvictions, 0u);
+
+	// Nothing moves once the request fits.
+	uint64 relocations = atlas.getStats().numRelocations;
+	for (uint32 i = 0; i < 10; ++i)
+	{
+		atlas.beginFrame();
+	}
+	EXPECT_EQ(atlas.getStats().numRelocations, relocations);
+}
+
+TEST(Rendering_ShadowAtlas, SimulatedChurn) {
+
+	using namespace era_engine;
+
+	RandomNumberGenerator rng(7);
+
+	shadow_atlas atlas = createAtlas();
+
+	// Many more lights than fit into the atlas, a random subset of which is visible in each frame. A few of them move.
+	const uint32 numLights = 500;
+	const uint32 numFrames = 1000;
+
+	std::vector<uint32> sizes(numLights);
+	std::vector<float> priorities(numLights);
+	std::vector<uint64> movementHashes(numLights, 0);
+	for (uint32 i = 0; i < numLights; ++i)
+	{
+		sizes[i] = MINIMUM_SIZE << rng.random_uint32_between(0, 4);
+		priorities[i] = rng.random_float_between(0.1f, 10.f);
+	}
+
+	std::vector<bool> visible(numLights, false);
+	uint64 numRequests = 0;
+	uint64 numShadowless = 0;
+
+	for (uint32 frame = 0; frame < numFrames; ++frame)
+	{
+		atlas.beginFrame();
+
+		std::vector<shadow_map_viewport> frameViewports;
+		for (uint32 i = 0; i < numLights; ++i)
+		{
+			// Visibility changes slowly, like with a moving camera.
+			if (rng.random_uint32() % 100 == 0)
+			{
+				visible[i] = !visible[i];
+			}
+			if (!visible[i])
+			{
+				continue;
+			}
+
+			if (rng.random_uint32() % 20 == 0)
+			{
+				++movementHashes[i];
+			}
+
+			shadow_atlas_allocation allocation = atlas.request(i, movementHashes[i], sizes[i], priorities[i]);
+			++numRequests;
+			numShadowless += (allocation.viewport.size == 0);
+
+			if (allocation.viewport.size)
+			{
+				for (shadow_map_viewport other : frameViewports)
+				{
+					ASSERT_FALSE(overlaps(allocation.viewport, other));
+				}
+				frameViewports.push_back(allocation.viewport);
+			}
+		}
+
+		if (frame % 100 == 0)
+		{
+			expectConsistent(atlas);
+		}
+	}
+
+	shadow_atlas_stats stats = atlas.getStats();
+	EXPECT_EQ(stats.numRequests, numRequests);
+	EXPECT_EQ(stats.numFailed, numShadowless);
+	EXPECT_GT(stats.cacheHitRate(), 0.5f);
+}
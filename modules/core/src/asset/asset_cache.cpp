@@ -0,0 +1,177 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#include "asset/asset_cache.h"
+#include "asset/io.h"
+
+#include "core/hash.h"
+#include "core/log.h"
+
+namespace era_engine
+{
+	struct file_hash_entry
+	{
+		uint64 size;
+		fs::file_time_type write_time;
+		uint64 hash;
+	};
+
+	static std::mutex cacheMutex;
+	static fs::path cacheDirectory;
+	static std::unordered_map<fs::path, file_hash_entry> fileHashes;
+
+	static std::atomic<uint64> cacheHits = 0;
+	static std::atomic<uint64> cacheMisses = 0;
+	static std::atomic<uint64> cacheWrites = 0;
+	static std::atomic<uint64> hashedFiles = 0;
+	static std::atomic<uint64> hashedBytes = 0;
+	static std::atomic<uint64> hashingMicroseconds = 0;
+	static std::atomic<uint32> tempCounter = 0;
+
+	void set_asset_cache_directory(const fs::path& directory)
+	{
+		std::lock_guard lock{ cacheMutex };
+		cacheDirectory = directory;
+	}
+
+	fs::path get_asset_cache_directory()
+	{
+		std::lock_guard lock{ cacheMutex };
+		if (cacheDirectory.empty())
+		{
+			const char* environment = getenv("ERA_ASSET_CACHE_DIR");
+			cacheDirectory = (environment && *environment) ? fs::path(environment) : fs::path(L"asset_cache");
+		}
+		return cacheDirectory;
+	}
+
+	uint64 hash_file_content(const fs::path& path)
+	{
+		std::error_code ec;
+		uint64 size = fs::file_size(path, ec);
+		if (ec)
+		{
+			return 0;
+		}
+		fs::file_time_type writeTime = fs::last_write_time(path, ec);
+
+		{
+			std::lock_guard lock{ cacheMutex };
+			auto it = fileHashes.find(path);
+			if (it != fileHashes.end() && it->second.size == size && it->second.write_time == writeTime)
+			{
+				return it->second.hash;
+			}
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		EntireFile file = map_file(path, true);
+		if (!file.content && size > 0)
+		{
+			return 0;
+		}
+
+		uint64 hash = hash_bytes(file.content, file.size);
+		free_file(file);
+
+		auto end = std::chrono::high_resolution_clock::now();
+
+		++hashedFiles;
+		hashedBytes += size;
+		hashingMicroseconds += (uint64)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+
+		std::lock_guard lock{ cacheMutex };
+		fileHashes[path] = { size, writeTime, hash };
+		return hash;
+	}
+
+	uint64 get_asset_cache_key(uint64 content_hash, uint32 import_flags, uint32 importer_version)
+	{
+		struct
+		{
+			uint64 content_hash;
+			uint32 import_flags;
+			uint32 importer_version;
+		} key = { content_hash, import_flags, importer_version };
+
+		return hash_bytes(&key, sizeof(key));
+	}
+
+	fs::path get_asset_cache_path(uint64 key, const char* extension)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+		return get_asset_cache_directory() / std::string(name, 2) / (std::string(name) + extension);
+	}
+
+	bool find_asset_cache_entry(uint64 key, const char* extension, fs::path& out_path)
+	{
+		out_path = get_asset_cache_path(key, extension);
+
+		std::error_code ec;
+		if (fs::is_regular_file(out_path, ec))
+		{
+			++cacheHits;
+			return true;
+		}
+
+		++cacheMisses;
+		return false;
+	}
+
+	fs::path begin_asset_cache_entry(uint64 key, const char* extension)
+	{
+		fs::path path = get_asset_cache_path(key, extension);
+
+		std::error_code ec;
+		fs::create_directories(path.parent_path(), ec);
+
+		// Process id and counter keep concurrent writers (threads or other machines sharing the directory) apart.
+		path += ".tmp" + std::to_string(GetCurrentProcessId()) + "_" + std::to_string(tempCounter++);
+		return path;
+	}
+
+	bool commit_asset_cache_entry(const fs::path& temp_path, uint64 key, const char* extension)
+	{
+		fs::path path = get_asset_cache_path(key, extension);
+
+		// Renaming within a directory is atomic, so readers never see partially written entries.
+		// If another writer won the race, both files have the same content and either one is fine.
+		std::error_code ec;
+		fs::rename(temp_path, path, ec);
+		if (ec)
+		{
+			fs::remove(temp_path, ec);
+			if (!fs::is_regular_file(path, ec))
+			{
+				LOG_ERROR("Could not write asset cache entry '%ws'", path.c_str());
+				return false;
+			}
+		}
+
+		++cacheWrites;
+		return true;
+	}
+
+	AssetCacheStats get_asset_cache_stats()
+	{
+		AssetCacheStats stats;
+		stats.hits = cacheHits;
+		stats.misses = cacheMisses;
+		stats.writes = cacheWrites;
+		stats.hashed_files = hashedFiles;
+		stats.hashed_bytes = hashedBytes;
+		stats.hashing_ms = hashingMicroseconds / 1000.0;
+		return stats;
+	}
+
+	void reset_asset_cache_stats()
+	{
+		cacheHits = 0;
+		cacheMisses = 0;
+		cacheWrites = 0;
+		hashedFiles = 0;
+		hashedBytes = 0;
+		hashingMicroseconds = 0;
+	}
+}
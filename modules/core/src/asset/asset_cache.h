@@ -0,0 +1,47 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#pragma once
+
+#include "core_api.h"
+
+namespace era_engine
+{
+	// Content-addressed cache for preprocessed assets.
+	// Entries are keyed by a hash of the source file's bytes, the import flags and the importer version, so they do not
+	// depend on the source path or on file timestamps. The same cache directory can therefore be shared between
+	// checkouts and machines (e.g. on a network drive), and entries are written atomically so concurrent writers are safe.
+	// The directory defaults to 'asset_cache' and can be overridden with the ERA_ASSET_CACHE_DIR environment variable.
+
+	struct AssetCacheStats
+	{
+		uint64 hits = 0;
+		uint64 misses = 0;
+		uint64 writes = 0;
+
+		uint64 hashed_files = 0;
+		uint64 hashed_bytes = 0;
+		double hashing_ms = 0.0;
+	};
+
+	ERA_CORE_API void set_asset_cache_directory(const fs::path& directory);
+	NODISCARD ERA_CORE_API fs::path get_asset_cache_directory();
+
+	// Hash of the file content. Memoized per path, size and write time, so unchanged files are only read once per run.
+	// Returns 0 if the file cannot be read.
+	NODISCARD ERA_CORE_API uint64 hash_file_content(const fs::path& path);
+
+	NODISCARD ERA_CORE_API uint64 get_asset_cache_key(uint64 content_hash, uint32 import_flags, uint32 importer_version);
+
+	// <cache dir>/<first two hex digits>/<16 hex digits><extension>.
+	NODISCARD ERA_CORE_API fs::path get_asset_cache_path(uint64 key, const char* extension);
+
+	// Looks up an entry and records a hit or miss.
+	ERA_CORE_API bool find_asset_cache_entry(uint64 key, const char* extension, fs::path& out_path);
+
+	// Returns a unique temporary path next to the final entry. Write the entry there and publish it with commit_asset_cache_entry.
+	NODISCARD ERA_CORE_API fs::path begin_asset_cache_entry(uint64 key, const char* extension);
+	ERA_CORE_API bool commit_asset_cache_entry(const fs::path& temp_path, uint64 key, const char* extension);
+
+	NODISCARD ERA_CORE_API AssetCacheStats get_asset_cache_stats();
+	ERA_CORE_API void reset_asset_cache_stats();
+}
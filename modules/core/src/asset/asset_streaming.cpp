@@ -0,0 +1,578 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#include "asset/asset_streaming.h"
+
+#include "core/log.h"
+
+namespace era_engine
+{
+	using streaming_clock = std::chrono::high_resolution_clock;
+
+	static constexpr uint32 MAX_LATENCY_SAMPLES = 1024;
+
+	struct streaming_queue_entry
+	{
+		float priority;
+		uint32 generation;
+		ref<streaming_request> request;
+	};
+
+	// Min-heap on priority. Entries are invalidated lazily: a priority change pushes a new entry with the next
+	// generation, the old one is skipped when it reaches the top.
+	static bool operator<(const streaming_queue_entry& a, const streaming_queue_entry& b)
+	{
+		return a.priority > b.priority;
+	}
+
+	struct asset_streaming_service
+	{
+		asset_streaming_settings settings;
+
+		std::mutex mutex;
+		std::condition_variable io_condition;
+		std::vector<std::thread> io_threads;
+		bool running = true;
+
+		std::vector<streaming_queue_entry> queue;
+		std::unordered_map<uint64, ref<streaming_request>> requests;
+		std::vector<ref<streaming_request>> pending_release;
+
+		uint32 num_queued = 0;
+		uint32 num_reading = 0;
+		uint32 num_decoding = 0;
+		uint32 num_resident = 0;
+
+		uint64 bytes_in_flight = 0;
+		uint64 resident_bytes = 0;
+
+		uint64 completed = 0;
+		uint64 failed = 0;
+		uint64 canceled = 0;
+		uint64 evicted = 0;
+
+		std::vector<float> latencies;
+		uint32 next_latency = 0;
+	};
+
+	static asset_streaming_service* service = nullptr;
+	static std::atomic<uint64> currentFrame = 1;
+
+	// The helpers below expect the service mutex to be held.
+
+	static void pushToQueue(asset_streaming_service& s, const ref<streaming_request>& request)
+	{
+		s.queue.push_back({ request->priority.load(std::memory_order_relaxed), ++request->generation, request });
+		std::push_heap(s.queue.begin(), s.queue.end());
+
+		// Frequent priority updates leave many stale entries behind.
+		if (s.queue.size() > 2 * s.num_queued + 64)
+		{
+			std::erase_if(s.queue, [](const streaming_queue_entry& e)
+			{
+				return e.generation != e.request->generation || e.request->state != streaming_request_state::QUEUED;
+			});
+			std::make_heap(s.queue.begin(), s.queue.end());
+		}
+	}
+
+	static ref<streaming_request> popFromQueue(asset_streaming_service& s)
+	{
+		while (!s.queue.empty())
+		{
+			std::pop_heap(s.queue.begin(), s.queue.end());
+			streaming_queue_entry entry = std::move(s.queue.back());
+			s.queue.pop_back();
+
+			if (entry.generation == entry.request->generation && entry.request->state == streaming_request_state::QUEUED)
+			{
+				return entry.request;
+			}
+		}
+		return nullptr;
+	}
+
+	static void retireRequest(asset_streaming_service& s, const ref<streaming_request>& request, streaming_request_state state)
+	{
+		request->state = state;
+		if (state == streaming_request_state::CANCELED)
+		{
+			++s.canceled;
+		}
+		else if (state == streaming_request_state::FAILED)
+		{
+			++s.failed;
+		}
+
+		// Failed requests stay registered, so that callers do not retry them every frame.
+		if (state == streaming_request_state::CANCELED)
+		{
+			auto it = s.requests.find(request->key);
+			if (it != s.requests.end() && it->second == request)
+			{
+				s.requests.erase(it);
+			}
+		}
+
+		s.pending_release.push_back(request);
+	}
+
+	static void recordLatency(asset_streaming_service& s, float milliseconds)
+	{
+		if (s.latencies.size() < MAX_LATENCY_SAMPLES)
+		{
+			s.latencies.push_back(milliseconds);
+		}
+		else
+		{
+			s.latencies[s.next_latency] = milliseconds;
+			s.next_latency = (s.next_latency + 1) % MAX_LATENCY_SAMPLES;
+		}
+	}
+
+	static void submitDecode(const ref<streaming_request>& request)
+	{
+		struct decode_data
+		{
+			ref<streaming_request> request;
+		};
+
+		JobHandle job = low_priority_job_queue.createJob<decode_data>([](decode_data& data, JobHandle job)
+			{
+				streaming_request& request = *data.request;
+				uint64 residentBytes = request.asset->decode(job);
+
+				asset_streaming_service& s = *service;
+				{
+					std::lock_guard lock{ s.mutex };
+
+					--s.num_decoding;
+					s.bytes_in_flight -= request.read_bytes;
+
+					if (request.cancel_requested)
+					{
+						retireRequest(s, data.request, streaming_request_state::CANCELED);
+					}
+					else if (!residentBytes)
+					{
+						retireRequest(s, data.request, streaming_request_state::FAILED);
+					}
+					else
+					{
+						request.resident_bytes = residentBytes;
+						request.state = streaming_request_state::RESIDENT;
+						++s.num_resident;
+						s.resident_bytes += residentBytes;
+						++s.completed;
+
+						recordLatency(s, std::chrono::duration<float, std::milli>(streaming_clock::now() - request.request_time).count());
+					}
+				}
+				s.io_condition.notify_one();
+			}, { request });
+		job.submit_now();
+	}
+
+	static void ioThread()
+	{
+		asset_streaming_service& s = *service;
+
+		std::unique_lock lock{ s.mutex };
+		while (true)
+		{
+			s.io_condition.wait(lock, [&s]()
+			{
+				bool throttled = s.bytes_in_flight >= s.settings.max_bytes_in_flight && (s.num_reading + s.num_decoding) > 0;
+				return !s.running || (s.num_queued > 0 && !throttled);
+			});
+
+			if (!s.running)
+			{
+				break;
+			}
+
+			ref<streaming_request> request = popFromQueue(s);
+			if (!request)
+			{
+				continue;
+			}
+
+			uint64 estimate = request->asset->estimate_read_size();
+
+			--s.num_queued;
+			++s.num_reading;
+			s.bytes_in_flight += estimate;
+			request->state = streaming_request_state::READING;
+
+			lock.unlock();
+			uint64 readBytes = request->cancel_requested ? 0 : request->asset->read();
+			lock.lock();
+
+			--s.num_reading;
+			s.bytes_in_flight = s.bytes_in_flight - estimate + readBytes;
+
+			if (request->cancel_requested || !readBytes)
+			{
+				s.bytes_in_flight -= readBytes;
+				retireRequest(s, request, request->cancel_requested ? streaming_request_state::CANCELED : streaming_request_state::FAILED);
+				continue;
+			}
+
+			request->read_bytes = readBytes;
+			request->state = streaming_request_state::DECODING;
+			++s.num_decoding;
+
+			submitDecode(request);
+		}
+	}
+
+	void initializeAssetStreaming(const asset_streaming_settings& settings)
+	{
+		ASSERT(!service);
+
+		service = new asset_streaming_service;
+		service->settings = settings;
+
+		uint32 numThreads = max(settings.num_io_threads, 1u);
+		for (uint32 i = 0; i < numThreads; ++i)
+		{
+			std::thread& thread = service->io_threads.emplace_back(ioThread);
+			SetThreadDescription((HANDLE)thread.native_handle(), L"Asset streaming I/O");
+		}
+	}
+
+	void shutdownAssetStreaming()
+	{
+		if (!service)
+		{
+			return;
+		}
+
+		{
+			std::lock_guard lock{ service->mutex };
+			service->running = false;
+		}
+		service->io_condition.notify_all();
+
+		for (std::thread& thread : service->io_threads)
+		{
+			thread.join();
+		}
+
+		// Decode jobs still reference the service.
+		low_priority_job_queue.wait_for_completion();
+
+		for (auto& [key, request] : service->requests)
+		{
+			if (request->state == streaming_request_state::RESIDENT)
+			{
+				request->asset->release();
+			}
+		}
+		for (const ref<streaming_request>& request : service->pending_release)
+		{
+			request->asset->release();
+		}
+
+		delete service;
+		service = nullptr;
+	}
+
+	bool isAssetStreamingInitialized()
+	{
+		return service != nullptr;
+	}
+
+	void updateAssetStreaming()
+	{
+		if (!service)
+		{
+			return;
+		}
+
+		asset_streaming_service& s = *service;
+		uint64 frame = currentFrame.fetch_add(1, std::memory_order_relaxed);
+
+		std::vector<ref<streaming_request>> release;
+		std::vector<ref<streaming_request>> evict;
+
+		{
+			std::lock_guard lock{ s.mutex };
+
+			release.swap(s.pending_release);
+
+			if (s.resident_bytes > s.settings.memory_budget)
+			{
+				std::vector<ref<streaming_request>> candidates;
+				for (auto& [key, request] : s.requests)
+				{
+					if (request->state == streaming_request_state::RESIDENT && request->last_used_frame.load(std::memory_order_relaxed) < frame)
+					{
+						candidates.push_back(request);
+					}
+				}
+
+				// Least recently used first, the farthest (highest priority value) of those first.
+				std::sort(candidates.begin(), candidates.end(), [](const ref<streaming_request>& a, const ref<streaming_request>& b)
+				{
+					uint64 frameA = a->last_used_frame.load(std::memory_order_relaxed);
+					uint64 frameB = b->last_used_frame.load(std::memory_order_relaxed);
+					return (frameA != frameB) ? (frameA < frameB) : (a->priority > b->priority);
+				});
+
+				for (const ref<streaming_request>& request : candidates)
+				{
+					if (s.resident_bytes <= s.settings.memory_budget)
+					{
+						break;
+					}
+
+					request->state = streaming_request_state::EVICTED;
+					request->releasing = true;
+					--s.num_resident;
+					s.resident_bytes -= request->resident_bytes;
+					request->resident_bytes = 0;
+					++s.evicted;
+
+					evict.push_back(request);
+				}
+			}
+		}
+
+		for (const ref<streaming_request>& request : release)
+		{
+			request->asset->release();
+		}
+
+		if (evict.empty())
+		{
+			return;
+		}
+
+		for (const ref<streaming_request>& request : evict)
+		{
+			request->asset->release();
+		}
+
+		bool requeued = false;
+		{
+			std::lock_guard lock{ s.mutex };
+			for (const ref<streaming_request>& request : evict)
+			{
+				request->releasing = false;
+
+				// Used again (from another thread) while it was being released.
+				if (request->requeue_after_release && request->state == streaming_request_state::EVICTED)
+				{
+					request->state = streaming_request_state::QUEUED;
+					request->request_time = streaming_clock::now();
+					++s.num_queued;
+					pushToQueue(s, request);
+					requeued = true;
+				}
+				request->requeue_after_release = false;
+			}
+		}
+
+		if (requeued)
+		{
+			s.io_condition.notify_all();
+		}
+	}
+
+	void setAssetStreamingBudget(uint64 memoryBudget)
+	{
+		if (service)
+		{
+			std::lock_guard lock{ service->mutex };
+			service->settings.memory_budget = memoryBudget;
+		}
+	}
+
+	ref<streaming_request> requestStreaming(uint64 key, const ref<streaming_asset>& asset, float priority)
+	{
+		ASSERT(service);
+		asset_streaming_service& s = *service;
+
+		ref<streaming_request> request;
+		{
+			std::lock_guard lock{ s.mutex };
+
+			auto it = s.requests.find(key);
+			if (it != s.requests.end())
+			{
+				request = it->second;
+				if (priority < request->priority && request->state == streaming_request_state::QUEUED)
+				{
+					request->priority = priority;
+					pushToQueue(s, request);
+				}
+				return request;
+			}
+
+			request = make_ref<streaming_request>();
+			request->key = key;
+			request->asset = asset;
+			request->priority = priority;
+			request->last_used_frame = currentFrame.load(std::memory_order_relaxed);
+			request->request_time = streaming_clock::now();
+
+			s.requests[key] = request;
+			++s.num_queued;
+			pushToQueue(s, request);
+		}
+		s.io_condition.notify_one();
+
+		return request;
+	}
+
+	void setStreamingPriority(const ref<streaming_request>& request, float priority)
+	{
+		if (request->priority == priority)
+		{
+			return;
+		}
+
+		if (!service)
+		{
+			request->priority = priority;
+			return;
+		}
+
+		std::lock_guard lock{ service->mutex };
+		request->priority = priority;
+		if (request->state == streaming_request_state::QUEUED)
+		{
+			pushToQueue(*service, request);
+		}
+	}
+
+	void cancelStreaming(const ref<streaming_request>& request)
+	{
+		request->cancel_requested = true;
+
+		if (!service)
+		{
+			return;
+		}
+
+		asset_streaming_service& s = *service;
+		std::lock_guard lock{ s.mutex };
+
+		switch (request->state)
+		{
+			case streaming_request_state::QUEUED:
+			{
+				// Nothing was read yet, so there is nothing to release.
+				--s.num_queued;
+				request->state = streaming_request_state::CANCELED;
+				++s.canceled;
+				s.requests.erase(request->key);
+			} break;
+			case streaming_request_state::RESIDENT:
+			{
+				--s.num_resident;
+				s.resident_bytes -= request->resident_bytes;
+				request->resident_bytes = 0;
+				retireRequest(s, request, streaming_request_state::CANCELED);
+			} break;
+			case streaming_request_state::EVICTED:
+			{
+				// Already released, or being released in updateAssetStreaming.
+				request->state = streaming_request_state::CANCELED;
+				++s.canceled;
+				s.requests.erase(request->key);
+			} break;
+			default:
+			{
+				// The I/O thread or the decode job picks up the flag.
+			} break;
+		}
+	}
+
+	void markStreamedAssetUsed(const ref<streaming_request>& request, float priority)
+	{
+		request->last_used_frame.store(currentFrame.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+		streaming_request_state state = request->state;
+		if (state == streaming_request_state::RESIDENT || !service)
+		{
+			return;
+		}
+
+		if (state == streaming_request_state::QUEUED)
+		{
+			setStreamingPriority(request, priority);
+		}
+		else if (state == streaming_request_state::EVICTED)
+		{
+			asset_streaming_service& s = *service;
+			{
+				std::lock_guard lock{ s.mutex };
+
+				if (request->state != streaming_request_state::EVICTED)
+				{
+					return;
+				}
+
+				request->priority = priority;
+				if (request->releasing)
+				{
+					// updateAssetStreaming queues it again once the release is done.
+					request->requeue_after_release = true;
+					return;
+				}
+
+				request->state = streaming_request_state::QUEUED;
+				request->request_time = streaming_clock::now();
+				++s.num_queued;
+				pushToQueue(s, request);
+			}
+			s.io_condition.notify_one();
+		}
+	}
+
+	asset_streaming_stats getAssetStreamingStats()
+	{
+		asset_streaming_stats stats;
+		if (!service)
+		{
+			return stats;
+		}
+
+		asset_streaming_service& s = *service;
+		std::vector<float> latencies;
+		{
+			std::lock_guard lock{ s.mutex };
+
+			stats.queued = s.num_queued;
+			stats.reading = s.num_reading;
+			stats.decoding = s.num_decoding;
+			stats.resident = s.num_resident;
+			stats.bytes_in_flight = s.bytes_in_flight;
+			stats.resident_bytes = s.resident_bytes;
+			stats.memory_budget = s.settings.memory_budget;
+			stats.completed = s.completed;
+			stats.failed = s.failed;
+			stats.canceled = s.canceled;
+			stats.evicted = s.evicted;
+
+			latencies = s.latencies;
+		}
+
+		if (!latencies.empty())
+		{
+			auto percentile = [&latencies](float p)
+			{
+				auto nth = latencies.begin() + (size_t)(p * (latencies.size() - 1));
+				std::nth_element(latencies.begin(), nth, latencies.end());
+				return *nth;
+			};
+
+			stats.latency_p50 = percentile(0.5f);
+			stats.latency_p90 = percentile(0.9f);
+			stats.latency_p99 = percentile(0.99f);
+		}
+
+		return stats;
+	}
+}
@@ -0,0 +1,138 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#pragma once
+
+#include "core_api.h"
+
+#include "core/job_system.h"
+
+namespace era_engine
+{
+	// Asset which can be streamed in and out by the streaming service. The service never runs two stages of the same
+	// asset concurrently.
+	struct ERA_CORE_API streaming_asset
+	{
+		virtual ~streaming_asset() = default;
+
+		// I/O stage. Runs on one of the streaming service's I/O threads. Returns the number of bytes read, 0 on failure.
+		virtual uint64 read() = 0;
+
+		// Decode stage. Runs on the low priority job queue after a successful read. Returns the number of resident bytes
+		// the asset occupies afterwards, 0 on failure. 'job' may be used as parent for dependent loads.
+		virtual uint64 decode(JobHandle job) = 0;
+
+		// Frees everything read or decoded. Always called on the main thread, from updateAssetStreaming. The asset may
+		// be streamed in again afterwards.
+		virtual void release() = 0;
+
+		// Expected number of bytes read, used to throttle the I/O stage before the real size is known.
+		virtual uint64 estimate_read_size() const { return 0; }
+	};
+
+	enum class streaming_request_state
+	{
+		QUEUED,
+		READING,
+		DECODING,
+		RESIDENT,
+		FAILED,
+		CANCELED,
+		EVICTED,
+
+		COUNT,
+	};
+
+	static const char* streaming_request_state_names[] =
+	{
+		"Queued",
+		"Reading",
+		"Decoding",
+		"Resident",
+		"Failed",
+		"Canceled",
+		"Evicted",
+	};
+
+	struct streaming_request
+	{
+		uint64 key = 0;
+		ref<streaming_asset> asset;
+
+		std::atomic<streaming_request_state> state = streaming_request_state::QUEUED;
+
+		// Requests with lower values are read first, e.g. the distance to the camera.
+		std::atomic<float> priority = 0.f;
+
+		std::atomic<bool> cancel_requested = false;
+		std::atomic<uint64> last_used_frame = 0;
+
+		// Guarded by the service.
+		uint64 read_bytes = 0;
+		uint64 resident_bytes = 0;
+		uint32 generation = 0;
+		bool releasing = false;
+		bool requeue_after_release = false;
+		std::chrono::high_resolution_clock::time_point request_time;
+	};
+
+	struct asset_streaming_settings
+	{
+		// Least recently used assets are evicted while the resident bytes exceed this. Assets used in the current frame
+		// are never evicted, so the budget may be exceeded temporarily.
+		uint64 memory_budget = 1024ull * 1024 * 1024;
+
+		// The I/O stage pauses while this many bytes are read or waiting to be decoded. One request is always let
+		// through, so assets larger than this still load.
+		uint64 max_bytes_in_flight = 256ull * 1024 * 1024;
+
+		uint32 num_io_threads = 2;
+	};
+
+	struct asset_streaming_stats
+	{
+		uint32 queued = 0;
+		uint32 reading = 0;
+		uint32 decoding = 0;
+		uint32 resident = 0;
+
+		uint64 bytes_in_flight = 0;
+		uint64 resident_bytes = 0;
+		uint64 memory_budget = 0;
+
+		uint64 completed = 0;
+		uint64 failed = 0;
+		uint64 canceled = 0;
+		uint64 evicted = 0;
+
+		// Request to resident, over the most recent completed requests. In milliseconds.
+		float latency_p50 = 0.f;
+		float latency_p90 = 0.f;
+		float latency_p99 = 0.f;
+	};
+
+	ERA_CORE_API void initializeAssetStreaming(const asset_streaming_settings& settings = {});
+	ERA_CORE_API void shutdownAssetStreaming();
+	NODISCARD ERA_CORE_API bool isAssetStreamingInitialized();
+
+	// Call once per frame on the main thread. Releases canceled assets and evicts least recently used ones if the
+	// resident bytes exceed the budget.
+	ERA_CORE_API void updateAssetStreaming();
+
+	ERA_CORE_API void setAssetStreamingBudget(uint64 memoryBudget);
+
+	// Requests with the same key are merged: the existing request is returned and keeps the lower priority value.
+	// 'asset' is only used if no request with this key exists.
+	ERA_CORE_API ref<streaming_request> requestStreaming(uint64 key, const ref<streaming_asset>& asset, float priority);
+
+	ERA_CORE_API void setStreamingPriority(const ref<streaming_request>& request, float priority);
+
+	// Queued requests are dropped, requests in the I/O or decode stage are released once the stage finishes. Resident
+	// assets are released in the next update.
+	ERA_CORE_API void cancelStreaming(const ref<streaming_request>& request);
+
+	// Marks the asset as used in the current frame, which protects it from eviction. Evicted assets are queued again
+	// with the given priority. Cheap for resident assets.
+	ERA_CORE_API void markStreamedAssetUsed(const ref<streaming_request>& request, float priority);
+
+	NODISCARD ERA_CORE_API asset_streaming_stats getAssetStreamingStats();
+}
@@ -4,8 +4,11 @@
 
 #include "asset/model_asset.h"
 #include "asset/io.h"
+#include "asset/lz4.h"
 
 #include "core/cpu_profiling.h"
+#include "core/job_system.h"
+#include "core/memory.h"
 
 #include "rendering/pbr_material.h"
 
@@ -16,10 +19,16 @@ namespace era_engine
 {
 	static const uint32 BIN_HEADER = 'BIN ';
 
+	static const uint32 BIN_VERSION_1 = 1;
+	static const uint32 BIN_VERSION_2 = 2;
+	static const uint32 BIN_VERSION_3 = 3;
+	static const uint32 BIN_VERSION_4 = 4;
+
+	// Version 1 layout: header, then meshes with their attribute arrays inline, materials, skeletons and animations.
 	struct bin_header
 	{
 		uint32 header = BIN_HEADER;
-		uint32 version = 1;
+		uint32 version = BIN_VERSION_1;
 		uint32 flags;
 		uint32 numMeshes;
 		uint32 numMaterials;
@@ -27,6 +36,47 @@ namespace era_engine
 		uint32 numAnimations;
 	};
 
+	// Version 2 layout: header, metadata (mesh and submesh headers, materials, skeletons, animations), then all
+	// geometry blobs, each aligned to BIN_BLOB_ALIGNMENT, and finally the blob table (table of contents).
+	// Submesh headers reference their blobs by index into the table.
+	// Version 3 is identical, except that every submesh header is followed by its LOD chain (count + entries).
+	// Version 4 adds a meshlet header after the LOD chain.
+	struct bin_header_v2
+	{
+		uint32 header = BIN_HEADER;
+		uint32 version = BIN_VERSION_4;
+		uint32 flags;
+		uint32 numMeshes;
+		uint32 numMaterials;
+		uint32 numSkeletons;
+		uint32 numAnimations;
+		uint32 numBlobs;
+		uint64 blobTableOffset;
+	};
+
+	static constexpr uint64 BIN_BLOB_ALIGNMENT = 64;
+	static constexpr uint32 BIN_NO_BLOB = (uint32)-1;
+
+	enum bin_blob_type
+	{
+		bin_blob_type_positions,
+		bin_blob_type_others,
+		bin_blob_type_colors,
+		bin_blob_type_triangles,
+		bin_blob_type_meshlets,
+		bin_blob_type_meshlet_vertices,
+		bin_blob_type_meshlet_primitives,
+	};
+
+	struct bin_blob_entry
+	{
+		uint64 offset;
+		uint64 storedSize;
+		uint64 size;
+		uint32 type;
+		uint32 compression;
+	};
+
 	struct bin_mesh_header
 	{
 		uint32 numSubmeshes;
@@ -34,22 +84,62 @@ namespace era_engine
 		uint32 nameLength;
 	};
 
-	enum bin_submesh_flag
+	struct bin_submesh_header
 	{
-		bin_submesh_flag_positions = (1 << 0),
-		bin_submesh_flag_uvs = (1 << 1),
-		bin_submesh_flag_normals = (1 << 2),
-		bin_submesh_flag_tangents = (1 << 3),
-		bin_submesh_flag_colors = (1 << 4),
-		bin_submesh_flag_skin = (1 << 5),
+		uint32 numVertices;
+		uint32 numTriangles;
+		int32 materialIndex;
+		uint32 flags;
 	};
 
-	struct bin_submesh_header
+	struct bin_submesh_header_v2
 	{
 		uint32 numVertices;
 		uint32 numTriangles;
 		int32 materialIndex;
 		uint32 flags;
+		bounding_box aabb;
+
+		uint32 positionsBlob;
+		uint32 othersBlob;
+		uint32 colorsBlob;
+		uint32 trianglesBlob;
+	};
+
+	struct bin_submesh_lod_entry
+	{
+		uint32 numTriangles;
+		float error;
+		uint32 trianglesBlob; // Same index type as the submesh's LOD 0.
+	};
+
+	struct bin_submesh_meshlet_header
+	{
+		uint32 numMeshlets;
+		uint32 numMeshletVertices;
+		uint32 numMeshletPrimitives;
+
+		uint32 meshletsBlob;
+		uint32 meshletVerticesBlob;
+		uint32 meshletPrimitivesBlob;
+	};
+
+	struct bin_others_layout
+	{
+		uint32 stride;
+		uint32 uvOffset;
+		uint32 normalOffset;
+		uint32 tangentOffset;
+		uint32 skinOffset;
+	};
+
+	static constexpr bin_others_layout binOthersLayout =
+	{
+		getVertexOthersSize(bin_gpu_vertex_flags),
+		0,
+		sizeof(vec2),
+		sizeof(vec2) + sizeof(vec3),
+		sizeof(vec2) + sizeof(vec3) + sizeof(vec3),
 	};
 
 	struct bin_material_header
@@ -82,7 +172,7 @@ namespace era_engine
 		fwrite(in.data(), sizeof(T), in.size(), file);
 	}
 
-	static void writeMesh(const MeshAsset& mesh, FILE* file)
+	static void writeMesh(const MeshAsset& mesh, FILE* file, uint32& nextBlob)
 	{
 		bin_mesh_header header;
 		header.skeletonIndex = mesh.skeleton_index;
@@ -96,12 +186,13 @@ namespace era_engine
 		{
 			const SubmeshAsset& in = mesh.submeshes[i];
 
-			bin_submesh_header subHeader;
+			bin_submesh_header_v2 subHeader;
 			subHeader.materialIndex = in.material_index;
 			subHeader.numVertices = (uint32)in.positions.size();
 			subHeader.numTriangles = (uint32)in.triangles.size();
 
 			subHeader.flags = 0;
+			if (subHeader.numVertices > UINT16_MAX + 1) { subHeader.flags |= bin_submesh_flag_index32; }
 			if (!in.positions.empty()) { subHeader.flags |= bin_submesh_flag_positions; }
 			if (!in.uvs.empty()) { subHeader.flags |= bin_submesh_flag_uvs; }
 			if (!in.normals.empty()) { subHeader.flags |= bin_submesh_flag_normals; }
@@ -109,15 +200,126 @@ namespace era_engine
 			if (!in.colors.empty()) { subHeader.flags |= bin_submesh_flag_colors; }
 			if (!in.skin.empty()) { subHeader.flags |= bin_submesh_flag_skin; }
 
-			fwrite(&subHeader, sizeof(bin_submesh_header), 1, file);
+			subHeader.aabb = bounding_box::negativeInfinity();
+			for (vec3 p : in.positions)
+			{
+				subHeader.aabb.grow(p);
+			}
+
+			// Must match the order in which writeSubmeshBlobs emits the blobs.
+			subHeader.positionsBlob = nextBlob++;
+			subHeader.othersBlob = nextBlob++;
+			subHeader.colorsBlob = !in.colors.empty() ? nextBlob++ : BIN_NO_BLOB;
+			subHeader.trianglesBlob = nextBlob++;
+
+			fwrite(&subHeader, sizeof(bin_submesh_header_v2), 1, file);
+
+			uint32 numLods = (uint32)in.lods.size();
+			fwrite(&numLods, sizeof(uint32), 1, file);
+			for (const SubmeshLodAsset& lod : in.lods)
+			{
+				bin_submesh_lod_entry entry;
+				entry.numTriangles = (uint32)lod.triangles.size();
+				entry.error = lod.error;
+				entry.trianglesBlob = nextBlob++;
+				fwrite(&entry, sizeof(bin_submesh_lod_entry), 1, file);
+			}
+
+			bin_submesh_meshlet_header meshletHeader;
+			meshletHeader.numMeshlets = (uint32)in.meshlets.size();
+			meshletHeader.numMeshletVertices = (uint32)in.meshlet_vertices.size();
+			meshletHeader.numMeshletPrimitives = (uint32)in.meshlet_primitives.size();
+			meshletHeader.meshletsBlob = !in.meshlets.empty() ? nextBlob++ : BIN_NO_BLOB;
+			meshletHeader.meshletVerticesBlob = !in.meshlets.empty() ? nextBlob++ : BIN_NO_BLOB;
+			meshletHeader.meshletPrimitivesBlob = !in.meshlets.empty() ? nextBlob++ : BIN_NO_BLOB;
+			fwrite(&meshletHeader, sizeof(bin_submesh_meshlet_header), 1, file);
+		}
+	}
+
+	static void writeBlob(const void* data, uint64 size, bin_blob_type type, const bin_write_options& options, FILE* file,
+		std::vector<bin_blob_entry>& outEntries)
+	{
+		uint64 position = _ftelli64(file);
+		uint64 aligned = align_to(position, BIN_BLOB_ALIGNMENT);
+		static const uint8 zeros[BIN_BLOB_ALIGNMENT] = {};
+		fwrite(zeros, 1, aligned - position, file);
+
+		bin_blob_entry entry;
+		entry.offset = aligned;
+		entry.size = size;
+		entry.storedSize = size;
+		entry.type = type;
+		entry.compression = bin_compression_none;
+
+		if (options.compression == bin_compression_lz4 && size > 0)
+		{
+			std::vector<uint8> compressed(lz4_compress_bound(size));
+			uint64 compressedSize = lz4_compress((const uint8*)data, size, compressed.data());
+
+			if (compressedSize < (uint64)(size * (1.f - options.min_compression_gain)))
+			{
+				entry.storedSize = compressedSize;
+				entry.compression = bin_compression_lz4;
+				fwrite(compressed.data(), 1, compressedSize, file);
+				outEntries.push_back(entry);
+				return;
+			}
+		}
 
-			if (!in.positions.empty()) { writeArray(in.positions, file); }
-			if (!in.uvs.empty()) { writeArray(in.uvs, file); }
-			if (!in.normals.empty()) { writeArray(in.normals, file); }
-			if (!in.tangents.empty()) { writeArray(in.tangents, file); }
-			if (!in.colors.empty()) { writeArray(in.colors, file); }
-			if (!in.skin.empty()) { writeArray(in.skin, file); }
-			writeArray(in.triangles, file);
+		fwrite(data, 1, size, file);
+		outEntries.push_back(entry);
+	}
+
+	static void writeTrianglesBlob(const std::vector<indexed_triangle32>& in, uint32 numVertices, const bin_write_options& options, FILE* file,
+		std::vector<bin_blob_entry>& outEntries)
+	{
+		if (numVertices > UINT16_MAX + 1)
+		{
+			writeBlob(in.data(), in.size() * sizeof(indexed_triangle32), bin_blob_type_triangles, options, file, outEntries);
+		}
+		else
+		{
+			std::vector<indexed_triangle16> triangles(in.size());
+			for (uint32 i = 0; i < (uint32)triangles.size(); ++i)
+			{
+				const indexed_triangle32& tri = in[i];
+				triangles[i] = { (uint16)tri.a, (uint16)tri.b, (uint16)tri.c };
+			}
+			writeBlob(triangles.data(), triangles.size() * sizeof(indexed_triangle16), bin_blob_type_triangles, options, file, outEntries);
+		}
+	}
+
+	static void writeSubmeshBlobs(const SubmeshAsset& in, const bin_write_options& options, FILE* file, std::vector<bin_blob_entry>& outEntries)
+	{
+		uint32 numVertices = (uint32)in.positions.size();
+
+		// Interleave into the GPU layout once here, so loading is a plain copy.
+		std::vector<uint8> others((uint64)numVertices * binOthersLayout.stride, 0);
+		for (uint32 i = 0; i < numVertices; ++i)
+		{
+			uint8* vertex = others.data() + (uint64)i * binOthersLayout.stride;
+			if (!in.uvs.empty()) { memcpy(vertex + binOthersLayout.uvOffset, &in.uvs[i], sizeof(vec2)); }
+			if (!in.normals.empty()) { memcpy(vertex + binOthersLayout.normalOffset, &in.normals[i], sizeof(vec3)); }
+			if (!in.tangents.empty()) { memcpy(vertex + binOthersLayout.tangentOffset, &in.tangents[i], sizeof(vec3)); }
+			if (!in.skin.empty()) { memcpy(vertex + binOthersLayout.skinOffset, &in.skin[i], sizeof(animation::SkinningWeights)); }
+		}
+
+		writeBlob(in.positions.data(), in.positions.size() * sizeof(vec3), bin_blob_type_positions, options, file, outEntries);
+		writeBlob(others.data(), others.size(), bin_blob_type_others, options, file, outEntries);
+		if (!in.colors.empty())
+		{
+			writeBlob(in.colors.data(), in.colors.size() * sizeof(uint32), bin_blob_type_colors, options, file, outEntries);
+		}
+		writeTrianglesBlob(in.triangles, numVertices, options, file, outEntries);
+		for (const SubmeshLodAsset& lod : in.lods)
+		{
+			writeTrianglesBlob(lod.triangles, numVertices, options, file, outEntries);
+		}
+		if (!in.meshlets.empty())
+		{
+			writeBlob(in.meshlets.data(), in.meshlets.size() * sizeof(MeshletAsset), bin_blob_type_meshlets, options, file, outEntries);
+			writeBlob(in.meshlet_vertices.data(), in.meshlet_vertices.size() * sizeof(uint32), bin_blob_type_meshlet_vertices, options, file, outEntries);
+			writeBlob(in.meshlet_primitives.data(), in.meshlet_primitives.size() * sizeof(uint32), bin_blob_type_meshlet_primitives, options, file, outEntries);
 		}
 	}
 
@@ -204,22 +406,29 @@ namespace era_engine
 		writeArray(animation.scale_keyframes, file);
 	}
 
-	void writeBIN(const ModelAsset& asset, const fs::path& path)
+	void writeBIN(const ModelAsset& asset, const fs::path& path, const bin_write_options& options)
 	{
 		FILE* file = fopen(path.string().c_str(), "wb");
+		if (!file)
+		{
+			return;
+		}
 
-		bin_header header;
+		bin_header_v2 header;
 		header.flags = asset.flags;
 		header.numMeshes = (uint32)asset.meshes.size();
 		header.numMaterials = (uint32)asset.materials.size();
 		header.numSkeletons = (uint32)asset.skeletons.size();
 		header.numAnimations = (uint32)asset.animations.size();
+		header.numBlobs = 0;
+		header.blobTableOffset = 0;
 
+		// Written again at the end, once the blob table offset is known.
 		fwrite(&header, sizeof(header), 1, file);
 
 		for (uint32 i = 0; i < header.numMeshes; ++i)
 		{
-			writeMesh(asset.meshes[i], file);
+			writeMesh(asset.meshes[i], file, header.numBlobs);
 		}
 		for (uint32 i = 0; i < header.numMaterials; ++i)
 		{
@@ -234,6 +443,26 @@ namespace era_engine
 			writeAnimation(asset.animations[i], file);
 		}
 
+		std::vector<bin_blob_entry> blobs;
+		blobs.reserve(header.numBlobs);
+		for (const MeshAsset& mesh : asset.meshes)
+		{
+			for (const SubmeshAsset& sub : mesh.submeshes)
+			{
+				writeSubmeshBlobs(sub, options, file, blobs);
+			}
+		}
+		ASSERT(blobs.size() == header.numBlobs);
+
+		uint64 position = _ftelli64(file);
+		header.blobTableOffset = align_to(position, (uint64)alignof(bin_blob_entry));
+		static const uint8 zeros[alignof(bin_blob_entry)] = {};
+		fwrite(zeros, 1, header.blobTableOffset - position, file);
+		writeArray(blobs, file);
+
+		_fseeki64(file, 0, SEEK_SET);
+		fwrite(&header, sizeof(header), 1, file);
+
 		fclose(file);
 	}
 
@@ -245,7 +474,7 @@ namespace era_engine
 		memcpy(out.data(), ptr, sizeof(T) * count);
 	}
 
-	static MeshAsset readMesh(EntireFile& file)
+	static MeshAsset readMeshV1(EntireFile& file)
 	{
 		bin_mesh_header* header = file.consume<bin_mesh_header>();
 		char* name = file.consume<char>(header->nameLength);
@@ -267,7 +496,14 @@ namespace era_engine
 			if (subHeader->flags & bin_submesh_flag_tangents) { readArray(file, sub.tangents, subHeader->numVertices); }
 			if (subHeader->flags & bin_submesh_flag_colors) { readArray(file, sub.colors, subHeader->numVertices); }
 			if (subHeader->flags & bin_submesh_flag_skin) { readArray(file, sub.skin, subHeader->numVertices); }
-			readArray(file, sub.triangles, subHeader->numTriangles);
+
+			// v1 files only know 16-bit indices.
+			indexed_triangle16* triangles = file.consume<indexed_triangle16>(subHeader->numTriangles);
+			sub.triangles.resize(subHeader->numTriangles);
+			for (uint32 j = 0; j < subHeader->numTriangles; ++j)
+			{
+				sub.triangles[j] = { triangles[j].a, triangles[j].b, triangles[j].c };
+			}
 		}
 
 		return result;
@@ -361,20 +597,220 @@ namespace era_engine
 		return result;
 	}
 
+	static bool readMeshV2(EntireFile& file, uint32 version, const std::vector<const uint8*>& blobs, BinMeshView& out)
+	{
+		bin_mesh_header* header = file.consume<bin_mesh_header>();
+		char* name = header ? file.consume<char>(header->nameLength) : 0;
+		if (!header || (header->nameLength && !name))
+		{
+			return false;
+		}
+
+		out.name = std::string(name, header->nameLength);
+		out.skeleton_index = header->skeletonIndex;
+		out.submeshes.resize(header->numSubmeshes);
+
+		auto getBlob = [&blobs](uint32 index) { return (index < (uint32)blobs.size()) ? blobs[index] : nullptr; };
+
+		for (uint32 i = 0; i < header->numSubmeshes; ++i)
+		{
+			bin_submesh_header_v2* subHeader = file.consume<bin_submesh_header_v2>();
+			if (!subHeader)
+			{
+				return false;
+			}
+
+			BinSubmeshView& sub = out.submeshes[i];
+			sub.material_index = subHeader->materialIndex;
+			sub.attribute_flags = subHeader->flags;
+			sub.num_vertices = subHeader->numVertices;
+			sub.num_triangles = subHeader->numTriangles;
+			sub.aabb = subHeader->aabb;
+			sub.positions = (const vec3*)getBlob(subHeader->positionsBlob);
+			sub.others = getBlob(subHeader->othersBlob);
+			sub.colors = (subHeader->colorsBlob != BIN_NO_BLOB) ? (const uint32*)getBlob(subHeader->colorsBlob) : nullptr;
+			sub.index_type = (subHeader->flags & bin_submesh_flag_index32) ? mesh_index_uint32 : mesh_index_uint16;
+			sub.triangles = getBlob(subHeader->trianglesBlob);
+
+			if (version >= BIN_VERSION_3)
+			{
+				uint32* numLods = file.consume<uint32>();
+				bin_submesh_lod_entry* lods = numLods ? file.consume<bin_submesh_lod_entry>(*numLods) : 0;
+				if (!numLods || (*numLods && !lods))
+				{
+					return false;
+				}
+
+				sub.lods.resize(*numLods);
+				for (uint32 l = 0; l < *numLods; ++l)
+				{
+					sub.lods[l].num_triangles = lods[l].numTriangles;
+					sub.lods[l].error = lods[l].error;
+					sub.lods[l].triangles = getBlob(lods[l].trianglesBlob);
+				}
+			}
+
+			sub.num_meshlets = 0;
+			sub.num_meshlet_vertices = 0;
+			sub.num_meshlet_primitives = 0;
+			sub.meshlets = nullptr;
+			sub.meshlet_vertices = nullptr;
+			sub.meshlet_primitives = nullptr;
+
+			if (version >= BIN_VERSION_4)
+			{
+				bin_submesh_meshlet_header* meshletHeader = file.consume<bin_submesh_meshlet_header>();
+				if (!meshletHeader)
+				{
+					return false;
+				}
+
+				if (meshletHeader->numMeshlets)
+				{
+					sub.num_meshlets = meshletHeader->numMeshlets;
+					sub.num_meshlet_vertices = meshletHeader->numMeshletVertices;
+					sub.num_meshlet_primitives = meshletHeader->numMeshletPrimitives;
+					sub.meshlets = (const MeshletAsset*)getBlob(meshletHeader->meshletsBlob);
+					sub.meshlet_vertices = (const uint32*)getBlob(meshletHeader->meshletVerticesBlob);
+					sub.meshlet_primitives = (const uint32*)getBlob(meshletHeader->meshletPrimitivesBlob);
+				}
+			}
+		}
+
+		return true;
+	}
+
+	static bool mapBINInternal(const fs::path& path, BinModelView& out)
+	{
+		out.file = map_file(path);
+
+		EntireFile& file = out.file;
+		bin_header_v2* header = file.consume<bin_header_v2>();
+		if (!header || header->header != BIN_HEADER || header->version < BIN_VERSION_2 || header->version > BIN_VERSION_4)
+		{
+			return false;
+		}
+
+		uint64 tableSize = (uint64)header->numBlobs * sizeof(bin_blob_entry);
+		if (header->blobTableOffset > file.size || tableSize > file.size - header->blobTableOffset)
+		{
+			return false;
+		}
+
+		const bin_blob_entry* table = (const bin_blob_entry*)(file.content + header->blobTableOffset);
+
+		std::vector<const uint8*> blobs(header->numBlobs, nullptr);
+		std::vector<uint32> compressedBlobs;
+		for (uint32 i = 0; i < header->numBlobs; ++i)
+		{
+			const bin_blob_entry& entry = table[i];
+			if (entry.offset > file.size || entry.storedSize > file.size - entry.offset)
+			{
+				return false;
+			}
+
+			if (entry.compression == bin_compression_none)
+			{
+				blobs[i] = file.content + entry.offset;
+			}
+			else
+			{
+				compressedBlobs.push_back(i);
+				out.decompressed_blobs.push_back(std::make_unique<uint8[]>(entry.size));
+				blobs[i] = out.decompressed_blobs.back().get();
+			}
+		}
+
+		std::atomic<bool> decompressionFailed = false;
+		parallel_for(low_priority_job_queue, (uint32)compressedBlobs.size(), 1, [&](uint32 i)
+		{
+			const bin_blob_entry& entry = table[compressedBlobs[i]];
+			uint8* output = out.decompressed_blobs[i].get();
+			if (lz4_decompress(file.content + entry.offset, entry.storedSize, output, entry.size) != entry.size)
+			{
+				decompressionFailed = true;
+			}
+		});
+
+		if (decompressionFailed)
+		{
+			return false;
+		}
+
+		out.flags = header->flags;
+		out.meshes.resize(header->numMeshes);
+		out.materials.resize(header->numMaterials);
+		out.skeletons.resize(header->numSkeletons);
+		out.animations.resize(header->numAnimations);
+
+		for (uint32 i = 0; i < header->numMeshes; ++i)
+		{
+			if (!readMeshV2(file, header->version, blobs, out.meshes[i]))
+			{
+				return false;
+			}
+		}
+		for (uint32 i = 0; i < header->numMaterials; ++i)
+		{
+			out.materials[i] = readMaterial(file);
+		}
+		for (uint32 i = 0; i < header->numSkeletons; ++i)
+		{
+			out.skeletons[i] = readSkeleton(file);
+		}
+		for (uint32 i = 0; i < header->numAnimations; ++i)
+		{
+			out.animations[i] = readAnimation(file);
+		}
+
+		return true;
+	}
+
+	bool mapBIN(const fs::path& path, BinModelView& out)
+	{
+		PROFILE("Mapping BIN");
+
+		out = BinModelView();
+		if (!mapBINInternal(path, out))
+		{
+			out = BinModelView();
+			return false;
+		}
+		return true;
+	}
+
 	ModelAsset loadBIN(const fs::path& path)
 	{
 		PROFILE("Loading BIN");
 
-		EntireFile file = load_file(path);
+		// Cached BINs are read front to back exactly once, so map them and let the OS read ahead instead of copying to the heap first.
+		EntireFile file = map_file(path);
+		if (!file.content)
+		{
+			return {};
+		}
 
 		bin_header* header = file.consume<bin_header>();
-		if (header->header != BIN_HEADER)
+		if (!header || header->header != BIN_HEADER)
 		{
 			free_file(file);
 			return {};
 		}
 
+		if (header->version >= BIN_VERSION_2 && header->version <= BIN_VERSION_4)
+		{
+			free_file(file);
+
+			BinModelView view;
+			if (!mapBIN(path, view))
+			{
+				return {};
+			}
+			return view.to_model_asset();
+		}
+
 		ModelAsset result;
+		result.flags = header->flags;
 		result.meshes.resize(header->numMeshes);
 		result.materials.resize(header->numMaterials);
 		result.skeletons.resize(header->numSkeletons);
@@ -382,7 +818,7 @@ namespace era_engine
 
 		for (uint32 i = 0; i < header->numMeshes; ++i)
 		{
-			result.meshes[i] = readMesh(file);
+			result.meshes[i] = readMeshV1(file);
 		}
 		for (uint32 i = 0; i < header->numMaterials; ++i)
 		{
@@ -401,4 +837,116 @@ namespace era_engine
 
 		return result;
 	}
+
+	BinModelView::BinModelView(BinModelView&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	BinModelView& BinModelView::operator=(BinModelView&& other) noexcept
+	{
+		if (this != &other)
+		{
+			if (file.content)
+			{
+				free_file(file);
+			}
+
+			flags = other.flags;
+			meshes = std::move(other.meshes);
+			materials = std::move(other.materials);
+			skeletons = std::move(other.skeletons);
+			animations = std::move(other.animations);
+			decompressed_blobs = std::move(other.decompressed_blobs);
+			file = other.file;
+			other.file = {};
+		}
+		return *this;
+	}
+
+	BinModelView::~BinModelView()
+	{
+		if (file.content)
+		{
+			free_file(file);
+		}
+	}
+
+	static void copyTriangles(const void* triangles, mesh_index_type indexType, uint32 numTriangles, std::vector<indexed_triangle32>& out)
+	{
+		out.resize(numTriangles);
+		if (indexType == mesh_index_uint32)
+		{
+			memcpy(out.data(), triangles, sizeof(indexed_triangle32) * numTriangles);
+		}
+		else
+		{
+			const indexed_triangle16* in = (const indexed_triangle16*)triangles;
+			for (uint32 i = 0; i < numTriangles; ++i)
+			{
+				out[i] = { in[i].a, in[i].b, in[i].c };
+			}
+		}
+	}
+
+	ModelAsset BinModelView::to_model_asset() const
+	{
+		ModelAsset result;
+		result.flags = flags;
+		result.materials = materials;
+		result.skeletons = skeletons;
+		result.animations = animations;
+
+		result.meshes.resize(meshes.size());
+		for (uint32 m = 0; m < (uint32)meshes.size(); ++m)
+		{
+			const BinMeshView& in = meshes[m];
+			MeshAsset& mesh = result.meshes[m];
+			mesh.name = in.name;
+			mesh.skeleton_index = in.skeleton_index;
+			mesh.submeshes.resize(in.submeshes.size());
+
+			for (uint32 s = 0; s < (uint32)in.submeshes.size(); ++s)
+			{
+				const BinSubmeshView& view = in.submeshes[s];
+				SubmeshAsset& sub = mesh.submeshes[s];
+				uint32 numVertices = view.num_vertices;
+
+				sub.material_index = view.material_index;
+				sub.positions.assign(view.positions, view.positions + numVertices);
+				copyTriangles(view.triangles, view.index_type, view.num_triangles, sub.triangles);
+
+				sub.lods.resize(view.lods.size());
+				for (uint32 l = 0; l < (uint32)view.lods.size(); ++l)
+				{
+					copyTriangles(view.lods[l].triangles, view.index_type, view.lods[l].num_triangles, sub.lods[l].triangles);
+					sub.lods[l].error = view.lods[l].error;
+				}
+
+				if (view.num_meshlets)
+				{
+					sub.meshlets.assign(view.meshlets, view.meshlets + view.num_meshlets);
+					sub.meshlet_vertices.assign(view.meshlet_vertices, view.meshlet_vertices + view.num_meshlet_vertices);
+					sub.meshlet_primitives.assign(view.meshlet_primitives, view.meshlet_primitives + view.num_meshlet_primitives);
+				}
+				if (view.colors) { sub.colors.assign(view.colors, view.colors + numVertices); }
+
+				if (view.attribute_flags & bin_submesh_flag_uvs) { sub.uvs.resize(numVertices); }
+				if (view.attribute_flags & bin_submesh_flag_normals) { sub.normals.resize(numVertices); }
+				if (view.attribute_flags & bin_submesh_flag_tangents) { sub.tangents.resize(numVertices); }
+				if (view.attribute_flags & bin_submesh_flag_skin) { sub.skin.resize(numVertices); }
+
+				for (uint32 i = 0; i < numVertices; ++i)
+				{
+					const uint8* vertex = view.others + (uint64)i * binOthersLayout.stride;
+					if (!sub.uvs.empty()) { memcpy(&sub.uvs[i], vertex + binOthersLayout.uvOffset, sizeof(vec2)); }
+					if (!sub.normals.empty()) { memcpy(&sub.normals[i], vertex + binOthersLayout.normalOffset, sizeof(vec3)); }
+					if (!sub.tangents.empty()) { memcpy(&sub.tangents[i], vertex + binOthersLayout.tangentOffset, sizeof(vec3)); }
+					if (!sub.skin.empty()) { memcpy(&sub.skin[i], vertex + binOthersLayout.skinOffset, sizeof(animation::SkinningWeights)); }
+				}
+			}
+		}
+
+		return result;
+	}
 }
\ No newline at end of file
@@ -1,14 +1,122 @@
-#pragma once 
+#pragma once
 
 #include "core_api.h"
 
+#include "asset/io.h"
+#include "asset/model_asset.h"
+#include "asset/pbr_material_desc.h"
+
+#include "core/bounding_volumes.h"
+
 namespace era_engine
 {
-	struct ModelAsset;
+	enum bin_submesh_flag
+	{
+		bin_submesh_flag_positions = (1 << 0),
+		bin_submesh_flag_uvs = (1 << 1),
+		bin_submesh_flag_normals = (1 << 2),
+		bin_submesh_flag_tangents = (1 << 3),
+		bin_submesh_flag_colors = (1 << 4),
+		bin_submesh_flag_skin = (1 << 5),
+		bin_submesh_flag_index32 = (1 << 6), // Triangles are stored as indexed_triangle32. Only used for submeshes with more than 65536 vertices.
+	};
+
+	enum bin_compression
+	{
+		bin_compression_none,
+		bin_compression_lz4,
+	};
+
+	struct bin_write_options
+	{
+		bin_compression compression = bin_compression_none;
+
+		// Blobs are only stored compressed if that saves at least this fraction of their size.
+		float min_compression_gain = 0.1f;
+	};
+
+	// Vertex layout of the 'others' blob in BIN v2 caches. Matches the mesh_builder layout used by the mesh loader
+	// (mesh_creation_flags_default | mesh_creation_flags_with_skin), so cached vertices can be copied to the GPU as-is.
+	static constexpr uint32 bin_gpu_vertex_flags = mesh_creation_flags_with_uvs | mesh_creation_flags_with_normals
+		| mesh_creation_flags_with_tangents | mesh_creation_flags_with_skin;
+
+	struct ERA_CORE_API BinLodView
+	{
+		uint32 num_triangles;
+		float error;
+		const void* triangles;		// Same index type as LOD 0.
+	};
+
+	// Geometry of one submesh in a mapped BIN v2 file. Pointers are only valid while the owning BinModelView lives.
+	struct ERA_CORE_API BinSubmeshView
+	{
+		int32 material_index;
+		uint32 attribute_flags; // Which attributes the source mesh had (bin_submesh_flag_*).
+
+		uint32 num_vertices;
+		uint32 num_triangles;
+		bounding_box aabb;
+
+		const vec3* positions;
+		const uint8* others;		// Interleaved in bin_gpu_vertex_flags layout. Missing attributes are zero.
+		const uint32* colors;		// Null if the mesh has no vertex colors.
+
+		mesh_index_type index_type;
+		const void* triangles;		// indexed_triangle16 or indexed_triangle32, depending on index_type.
 
-	ERA_CORE_API void writeBIN(const ModelAsset& asset, const fs::path& path);
+		std::vector<BinLodView> lods; // Empty for v2 files.
+
+		// Zero for files older than v4.
+		uint32 num_meshlets;
+		uint32 num_meshlet_vertices;
+		uint32 num_meshlet_primitives;
+		const MeshletAsset* meshlets;
+		const uint32* meshlet_vertices;
+		const uint32* meshlet_primitives;
+	};
+
+	struct ERA_CORE_API BinMeshView
+	{
+		std::string name;
+		int32 skeleton_index;
+		std::vector<BinSubmeshView> submeshes;
+	};
+
+	// Zero-copy view of a BIN v2 cache. Uncompressed geometry points directly into the memory-mapped file,
+	// compressed blobs are inflated once into 'decompressed_blobs'.
+	struct ERA_CORE_API BinModelView
+	{
+		BinModelView() = default;
+		BinModelView(const BinModelView&) = delete;
+		BinModelView(BinModelView&& other) noexcept;
+		BinModelView& operator=(const BinModelView&) = delete;
+		BinModelView& operator=(BinModelView&& other) noexcept;
+		~BinModelView();
+
+		// Copies the geometry into a regular model asset.
+		ModelAsset to_model_asset() const;
+
+		uint32 flags = 0;
+		std::vector<BinMeshView> meshes;
+
+		// Everything except the geometry.
+		std::vector<PbrMaterialDesc> materials;
+		std::vector<SkeletonAsset> skeletons;
+		std::vector<AnimationAsset> animations;
+
+		EntireFile file = {};
+		std::vector<std::unique_ptr<uint8[]>> decompressed_blobs;
+	};
+
+	ERA_CORE_API void writeBIN(const ModelAsset& asset, const fs::path& path, const bin_write_options& options = {});
 
 	ERA_CORE_API ModelAsset loadFBX(const fs::path& path, uint32 flags);
-	ERA_CORE_API ModelAsset loadOBJ(const fs::path& path, uint32 flags);
+	// Parses large files in parallel, in line-aligned chunks. The result is identical to the serial parser (parallel = false).
+	ERA_CORE_API ModelAsset loadOBJ(const fs::path& path, uint32 flags, bool parallel = true);
+
+	// Reads the legacy v1 format and the v2 to v4 formats.
 	ERA_CORE_API ModelAsset loadBIN(const fs::path& path);
-}
\ No newline at end of file
+
+	// Maps a v2, v3 or v4 file. Returns false for missing, corrupt or v1 files.
+	ERA_CORE_API bool mapBIN(const fs::path& path, BinModelView& out);
+}
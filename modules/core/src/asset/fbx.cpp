@@ -9,6 +9,9 @@
 #include "core/cpu_profiling.h"
 #include "core/color.h"
 #include "core/yaml.h" 
+#include "core/job_system.h"
+#include "core/memory.h"
+#include "core/log.h"
 
 #include "geometry/mesh.h"
 
@@ -300,7 +303,7 @@ namespace YAML
 namespace era_engine
 {
 	void testDumpToPLY(const std::string& filename,
-		const std::vector<vec3>& positions, const std::vector<vec2>& uvs, const std::vector<vec3>& normals, const std::vector<indexed_triangle16>& triangles,
+		const std::vector<vec3>& positions, const std::vector<vec2>& uvs, const std::vector<vec3>& normals, const std::vector<indexed_triangle32>& triangles,
 		uint8 r = 255, uint8 g = 255, uint8 b = 255);
 
 	static uint32 parseProperties(EntireFile& file, std::vector<fbx_property>& outProperties, uint32 numProperties)
@@ -472,6 +475,58 @@ namespace era_engine
 		}
 	}
 
+	static uint32 getArrayElementSize(fbx_property_type type)
+	{
+		switch (type)
+		{
+		case fbx_property_type_bool: return sizeof(bool);
+		case fbx_property_type_float: return sizeof(float);
+		case fbx_property_type_double: return sizeof(double);
+		case fbx_property_type_int16: return sizeof(int16);
+		case fbx_property_type_int32: return sizeof(int32);
+		case fbx_property_type_int64: return sizeof(int64);
+		default: return 0;
+		}
+	}
+
+	// Inflates all compressed array properties up front, fanned out over the job system. Every property gets its own
+	// slot in 'outStorage', so the result does not depend on scheduling. Afterwards all properties are uncompressed
+	// and point either into the file or into 'outStorage'.
+	static uint64 decompressArrays(std::vector<fbx_property>& properties, std::vector<uint8>& outStorage)
+	{
+		std::vector<uint32> compressedProperties;
+		std::vector<uint64> offsets;
+
+		uint64 totalSize = 0;
+		for (uint32 i = 0; i < (uint32)properties.size(); ++i)
+		{
+			const fbx_property& prop = properties[i];
+			if (prop.encoding != 0)
+			{
+				compressedProperties.push_back(i);
+				offsets.push_back(totalSize);
+				totalSize += align_to((uint64)prop.numElements * getArrayElementSize(prop.type), 16ull);
+			}
+		}
+
+		outStorage.resize(totalSize);
+
+		parallel_for(low_priority_job_queue, (uint32)compressedProperties.size(), 4, [&](uint32 i)
+		{
+			fbx_property& prop = properties[compressedProperties[i]];
+			uint8* out = outStorage.data() + offsets[i];
+
+			uint64 decompressedBytes = decompress(prop.data, prop.encodedLength, out);
+			ASSERT(decompressedBytes == (uint64)prop.numElements * getArrayElementSize(prop.type));
+
+			prop.data = out;
+			prop.encoding = 0;
+			prop.encodedLength = (uint32)decompressedBytes;
+		});
+
+		return totalSize;
+	}
+
 	static uint64 readArray(const fbx_property& prop, uint8* out)
 	{
 		if (prop.encoding == 0)
@@ -1771,16 +1826,17 @@ namespace era_engine
 		}
 	}
 
-	static void finishMesh(fbx_mesh& mesh, uint32 flags, std::unordered_map<int64, fbx_skeleton>& skeletons)
+	static void finishMesh(fbx_mesh& mesh, uint32 flags, const std::unordered_map<int64, fbx_skeleton>& skeletons)
 	{
 		// Assign materials and skinning weights, remove duplicate vertices and triangulate.
+		// Runs concurrently for different meshes, so the skeleton map must already contain every referenced skeleton.
 
 		if (mesh.skeletonID && flags & mesh_flag_load_skin)
 		{
 			PROFILE("Assigning skinning weights");
 
 			mesh.skin.resize(mesh.positions.size(), {});
-			fbx_skeleton& skeleton = skeletons[mesh.skeletonID];
+			const fbx_skeleton& skeleton = skeletons.at(mesh.skeletonID);
 
 			for (uint32 jointID = 0; jointID < (uint32)skeleton.joints.size(); ++jointID)
 			{
@@ -1847,17 +1903,21 @@ namespace era_engine
 				int32 material = mesh.materialIndexPerFace[faceIndex];
 
 				per_material& perMat = materialToMesh[material];
-				perMat.sub.material_index = material;
-
-				perMat.addTriangles(mesh.positions, mesh.uvs, mesh.normals, mesh.tangents, mesh.colors, mesh.skin, firstIndex, faceSize, mesh.submeshes);
+				perMat.material_index = material;
+				perMat.addTriangles(firstIndex, faceSize);
 
 				firstIndex += faceSize;
 			}
-		}
 
-		for (auto [i, perMat] : materialToMesh)
-		{
-			perMat.flush(mesh.submeshes);
+			corner_attributes attributes = {
+				mesh.positions.data(),
+				!mesh.uvs.empty() ? mesh.uvs.data() : nullptr,
+				!mesh.normals.empty() ? mesh.normals.data() : nullptr,
+				!mesh.tangents.empty() ? mesh.tangents.data() : nullptr,
+				!mesh.colors.empty() ? mesh.colors.data() : nullptr,
+				!mesh.skin.empty() ? mesh.skin.data() : nullptr,
+			};
+			flushPerMaterial(materialToMesh, attributes, mesh.submeshes);
 		}
 
 		generateNormalsAndTangents(mesh.submeshes, flags);
@@ -2005,11 +2065,62 @@ namespace era_engine
 		return 0;
 	}
 
+	enum fbx_import_stage
+	{
+		fbx_import_stage_parse,
+		fbx_import_stage_decompress,
+		fbx_import_stage_objects,
+		fbx_import_stage_connections,
+		fbx_import_stage_meshes,
+		fbx_import_stage_assemble,
+
+		fbx_import_stage_count,
+	};
+
+	static const char* fbxImportStageNames[] =
+	{
+		"parse",
+		"decompress",
+		"objects",
+		"connections",
+		"meshes",
+		"assemble",
+	};
+
+	struct fbx_import_timer
+	{
+		using clock = std::chrono::high_resolution_clock;
+
+		void lap(fbx_import_stage stage)
+		{
+			clock::time_point now = clock::now();
+			stageMilliseconds[stage] += std::chrono::duration<float, std::milli>(now - last).count();
+			last = now;
+		}
+
+		void print(const char* path, uint32 numMeshes, uint64 decompressedBytes) const
+		{
+			char buffer[256];
+			int32 length = 0;
+			float total = 0.f;
+			for (uint32 i = 0; i < fbx_import_stage_count; ++i)
+			{
+				length += snprintf(buffer + length, sizeof(buffer) - length, "%s%s %.1fms", (i == 0) ? "" : ", ", fbxImportStageNames[i], stageMilliseconds[i]);
+				total += stageMilliseconds[i];
+			}
+
+			LOG_MESSAGE("Imported FBX '%s' (%u meshes, %.1fMB decompressed) in %.1fms: %s", path, numMeshes, (float)decompressedBytes / MB(1), total, buffer);
+		}
+
+		clock::time_point last = clock::now();
+		float stageMilliseconds[fbx_import_stage_count] = {};
+	};
+
 	ModelAsset loadFBX(const fs::path& path, uint32 flags)
 	{
 		std::string pathStr = path.string();
 		const char* s = pathStr.c_str();
-		EntireFile file = load_file(path);
+		EntireFile file = map_file(path);
 		if (file.size < sizeof(fbx_header))
 		{
 			printf("File '%s' is smaller than FBX header.\n", s);
@@ -2039,11 +2150,23 @@ namespace era_engine
 
 		std::vector<fbx_property> properties;
 
+		fbx_import_timer timer;
+
 		{
 			PROFILE("Parse FBX nodes");
 			parseNodes(version, file, nodes, properties, 0, 0);
 		}
 
+		timer.lap(fbx_import_stage_parse);
+
+		std::vector<uint8> decompressedArrays;
+		{
+			PROFILE("Decompress FBX arrays");
+			decompressArrays(properties, decompressedArrays);
+		}
+
+		timer.lap(fbx_import_stage_decompress);
+
 #if 0
 		{
 			YAML::Node out;
@@ -2070,6 +2193,10 @@ namespace era_engine
 			objectLUT.idToObject.reserve(objectsNode->numChildren + 1);
 			objectLUT.idToObject[0] = { fbx_object_type_global, 0 };
 
+			// Geometry is by far the most expensive object type, so it is read in parallel below. All other objects are cheap
+			// (or append to shared animation arrays) and are read in file order here.
+			std::vector<const fbx_node*> geometryNodes;
+
 			for (const fbx_node& objectNode : fbx_node_iterator{ objectsNode, nodes })
 			{
 				if (objectNode.name == "Model")
@@ -2078,7 +2205,7 @@ namespace era_engine
 				}
 				if (objectNode.name == "Geometry")
 				{
-					objectLUT.push(readMesh(objectNode, nodes, properties, flags));
+					geometryNodes.push_back(&objectNode);
 				}
 				else if (objectNode.name == "Material")
 				{
@@ -2109,21 +2236,51 @@ namespace era_engine
 					objectLUT.push(readAnimationCurve(objectNode, nodes, properties, animationTimes, animationValues));
 				}
 			}
+
+			std::vector<fbx_mesh> meshes(geometryNodes.size());
+			parallel_for(low_priority_job_queue, (uint32)geometryNodes.size(), 1, [&](uint32 i)
+			{
+				meshes[i] = readMesh(*geometryNodes[i], nodes, properties, flags);
+			});
+
+			// Pushed in file order, so mesh indices are identical to a serial import.
+			for (fbx_mesh& mesh : meshes)
+			{
+				objectLUT.push(std::move(mesh));
+			}
 		}
 
+		timer.lap(fbx_import_stage_objects);
+
 		{
 			PROFILE("Resolving FBX connections");
 			resolveConnections(findNode(nodes, { "Connections" }), nodes, properties, objectLUT);
 		}
 
+		timer.lap(fbx_import_stage_connections);
+
 		{
 			PROFILE("Finishing FBX meshes");
-			for (fbx_mesh& mesh : objectLUT.meshes)
+
+			if (flags & mesh_flag_load_skin)
 			{
-				finishMesh(mesh, flags, objectLUT.skeletons);
+				for (fbx_mesh& mesh : objectLUT.meshes)
+				{
+					if (mesh.skeletonID)
+					{
+						objectLUT.skeletons[mesh.skeletonID];
+					}
+				}
 			}
+
+			parallel_for(low_priority_job_queue, (uint32)objectLUT.meshes.size(), 1, [&](uint32 i)
+			{
+				finishMesh(objectLUT.meshes[i], flags, objectLUT.skeletons);
+			});
 		}
 
+		timer.lap(fbx_import_stage_meshes);
+
 		std::unordered_map<fbx_material*, int32> materialToGlobalIndex;
 		int32 globalMaterialIndex = 0;
 		for (fbx_material& mat : objectLUT.materials)
@@ -2250,6 +2407,9 @@ namespace era_engine
 
 		free_file(file);
 
+		timer.lap(fbx_import_stage_assemble);
+		timer.print(s, (uint32)objectLUT.meshes.size(), decompressedArrays.size());
+
 #if 0
 		for (uint32 i = 0; i < (uint32)result.meshes.size(); ++i)
 		{
@@ -9,5 +9,9 @@ namespace era_engine
 	NODISCARD AssetHandle getAssetHandleFromPath(const fs::path& path);
 	NODISCARD fs::path getPathFromAssetHandle(AssetHandle handle);
 
+	// Opens resources/files.bin, migrating a legacy resources/files.yaml if there is no binary registry yet.
 	void initializeFileRegistry();
+
+	// Writes the registry in the legacy YAML format, e.g. for diffing or for moving it to another platform.
+	bool exportFileRegistryToYAML(const fs::path& path);
 }
\ No newline at end of file
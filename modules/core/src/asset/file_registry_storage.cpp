@@ -0,0 +1,549 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#include "asset/file_registry_storage.h"
+
+#include "core/hash.h"
+#include "core/yaml.h"
+#include "core/log.h"
+
+namespace era_engine
+{
+	static constexpr uint32 REGISTRY_SNAPSHOT_MAGIC = 0x47524645; // 'EFRG'
+	static constexpr uint32 REGISTRY_SNAPSHOT_VERSION = 1;
+
+	static constexpr uint32 JOURNAL_OP_SET = 1;
+	static constexpr uint32 JOURNAL_OP_REMOVE = 2;
+
+	static constexpr uint64 MIN_RECORDS_BEFORE_COMPACTION = 1024;
+
+	// Buckets store the entry index + 1, zero marks an empty bucket. All sections are 8 byte aligned.
+	struct snapshot_header
+	{
+		uint32 magic;
+		uint32 version;
+		uint32 path_char_size;
+		uint32 padding;
+
+		uint64 num_entries;
+		uint64 num_buckets;
+
+		uint64 entries_offset;
+		uint64 handle_buckets_offset;
+		uint64 path_buckets_offset;
+		uint64 strings_offset;
+		uint64 strings_size;
+	};
+
+	struct file_registry_storage::snapshot_entry
+	{
+		uint64 handle;
+		uint64 path_hash;
+		uint64 path_offset;
+		uint64 path_size; // In bytes.
+	};
+
+	// Followed by 'path_size' bytes of native path characters. The checksum covers everything after itself.
+	struct journal_record_header
+	{
+		uint32 size;
+		uint32 checksum;
+		uint64 handle;
+		uint32 op;
+		uint32 path_size;
+	};
+
+	static uint64 hashHandle(AssetHandle handle)
+	{
+		return hash_bytes(&handle.value, sizeof(handle.value));
+	}
+
+	static uint64 hashPath(const fs::path& path)
+	{
+		const fs::path::string_type& native = path.native();
+		return hash_bytes(native.data(), native.size() * sizeof(fs::path::value_type));
+	}
+
+	static uint64 alignTo8(uint64 offset)
+	{
+		return (offset + 7) & ~7ull;
+	}
+
+	file_registry_storage::~file_registry_storage()
+	{
+		close();
+	}
+
+	bool file_registry_storage::open(const fs::path& snapshotPath, const fs::path& journalPath)
+	{
+		close();
+
+		snapshot_path = snapshotPath;
+		journal_path = journalPath;
+
+		bool validSnapshot = false;
+		if (fs::exists(snapshotPath))
+		{
+			snapshot = map_file(snapshotPath, false);
+
+			const snapshot_header* header = (const snapshot_header*)snapshot.content;
+			if (snapshot.content && snapshot.size >= sizeof(snapshot_header)
+				&& header->magic == REGISTRY_SNAPSHOT_MAGIC
+				&& header->version == REGISTRY_SNAPSHOT_VERSION
+				&& header->path_char_size == sizeof(fs::path::value_type)
+				&& header->num_buckets && (header->num_buckets & (header->num_buckets - 1)) == 0
+				&& header->num_buckets >= header->num_entries
+				&& header->entries_offset + header->num_entries * sizeof(snapshot_entry) <= snapshot.size
+				&& header->handle_buckets_offset + header->num_buckets * sizeof(uint32) <= snapshot.size
+				&& header->path_buckets_offset + header->num_buckets * sizeof(uint32) <= snapshot.size
+				&& header->strings_offset + header->strings_size <= snapshot.size)
+			{
+				entries = (const snapshot_entry*)(snapshot.content + header->entries_offset);
+				handle_buckets = (const uint32*)(snapshot.content + header->handle_buckets_offset);
+				path_buckets = (const uint32*)(snapshot.content + header->path_buckets_offset);
+				strings = snapshot.content + header->strings_offset;
+				num_entries = header->num_entries;
+				bucket_mask = header->num_buckets - 1;
+				num_live_entries = num_entries;
+				validSnapshot = true;
+			}
+			else
+			{
+				LOG_WARNING("File registry snapshot '%ws' is invalid", snapshotPath.c_str());
+				if (snapshot.content)
+				{
+					free_file(snapshot);
+				}
+				snapshot = {};
+			}
+		}
+
+		// Replay the journal. A torn record at the end (crash during the write) is cut off, so that new records are not
+		// appended behind it.
+		uint64 validJournalSize = 0;
+		if (fs::exists(journalPath))
+		{
+			EntireFile file = load_file(journalPath);
+			uint64 offset = 0;
+			while (file.content && offset + sizeof(journal_record_header) <= file.size)
+			{
+				journal_record_header header;
+				memcpy(&header, file.content + offset, sizeof(header));
+
+				if (header.size != sizeof(journal_record_header) + header.path_size
+					|| header.size > file.size - offset
+					|| header.path_size % sizeof(fs::path::value_type) != 0
+					|| header.checksum != (uint32)hash_bytes(file.content + offset + 8, header.size - 8))
+				{
+					break;
+				}
+
+				fs::path::string_type native(header.path_size / sizeof(fs::path::value_type), 0);
+				memcpy(native.data(), file.content + offset + sizeof(journal_record_header), header.path_size);
+
+				if (header.op == JOURNAL_OP_SET)
+				{
+					apply_set(header.handle, fs::path(std::move(native)));
+				}
+				else if (header.op == JOURNAL_OP_REMOVE)
+				{
+					apply_remove(header.handle);
+				}
+
+				offset += header.size;
+				++num_journal_records;
+			}
+			validJournalSize = offset;
+
+			if (file.content)
+			{
+				if (validJournalSize != file.size)
+				{
+					LOG_WARNING("File registry journal '%ws' has a damaged tail, %llu bytes are dropped", journalPath.c_str(), file.size - validJournalSize);
+				}
+				free_file(file);
+			}
+
+			std::error_code ec;
+			fs::resize_file(journalPath, validJournalSize, ec);
+		}
+
+		fs::create_directories(journalPath.parent_path());
+		journal.open(journalPath, std::ios::binary | std::ios::app);
+
+		return validSnapshot;
+	}
+
+	void file_registry_storage::close()
+	{
+		if (journal.is_open())
+		{
+			journal.close();
+		}
+
+		if (snapshot.content)
+		{
+			free_file(snapshot);
+		}
+		snapshot = {};
+		entries = nullptr;
+		handle_buckets = nullptr;
+		path_buckets = nullptr;
+		strings = nullptr;
+		num_entries = 0;
+		bucket_mask = 0;
+
+		overlay_paths.clear();
+		overlay_handles.clear();
+		num_journal_records = 0;
+		num_live_entries = 0;
+	}
+
+	const file_registry_storage::snapshot_entry* file_registry_storage::find_snapshot_entry(AssetHandle handle) const
+	{
+		if (!num_entries)
+		{
+			return nullptr;
+		}
+
+		for (uint64 bucket = hashHandle(handle) & bucket_mask; handle_buckets[bucket]; bucket = (bucket + 1) & bucket_mask)
+		{
+			const snapshot_entry& entry = entries[handle_buckets[bucket] - 1];
+			if (entry.handle == handle.value)
+			{
+				return &entry;
+			}
+		}
+		return nullptr;
+	}
+
+	const file_registry_storage::snapshot_entry* file_registry_storage::find_snapshot_entry(const fs::path& path) const
+	{
+		if (!num_entries)
+		{
+			return nullptr;
+		}
+
+		const fs::path::string_type& native = path.native();
+		uint64 size = native.size() * sizeof(fs::path::value_type);
+		uint64 hash = hashPath(path);
+
+		for (uint64 bucket = hash & bucket_mask; path_buckets[bucket]; bucket = (bucket + 1) & bucket_mask)
+		{
+			const snapshot_entry& entry = entries[path_buckets[bucket] - 1];
+			if (entry.path_hash == hash && entry.path_size == size && memcmp(strings + entry.path_offset, native.data(), size) == 0)
+			{
+				return &entry;
+			}
+		}
+		return nullptr;
+	}
+
+	fs::path file_registry_storage::get_snapshot_path(const snapshot_entry& entry) const
+	{
+		fs::path::string_type native(entry.path_size / sizeof(fs::path::value_type), 0);
+		memcpy(native.data(), strings + entry.path_offset, entry.path_size);
+		return fs::path(std::move(native));
+	}
+
+	AssetHandle file_registry_storage::find_handle(const fs::path& path) const
+	{
+		auto it = overlay_handles.find(path);
+		if (it != overlay_handles.end())
+		{
+			return it->second;
+		}
+
+		// Snapshot entries whose handle was changed since are stale.
+		const snapshot_entry* entry = find_snapshot_entry(path);
+		if (!entry || overlay_paths.contains(entry->handle))
+		{
+			return {};
+		}
+		return entry->handle;
+	}
+
+	fs::path file_registry_storage::find_path(AssetHandle handle) const
+	{
+		auto it = overlay_paths.find(handle);
+		if (it != overlay_paths.end())
+		{
+			return it->second;
+		}
+
+		const snapshot_entry* entry = find_snapshot_entry(handle);
+		return entry ? get_snapshot_path(*entry) : fs::path();
+	}
+
+	void file_registry_storage::apply_set(AssetHandle handle, const fs::path& path)
+	{
+		if (find_path(handle).empty())
+		{
+			++num_live_entries;
+		}
+
+		auto it = overlay_paths.find(handle);
+		if (it != overlay_paths.end() && !it->second.empty())
+		{
+			overlay_handles.erase(it->second);
+		}
+
+		overlay_paths[handle] = path;
+		overlay_handles[path] = handle;
+	}
+
+	void file_registry_storage::apply_remove(AssetHandle handle)
+	{
+		if (find_path(handle).empty())
+		{
+			return;
+		}
+		--num_live_entries;
+
+		auto it = overlay_paths.find(handle);
+		if (it != overlay_paths.end())
+		{
+			overlay_handles.erase(it->second);
+		}
+
+		if (find_snapshot_entry(handle))
+		{
+			overlay_paths[handle] = fs::path();
+		}
+		else
+		{
+			overlay_paths.erase(handle);
+		}
+	}
+
+	void file_registry_storage::append_to_journal(uint32 op, AssetHandle handle, const fs::path& path)
+	{
+		const fs::path::string_type& native = path.native();
+
+		journal_record_header header;
+		header.path_size = (uint32)(native.size() * sizeof(fs::path::value_type));
+		header.size = (uint32)sizeof(journal_record_header) + header.path_size;
+		header.checksum = 0;
+		header.handle = handle.value;
+		header.op = op;
+
+		std::vector<uint8> record(header.size);
+		memcpy(record.data(), &header, sizeof(header));
+		memcpy(record.data() + sizeof(header), native.data(), header.path_size);
+
+		header.checksum = (uint32)hash_bytes(record.data() + 8, header.size - 8);
+		memcpy(record.data(), &header, sizeof(header));
+
+		journal.write((const char*)record.data(), record.size());
+		journal.flush();
+
+		++num_journal_records;
+	}
+
+	void file_registry_storage::set(AssetHandle handle, const fs::path& path)
+	{
+		apply_set(handle, path);
+		append_to_journal(JOURNAL_OP_SET, handle, path);
+	}
+
+	void file_registry_storage::remove(AssetHandle handle)
+	{
+		apply_remove(handle);
+		append_to_journal(JOURNAL_OP_REMOVE, handle, fs::path());
+	}
+
+	void file_registry_storage::for_each(const std::function<void(AssetHandle, const fs::path&)>& func) const
+	{
+		for (uint64 i = 0; i < num_entries; ++i)
+		{
+			if (!overlay_paths.contains(entries[i].handle))
+			{
+				func(entries[i].handle, get_snapshot_path(entries[i]));
+			}
+		}
+
+		for (const auto& [handle, path] : overlay_paths)
+		{
+			if (!path.empty())
+			{
+				func(handle, path);
+			}
+		}
+	}
+
+	bool file_registry_storage::needs_compaction() const
+	{
+		return num_journal_records > max(MIN_RECORDS_BEFORE_COMPACTION, num_live_entries / 4);
+	}
+
+	bool file_registry_storage::compact()
+	{
+		struct live_entry
+		{
+			AssetHandle handle;
+			fs::path path;
+		};
+
+		std::vector<live_entry> live;
+		live.reserve(num_live_entries);
+		for_each([&live](AssetHandle handle, const fs::path& path) { live.push_back({ handle, path }); });
+
+		// Sorted, so that the same registry always produces the same file.
+		std::sort(live.begin(), live.end(), [](const live_entry& a, const live_entry& b) { return a.handle.value < b.handle.value; });
+
+		uint64 numBuckets = 16;
+		while (numBuckets < live.size() * 2)
+		{
+			numBuckets *= 2;
+		}
+
+		snapshot_header header = {};
+		header.magic = REGISTRY_SNAPSHOT_MAGIC;
+		header.version = REGISTRY_SNAPSHOT_VERSION;
+		header.path_char_size = sizeof(fs::path::value_type);
+		header.num_entries = live.size();
+		header.num_buckets = numBuckets;
+		header.entries_offset = alignTo8(sizeof(snapshot_header));
+		header.handle_buckets_offset = alignTo8(header.entries_offset + live.size() * sizeof(snapshot_entry));
+		header.path_buckets_offset = alignTo8(header.handle_buckets_offset + numBuckets * sizeof(uint32));
+		header.strings_offset = alignTo8(header.path_buckets_offset + numBuckets * sizeof(uint32));
+
+		std::vector<snapshot_entry> newEntries(live.size());
+		std::vector<uint32> newHandleBuckets(numBuckets, 0);
+		std::vector<uint32> newPathBuckets(numBuckets, 0);
+		std::vector<uint8> newStrings;
+
+		for (uint32 i = 0; i < (uint32)live.size(); ++i)
+		{
+			const fs::path::string_type& native = live[i].path.native();
+
+			snapshot_entry& entry = newEntries[i];
+			entry.handle = live[i].handle.value;
+			entry.path_hash = hashPath(live[i].path);
+			entry.path_offset = newStrings.size();
+			entry.path_size = native.size() * sizeof(fs::path::value_type);
+
+			newStrings.insert(newStrings.end(), (const uint8*)native.data(), (const uint8*)native.data() + entry.path_size);
+
+			uint64 bucket = hashHandle(live[i].handle) & (numBuckets - 1);
+			while (newHandleBuckets[bucket])
+			{
+				bucket = (bucket + 1) & (numBuckets - 1);
+			}
+			newHandleBuckets[bucket] = i + 1;
+
+			bucket = entry.path_hash & (numBuckets - 1);
+			while (newPathBuckets[bucket])
+			{
+				bucket = (bucket + 1) & (numBuckets - 1);
+			}
+			newPathBuckets[bucket] = i + 1;
+		}
+		header.strings_size = newStrings.size();
+
+		// Written next to the snapshot and renamed over it, so that a crash never leaves a partial snapshot behind.
+		fs::path tempPath = snapshot_path;
+		tempPath += ".tmp";
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			if (!out)
+			{
+				LOG_WARNING("Could not write file registry snapshot '%ws'", tempPath.c_str());
+				return false;
+			}
+
+			auto writeAt = [&out](uint64 offset, const void* data, uint64 size)
+			{
+				static const char zeros[8] = {};
+				uint64 position = (uint64)out.tellp();
+				out.write(zeros, offset - position);
+				out.write((const char*)data, size);
+			};
+
+			out.write((const char*)&header, sizeof(header));
+			writeAt(header.entries_offset, newEntries.data(), newEntries.size() * sizeof(snapshot_entry));
+			writeAt(header.handle_buckets_offset, newHandleBuckets.data(), numBuckets * sizeof(uint32));
+			writeAt(header.path_buckets_offset, newPathBuckets.data(), numBuckets * sizeof(uint32));
+			writeAt(header.strings_offset, newStrings.data(), newStrings.size());
+
+			if (!out)
+			{
+				LOG_WARNING("Could not write file registry snapshot '%ws'", tempPath.c_str());
+				return false;
+			}
+		}
+
+		// The mapped snapshot must be closed before it can be replaced. Journal records are idempotent, so a crash
+		// before the journal is emptied only replays changes which are already in the new snapshot.
+		fs::path snapshotPath = snapshot_path;
+		fs::path journalPath = journal_path;
+		close();
+
+		std::error_code ec;
+		fs::rename(tempPath, snapshotPath, ec);
+		if (ec)
+		{
+			LOG_WARNING("Could not replace file registry snapshot '%ws'", snapshotPath.c_str());
+			open(snapshotPath, journalPath);
+			return false;
+		}
+
+		{
+			std::ofstream truncate(journalPath, std::ios::binary | std::ios::trunc);
+		}
+
+		return open(snapshotPath, journalPath);
+	}
+
+	bool file_registry_storage::import_yaml(const fs::path& path)
+	{
+		std::ifstream stream(path);
+		if (!stream)
+		{
+			return false;
+		}
+
+		try
+		{
+			YAML::Node n = YAML::Load(stream);
+
+			for (auto entryNode : n)
+			{
+				AssetHandle handle = 0;
+				fs::path entryPath;
+
+				YAML_LOAD(entryNode, handle, "Handle");
+				YAML_LOAD(entryNode, entryPath, "Path");
+
+				if (handle)
+				{
+					set(handle, entryPath);
+				}
+			}
+		}
+		catch (const YAML::Exception&)
+		{
+			LOG_WARNING("Could not parse file registry '%ws'", path.c_str());
+			return false;
+		}
+
+		return true;
+	}
+
+	bool file_registry_storage::export_yaml(const fs::path& path) const
+	{
+		YAML::Node out;
+
+		for_each([&out](AssetHandle handle, const fs::path& entryPath)
+		{
+			YAML::Node n;
+			n["Handle"] = handle;
+			n["Path"] = entryPath;
+			out.push_back(n);
+		});
+
+		fs::create_directories(path.parent_path());
+		std::ofstream fout(path);
+		fout << out;
+		return (bool)fout;
+	}
+}
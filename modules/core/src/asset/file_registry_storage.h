@@ -0,0 +1,86 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#pragma once
+
+#include "asset/asset.h"
+#include "asset/io.h"
+
+#include <fstream>
+
+namespace era_engine
+{
+	// Persistent path <-> handle table of the file registry.
+	//
+	// The snapshot file holds all entries plus two open addressing hash indices (by handle and by path). It is
+	// memory-mapped and looked up in place, so opening it costs the same for ten or a hundred thousand assets. Changes
+	// are appended to a journal, one small record each, and kept in an in-memory overlay on top of the snapshot. Once the
+	// journal grows past a quarter of the snapshot, compact() folds both into a new snapshot.
+	//
+	// Snapshots store native path strings, so they are not portable between platforms. YAML import and export exist for
+	// migration. Not thread safe.
+	struct ERA_CORE_API file_registry_storage
+	{
+		file_registry_storage() = default;
+		file_registry_storage(const file_registry_storage&) = delete;
+		file_registry_storage& operator=(const file_registry_storage&) = delete;
+		~file_registry_storage();
+
+		// Maps the snapshot and replays the journal. Returns false if there is no valid snapshot, in which case the
+		// storage only contains the journal's entries.
+		bool open(const fs::path& snapshotPath, const fs::path& journalPath);
+		void close();
+
+		NODISCARD AssetHandle find_handle(const fs::path& path) const;
+
+		// Returns an empty path if the handle is unknown.
+		NODISCARD fs::path find_path(AssetHandle handle) const;
+
+		// Both are journaled right away. A handle can only have one path, so setting a new path renames the entry.
+		void set(AssetHandle handle, const fs::path& path);
+		void remove(AssetHandle handle);
+
+		void for_each(const std::function<void(AssetHandle, const fs::path&)>& func) const;
+
+		NODISCARD uint64 size() const { return num_live_entries; }
+		NODISCARD uint64 get_journal_record_count() const { return num_journal_records; }
+
+		NODISCARD bool needs_compaction() const;
+
+		// Writes a new snapshot with all live entries and empties the journal.
+		bool compact();
+
+		// Adds all entries of a legacy files.yaml. Journaled like set().
+		bool import_yaml(const fs::path& path);
+		bool export_yaml(const fs::path& path) const;
+
+	private:
+		struct snapshot_entry;
+
+		NODISCARD const snapshot_entry* find_snapshot_entry(AssetHandle handle) const;
+		NODISCARD const snapshot_entry* find_snapshot_entry(const fs::path& path) const;
+		NODISCARD fs::path get_snapshot_path(const snapshot_entry& entry) const;
+
+		void apply_set(AssetHandle handle, const fs::path& path);
+		void apply_remove(AssetHandle handle);
+		void append_to_journal(uint32 op, AssetHandle handle, const fs::path& path);
+
+		fs::path snapshot_path;
+		fs::path journal_path;
+
+		EntireFile snapshot = {};
+		const snapshot_entry* entries = nullptr;
+		const uint32* handle_buckets = nullptr;
+		const uint32* path_buckets = nullptr;
+		const uint8* strings = nullptr;
+		uint64 num_entries = 0;
+		uint64 bucket_mask = 0;
+
+		// Changes since the snapshot was written. An empty path marks a removed handle.
+		std::unordered_map<AssetHandle, fs::path> overlay_paths;
+		std::unordered_map<fs::path, AssetHandle> overlay_handles;
+
+		std::ofstream journal;
+		uint64 num_journal_records = 0;
+		uint64 num_live_entries = 0;
+	};
+}
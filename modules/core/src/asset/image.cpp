@@ -1,6 +1,7 @@
 // Copyright (c) 2023-present Eldar Muradov. All rights reserved.
 
 #include "asset/image.h"
+#include "asset/texture_cooker.h"
 
 #include "core/memory.h"
 #include "core/log.h"
@@ -73,12 +74,17 @@ namespace era_engine
 		return format;
 	}
 
-	static bool tryLoadFromCache(const fs::path& filepath, uint32 flags, fs::path& cacheFilepath, DirectX::ScratchImage& scratchImage, DirectX::TexMetadata& metadata)
+	fs::path getImageCachePath(const fs::path& filepath, uint32 flags)
 	{
 		fs::path cachedFilename = filepath;
 		cachedFilename.replace_extension("." + std::to_string(flags) + ".cache.dds");
 
-		cacheFilepath = L"asset_cache" / cachedFilename;
+		return L"asset_cache" / cachedFilename;
+	}
+
+	static bool tryLoadFromCache(const fs::path& filepath, uint32 flags, fs::path& cacheFilepath, DirectX::ScratchImage& scratchImage, DirectX::TexMetadata& metadata)
+	{
+		cacheFilepath = getImageCachePath(filepath, flags);
 
 		bool fromCache = false;
 
@@ -101,6 +107,13 @@ namespace era_engine
 					fromCache = SUCCEEDED(DirectX::LoadFromDDSFile(cacheFilepath.c_str(), DirectX::DDS_FLAGS_NONE, &metadata, scratchImage));
 				}
 			}
+
+			// Textures cooked by the assets compiler, possibly on another machine sharing the cache.
+			fs::path cookedFilepath;
+			if (!fromCache && (flags & image_load_flags_cache_to_dds) && findCookedTexture(filepath, flags, cookedFilepath))
+			{
+				fromCache = SUCCEEDED(DirectX::LoadFromDDSFile(cookedFilepath.c_str(), DirectX::DDS_FLAGS_NONE, &metadata, scratchImage));
+			}
 		}
 
 		return fromCache;
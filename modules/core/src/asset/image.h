@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include "core_api.h"
+
 #include <dx/d3dx12.h>
 
 namespace DirectX
@@ -40,12 +42,15 @@ namespace era_engine
 		image_format_wic, // Other formats: png, jpeg, etc.
 	};
 
-	bool isImageExtension(const fs::path& extension);
-	bool isImageExtension(const std::string& extension);
+	ERA_CORE_API bool isImageExtension(const fs::path& extension);
+	ERA_CORE_API bool isImageExtension(const std::string& extension);
+
+	// Path of the DDS written for this source file and these flags when image_load_flags_cache_to_dds is set.
+	NODISCARD ERA_CORE_API fs::path getImageCachePath(const fs::path& filepath, uint32 flags);
 
 	bool loadImageFromMemory(const void* data, uint32 size, image_format imageFormat, const fs::path& cachingFilepath,
 		uint32 flags, DirectX::ScratchImage& scratchImage, D3D12_RESOURCE_DESC& textureDesc);
-	bool loadImageFromFile(const fs::path& filepath, uint32 flags, DirectX::ScratchImage& scratchImage, D3D12_RESOURCE_DESC& textureDesc);
+	ERA_CORE_API bool loadImageFromFile(const fs::path& filepath, uint32 flags, DirectX::ScratchImage& scratchImage, D3D12_RESOURCE_DESC& textureDesc);
 	bool loadSVGFromFile(const fs::path& filepath, uint32 flags, DirectX::ScratchImage& scratchImage, D3D12_RESOURCE_DESC& textureDesc);
 
 	bool saveImageToFile(const fs::path& filepath, const DirectX::Image& image);
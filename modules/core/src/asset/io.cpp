@@ -10,8 +10,8 @@ namespace era_engine
 			return {};
 		}
 
-		fseek(file, 0, SEEK_END);
-		uint32 file_size = ftell(file);
+		_fseeki64(file, 0, SEEK_END);
+		uint64 file_size = _ftelli64(file);
 
 		if (file_size == 0)
 		{
@@ -19,7 +19,7 @@ namespace era_engine
 			return {};
 		}
 
-		fseek(file, 0, SEEK_SET);
+		_fseeki64(file, 0, SEEK_SET);
 		uint8* buffer = (uint8*)malloc(file_size);
 		fread(buffer, file_size, 1, file);
 		fclose(file);
@@ -27,8 +27,57 @@ namespace era_engine
 		return { buffer, file_size };
 	}
 
+	EntireFile map_file(const fs::path& path, bool prefetch)
+	{
+		HANDLE file_handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0);
+		if (file_handle == INVALID_HANDLE_VALUE)
+		{
+			return {};
+		}
+
+		LARGE_INTEGER file_size;
+		if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+		{
+			CloseHandle(file_handle);
+			return {};
+		}
+
+		// The mapping keeps the file open and the view keeps the mapping alive, so both handles can be closed right away.
+		HANDLE mapping = CreateFileMappingW(file_handle, 0, PAGE_WRITECOPY, 0, 0, 0);
+		CloseHandle(file_handle);
+
+		if (!mapping)
+		{
+			return load_file(path);
+		}
+
+		void* view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+		CloseHandle(mapping);
+
+		if (!view)
+		{
+			return load_file(path);
+		}
+
+		if (prefetch)
+		{
+			WIN32_MEMORY_RANGE_ENTRY range = { view, (SIZE_T)file_size.QuadPart };
+			PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+		}
+
+		return { (uint8*)view, (uint64)file_size.QuadPart, 0, true };
+	}
+
 	void free_file(const EntireFile& file)
 	{
-		free(file.content);
+		if (file.mapped)
+		{
+			UnmapViewOfFile(file.content);
+		}
+		else
+		{
+			free(file.content);
+		}
 	}
 }
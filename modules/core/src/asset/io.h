@@ -25,10 +25,20 @@ namespace era_engine
 		uint8* content;
 		uint64 size;
 		uint64 read_offset;
+
+		// True if content is a view of a memory-mapped file instead of a heap copy.
+		bool mapped = false;
 	};
 
 	EntireFile load_file(const fs::path& path);
 
+	// Maps the file into the address space instead of copying it to the heap. Pages come straight from the OS file cache
+	// and are copy-on-write, so readers may still patch the content in place. If 'prefetch' is set, the whole file is
+	// read ahead asynchronously, which pays off for readers that touch every byte (BIN, FBX).
+	// Falls back to load_file if the file cannot be mapped.
+	EntireFile map_file(const fs::path& path, bool prefetch = true);
+
+	// Releases files returned by both load_file and map_file.
 	void free_file(const EntireFile& file);
 
 	struct ERA_CORE_API sized_string
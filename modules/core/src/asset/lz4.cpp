@@ -0,0 +1,199 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#include "asset/lz4.h"
+
+namespace era_engine
+{
+	static constexpr uint32 LZ4_MIN_MATCH = 4;
+	static constexpr uint32 LZ4_LAST_LITERALS = 5; // The last 5 bytes of a block are always literals.
+	static constexpr uint32 LZ4_MATCH_FIND_LIMIT = 12; // The last match must start at least 12 bytes before the end of the block.
+	static constexpr uint32 LZ4_MAX_OFFSET = 65535;
+	static constexpr uint32 LZ4_HASH_LOG = 16;
+
+	static uint32 read32(const uint8* p)
+	{
+		uint32 result;
+		memcpy(&result, p, sizeof(uint32));
+		return result;
+	}
+
+	static uint32 hash_sequence(uint32 sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - LZ4_HASH_LOG);
+	}
+
+	static uint8* write_length(uint8* out, uint64 length)
+	{
+		while (length >= 255)
+		{
+			*out++ = 255;
+			length -= 255;
+		}
+		*out++ = (uint8)length;
+		return out;
+	}
+
+	static uint8* write_sequence(uint8* out, const uint8* literals, uint64 literal_length, uint32 offset, uint64 match_length)
+	{
+		uint8* token = out++;
+		*token = (uint8)(min(literal_length, (uint64)15) << 4);
+		if (literal_length >= 15)
+		{
+			out = write_length(out, literal_length - 15);
+		}
+
+		memcpy(out, literals, literal_length);
+		out += literal_length;
+
+		if (offset)
+		{
+			*out++ = (uint8)(offset & 0xFF);
+			*out++ = (uint8)(offset >> 8);
+
+			*token |= (uint8)min(match_length, (uint64)15);
+			if (match_length >= 15)
+			{
+				out = write_length(out, match_length - 15);
+			}
+		}
+
+		return out;
+	}
+
+	uint64 lz4_compress(const uint8* data, uint64 size, uint8* output)
+	{
+		const uint8* ip = data;
+		const uint8* anchor = data;
+		const uint8* end = data + size;
+
+		uint8* op = output;
+
+		if (size > LZ4_MATCH_FIND_LIMIT)
+		{
+			const uint8* match_limit = end - LZ4_LAST_LITERALS;
+			const uint8* find_limit = end - LZ4_MATCH_FIND_LIMIT;
+
+			std::vector<uint32> hash_table(1 << LZ4_HASH_LOG, 0);
+
+			while (ip < find_limit)
+			{
+				uint32 sequence = read32(ip);
+				uint32 hash = hash_sequence(sequence);
+
+				const uint8* candidate = data + hash_table[hash];
+				hash_table[hash] = (uint32)(ip - data);
+
+				if (candidate < ip && (uint64)(ip - candidate) <= LZ4_MAX_OFFSET && read32(candidate) == sequence)
+				{
+					const uint8* match_end = ip + LZ4_MIN_MATCH;
+					const uint8* ref = candidate + LZ4_MIN_MATCH;
+					while (match_end < match_limit && *match_end == *ref)
+					{
+						++match_end;
+						++ref;
+					}
+
+					op = write_sequence(op, anchor, ip - anchor, (uint32)(ip - candidate), match_end - ip - LZ4_MIN_MATCH);
+
+					ip = match_end;
+					anchor = ip;
+				}
+				else
+				{
+					++ip;
+				}
+			}
+		}
+
+		op = write_sequence(op, anchor, end - anchor, 0, 0);
+
+		return op - output;
+	}
+
+	uint64 lz4_decompress(const uint8* data, uint64 compressed_size, uint8* output, uint64 output_capacity)
+	{
+		const uint8* ip = data;
+		const uint8* input_end = data + compressed_size;
+
+		uint8* op = output;
+		uint8* output_end = output + output_capacity;
+
+		while (ip < input_end)
+		{
+			uint32 token = *ip++;
+
+			uint64 literal_length = token >> 4;
+			if (literal_length == 15)
+			{
+				uint8 b;
+				do
+				{
+					if (ip >= input_end)
+					{
+						return 0;
+					}
+					b = *ip++;
+					literal_length += b;
+				} while (b == 255);
+			}
+
+			if ((uint64)(input_end - ip) < literal_length || (uint64)(output_end - op) < literal_length)
+			{
+				return 0;
+			}
+
+			memcpy(op, ip, literal_length);
+			ip += literal_length;
+			op += literal_length;
+
+			if (ip >= input_end)
+			{
+				break; // The last sequence has no match.
+			}
+
+			if (input_end - ip < 2)
+			{
+				return 0;
+			}
+
+			uint32 offset = ip[0] | (ip[1] << 8);
+			ip += 2;
+
+			if (offset == 0 || offset > (uint64)(op - output))
+			{
+				return 0;
+			}
+
+			uint64 match_length = token & 15;
+			if (match_length == 15)
+			{
+				uint8 b;
+				do
+				{
+					if (ip >= input_end)
+					{
+						return 0;
+					}
+					b = *ip++;
+					match_length += b;
+				} while (b == 255);
+			}
+			match_length += LZ4_MIN_MATCH;
+
+			if ((uint64)(output_end - op) < match_length)
+			{
+				return 0;
+			}
+
+			// Matches may overlap the bytes they produce, so copy byte by byte.
+			const uint8* match = op - offset;
+			for (uint64 i = 0; i < match_length; ++i)
+			{
+				op[i] = match[i];
+			}
+			op += match_length;
+		}
+
+		return op - output;
+	}
+}
@@ -0,0 +1,21 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#pragma once
+
+#include "core_api.h"
+
+namespace era_engine
+{
+	// LZ4 block format (no frame header). Used for optional blob compression in BIN caches.
+
+	inline uint64 lz4_compress_bound(uint64 size)
+	{
+		return size + size / 255 + 16;
+	}
+
+	// Returns the compressed size. 'output' must hold at least lz4_compress_bound(size) bytes.
+	ERA_CORE_API uint64 lz4_compress(const uint8* data, uint64 size, uint8* output);
+
+	// Returns the decompressed size, or 0 if the input is malformed or does not fit into 'output_capacity' bytes.
+	ERA_CORE_API uint64 lz4_decompress(const uint8* data, uint64 compressed_size, uint8* output, uint64 output_capacity);
+}
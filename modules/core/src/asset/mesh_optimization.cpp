@@ -0,0 +1,449 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#include "asset/mesh_optimization.h"
+
+#include "core/job_system.h"
+#include "core/log.h"
+
+namespace era_engine
+{
+	static constexpr uint32 MAX_CACHE_SIZE = 64;
+	static constexpr uint32 MAX_PRECOMPUTED_VALENCE = 32;
+
+	// FIFO simulation with timestamps: a vertex is in the cache if it was transformed less than 'cacheSize' transforms ago.
+	struct fifo_cache
+	{
+		fifo_cache(uint32 numVertices, uint32 cacheSize)
+			: timestamps(numVertices, 0), cacheSize(cacheSize), timestamp(cacheSize + 1) {}
+
+		bool access(uint32 vertex)
+		{
+			if (timestamp - timestamps[vertex] > cacheSize)
+			{
+				timestamps[vertex] = timestamp++;
+				return false;
+			}
+			return true;
+		}
+
+		std::vector<uint32> timestamps;
+		uint32 cacheSize;
+		uint32 timestamp;
+	};
+
+	vertex_cache_statistics analyzeVertexCache(const indexed_triangle32* triangles, uint32 numTriangles, uint32 numVertices, uint32 cacheSize)
+	{
+		vertex_cache_statistics result;
+		result.num_triangles = numTriangles;
+		result.num_vertices = numVertices;
+
+		fifo_cache cache(numVertices, cacheSize);
+		for (uint32 i = 0; i < numTriangles; ++i)
+		{
+			const indexed_triangle32& tri = triangles[i];
+			result.vertices_transformed += !cache.access(tri.a);
+			result.vertices_transformed += !cache.access(tri.b);
+			result.vertices_transformed += !cache.access(tri.c);
+		}
+
+		return result;
+	}
+
+	struct forsyth_scores
+	{
+		forsyth_scores(uint32 cacheSize)
+		{
+			for (uint32 i = 0; i < cacheSize; ++i)
+			{
+				// The three most recent vertices were used by the last triangle. Scoring them lower avoids strip-like orders.
+				cachePosition[i] = (i < 3) ? 0.75f : powf(1.f - (float)(i - 3) / (float)(cacheSize - 3), 1.5f);
+			}
+			for (uint32 i = 1; i < MAX_PRECOMPUTED_VALENCE; ++i)
+			{
+				valence[i] = 2.f / sqrtf((float)i);
+			}
+			valence[0] = 0.f;
+		}
+
+		float get(int32 position, uint32 remainingTriangles) const
+		{
+			if (remainingTriangles == 0)
+			{
+				return -1.f;
+			}
+
+			float score = (position >= 0) ? cachePosition[position] : 0.f;
+			score += (remainingTriangles < MAX_PRECOMPUTED_VALENCE) ? valence[remainingTriangles] : 2.f / sqrtf((float)remainingTriangles);
+			return score;
+		}
+
+		float cachePosition[MAX_CACHE_SIZE];
+		float valence[MAX_PRECOMPUTED_VALENCE];
+	};
+
+	void optimizeVertexCache(indexed_triangle32* triangles, uint32 numTriangles, uint32 numVertices, uint32 cacheSize)
+	{
+		if (numTriangles == 0)
+		{
+			return;
+		}
+
+		cacheSize = clamp(cacheSize, 4u, MAX_CACHE_SIZE);
+		const forsyth_scores scores(cacheSize);
+		const uint32* indices = (const uint32*)triangles;
+
+		// Vertex -> triangle adjacency. 'remaining' doubles as the live length of each vertex's list.
+		std::vector<uint32> remaining(numVertices, 0);
+		for (uint32 i = 0; i < numTriangles * 3; ++i)
+		{
+			++remaining[indices[i]];
+		}
+
+		std::vector<uint32> offsets(numVertices + 1, 0);
+		for (uint32 v = 0; v < numVertices; ++v)
+		{
+			offsets[v + 1] = offsets[v] + remaining[v];
+		}
+
+		std::vector<uint32> adjacency(numTriangles * 3);
+		{
+			std::vector<uint32> cursor(offsets.begin(), offsets.end() - 1);
+			for (uint32 i = 0; i < numTriangles * 3; ++i)
+			{
+				adjacency[cursor[indices[i]]++] = i / 3;
+			}
+		}
+
+		std::vector<int32> cachePosition(numVertices, -1);
+		std::vector<float> vertexScore(numVertices);
+		for (uint32 v = 0; v < numVertices; ++v)
+		{
+			vertexScore[v] = scores.get(-1, remaining[v]);
+		}
+
+		auto scoreTriangle = [&](uint32 t)
+		{
+			return vertexScore[indices[t * 3 + 0]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+		};
+
+		std::vector<float> triangleScore(numTriangles);
+		int32 bestTriangle = 0;
+		for (uint32 t = 0; t < numTriangles; ++t)
+		{
+			triangleScore[t] = scoreTriangle(t);
+			if (triangleScore[t] > triangleScore[bestTriangle])
+			{
+				bestTriangle = t;
+			}
+		}
+
+		std::vector<uint8> emitted(numTriangles, 0);
+		std::vector<indexed_triangle32> output;
+		output.reserve(numTriangles);
+
+		uint32 cache[MAX_CACHE_SIZE + 3];
+		uint32 cacheCount = 0;
+		uint32 scanCursor = 0;
+
+		while (output.size() < numTriangles)
+		{
+			if (bestTriangle < 0)
+			{
+				// Nothing adjacent to the cache is left. Continue with the next unemitted triangle in input order.
+				while (emitted[scanCursor])
+				{
+					++scanCursor;
+				}
+				bestTriangle = scanCursor;
+			}
+
+			uint32 t = (uint32)bestTriangle;
+			emitted[t] = 1;
+			output.push_back(triangles[t]);
+
+			const uint32 tri[3] = { indices[t * 3 + 0], indices[t * 3 + 1], indices[t * 3 + 2] };
+
+			for (uint32 v : tri)
+			{
+				uint32* list = adjacency.data() + offsets[v];
+				for (uint32 i = 0; i < remaining[v]; ++i)
+				{
+					if (list[i] == t)
+					{
+						list[i] = list[remaining[v] - 1];
+						--remaining[v];
+						break;
+					}
+				}
+			}
+
+			uint32 newCache[MAX_CACHE_SIZE + 3];
+			uint32 newCount = 0;
+			for (uint32 v : tri)
+			{
+				// Degenerate triangles reference a vertex more than once.
+				bool duplicate = false;
+				for (uint32 i = 0; i < newCount; ++i)
+				{
+					duplicate |= (newCache[i] == v);
+				}
+				if (!duplicate)
+				{
+					newCache[newCount++] = v;
+				}
+			}
+			for (uint32 i = 0; i < cacheCount; ++i)
+			{
+				uint32 v = cache[i];
+				if (v != tri[0] && v != tri[1] && v != tri[2])
+				{
+					newCache[newCount++] = v;
+				}
+			}
+
+			for (uint32 i = 0; i < newCount; ++i)
+			{
+				uint32 v = newCache[i];
+				cachePosition[v] = (i < cacheSize) ? (int32)i : -1;
+				vertexScore[v] = scores.get(cachePosition[v], remaining[v]);
+			}
+
+			cacheCount = min(newCount, cacheSize);
+			memcpy(cache, newCache, sizeof(uint32) * cacheCount);
+
+			// Rescore everything touching the old or new cache. Only triangles with a vertex in the cache are candidates.
+			bestTriangle = -1;
+			float bestScore = -1.f;
+			for (uint32 i = 0; i < newCount; ++i)
+			{
+				uint32 v = newCache[i];
+				const uint32* list = adjacency.data() + offsets[v];
+				for (uint32 j = 0; j < remaining[v]; ++j)
+				{
+					uint32 candidate = list[j];
+					float score = scoreTriangle(candidate);
+					triangleScore[candidate] = score;
+					if (i < cacheCount && score > bestScore)
+					{
+						bestScore = score;
+						bestTriangle = (int32)candidate;
+					}
+				}
+			}
+		}
+
+		memcpy(triangles, output.data(), sizeof(indexed_triangle32) * numTriangles);
+	}
+
+	void optimizeOverdraw(indexed_triangle32* triangles, uint32 numTriangles, const vec3* positions, uint32 numVertices)
+	{
+		if (numTriangles == 0 || numVertices == 0)
+		{
+			return;
+		}
+
+		// A triangle for which all three vertices miss the cache starts a new cluster (Sander et al., "Fast Triangle
+		// Reordering for Vertex Locality and Reduced Overdraw"). Reordering whole clusters keeps the cache behavior within them.
+		std::vector<uint32> clusterStarts;
+		{
+			fifo_cache cache(numVertices, 16);
+			for (uint32 i = 0; i < numTriangles; ++i)
+			{
+				const indexed_triangle32& tri = triangles[i];
+				uint32 misses = !cache.access(tri.a) + !cache.access(tri.b) + !cache.access(tri.c);
+				if (i == 0 || misses == 3)
+				{
+					clusterStarts.push_back(i);
+				}
+			}
+		}
+
+		uint32 numClusters = (uint32)clusterStarts.size();
+		if (numClusters <= 1)
+		{
+			return;
+		}
+		clusterStarts.push_back(numTriangles);
+
+		vec3 meshCentroid(0.f);
+		for (uint32 v = 0; v < numVertices; ++v)
+		{
+			meshCentroid += positions[v];
+		}
+		meshCentroid *= 1.f / numVertices;
+
+		// Clusters facing away from the mesh center are likely to occlude the rest, so they are drawn first.
+		std::vector<float> sortKeys(numClusters);
+		for (uint32 c = 0; c < numClusters; ++c)
+		{
+			vec3 centroid(0.f);
+			vec3 normal(0.f);
+			float area = 0.f;
+
+			for (uint32 i = clusterStarts[c]; i < clusterStarts[c + 1]; ++i)
+			{
+				vec3 a = positions[triangles[i].a];
+				vec3 b = positions[triangles[i].b];
+				vec3 d = positions[triangles[i].c];
+
+				vec3 n = cross(b - a, d - a);
+				float triangleArea = length(n);
+
+				centroid += (a + b + d) * (triangleArea / 3.f);
+				normal += n;
+				area += triangleArea;
+			}
+
+			float normalLength = length(normal);
+			if (area > 0.f && normalLength > 0.f)
+			{
+				centroid *= 1.f / area;
+				normal *= 1.f / normalLength;
+				sortKeys[c] = dot(centroid - meshCentroid, normal);
+			}
+			else
+			{
+				sortKeys[c] = 0.f;
+			}
+		}
+
+		std::vector<uint32> order(numClusters);
+		for (uint32 c = 0; c < numClusters; ++c)
+		{
+			order[c] = c;
+		}
+		std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32 a, uint32 b) { return sortKeys[a] > sortKeys[b]; });
+
+		std::vector<indexed_triangle32> output;
+		output.reserve(numTriangles);
+		for (uint32 c : order)
+		{
+			output.insert(output.end(), triangles + clusterStarts[c], triangles + clusterStarts[c + 1]);
+		}
+
+		memcpy(triangles, output.data(), sizeof(indexed_triangle32) * numTriangles);
+	}
+
+	template <typename T>
+	static void remapAttribute(std::vector<T>& attribute, const std::vector<uint32>& remap, uint32 newNumVertices)
+	{
+		if (attribute.empty())
+		{
+			return;
+		}
+
+		std::vector<T> result(newNumVertices);
+		for (uint32 i = 0; i < (uint32)attribute.size(); ++i)
+		{
+			if (remap[i] != UINT32_MAX)
+			{
+				result[remap[i]] = attribute[i];
+			}
+		}
+		attribute = std::move(result);
+	}
+
+	void optimizeVertexFetch(SubmeshAsset& submesh)
+	{
+		uint32 numVertices = (uint32)submesh.positions.size();
+
+		std::vector<uint32> remap(numVertices, UINT32_MAX);
+		uint32 nextVertex = 0;
+
+		auto remapTriangles = [&](std::vector<indexed_triangle32>& triangles)
+		{
+			uint32* indices = (uint32*)triangles.data();
+			for (uint32 i = 0; i < (uint32)triangles.size() * 3; ++i)
+			{
+				uint32& index = indices[i];
+				if (remap[index] == UINT32_MAX)
+				{
+					remap[index] = nextVertex++;
+				}
+				index = remap[index];
+			}
+		};
+
+		// LODs only reference LOD 0 vertices, so they end up sharing its order.
+		remapTriangles(submesh.triangles);
+		for (SubmeshLodAsset& lod : submesh.lods)
+		{
+			remapTriangles(lod.triangles);
+		}
+
+		remapAttribute(submesh.positions, remap, nextVertex);
+		remapAttribute(submesh.uvs, remap, nextVertex);
+		remapAttribute(submesh.normals, remap, nextVertex);
+		remapAttribute(submesh.tangents, remap, nextVertex);
+		remapAttribute(submesh.colors, remap, nextVertex);
+		remapAttribute(submesh.skin, remap, nextVertex);
+	}
+
+	void optimizeSubmesh(SubmeshAsset& submesh, const mesh_optimization_options& options)
+	{
+		uint32 numVertices = (uint32)submesh.positions.size();
+		uint32 numTriangles = (uint32)submesh.triangles.size();
+
+		if (options.optimize_vertex_cache)
+		{
+			optimizeVertexCache(submesh.triangles.data(), numTriangles, numVertices, options.cache_size);
+			for (SubmeshLodAsset& lod : submesh.lods)
+			{
+				optimizeVertexCache(lod.triangles.data(), (uint32)lod.triangles.size(), numVertices, options.cache_size);
+			}
+		}
+		if (options.optimize_overdraw)
+		{
+			optimizeOverdraw(submesh.triangles.data(), numTriangles, submesh.positions.data(), numVertices);
+		}
+		if (options.optimize_vertex_fetch)
+		{
+			optimizeVertexFetch(submesh);
+		}
+	}
+
+	mesh_optimization_report optimizeModel(ModelAsset& model, const mesh_optimization_options& options)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		std::vector<SubmeshAsset*> submeshes;
+		for (MeshAsset& mesh : model.meshes)
+		{
+			for (SubmeshAsset& sub : mesh.submeshes)
+			{
+				submeshes.push_back(&sub);
+			}
+		}
+
+		std::vector<vertex_cache_statistics> before(submeshes.size());
+		std::vector<vertex_cache_statistics> after(submeshes.size());
+
+		parallel_for(low_priority_job_queue, (uint32)submeshes.size(), 1, [&](uint32 i)
+		{
+			SubmeshAsset& sub = *submeshes[i];
+			before[i] = analyzeVertexCache(sub.triangles.data(), (uint32)sub.triangles.size(), (uint32)sub.positions.size());
+			optimizeSubmesh(sub, options);
+			after[i] = analyzeVertexCache(sub.triangles.data(), (uint32)sub.triangles.size(), (uint32)sub.positions.size());
+		});
+
+		mesh_optimization_report report;
+		report.num_submeshes = (uint32)submeshes.size();
+		for (uint32 i = 0; i < (uint32)submeshes.size(); ++i)
+		{
+			report.before.add(before[i]);
+			report.after.add(after[i]);
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+		report.milliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+		return report;
+	}
+
+	void printOptimizationReport(const mesh_optimization_report& report, const fs::path& path)
+	{
+		LOG_MESSAGE("Optimized %u submeshes (%llu triangles) of '%ws' in %.1f ms. ACMR: %.3f -> %.3f, ATVR: %.3f -> %.3f",
+			report.num_submeshes, report.after.num_triangles, path.c_str(), report.milliseconds,
+			report.before.acmr(), report.after.acmr(), report.before.atvr(), report.after.atvr());
+	}
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#pragma once
+
+#include "core_api.h"
+
+#include "core/math.h"
+
+#include "asset/model_asset.h"
+
+namespace era_engine
+{
+	struct mesh_optimization_options
+	{
+		bool optimize_vertex_cache = true;
+		bool optimize_overdraw = false;	// Reorders cache-friendly triangle clusters front to back. Slightly worse ACMR.
+		bool optimize_vertex_fetch = true;
+
+		uint32 cache_size = 32;			// LRU size assumed by the triangle reordering.
+	};
+
+	// Post-transform cache statistics of a triangle list, measured with a FIFO cache.
+	// ACMR = transformed vertices per triangle (0.5 is the ideal for regular grids, 3 the worst case).
+	// ATVR = transformed vertices per unique vertex (1 is ideal).
+	struct vertex_cache_statistics
+	{
+		uint64 num_triangles = 0;
+		uint64 num_vertices = 0;
+		uint64 vertices_transformed = 0;
+
+		float acmr() const { return num_triangles ? (float)vertices_transformed / num_triangles : 0.f; }
+		float atvr() const { return num_vertices ? (float)vertices_transformed / num_vertices : 0.f; }
+
+		void add(const vertex_cache_statistics& other)
+		{
+			num_triangles += other.num_triangles;
+			num_vertices += other.num_vertices;
+			vertices_transformed += other.vertices_transformed;
+		}
+	};
+
+	struct mesh_optimization_report
+	{
+		uint32 num_submeshes = 0;
+		vertex_cache_statistics before;
+		vertex_cache_statistics after;
+		float milliseconds = 0.f;
+	};
+
+	NODISCARD ERA_CORE_API vertex_cache_statistics analyzeVertexCache(const indexed_triangle32* triangles, uint32 numTriangles, uint32 numVertices, uint32 cacheSize = 16);
+
+	// Reorders triangles for post-transform cache locality (Forsyth, "Linear-Speed Vertex Cache Optimisation").
+	ERA_CORE_API void optimizeVertexCache(indexed_triangle32* triangles, uint32 numTriangles, uint32 numVertices, uint32 cacheSize = 32);
+
+	// Splits a cache-optimized triangle list into clusters at cache restarts and sorts the clusters so that outward facing
+	// ones come first. Cluster contents are left untouched, so most of the cache efficiency is kept.
+	ERA_CORE_API void optimizeOverdraw(indexed_triangle32* triangles, uint32 numTriangles, const vec3* positions, uint32 numVertices);
+
+	// Renumbers vertices in order of first use and permutes all attribute arrays accordingly. Unreferenced vertices are dropped.
+	ERA_CORE_API void optimizeVertexFetch(SubmeshAsset& submesh);
+
+	ERA_CORE_API void optimizeSubmesh(SubmeshAsset& submesh, const mesh_optimization_options& options = {});
+
+	// Optimizes all submeshes in parallel. Runs while building the BIN cache.
+	ERA_CORE_API mesh_optimization_report optimizeModel(ModelAsset& model, const mesh_optimization_options& options = {});
+
+	ERA_CORE_API void printOptimizationReport(const mesh_optimization_report& report, const fs::path& path);
+}
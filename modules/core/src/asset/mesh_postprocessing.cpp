@@ -2,258 +2,479 @@
 
 #include "asset/mesh_postprocessing.h"
 
-#include "core/cpu_profiling.h"
+#include "core/job_system.h"
+#include "core/math_simd.h"
 
 namespace era_engine
 {
-	void generateNormalsAndTangents(std::vector<SubmeshAsset>& submeshes, uint32 flags)
+	// Per-face values, computed in parallel before the per-vertex gather.
+	struct face_data
 	{
-		if (flags & mesh_flag_gen_tangents)
+		std::vector<vec3> normals;		// Unnormalized, length is twice the area.
+		std::vector<vec3> tangents;		// Unnormalized. Empty if no tangents are generated.
+		std::vector<float> angles;		// Per corner. Empty if neither angle weighting nor MikkTSpace tangents are requested.
+	};
+
+	static constexpr float DEGENERATE_UV_DETERMINANT = 1e-12f;
+
+	// Faces of vertices at the same position are smoothed across a seam up to this angle between the face normal and the
+	// vertex's own normal, in degrees. Larger angles are treated as hard edges.
+	static constexpr float SEAM_SMOOTHING_ANGLE = 60.f;
+
+	// Four triangles per iteration. Lanes past the end repeat the last triangle and are not stored.
+	static void computeFaceData4(const SubmeshAsset& sub, uint32 firstTriangle, bool withTangents, bool withAngles, face_data& out)
+	{
+		uint32 numTriangles = (uint32)sub.triangles.size();
+		uint32 numLanes = min(numTriangles - firstTriangle, 4u);
+
+		int32 ia[4], ib[4], ic[4];
+		for (uint32 i = 0; i < 4; ++i)
 		{
-			flags |= mesh_flag_gen_normals;
+			const indexed_triangle32& tri = sub.triangles[firstTriangle + min(i, numLanes - 1)];
+			ia[i] = (int32)tri.a;
+			ib[i] = (int32)tri.b;
+			ic[i] = (int32)tri.c;
 		}
 
-		for (SubmeshAsset& sub : submeshes)
+		auto gather3 = [](const vec3* v, const int32* index, uint32 component)
 		{
-			if (sub.normals.empty() && flags & mesh_flag_gen_normals)
-			{
-				printf("Generating normals\n");
-				CPU_PRINT_PROFILE_BLOCK("Generating normals");
+			const float* base = &v->x + component;
+			return w4_float(base, index[0] * 3, index[1] * 3, index[2] * 3, index[3] * 3);
+		};
+		auto gatherVec3 = [&](const vec3* v, const int32* index)
+		{
+			return w4_vec3(gather3(v, index, 0), gather3(v, index, 1), gather3(v, index, 2));
+		};
 
-				sub.normals.resize(sub.positions.size(), vec3(0.f));
-				for (indexed_triangle16 tri : sub.triangles)
-				{
-					vec3 a = sub.positions[tri.a];
-					vec3 b = sub.positions[tri.b];
-					vec3 c = sub.positions[tri.c];
-
-					vec3 n = cross(b - a, c - a);
-					sub.normals[tri.a] += n;
-					sub.normals[tri.b] += n;
-					sub.normals[tri.c] += n;
-				}
-				for (vec3& n : sub.normals)
-				{
-					n = normalize(n);
-				}
+		w4_vec3 a = gatherVec3(sub.positions.data(), ia);
+		w4_vec3 b = gatherVec3(sub.positions.data(), ib);
+		w4_vec3 c = gatherVec3(sub.positions.data(), ic);
+
+		w4_vec3 ab = b - a;
+		w4_vec3 ac = c - a;
+		w4_vec3 n = cross(ab, ac);
+
+		float nx[4], ny[4], nz[4];
+		n.x.store(nx); n.y.store(ny); n.z.store(nz);
+		for (uint32 i = 0; i < numLanes; ++i)
+		{
+			out.normals[firstTriangle + i] = vec3(nx[i], ny[i], nz[i]);
+		}
+
+		if (withAngles)
+		{
+			w4_vec3 bc = c - b;
+			w4_vec3 abn = noz(ab);
+			w4_vec3 acn = noz(ac);
+			w4_vec3 bcn = noz(bc);
+
+			w4_float angleA = acos(clamp(dot(abn, acn), w4_float(-1.f), w4_float(1.f)));
+			w4_float angleB = acos(clamp(-dot(abn, bcn), w4_float(-1.f), w4_float(1.f)));
+			w4_float angleC = w4_float(3.14159265359f) - angleA - angleB;
+
+			float aa[4], ab_[4], ac_[4];
+			angleA.store(aa); angleB.store(ab_); angleC.store(ac_);
+			for (uint32 i = 0; i < numLanes; ++i)
+			{
+				uint32 corner = (firstTriangle + i) * 3;
+				out.angles[corner + 0] = aa[i];
+				out.angles[corner + 1] = ab_[i];
+				out.angles[corner + 2] = ac_[i];
 			}
+		}
 
-			if (sub.tangents.empty() && flags & mesh_flag_gen_tangents)
+		if (withTangents)
+		{
+			auto gatherVec2 = [&](const vec2* v, const int32* index)
 			{
-				printf("Generating tangents\n");
-				CPU_PRINT_PROFILE_BLOCK("Generating tangents");
+				const float* base = &v->x;
+				return w4_vec2(
+					w4_float(base, index[0] * 2, index[1] * 2, index[2] * 2, index[3] * 2),
+					w4_float(base + 1, index[0] * 2, index[1] * 2, index[2] * 2, index[3] * 2));
+			};
 
-				sub.tangents.resize(sub.positions.size(), vec3(0.f));
-				if (!sub.uvs.empty())
-				{
-					for (indexed_triangle16 tri : sub.triangles)
-					{
-						vec3 a = sub.positions[tri.a];
-						vec3 b = sub.positions[tri.b];
-						vec3 c = sub.positions[tri.c];
-
-						vec2 h = sub.uvs[tri.a];
-						vec2 k = sub.uvs[tri.b];
-						vec2 l = sub.uvs[tri.c];
-
-						vec3 d = b - a;
-						vec3 e = c - a;
-
-						vec2 f = k - h;
-						vec2 g = l - h;
-
-						float invDet = 1.f / (f.x * g.y - f.y * g.x);
-
-						vec3 t;
-						t.x = g.y * d.x - f.y * e.x;
-						t.y = g.y * d.y - f.y * e.y;
-						t.z = g.y * d.z - f.y * e.z;
-						t *= invDet;
-						sub.tangents[tri.a] += t;
-						sub.tangents[tri.b] += t;
-						sub.tangents[tri.c] += t;
-					}
-					for (uint32 i = 0; i < (uint32)sub.positions.size(); ++i)
-					{
-						vec3 t = sub.tangents[i];
-						vec3 n = sub.normals[i];
+			w4_vec2 uvA = gatherVec2(sub.uvs.data(), ia);
+			w4_vec2 f = gatherVec2(sub.uvs.data(), ib) - uvA;
+			w4_vec2 g = gatherVec2(sub.uvs.data(), ic) - uvA;
 
-						vec3 b = cross(t, n);
-						t = cross(n, b);
+			w4_float det = f.x * g.y - f.y * g.x;
+			w4_float valid = abs(det) > w4_float(DEGENERATE_UV_DETERMINANT);
+			w4_float invDet = if_then(valid, w4_float(1.f) / if_then(valid, det, w4_float(1.f)), w4_float::zero());
 
-						sub.tangents[i] = normalize(t);
-					}
-				}
-				else
-				{
-					printf("Mesh has no UVs. Generating suboptimal tangents.\n");
-					for (uint32 i = 0; i < (uint32)sub.positions.size(); ++i)
-					{
-						sub.tangents[i] = get_tangent(sub.normals[i]);
-					}
-				}
+			w4_vec3 t = (ab * g.y - ac * f.y) * invDet;
+
+			float tx[4], ty[4], tz[4];
+			t.x.store(tx); t.y.store(ty); t.z.store(tz);
+			for (uint32 i = 0; i < numLanes; ++i)
+			{
+				out.tangents[firstTriangle + i] = vec3(tx[i], ty[i], tz[i]);
 			}
 		}
 	}
 
-	void generateNormalsAndTangents(ref<SubmeshAsset> submesh, uint32 flags)
+	static vec3 safeNormalize(vec3 v, vec3 fallback)
+	{
+		float l = length(v);
+		return (l > 1e-20f) ? v * (1.f / l) : fallback;
+	}
+
+	void generateNormalsAndTangents(SubmeshAsset& sub, uint32 flags)
 	{
 		if (flags & mesh_flag_gen_tangents)
 		{
 			flags |= mesh_flag_gen_normals;
 		}
 
-		if (submesh->normals.empty() && flags & mesh_flag_gen_normals)
+		bool genNormals = sub.normals.empty() && (flags & mesh_flag_gen_normals);
+		bool genTangents = sub.tangents.empty() && (flags & mesh_flag_gen_tangents);
+		if (!genNormals && !genTangents)
 		{
-			printf("Generating normals\n");
-			CPU_PRINT_PROFILE_BLOCK("Generating normals");
+			return;
+		}
+
+		uint32 numVertices = (uint32)sub.positions.size();
+		uint32 numTriangles = (uint32)sub.triangles.size();
+
+		// Without UVs there is no tangent space to derive, so tangents are only made orthogonal to the normals.
+		bool tangentsFromUVs = genTangents && !sub.uvs.empty();
+		bool angleWeighted = (flags & mesh_flag_angle_weighted_normals) != 0;
+		bool mikkTSpace = (flags & mesh_flag_mikktspace_tangents) != 0;
+		bool withAngles = (genNormals && angleWeighted) || (tangentsFromUVs && mikkTSpace);
+
+		face_data faces;
+		faces.normals.resize(numTriangles);
+		if (tangentsFromUVs) { faces.tangents.resize(numTriangles); }
+		if (withAngles) { faces.angles.resize(numTriangles * 3); }
+
+		parallel_for(low_priority_job_queue, (numTriangles + 3) / 4, 1024, [&](uint32 i)
+		{
+			computeFaceData4(sub, i * 4, tangentsFromUVs, withAngles, faces);
+		});
+
+		// Vertices at the same position are split by seams, e.g. in UVs or colors. They form one welded position, so that
+		// the faces on both sides of a seam contribute to both of its vertices.
+		std::vector<uint32> positionGroups(numVertices);
+		uint32 numGroups = 0;
+		{
+			auto comparePositions = [&](uint32 a, uint32 b)
+			{
+				return memcmp(&sub.positions[a], &sub.positions[b], sizeof(vec3));
+			};
+
+			std::vector<uint32> sortedVertices(numVertices);
+			for (uint32 v = 0; v < numVertices; ++v)
+			{
+				sortedVertices[v] = v;
+			}
+			std::sort(sortedVertices.begin(), sortedVertices.end(), [&](uint32 a, uint32 b)
+			{
+				int c = comparePositions(a, b);
+				return (c < 0) || (c == 0 && a < b);
+			});
 
-			submesh->normals.resize(submesh->positions.size(), vec3(0.f));
-			for (indexed_triangle16 tri : submesh->triangles)
+			for (uint32 i = 0; i < numVertices; ++i)
 			{
-				vec3 a = submesh->positions[tri.a];
-				vec3 b = submesh->positions[tri.b];
-				vec3 c = submesh->positions[tri.c];
-
-				vec3 n = cross(b - a, c - a);
-				submesh->normals[tri.a] += n;
-				submesh->normals[tri.b] += n;
-				submesh->normals[tri.c] += n;
+				if (i > 0 && comparePositions(sortedVertices[i], sortedVertices[i - 1]) != 0)
+				{
+					++numGroups;
+				}
+				positionGroups[sortedVertices[i]] = numGroups;
 			}
-			for (vec3& n : submesh->normals)
+			numGroups += (numVertices > 0);
+		}
+
+		// Welded position -> corner adjacency (counting sort). Corners of a position are ordered by triangle, which keeps
+		// the summation order, and therefore the result, deterministic.
+		std::vector<uint32> cornerOffsets(numGroups + 1, 0);
+		const uint32* indices = (const uint32*)sub.triangles.data();
+		for (uint32 i = 0; i < numTriangles * 3; ++i)
+		{
+			++cornerOffsets[positionGroups[indices[i]] + 1];
+		}
+		for (uint32 g = 0; g < numGroups; ++g)
+		{
+			cornerOffsets[g + 1] += cornerOffsets[g];
+		}
+		std::vector<uint32> corners(numTriangles * 3);
+		{
+			std::vector<uint32> cursor(cornerOffsets.begin(), cornerOffsets.end() - 1);
+			for (uint32 i = 0; i < numTriangles * 3; ++i)
 			{
-				n = normalize(n);
+				corners[cursor[positionGroups[indices[i]]]++] = i;
 			}
 		}
 
-		if (submesh->tangents.empty() && flags & mesh_flag_gen_tangents)
+		if (genNormals)
+		{
+			sub.normals.resize(numVertices);
+		}
+		if (genTangents)
+		{
+			sub.tangents.resize(numVertices);
+		}
+
+		const float cosSeamSmoothingAngle = cos(deg2rad(SEAM_SMOOTHING_ANGLE));
+
+		parallel_for(low_priority_job_queue, numVertices, 4096, [&](uint32 v)
 		{
-			printf("Generating tangents\n");
-			CPU_PRINT_PROFILE_BLOCK("Generating tangents");
+			uint32 group = positionGroups[v];
+			uint32 begin = cornerOffsets[group];
+			uint32 end = cornerOffsets[group + 1];
 
-			submesh->tangents.resize(submesh->positions.size(), vec3(0.f));
-			if (!submesh->uvs.empty())
+			auto faceNormalWeight = [&](uint32 corner)
 			{
-				for (indexed_triangle16 tri : submesh->triangles)
+				vec3 faceNormal = faces.normals[corner / 3];
+				return (genNormals && angleWeighted) ? safeNormalize(faceNormal, vec3(0.f)) * faces.angles[corner] : faceNormal;
+			};
+
+			// The vertex's own faces define its side of a seam. Faces of other vertices at the same position only
+			// contribute if they do not bend away further than the smoothing angle, so hard edges stay hard.
+			vec3 ownNormal(0.f);
+			bool onSeam = false;
+			for (uint32 i = begin; i < end; ++i)
+			{
+				if (indices[corners[i]] == v)
 				{
-					vec3 a = submesh->positions[tri.a];
-					vec3 b = submesh->positions[tri.b];
-					vec3 c = submesh->positions[tri.c];
-
-					vec2 h = submesh->uvs[tri.a];
-					vec2 k = submesh->uvs[tri.b];
-					vec2 l = submesh->uvs[tri.c];
-
-					vec3 d = b - a;
-					vec3 e = c - a;
-
-					vec2 f = k - h;
-					vec2 g = l - h;
-
-					float invDet = 1.f / (f.x * g.y - f.y * g.x);
-
-					vec3 t;
-					t.x = g.y * d.x - f.y * e.x;
-					t.y = g.y * d.y - f.y * e.y;
-					t.z = g.y * d.z - f.y * e.z;
-					t *= invDet;
-					submesh->tangents[tri.a] += t;
-					submesh->tangents[tri.b] += t;
-					submesh->tangents[tri.c] += t;
+					ownNormal += faceNormalWeight(corners[i]);
 				}
-
-				for (uint32 i = 0; i < (uint32)submesh->positions.size(); ++i)
+				else
 				{
-					vec3 t = submesh->tangents[i];
-					vec3 n = submesh->normals[i];
+					onSeam = true;
+				}
+			}
+			ownNormal = safeNormalize(ownNormal, vec3(0.f, 1.f, 0.f));
 
-					vec3 b = cross(t, n);
-					t = cross(n, b);
+			auto smoothsWith = [&](uint32 corner)
+			{
+				return indices[corner] == v
+					|| dot(safeNormalize(faces.normals[corner / 3], vec3(0.f)), ownNormal) >= cosSeamSmoothingAngle;
+			};
 
-					submesh->tangents[i] = normalize(t);
+			if (genNormals)
+			{
+				vec3 n = ownNormal;
+				if (onSeam)
+				{
+					n = vec3(0.f);
+					for (uint32 i = begin; i < end; ++i)
+					{
+						uint32 corner = corners[i];
+						if (smoothsWith(corner))
+						{
+							n += faceNormalWeight(corner);
+						}
+					}
+					n = safeNormalize(n, ownNormal);
 				}
+				sub.normals[v] = n;
 			}
-			else
+
+			if (genTangents)
 			{
-				printf("Mesh has no UVs. Generating suboptimal tangents.\n");
-				for (uint32 i = 0; i < (uint32)submesh->positions.size(); ++i)
+				vec3 n = sub.normals[v];
+
+				vec3 t(0.f);
+				if (tangentsFromUVs)
 				{
-					submesh->tangents[i] = get_tangent(submesh->normals[i]);
+					for (uint32 i = begin; i < end; ++i)
+					{
+						// Tangents are only shared with vertices of the same UV, since they legitimately differ across
+						// UV seams, e.g. on mirrored UV islands.
+						uint32 corner = corners[i];
+						uint32 cornerVertex = indices[corner];
+						if (cornerVertex != v && (!smoothsWith(corner) || sub.uvs[cornerVertex] != sub.uvs[v]))
+						{
+							continue;
+						}
+
+						vec3 faceTangent = faces.tangents[corner / 3];
+						if (mikkTSpace)
+						{
+							// Project into the vertex's tangent plane first, then weight by the corner angle.
+							vec3 projected = faceTangent - n * dot(n, faceTangent);
+							t += safeNormalize(projected, vec3(0.f)) * faces.angles[corner];
+						}
+						else
+						{
+							t += faceTangent;
+						}
+					}
+
+					t -= n * dot(n, t);
 				}
+				sub.tangents[v] = safeNormalize(t, get_tangent(n));
 			}
-		}
+		});
 	}
 
-	void per_material::addTriangles(const std::vector<vec3>& positions, const std::vector<vec2>& uvs, const std::vector<vec3>& normals, const std::vector<vec3>& tangents, const std::vector<uint32>& colors, const std::vector<era_engine::animation::SkinningWeights>& skins, int32 firstIndex, int32 faceSize, std::vector<SubmeshAsset>& outSubmeshes)
+	void generateNormalsAndTangents(std::vector<SubmeshAsset>& submeshes, uint32 flags)
 	{
-		if (faceSize < 3)
-			return;
+		// Serial, since every submesh already runs its faces and vertices in parallel.
+		for (SubmeshAsset& sub : submeshes)
+		{
+			generateNormalsAndTangents(sub, flags);
+		}
+	}
 
-		int32 aIndex = firstIndex++;
-		int32 bIndex = firstIndex++;
-		add_vertex_result a = addVertex(positions, uvs, normals, tangents, colors, skins, aIndex);
-		add_vertex_result b = addVertex(positions, uvs, normals, tangents, colors, skins, bIndex);
+	void per_material::addTriangles(int32 firstIndex, int32 faceSize)
+	{
 		for (int32 i = 2; i < faceSize; ++i)
 		{
-			int32 cIndex = firstIndex++;
-			add_vertex_result c = addVertex(positions, uvs, normals, tangents, colors, skins, cIndex);
+			corners.push_back((uint32)firstIndex);
+			corners.push_back((uint32)(firstIndex + i - 1));
+			corners.push_back((uint32)(firstIndex + i));
+		}
+	}
 
-			if (!(a.success && b.success && c.success))
-			{
-				flush(outSubmeshes);
-				a = addVertex(positions, uvs, normals, tangents, colors, skins, aIndex);
-				b = addVertex(positions, uvs, normals, tangents, colors, skins, bIndex);
-				c = addVertex(positions, uvs, normals, tangents, colors, skins, cIndex);
-				printf("Too many vertices for 16-bit indices. Splitting mesh!\n");
-			}
+	static full_vertex getCornerVertex(const corner_attributes& attributes, uint32 index)
+	{
+		full_vertex result = {};
+		result.position = attributes.positions[index];
+		if (attributes.uvs) { result.uv = attributes.uvs[index]; }
+		if (attributes.normals) { result.normal = attributes.normals[index]; }
+		if (attributes.tangents) { result.tangent = attributes.tangents[index]; }
+		if (attributes.colors) { result.color = attributes.colors[index]; }
+		if (attributes.skin) { result.skin = attributes.skin[index]; }
+		return result;
+	}
 
-			sub.triangles.push_back(indexed_triangle16{ a.index, b.index, c.index });
+	// Two independent multiply-xor lanes over the seven 64-bit words of a vertex, followed by a murmur finalizer.
+	// Much cheaper than chaining hash_combine over every float, and the fixed trip count unrolls completely.
+	static uint64 hashVertex(const full_vertex& vertex)
+	{
+		uint64 words[sizeof(full_vertex) / sizeof(uint64)];
+		memcpy(words, &vertex, sizeof(words));
 
-			b = c;
-			bIndex = cIndex;
+		uint64 h0 = 0x9E3779B97F4A7C15ull;
+		uint64 h1 = 0xC2B2AE3D27D4EB4Full;
+		for (uint32 i = 0; i < arraysize(words); i += 2)
+		{
+			h0 = (h0 ^ words[i]) * 0xFF51AFD7ED558CCDull;
+			if (i + 1 < arraysize(words))
+			{
+				h1 = (h1 ^ words[i + 1]) * 0xC4CEB9FE1A85EC53ull;
+			}
 		}
+
+		uint64 h = h0 ^ ((h1 << 31) | (h1 >> 33));
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53ull;
+		h ^= h >> 33;
+		return h;
 	}
 
-	void per_material::flush(std::vector<SubmeshAsset>& outSubmeshes)
+	void per_material::flush(const corner_attributes& attributes, std::vector<SubmeshAsset>& outSubmeshes)
 	{
-		if (vertexToIndex.size() > 0)
+		uint32 numCorners = (uint32)corners.size();
+		if (numCorners == 0)
 		{
-			outSubmeshes.push_back(std::move(sub));
-			vertexToIndex.clear();
+			return;
 		}
-	}
 
-	per_material::add_vertex_result per_material::addVertex(const std::vector<vec3>& positions, const std::vector<vec2>& uvs, const std::vector<vec3>& normals, const std::vector<vec3>& tangents, const std::vector<uint32>& colors, const std::vector<era_engine::animation::SkinningWeights>& skins, int32 index)
-	{
-		vec3 position = positions[index];
-		vec2 uv = !uvs.empty() ? uvs[index] : vec2(0.f, 0.f);
-		vec3 normal = !normals.empty() ? normals[index] : vec3(0.f, 0.f, 0.f);
-		vec3 tangent = !tangents.empty() ? tangents[index] : vec3(0.f, 0.f, 0.f);
-		uint32 color = !colors.empty() ? colors[index] : 0;
-		animation::SkinningWeights skin = !skins.empty() ? skins[index] : animation::SkinningWeights{};
-
-		full_vertex vertex = { position, uv, normal, tangent, color, skin, };
-		auto it = vertexToIndex.find(vertex);
-		if (it == vertexToIndex.end())
+		std::vector<uint64> hashes(numCorners);
+		for (uint32 i = 0; i < numCorners; ++i)
+		{
+			hashes[i] = hashVertex(getCornerVertex(attributes, corners[i]));
+		}
+
+		// Open addressing with linear probing. Each slot stores the unique vertex index and the upper hash bits, so
+		// most mismatches are rejected without touching the vertex data.
+		struct slot
+		{
+			uint32 vertex;
+			uint32 tag;
+		};
+
+		constexpr uint32 emptySlot = UINT32_MAX;
+
+		uint32 capacity = 16;
+		while (capacity < numCorners * 2)
 		{
-			uint32 vertexIndex = (uint32)sub.positions.size();
-			if (vertexIndex > UINT16_MAX)
+			capacity <<= 1;
+		}
+		uint32 mask = capacity - 1;
+
+		std::vector<slot> table(capacity, slot{ emptySlot, 0 });
+		std::vector<uint32> firstCorner; // Corner which introduced each unique vertex.
+		firstCorner.reserve(numCorners / 2);
+
+		SubmeshAsset sub;
+		sub.material_index = material_index;
+		sub.triangles.resize(numCorners / 3);
+		uint32* indices = (uint32*)sub.triangles.data();
+
+		for (uint32 i = 0; i < numCorners; ++i)
+		{
+			uint64 hash = hashes[i];
+			uint32 tag = (uint32)(hash >> 32);
+
+			for (uint32 s = (uint32)hash & mask;; s = (s + 1) & mask)
 			{
-				return { 0, false };
+				slot& entry = table[s];
+				if (entry.vertex == emptySlot)
+				{
+					entry = { (uint32)firstCorner.size(), tag };
+					indices[i] = entry.vertex;
+					firstCorner.push_back(corners[i]);
+					break;
+				}
+				if (entry.tag == tag && getCornerVertex(attributes, firstCorner[entry.vertex]) == getCornerVertex(attributes, corners[i]))
+				{
+					indices[i] = entry.vertex;
+					break;
+				}
 			}
+		}
 
-			vertexToIndex.insert({ vertex, (uint16)vertexIndex });
+		uint32 numVertices = (uint32)firstCorner.size();
 
-			sub.positions.push_back(position);
-			if (!uvs.empty()) { sub.uvs.push_back(uv); }
-			if (!normals.empty()) { sub.normals.push_back(normal); }
-			if (!tangents.empty()) { sub.tangents.push_back(tangent); }
-			if (!colors.empty()) { sub.colors.push_back(color); }
-			if (!skins.empty()) { sub.skin.push_back(skin); }
+		sub.positions.resize(numVertices);
+		if (attributes.uvs) { sub.uvs.resize(numVertices); }
+		if (attributes.normals) { sub.normals.resize(numVertices); }
+		if (attributes.tangents) { sub.tangents.resize(numVertices); }
+		if (attributes.colors) { sub.colors.resize(numVertices); }
+		if (attributes.skin) { sub.skin.resize(numVertices); }
 
-			return { (uint16)vertexIndex, true };
+		for (uint32 v = 0; v < numVertices; ++v)
+		{
+			uint32 c = firstCorner[v];
+			sub.positions[v] = attributes.positions[c];
+			if (attributes.uvs) { sub.uvs[v] = attributes.uvs[c]; }
+			if (attributes.normals) { sub.normals[v] = attributes.normals[c]; }
+			if (attributes.tangents) { sub.tangents[v] = attributes.tangents[c]; }
+			if (attributes.colors) { sub.colors[v] = attributes.colors[c]; }
+			if (attributes.skin) { sub.skin[v] = attributes.skin[c]; }
+		}
+
+		outSubmeshes.push_back(std::move(sub));
+		corners.clear();
+		corners.shrink_to_fit();
+	}
+
+	void flushPerMaterial(std::unordered_map<int32, per_material>& materials, const corner_attributes& attributes, std::vector<SubmeshAsset>& outSubmeshes)
+	{
+		std::vector<per_material*> sorted;
+		sorted.reserve(materials.size());
+		for (auto& [index, perMat] : materials)
+		{
+			sorted.push_back(&perMat);
+		}
+		std::sort(sorted.begin(), sorted.end(), [](const per_material* a, const per_material* b) { return a->material_index < b->material_index; });
+
+		std::vector<std::vector<SubmeshAsset>> results(sorted.size());
+		parallel_for(low_priority_job_queue, (uint32)sorted.size(), 1, [&](uint32 i)
+		{
+			sorted[i]->flush(attributes, results[i]);
+		});
+
+		for (auto& result : results)
+		{
+			for (auto& sub : result)
+			{
+				outSubmeshes.push_back(std::move(sub));
+			}
 		}
-		else
-			return { it->second, true };
 	}
-}
\ No newline at end of file
+}
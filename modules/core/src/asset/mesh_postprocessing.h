@@ -23,59 +23,44 @@ namespace era_engine
 		animation::SkinningWeights skin;
 	};
 
+	static_assert(sizeof(full_vertex) == 56, "full_vertex is hashed and compared bytewise, so it must not contain padding.");
+
 	static bool operator==(const full_vertex& a, const full_vertex& b)
 	{
 		return memcmp(&a, &b, sizeof(full_vertex)) == 0;
 	}
-}
 
-namespace std
-{
-	template<>
-	struct hash<era_engine::full_vertex>
+	// Per-corner vertex attributes of one source mesh. Null pointers mean the attribute is missing.
+	struct corner_attributes
 	{
-		size_t operator()(const era_engine::full_vertex& x) const
-		{
-			size_t seed = 0;
-
-			hash_combine(seed, x.position);
-			hash_combine(seed, x.uv);
-			hash_combine(seed, x.normal);
-			hash_combine(seed, x.tangent);
-			hash_combine(seed, x.color);
-			hash_combine(seed, *(uint32*)x.skin.skin_indices);
-			hash_combine(seed, *(uint32*)x.skin.skin_weights);
-
-			return seed;
-		}
+		const vec3* positions;
+		const vec2* uvs;
+		const vec3* normals;
+		const vec3* tangents;
+		const uint32* colors;
+		const animation::SkinningWeights* skin;
 	};
-}
 
-namespace era_engine
-{
 	struct ERA_CORE_API per_material
 	{
-		void addTriangles(const std::vector<vec3>& positions, const std::vector<vec2>& uvs, const std::vector<vec3>& normals,
-			const std::vector<vec3>& tangents, const std::vector<uint32>& colors, const std::vector<animation::SkinningWeights>& skins,
-			int32 firstIndex, int32 faceSize, std::vector<SubmeshAsset>& outSubmeshes);
-
-		void flush(std::vector<SubmeshAsset>& outSubmeshes);
+		// Triangulates the polygon made of corners [firstIndex, firstIndex + faceSize) as a fan. Corners are only
+		// recorded here, identical vertices are welded in flush.
+		void addTriangles(int32 firstIndex, int32 faceSize);
 
-		std::unordered_map<full_vertex, uint16> vertexToIndex;
-		SubmeshAsset sub;
+		// Welds identical corners and appends the resulting submesh.
+		void flush(const corner_attributes& attributes, std::vector<SubmeshAsset>& outSubmeshes);
 
-	private:
-		struct add_vertex_result
-		{
-			uint16 index;
-			bool success;
-		};
-
-		add_vertex_result addVertex(const std::vector<vec3>& positions, const std::vector<vec2>& uvs, const std::vector<vec3>& normals,
-			const std::vector<vec3>& tangents, const std::vector<uint32>& colors, const std::vector<animation::SkinningWeights>& skins,
-			int32 index);
+		int32 material_index = 0;
+		std::vector<uint32> corners;
 	};
 
+	// Flushes all materials in parallel. Submeshes are appended ordered by material index, so the output is deterministic.
+	void flushPerMaterial(std::unordered_map<int32, per_material>& materials, const corner_attributes& attributes, std::vector<SubmeshAsset>& outSubmeshes);
+
+	// Generates missing normals and tangents (mesh_flag_gen_*). Face values are computed four triangles at a time, then every
+	// vertex gathers the faces around it through a position -> corner adjacency list, so threads never write to the same vertex.
+	// Vertices split at the same position, e.g. by a UV seam, smooth across the seam unless the faces meet at a hard edge.
+	// The result does not depend on the number of threads.
+	void generateNormalsAndTangents(SubmeshAsset& submesh, uint32 flags);
 	void generateNormalsAndTangents(std::vector<SubmeshAsset>& submeshes, uint32 flags);
-	void generateNormalsAndTangents(ref<SubmeshAsset> submesh, uint32 flags);
-}
\ No newline at end of file
+}
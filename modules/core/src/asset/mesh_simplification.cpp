@@ -0,0 +1,420 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#include "asset/mesh_simplification.h"
+
+#include "core/job_system.h"
+#include "core/log.h"
+
+namespace era_engine
+{
+	static constexpr uint32 MAX_SIMPLIFICATION_PASSES = 64;
+
+	// Sum of squared distances to a set of planes, normalized by the accumulated weight.
+	struct quadric
+	{
+		double a2, ab, ac, ad;
+		double b2, bc, bd;
+		double c2, cd;
+		double d2;
+		double weight;
+
+		void addPlane(vec3 n, float d, float w)
+		{
+			a2 += w * n.x * n.x; ab += w * n.x * n.y; ac += w * n.x * n.z; ad += w * n.x * d;
+			b2 += w * n.y * n.y; bc += w * n.y * n.z; bd += w * n.y * d;
+			c2 += w * n.z * n.z; cd += w * n.z * d;
+			d2 += w * d * d;
+			weight += w;
+		}
+
+		void add(const quadric& o)
+		{
+			a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad;
+			b2 += o.b2; bc += o.bc; bd += o.bd;
+			c2 += o.c2; cd += o.cd;
+			d2 += o.d2;
+			weight += o.weight;
+		}
+
+		float evaluate(vec3 p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			double e = a2 * x * x + b2 * y * y + c2 * z * z
+				+ 2.0 * (ab * x * y + ac * x * z + bc * y * z)
+				+ 2.0 * (ad * x + bd * y + cd * z)
+				+ d2;
+			return (weight > 0.0) ? (float)max(e / weight, 0.0) : 0.f;
+		}
+	};
+
+	struct position_key
+	{
+		uint32 x, y, z;
+		bool operator==(const position_key& o) const { return x == o.x && y == o.y && z == o.z; }
+	};
+
+	struct position_key_hash
+	{
+		size_t operator()(const position_key& k) const
+		{
+			uint64 h = (uint64)k.x * 0x9E3779B97F4A7C15ull;
+			h ^= (uint64)k.y * 0xC2B2AE3D27D4EB4Full;
+			h ^= (uint64)k.z * 0x165667B19E3779F9ull;
+			return (size_t)(h ^ (h >> 29));
+		}
+	};
+
+	static uint64 edgeKey(uint32 a, uint32 b)
+	{
+		return (a < b) ? (((uint64)a << 32) | b) : (((uint64)b << 32) | a);
+	}
+
+	static vec3 triangleNormal(vec3 a, vec3 b, vec3 c)
+	{
+		return cross(b - a, c - a);
+	}
+
+	float simplifyMesh(const vec3* positions, const animation::SkinningWeights* skin, uint32 numVertices,
+		const indexed_triangle32* triangles, uint32 numTriangles, uint32 targetTriangles, float maxError,
+		std::vector<indexed_triangle32>& outTriangles)
+	{
+		outTriangles.assign(triangles, triangles + numTriangles);
+		if (numTriangles <= targetTriangles || numVertices == 0)
+		{
+			return 0.f;
+		}
+
+		// Vertices sharing a position form one wedge group. Groups with more than one vertex sit on a UV or normal seam.
+		std::vector<uint32> positionGroup(numVertices);
+		std::vector<uint32> groupSize(numVertices, 0);
+		{
+			std::unordered_map<position_key, uint32, position_key_hash> groups;
+			groups.reserve(numVertices);
+			for (uint32 v = 0; v < numVertices; ++v)
+			{
+				position_key key;
+				memcpy(&key, &positions[v], sizeof(key));
+				uint32 group = groups.try_emplace(key, v).first->second;
+				positionGroup[v] = group;
+				++groupSize[group];
+			}
+		}
+
+		// Edges in position space. Edges used by one triangle are borders, more than two are non-manifold.
+		std::vector<uint8> locked(numVertices, 0);
+		{
+			std::unordered_map<uint64, uint32> edgeCounts;
+			edgeCounts.reserve(numTriangles * 2);
+			for (const indexed_triangle32& tri : outTriangles)
+			{
+				uint32 g[3] = { positionGroup[tri.a], positionGroup[tri.b], positionGroup[tri.c] };
+				for (uint32 e = 0; e < 3; ++e)
+				{
+					++edgeCounts[edgeKey(g[e], g[(e + 1) % 3])];
+				}
+			}
+
+			for (const indexed_triangle32& tri : outTriangles)
+			{
+				const uint32 v[3] = { tri.a, tri.b, tri.c };
+				for (uint32 e = 0; e < 3; ++e)
+				{
+					if (edgeCounts[edgeKey(positionGroup[v[e]], positionGroup[v[(e + 1) % 3]])] != 2)
+					{
+						locked[v[e]] = 1;
+						locked[v[(e + 1) % 3]] = 1;
+					}
+				}
+			}
+
+			for (uint32 v = 0; v < numVertices; ++v)
+			{
+				if (groupSize[positionGroup[v]] > 1)
+				{
+					locked[v] = 1;
+				}
+			}
+		}
+
+		std::vector<quadric> quadrics(numVertices, quadric{});
+		for (const indexed_triangle32& tri : outTriangles)
+		{
+			vec3 a = positions[tri.a];
+			vec3 n = triangleNormal(a, positions[tri.b], positions[tri.c]);
+			float area = length(n);
+			if (area <= 0.f)
+			{
+				continue;
+			}
+			n *= 1.f / area;
+			float d = -dot(n, a);
+
+			quadrics[tri.a].addPlane(n, d, area);
+			quadrics[tri.b].addPlane(n, d, area);
+			quadrics[tri.c].addPlane(n, d, area);
+		}
+
+		struct collapse
+		{
+			uint32 from;
+			uint32 to;
+			float cost;
+		};
+
+		const float maxCost = maxError * maxError;
+		float resultCost = 0.f;
+
+		std::vector<collapse> candidates;
+		std::vector<uint32> adjacencyOffsets(numVertices + 1);
+		std::vector<uint32> adjacency;
+		std::vector<uint8> touched(numVertices);
+		std::vector<uint32> remap(numVertices);
+
+		for (uint32 pass = 0; pass < MAX_SIMPLIFICATION_PASSES && outTriangles.size() > targetTriangles; ++pass)
+		{
+			uint32 currentTriangles = (uint32)outTriangles.size();
+
+			candidates.clear();
+			for (const indexed_triangle32& tri : outTriangles)
+			{
+				const uint32 v[3] = { tri.a, tri.b, tri.c };
+				for (uint32 e = 0; e < 3; ++e)
+				{
+					uint32 a = v[e];
+					uint32 b = v[(e + 1) % 3];
+					if (!locked[a]) { candidates.push_back({ a, b, quadrics[a].evaluate(positions[b]) }); }
+					if (!locked[b]) { candidates.push_back({ b, a, quadrics[b].evaluate(positions[a]) }); }
+				}
+			}
+
+			if (candidates.empty())
+			{
+				break;
+			}
+
+			std::sort(candidates.begin(), candidates.end(), [](const collapse& x, const collapse& y)
+			{
+				if (x.cost != y.cost) { return x.cost < y.cost; }
+				if (x.from != y.from) { return x.from < y.from; }
+				return x.to < y.to;
+			});
+
+			// Vertex -> triangle adjacency of the current triangle list, for the flip test.
+			std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+			for (const indexed_triangle32& tri : outTriangles)
+			{
+				++adjacencyOffsets[tri.a + 1];
+				++adjacencyOffsets[tri.b + 1];
+				++adjacencyOffsets[tri.c + 1];
+			}
+			for (uint32 v = 0; v < numVertices; ++v)
+			{
+				adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+			}
+			adjacency.resize(currentTriangles * 3);
+			{
+				std::vector<uint32> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+				for (uint32 t = 0; t < currentTriangles; ++t)
+				{
+					adjacency[cursor[outTriangles[t].a]++] = t;
+					adjacency[cursor[outTriangles[t].b]++] = t;
+					adjacency[cursor[outTriangles[t].c]++] = t;
+				}
+			}
+
+			std::fill(touched.begin(), touched.end(), 0);
+			for (uint32 v = 0; v < numVertices; ++v)
+			{
+				remap[v] = v;
+			}
+
+			// Each collapse removes about two triangles. Collapses in one pass must not share triangles, so the
+			// neighborhood of every collapsed vertex is frozen until the next pass.
+			uint32 neededCollapses = (currentTriangles - targetTriangles) / 2 + 1;
+			uint32 numCollapses = 0;
+
+			for (const collapse& c : candidates)
+			{
+				if (numCollapses >= neededCollapses || c.cost > maxCost)
+				{
+					break;
+				}
+				if (touched[c.from] || touched[c.to] || c.from == c.to)
+				{
+					continue;
+				}
+				if (skin && skin[c.from].skin_indices[0] != skin[c.to].skin_indices[0])
+				{
+					continue;
+				}
+
+				bool valid = true;
+				vec3 target = positions[c.to];
+				for (uint32 i = adjacencyOffsets[c.from]; i < adjacencyOffsets[c.from + 1] && valid; ++i)
+				{
+					const indexed_triangle32& tri = outTriangles[adjacency[i]];
+					if (tri.a == c.to || tri.b == c.to || tri.c == c.to)
+					{
+						continue;
+					}
+
+					vec3 p[3] = { positions[tri.a], positions[tri.b], positions[tri.c] };
+					vec3 before = triangleNormal(p[0], p[1], p[2]);
+
+					if (tri.a == c.from) { p[0] = target; }
+					if (tri.b == c.from) { p[1] = target; }
+					if (tri.c == c.from) { p[2] = target; }
+					vec3 after = triangleNormal(p[0], p[1], p[2]);
+
+					// Reject collapses which flip or strongly rotate a remaining triangle.
+					valid = dot(before, after) > 0.25f * length(before) * length(after);
+				}
+				if (!valid)
+				{
+					continue;
+				}
+
+				remap[c.from] = c.to;
+				quadrics[c.to].add(quadrics[c.from]);
+				resultCost = max(resultCost, c.cost);
+				++numCollapses;
+
+				for (uint32 i = adjacencyOffsets[c.from]; i < adjacencyOffsets[c.from + 1]; ++i)
+				{
+					const indexed_triangle32& tri = outTriangles[adjacency[i]];
+					touched[tri.a] = 1;
+					touched[tri.b] = 1;
+					touched[tri.c] = 1;
+				}
+			}
+
+			if (numCollapses == 0)
+			{
+				break;
+			}
+
+			uint32 writeIndex = 0;
+			for (uint32 t = 0; t < currentTriangles; ++t)
+			{
+				indexed_triangle32 tri = { remap[outTriangles[t].a], remap[outTriangles[t].b], remap[outTriangles[t].c] };
+				if (tri.a != tri.b && tri.b != tri.c && tri.a != tri.c)
+				{
+					outTriangles[writeIndex++] = tri;
+				}
+			}
+			outTriangles.resize(writeIndex);
+		}
+
+		return sqrt(resultCost);
+	}
+
+	void generateLods(SubmeshAsset& submesh, const lod_generation_options& options)
+	{
+		submesh.lods.clear();
+
+		uint32 numVertices = (uint32)submesh.positions.size();
+		uint32 numTriangles = (uint32)submesh.triangles.size();
+		if (numTriangles < options.min_triangles * 2)
+		{
+			return;
+		}
+
+		bounding_box aabb = bounding_box::negativeInfinity();
+		for (vec3 p : submesh.positions)
+		{
+			aabb.grow(p);
+		}
+		float maxError = options.max_error * length(aabb.maxCorner - aabb.minCorner);
+
+		const animation::SkinningWeights* skin = !submesh.skin.empty() ? submesh.skin.data() : nullptr;
+
+		const std::vector<indexed_triangle32>* source = &submesh.triangles;
+		float sourceError = 0.f;
+
+		for (float ratio : options.ratios)
+		{
+			uint32 target = max((uint32)(numTriangles * ratio), options.min_triangles);
+			if (target >= source->size())
+			{
+				continue;
+			}
+
+			SubmeshLodAsset lod;
+			float error = simplifyMesh(submesh.positions.data(), skin, numVertices, source->data(), (uint32)source->size(), target, maxError, lod.triangles);
+
+			if (lod.triangles.size() > (uint64)(source->size() * (1.f - options.min_reduction)))
+			{
+				// Stuck on locked vertices or the error bound. Coarser targets won't get further.
+				break;
+			}
+
+			// Errors of a chain accumulate, since every level is simplified from the previous one.
+			lod.error = sourceError + error;
+			sourceError = lod.error;
+
+			submesh.lods.push_back(std::move(lod));
+			source = &submesh.lods.back().triangles;
+		}
+	}
+
+	lod_generation_report generateModelLods(ModelAsset& model, const lod_generation_options& options)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		std::vector<SubmeshAsset*> submeshes;
+		for (MeshAsset& mesh : model.meshes)
+		{
+			for (SubmeshAsset& sub : mesh.submeshes)
+			{
+				submeshes.push_back(&sub);
+			}
+		}
+
+		parallel_for(low_priority_job_queue, (uint32)submeshes.size(), 1, [&](uint32 i)
+		{
+			generateLods(*submeshes[i], options);
+		});
+
+		lod_generation_report report;
+		for (SubmeshAsset* sub : submeshes)
+		{
+			if (report.levels.size() < sub->lods.size())
+			{
+				report.levels.resize(sub->lods.size());
+			}
+
+			bounding_box aabb = bounding_box::negativeInfinity();
+			for (vec3 p : sub->positions)
+			{
+				aabb.grow(p);
+			}
+			float extent = length(aabb.maxCorner - aabb.minCorner);
+
+			for (uint32 l = 0; l < (uint32)sub->lods.size(); ++l)
+			{
+				lod_report_level& level = report.levels[l];
+				++level.num_submeshes;
+				level.source_triangles += sub->triangles.size();
+				level.triangles += sub->lods[l].triangles.size();
+				level.max_relative_error = max(level.max_relative_error, (extent > 0.f) ? sub->lods[l].error / extent : 0.f);
+			}
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+		report.milliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+		return report;
+	}
+
+	void printLodReport(const lod_generation_report& report, const fs::path& path)
+	{
+		LOG_MESSAGE("Generated %u LOD levels for '%ws' in %.1f ms", (uint32)report.levels.size(), path.c_str(), report.milliseconds);
+		for (uint32 l = 0; l < (uint32)report.levels.size(); ++l)
+		{
+			const lod_report_level& level = report.levels[l];
+			float achieved = level.source_triangles ? (float)level.triangles / level.source_triangles : 0.f;
+			LOG_MESSAGE("  LOD %u: %u submeshes, %llu -> %llu triangles (%.1f%%), max error %.3f%% of extent",
+				l + 1, level.num_submeshes, level.source_triangles, level.triangles, achieved * 100.f, level.max_relative_error * 100.f);
+		}
+	}
+}
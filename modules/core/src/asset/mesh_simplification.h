@@ -0,0 +1,56 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#pragma once
+
+#include "core_api.h"
+
+#include "core/math.h"
+
+#include "asset/model_asset.h"
+
+namespace era_engine
+{
+	struct lod_generation_options
+	{
+		// Target triangle counts relative to LOD 0. Each level is simplified from the previous one.
+		std::vector<float> ratios = { 0.5f, 0.25f, 0.125f };
+
+		// Maximum geometric error, relative to the diagonal of the submesh's bounding box.
+		float max_error = 0.02f;
+
+		// Levels which remove less than this fraction of the previous level's triangles are dropped.
+		float min_reduction = 0.1f;
+
+		uint32 min_triangles = 64;
+	};
+
+	struct lod_report_level
+	{
+		uint32 num_submeshes = 0;
+		uint64 source_triangles = 0;	// LOD 0 triangles of the submeshes which have this level.
+		uint64 triangles = 0;
+		float max_relative_error = 0.f;
+	};
+
+	struct lod_generation_report
+	{
+		std::vector<lod_report_level> levels;
+		float milliseconds = 0.f;
+	};
+
+	// Quadric error metric edge collapse (Garland and Heckbert), restricted to half-edge collapses so the simplified
+	// index list still references the original vertices. Vertices on UV or normal seams (several vertices sharing a
+	// position), on open borders and on non-manifold edges are never removed, and collapses between vertices whose
+	// dominant joints differ are rejected.
+	// Returns the resulting geometric error in object space.
+	ERA_CORE_API float simplifyMesh(const vec3* positions, const animation::SkinningWeights* skin, uint32 numVertices,
+		const indexed_triangle32* triangles, uint32 numTriangles, uint32 targetTriangles, float maxError,
+		std::vector<indexed_triangle32>& outTriangles);
+
+	ERA_CORE_API void generateLods(SubmeshAsset& submesh, const lod_generation_options& options = {});
+
+	// Generates LOD chains for all submeshes in parallel. Runs while building the BIN cache.
+	ERA_CORE_API lod_generation_report generateModelLods(ModelAsset& model, const lod_generation_options& options = {});
+
+	ERA_CORE_API void printLodReport(const lod_generation_report& report, const fs::path& path);
+}
@@ -0,0 +1,290 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#include "asset/meshlet_builder.h"
+
+#include "core/job_system.h"
+#include "core/log.h"
+
+namespace era_engine
+{
+	static uint32 packPrimitive(uint32 a, uint32 b, uint32 c)
+	{
+		return a | (b << 10) | (c << 20);
+	}
+
+	static void unpackPrimitive(uint32 packed, uint32& a, uint32& b, uint32& c)
+	{
+		a = packed & 0x3FF;
+		b = (packed >> 10) & 0x3FF;
+		c = (packed >> 20) & 0x3FF;
+	}
+
+	struct meshlet_chunk
+	{
+		std::vector<MeshletAsset> meshlets;
+		std::vector<uint32> vertices;
+		std::vector<uint32> primitives;
+	};
+
+	// Greedy scan: triangles are appended to the current meshlet until one of the limits would be exceeded.
+	static void buildChunkMeshlets(const indexed_triangle32* triangles, uint32 numTriangles, uint32 maxVertices, uint32 maxPrimitives,
+		meshlet_chunk& out)
+	{
+		out.meshlets.reserve(numTriangles / maxPrimitives + 1);
+		out.vertices.reserve(numTriangles);
+		out.primitives.reserve(numTriangles);
+
+		MeshletAsset current = {};
+
+		auto findOrAdd = [&](uint32 vertex, uint32& numNew) -> uint32
+		{
+			const uint32* vertices = out.vertices.data() + current.first_vertex;
+			for (uint32 i = 0; i < current.num_vertices + numNew; ++i)
+			{
+				if (vertices[i] == vertex)
+				{
+					return i;
+				}
+			}
+			out.vertices.push_back(vertex);
+			return current.num_vertices + numNew++;
+		};
+
+		for (uint32 t = 0; t < numTriangles; ++t)
+		{
+			const indexed_triangle32& tri = triangles[t];
+
+			uint32 numNew = 0;
+			uint32 a = findOrAdd(tri.a, numNew);
+			uint32 b = findOrAdd(tri.b, numNew);
+			uint32 c = findOrAdd(tri.c, numNew);
+
+			if (current.num_vertices + numNew > maxVertices || current.num_primitives + 1 > maxPrimitives)
+			{
+				// Close the current meshlet and start a new one with this triangle.
+				out.vertices.resize(out.vertices.size() - numNew);
+				out.meshlets.push_back(current);
+
+				current = {};
+				current.first_vertex = (uint32)out.vertices.size();
+				current.first_primitive = (uint32)out.primitives.size();
+
+				numNew = 0;
+				a = findOrAdd(tri.a, numNew);
+				b = findOrAdd(tri.b, numNew);
+				c = findOrAdd(tri.c, numNew);
+			}
+
+			current.num_vertices += numNew;
+			++current.num_primitives;
+			out.primitives.push_back(packPrimitive(a, b, c));
+		}
+
+		if (current.num_primitives)
+		{
+			out.meshlets.push_back(current);
+		}
+	}
+
+	void computeMeshletBounds(MeshletAsset& meshlet, const vec3* positions, const uint32* meshletVertices, const uint32* meshletPrimitives)
+	{
+		const uint32* vertices = meshletVertices + meshlet.first_vertex;
+		const uint32* primitives = meshletPrimitives + meshlet.first_primitive;
+
+		// Sphere around the center of the bounding box. Slightly larger than optimal, but cheap and stable.
+		vec3 minCorner(FLT_MAX), maxCorner(-FLT_MAX);
+		for (uint32 i = 0; i < meshlet.num_vertices; ++i)
+		{
+			vec3 p = positions[vertices[i]];
+			minCorner = vec3(min(minCorner.x, p.x), min(minCorner.y, p.y), min(minCorner.z, p.z));
+			maxCorner = vec3(max(maxCorner.x, p.x), max(maxCorner.y, p.y), max(maxCorner.z, p.z));
+		}
+
+		vec3 center = (minCorner + maxCorner) * 0.5f;
+		float radiusSquared = 0.f;
+		for (uint32 i = 0; i < meshlet.num_vertices; ++i)
+		{
+			vec3 d = positions[vertices[i]] - center;
+			radiusSquared = max(radiusSquared, dot(d, d));
+		}
+
+		meshlet.center = center;
+		meshlet.radius = sqrt(radiusSquared);
+
+		// Normal cone from the area-weighted average of the face normals.
+		vec3 normals[meshlet_max_primitives];
+		vec3 axis(0.f);
+		uint32 numNormals = 0;
+		for (uint32 i = 0; i < meshlet.num_primitives && numNormals < meshlet_max_primitives; ++i)
+		{
+			uint32 a, b, c;
+			unpackPrimitive(primitives[i], a, b, c);
+
+			vec3 p0 = positions[vertices[a]];
+			vec3 n = cross(positions[vertices[b]] - p0, positions[vertices[c]] - p0);
+			float area = length(n);
+			if (area <= 0.f)
+			{
+				continue;
+			}
+
+			axis += n;
+			normals[numNormals++] = n * (1.f / area);
+		}
+
+		meshlet.cone_axis = vec3(0.f);
+		meshlet.cone_cutoff = 1.f;
+		meshlet.cone_apex = center;
+		meshlet.padding = 0;
+
+		float axisLength = length(axis);
+		if (numNormals == 0 || axisLength <= 0.f)
+		{
+			return;
+		}
+		axis *= 1.f / axisLength;
+
+		float minDot = 1.f;
+		for (uint32 i = 0; i < numNormals; ++i)
+		{
+			minDot = min(minDot, dot(normals[i], axis));
+		}
+
+		// Cones wider than ~85 degrees cull almost nothing.
+		if (minDot <= 0.1f)
+		{
+			return;
+		}
+
+		// Move the apex back along the axis until every triangle's plane is in front of it, so the test is conservative
+		// for any camera position.
+		float maxT = 0.f;
+		uint32 n = 0;
+		for (uint32 i = 0; i < meshlet.num_primitives && n < numNormals; ++i)
+		{
+			uint32 a, b, c;
+			unpackPrimitive(primitives[i], a, b, c);
+
+			vec3 p0 = positions[vertices[a]];
+			vec3 faceNormal = cross(positions[vertices[b]] - p0, positions[vertices[c]] - p0);
+			if (length(faceNormal) <= 0.f)
+			{
+				continue;
+			}
+			vec3 normal = normals[n++];
+
+			float dc = dot(center - p0, normal);
+			float dn = dot(axis, normal);
+			maxT = max(maxT, dc / dn);
+		}
+
+		meshlet.cone_axis = axis;
+		meshlet.cone_cutoff = sqrt(1.f - minDot * minDot);
+		meshlet.cone_apex = center - axis * maxT;
+	}
+
+	void buildMeshlets(SubmeshAsset& submesh, const meshlet_build_options& options)
+	{
+		submesh.meshlets.clear();
+		submesh.meshlet_vertices.clear();
+		submesh.meshlet_primitives.clear();
+
+		uint32 numTriangles = (uint32)submesh.triangles.size();
+		if (numTriangles == 0)
+		{
+			return;
+		}
+
+		uint32 maxVertices = min(max(options.max_vertices, 3u), 1024u);
+		uint32 maxPrimitives = min(max(options.max_primitives, 1u), meshlet_max_primitives);
+		uint32 chunkSize = max(options.chunk_size, maxPrimitives);
+		uint32 numChunks = (numTriangles + chunkSize - 1) / chunkSize;
+
+		std::vector<meshlet_chunk> chunks(numChunks);
+		parallel_for(low_priority_job_queue, numChunks, 1, [&](uint32 i)
+		{
+			uint32 first = i * chunkSize;
+			buildChunkMeshlets(submesh.triangles.data() + first, min(chunkSize, numTriangles - first), maxVertices, maxPrimitives, chunks[i]);
+		});
+
+		// Concatenate in chunk order.
+		uint64 numMeshlets = 0, numVertices = 0, numPrimitives = 0;
+		for (const meshlet_chunk& chunk : chunks)
+		{
+			numMeshlets += chunk.meshlets.size();
+			numVertices += chunk.vertices.size();
+			numPrimitives += chunk.primitives.size();
+		}
+
+		submesh.meshlets.reserve(numMeshlets);
+		submesh.meshlet_vertices.reserve(numVertices);
+		submesh.meshlet_primitives.reserve(numPrimitives);
+
+		for (const meshlet_chunk& chunk : chunks)
+		{
+			uint32 vertexOffset = (uint32)submesh.meshlet_vertices.size();
+			uint32 primitiveOffset = (uint32)submesh.meshlet_primitives.size();
+
+			for (MeshletAsset meshlet : chunk.meshlets)
+			{
+				meshlet.first_vertex += vertexOffset;
+				meshlet.first_primitive += primitiveOffset;
+				submesh.meshlets.push_back(meshlet);
+			}
+			submesh.meshlet_vertices.insert(submesh.meshlet_vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+			submesh.meshlet_primitives.insert(submesh.meshlet_primitives.end(), chunk.primitives.begin(), chunk.primitives.end());
+		}
+
+		parallel_for(low_priority_job_queue, (uint32)submesh.meshlets.size(), 256, [&](uint32 i)
+		{
+			computeMeshletBounds(submesh.meshlets[i], submesh.positions.data(), submesh.meshlet_vertices.data(), submesh.meshlet_primitives.data());
+		});
+	}
+
+	meshlet_build_report buildModelMeshlets(ModelAsset& model, const meshlet_build_options& options)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+
+		std::vector<SubmeshAsset*> submeshes;
+		for (MeshAsset& mesh : model.meshes)
+		{
+			for (SubmeshAsset& sub : mesh.submeshes)
+			{
+				submeshes.push_back(&sub);
+			}
+		}
+
+		parallel_for(low_priority_job_queue, (uint32)submeshes.size(), 1, [&](uint32 i)
+		{
+			buildMeshlets(*submeshes[i], options);
+		});
+
+		meshlet_build_report report;
+		report.num_submeshes = (uint32)submeshes.size();
+		for (SubmeshAsset* sub : submeshes)
+		{
+			report.num_triangles += sub->triangles.size();
+			report.num_meshlets += sub->meshlets.size();
+			report.num_meshlet_vertices += sub->meshlet_vertices.size();
+			for (const MeshletAsset& meshlet : sub->meshlets)
+			{
+				report.num_culling_cones += (meshlet.cone_cutoff < 1.f);
+			}
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+		report.milliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+		return report;
+	}
+
+	void printMeshletReport(const meshlet_build_report& report, const fs::path& path)
+	{
+		float trianglesPerMeshlet = report.num_meshlets ? (float)report.num_triangles / report.num_meshlets : 0.f;
+		float verticesPerMeshlet = report.num_meshlets ? (float)report.num_meshlet_vertices / report.num_meshlets : 0.f;
+		float coneRatio = report.num_meshlets ? (float)report.num_culling_cones / report.num_meshlets : 0.f;
+
+		LOG_MESSAGE("Built %llu meshlets for '%ws' in %.1f ms (%.1f triangles, %.1f vertices per meshlet, %.0f%% with normal cones)",
+			report.num_meshlets, path.c_str(), report.milliseconds, trianglesPerMeshlet, verticesPerMeshlet, coneRatio * 100.f);
+	}
+}
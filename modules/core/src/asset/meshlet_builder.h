@@ -0,0 +1,50 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#pragma once
+
+#include "core_api.h"
+
+#include "core/math.h"
+
+#include "asset/model_asset.h"
+
+namespace era_engine
+{
+	struct meshlet_build_options
+	{
+		uint32 max_vertices = meshlet_max_vertices;
+		uint32 max_primitives = meshlet_max_primitives;
+
+		// Triangles are split into chunks of this size which are clustered in parallel. Meshlets never cross chunk
+		// boundaries, so the result does not depend on the number of worker threads.
+		uint32 chunk_size = 1 << 16;
+	};
+
+	struct meshlet_build_report
+	{
+		uint32 num_submeshes = 0;
+		uint64 num_triangles = 0;
+		uint64 num_meshlets = 0;
+		uint64 num_meshlet_vertices = 0;
+		uint64 num_culling_cones = 0;	// Meshlets with a usable backface cone.
+		float milliseconds = 0.f;
+	};
+
+	// Clusters the triangles in their current order, so run this after optimizeVertexCache, which makes consecutive
+	// triangles share vertices.
+	ERA_CORE_API void buildMeshlets(SubmeshAsset& submesh, const meshlet_build_options& options = {});
+
+	// Computes the bounding sphere and normal cone of a meshlet from its vertices and primitives.
+	ERA_CORE_API void computeMeshletBounds(MeshletAsset& meshlet, const vec3* positions, const uint32* meshletVertices, const uint32* meshletPrimitives);
+
+	NODISCARD inline bool isMeshletBackfacing(const MeshletAsset& meshlet, vec3 cameraPosition)
+	{
+		vec3 direction = meshlet.cone_apex - cameraPosition;
+		return dot(direction, meshlet.cone_axis) >= meshlet.cone_cutoff * length(direction);
+	}
+
+	// Builds meshlets for all submeshes. Runs while building the BIN cache, after optimizeModel.
+	ERA_CORE_API meshlet_build_report buildModelMeshlets(ModelAsset& model, const meshlet_build_options& options = {});
+
+	ERA_CORE_API void printMeshletReport(const meshlet_build_report& report, const fs::path& path);
+}
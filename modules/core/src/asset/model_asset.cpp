@@ -2,38 +2,50 @@
 
 #include "asset/bin.h"
 #include "asset/model_asset.h"
+#include "asset/asset_cache.h"
+#include "asset/mesh_optimization.h"
+#include "asset/mesh_simplification.h"
+#include "asset/meshlet_builder.h"
 #include "core/log.h"
 
 #include "rendering/pbr_material.h"
 
 namespace era_engine
 {
-	ModelAsset load_3d_model_from_file(const fs::path& path, uint32 meshFlags)
+	// Bump whenever the FBX/OBJ importers or the BIN writer change their output, so stale cache entries are not reused.
+	static constexpr uint32 MODEL_IMPORTER_VERSION = 6;
+
+	uint64 get_model_cache_key(const fs::path& path, uint32 meshFlags)
 	{
-		if (!fs::exists(path))
-		{
-			LOG_WARNING("Could not find file '%ws'", path.c_str());
-			std::cerr << "Could not find file '" << path << "'.\n";
-			return {};
-		}
+		return get_model_cache_key_for_content(hash_file_content(path), meshFlags);
+	}
 
-		std::string extension = path.extension().string();
+	uint64 get_model_cache_key_for_content(uint64 contentHash, uint32 meshFlags)
+	{
+		return contentHash ? get_asset_cache_key(contentHash, meshFlags, MODEL_IMPORTER_VERSION) : 0;
+	}
 
-		fs::path cachedFilename = path;
-		cachedFilename.replace_extension("." + std::to_string(meshFlags) + ".cache.bin");
-		fs::path cacheFilepath = L"asset_cache" / cachedFilename;
+	ModelAsset import_model_asset(const fs::path& path, uint32 meshFlags)
+	{
+		ModelAsset result;
 
-		if (fs::exists(cacheFilepath))
+		std::string extension = path.extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(),
+			[](char c) { return std::tolower(c); });
+		if (extension == ".fbx")
 		{
-			auto lastCacheWriteTime = fs::last_write_time(cacheFilepath);
-			auto lastOriginalWriteTime = fs::last_write_time(path);
-
-			if (lastCacheWriteTime > lastOriginalWriteTime)
-			{
-				return loadBIN(cacheFilepath);
-			}
+			result = loadFBX(path, meshFlags);
+		}
+		else if (extension == ".obj")
+		{
+			result = loadOBJ(path, meshFlags);
 		}
 
+		return result;
+	}
+
+	static ModelAsset import_and_cache(const fs::path& path, uint64 cacheKey, uint32 meshFlags)
+	{
 		LOG_MESSAGE("Preprocessing asset '%ws' for faster loading next time", path.c_str());
 		std::cout << "Preprocessing asset '" << path << "' for faster loading next time.";
 #ifdef _DEBUG
@@ -41,22 +53,65 @@ namespace era_engine
 #endif
 		std::cout << '\n';
 
-		ModelAsset result;
+		ModelAsset result = import_model_asset(path, meshFlags);
+		printLodReport(generateModelLods(result), path);
+		printOptimizationReport(optimizeModel(result), path);
+		printMeshletReport(buildModelMeshlets(result), path);
 
-		std::transform(extension.begin(), extension.end(), extension.begin(),
-			[](char c) { return std::tolower(c); });
-		if (extension == ".fbx")
+		if (cacheKey)
 		{
-			result = loadFBX(path, meshFlags);
+			fs::path tempPath = begin_asset_cache_entry(cacheKey, model_cache_extension);
+			writeBIN(result, tempPath);
+			commit_asset_cache_entry(tempPath, cacheKey, model_cache_extension);
 		}
-		else if (extension == ".obj")
+
+		return result;
+	}
+
+	ModelAsset load_3d_model_from_file(const fs::path& path, uint32 meshFlags)
+	{
+		if (!fs::exists(path))
 		{
-			result = loadOBJ(path, meshFlags);
+			LOG_WARNING("Could not find file '%ws'", path.c_str());
+			std::cerr << "Could not find file '" << path << "'.\n";
+			return {};
 		}
 
-		fs::create_directories(cacheFilepath.parent_path());
-		writeBIN(result, cacheFilepath);
+		uint64 cacheKey = get_model_cache_key(path, meshFlags);
 
-		return result;
+		fs::path cacheFilepath;
+		if (cacheKey && find_asset_cache_entry(cacheKey, model_cache_extension, cacheFilepath))
+		{
+			return loadBIN(cacheFilepath);
+		}
+
+		return import_and_cache(path, cacheKey, meshFlags);
+	}
+
+	bool load_3d_model_view_from_file(const fs::path& path, BinModelView& out, uint32 meshFlags)
+	{
+		if (!fs::exists(path))
+		{
+			LOG_WARNING("Could not find file '%ws'", path.c_str());
+			std::cerr << "Could not find file '" << path << "'.\n";
+			return false;
+		}
+
+		uint64 cacheKey = get_model_cache_key(path, meshFlags);
+		if (!cacheKey)
+		{
+			LOG_WARNING("Could not read file '%ws'", path.c_str());
+			return false;
+		}
+
+		// Corrupt entries are simply rebuilt.
+		fs::path cacheFilepath;
+		if (find_asset_cache_entry(cacheKey, model_cache_extension, cacheFilepath) && mapBIN(cacheFilepath, out))
+		{
+			return true;
+		}
+
+		import_and_cache(path, cacheKey, meshFlags);
+		return mapBIN(get_asset_cache_path(cacheKey, model_cache_extension), out);
 	}
-}
\ No newline at end of file
+}
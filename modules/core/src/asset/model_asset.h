@@ -34,6 +34,36 @@ namespace era_engine
 		std::vector<vec3> scale_keyframes;
 	};
 
+	// Coarser index list over the same vertices as LOD 0.
+	struct ERA_CORE_API SubmeshLodAsset
+	{
+		std::vector<indexed_triangle32> triangles;
+		float error; // Object space.
+	};
+
+	// Cluster of at most meshlet_max_vertices vertices and meshlet_max_primitives triangles of LOD 0. The first four
+	// members match the meshlet layout consumed by the mesh shader pipeline.
+	struct ERA_CORE_API MeshletAsset
+	{
+		uint32 num_vertices;
+		uint32 first_vertex;		// Into SubmeshAsset::meshlet_vertices.
+		uint32 num_primitives;
+		uint32 first_primitive;		// Into SubmeshAsset::meshlet_primitives.
+
+		vec3 center;
+		float radius;
+
+		// Backface cone: the whole meshlet faces away from the camera if dot(normalize(cone_apex - camera), cone_axis) >= cone_cutoff.
+		// A cutoff of 1 disables the test.
+		vec3 cone_axis;
+		float cone_cutoff;
+		vec3 cone_apex;
+		uint32 padding;
+	};
+
+	static constexpr uint32 meshlet_max_vertices = 64;
+	static constexpr uint32 meshlet_max_primitives = 126;
+
 	struct ERA_CORE_API SubmeshAsset
 	{
 		int32 material_index;
@@ -45,7 +75,14 @@ namespace era_engine
 		std::vector<uint32> colors;
 		std::vector<animation::SkinningWeights> skin;
 
-		std::vector<indexed_triangle16> triangles;
+		// Indices are 32 bit during import. The BIN writer narrows them to 16 bit where possible.
+		std::vector<indexed_triangle32> triangles;
+
+		std::vector<SubmeshLodAsset> lods; // LOD 1 and up, ordered from fine to coarse.
+
+		std::vector<MeshletAsset> meshlets;
+		std::vector<uint32> meshlet_vertices;		// Submesh vertex indices.
+		std::vector<uint32> meshlet_primitives;		// Three 10-bit indices into the meshlet's vertices.
 	};
 
 	struct ERA_CORE_API MeshAsset
@@ -76,6 +113,8 @@ namespace era_engine
 		mesh_flag_gen_tangents = (1 << 5), // Only if mesh has no tangents.
 		mesh_flag_load_colors = (1 << 6), // Only if mesh has no tangents.
 		mesh_flag_load_skin = (1 << 7),
+		mesh_flag_angle_weighted_normals = (1 << 8), // Generated normals weight faces by corner angle instead of area.
+		mesh_flag_mikktspace_tangents = (1 << 9), // Generated tangents follow MikkTSpace (angle weighted, projected per vertex).
 
 		mesh_flag_default = mesh_flag_load_uvs | mesh_flag_flip_uvs_vertically |
 		mesh_flag_load_normals | mesh_flag_gen_normals |
@@ -83,8 +122,25 @@ namespace era_engine
 		mesh_flag_load_colors | mesh_flag_load_skin,
 	};
 
+	struct BinModelView;
+
+	// Extension of model entries in the asset cache.
+	inline constexpr const char* model_cache_extension = ".bin";
+
+	// Runs the FBX/OBJ importer without touching the asset cache.
+	ERA_CORE_API ModelAsset import_model_asset(const fs::path& path, uint32 mesh_flags = mesh_flag_default);
+
+	// Key of the content-addressed cache entry for this source file (see asset/asset_cache.h). 0 if the file cannot be read.
+	ERA_CORE_API uint64 get_model_cache_key(const fs::path& path, uint32 mesh_flags = mesh_flag_default);
+
+	// Same key for an already known content hash, e.g. one recorded by a previous build.
+	ERA_CORE_API uint64 get_model_cache_key_for_content(uint64 content_hash, uint32 mesh_flags = mesh_flag_default);
+
 	ERA_CORE_API ModelAsset load_3d_model_from_file(const fs::path& path, uint32 mesh_flags = mesh_flag_default);
 
+	// Same as above, but maps the BIN cache instead of copying it into a ModelAsset. Imports and writes the cache first if necessary.
+	ERA_CORE_API bool load_3d_model_view_from_file(const fs::path& path, BinModelView& out, uint32 mesh_flags = mesh_flag_default);
+
 	inline bool is_mesh_extension(const fs::path& extension)
 	{
 		return extension == ".fbx" || extension == ".obj" || extension == ".bin";
@@ -9,12 +9,15 @@
 #include "core/math.h"
 #include "core/cpu_profiling.h"
 #include "core/bounding_volumes.h"
+#include "core/job_system.h"
 
 #include "geometry/mesh.h"
 
 //#define PROFILE(name) CPU_PRINT_PROFILE_BLOCK(name)
 #define PROFILE(name) 
 
+#include <charconv>
+
 namespace era_engine
 {
 	static bool is_end_of_line(char c)
@@ -92,43 +95,62 @@ namespace era_engine
 		return result;
 	}
 
+	// std::from_chars does not allocate, does not depend on the locale and does not need a null terminator. Parsing to
+	// double and then rounding to float gives the same result as (float)atof. Tokens which from_chars does not consume
+	// completely (leading '+', hex floats, trailing garbage, out of range values) are handed to atof so the result still
+	// matches it exactly.
+	static float parse_float(const char* begin, const char* end)
+	{
+		double value = 0.0;
+		auto [ptr, ec] = std::from_chars(begin, end, value);
+		if (ec != std::errc() || ptr != end)
+		{
+			value = atof(std::string(begin, end).c_str());
+		}
+		return (float)value;
+	}
+
+	static int32 parse_int32(const char* begin, const char* end)
+	{
+		int32 value = 0;
+		auto [ptr, ec] = std::from_chars(begin, end, value);
+		if (ec != std::errc() || ptr != end)
+		{
+			value = atoi(std::string(begin, end).c_str());
+		}
+		return value;
+	}
+
+	// Tokens are not null terminated, and the last one may end exactly at the end of the mapped file.
 	static int32 read_int32(EntireFile& file)
 	{
 		sized_string str = read_string(file);
-		return atoi(str.str);
+		return parse_int32(str.str, str.str + str.length);
 	}
 
-	static vec3 read_vec3(EntireFile& file)
+	static float read_float(EntireFile& file)
 	{
-		sized_string xStr = read_string(file);
-		sized_string yStr = read_string(file);
-		sized_string zStr = read_string(file);
+		sized_string str = read_string(file);
+		return parse_float(str.str, str.str + str.length);
+	}
 
-		float x = (float)atof(xStr.str);
-		float y = (float)atof(yStr.str);
-		float z = (float)atof(zStr.str);
+	static vec3 read_vec3(EntireFile& file)
+	{
+		float x = read_float(file);
+		float y = read_float(file);
+		float z = read_float(file);
 
 		return vec3(x, y, z);
 	}
 
 	static vec2 read_vec2(EntireFile& file)
 	{
-		sized_string xStr = read_string(file);
-		sized_string yStr = read_string(file);
-
-		float x = (float)atof(xStr.str);
-		float y = (float)atof(yStr.str);
+		float x = read_float(file);
+		float y = read_float(file);
 
 		return vec2(x, y);
 	}
 
-	static float read_float(EntireFile& file)
-	{
-		sized_string str = read_string(file);
-		float v = (float)atof(str.str);
-		return v;
-	}
-
 	struct obj_vertex_indices
 	{
 		int32 position_index;
@@ -154,9 +176,11 @@ namespace era_engine
 			}
 		}
 
-		int32 position_index = index_strs[0].length ? atoi(index_strs[0].str) : 0;
-		int32 uv_index = index_strs[1].length ? atoi(index_strs[1].str) : 0;
-		int32 normal_index = index_strs[2].length ? atoi(index_strs[2].str) : 0;
+		auto parse_index = [](sized_string str) { return str.length ? parse_int32(str.str, str.str + str.length) : 0; };
+
+		int32 position_index = parse_index(index_strs[0]);
+		int32 uv_index = parse_index(index_strs[1]);
+		int32 normal_index = parse_index(index_strs[2]);
 
 		if (position_index > 0)
 		{
@@ -309,162 +333,621 @@ namespace era_engine
 		return result;
 	}
 
-	ModelAsset loadOBJ(const fs::path& path, uint32 flags)
+	// Everything the OBJ parsers produce. Welding and normal generation run on this afterwards.
+	struct obj_geometry
 	{
-		PROFILE("Loading OBJ");
+		std::vector<PbrMaterialDesc> materials;
+		std::unordered_map<int32, per_material> material_to_mesh;
 
-		EntireFile file = load_file(path);
+		// Attributes per face corner. Faces only record corner ranges, welding happens once per material at the end.
+		std::vector<vec3> corner_positions;
+		std::vector<vec2> corner_uvs;
+		std::vector<vec3> corner_normals;
+	};
+
+	static void parse_obj_serial(EntireFile& file, const fs::path& path, uint32 flags, obj_geometry& out)
+	{
+		PROFILE("Parse OBJ");
 
 		std::vector<vec3> positions; positions.reserve(1 << 16);
 		std::vector<vec2> uvs; uvs.reserve(1 << 16);
 		std::vector<vec3> normals; normals.reserve(1 << 16);
 
-		std::vector<PbrMaterialDesc> materials;
+		std::vector<PbrMaterialDesc>& materials = out.materials;
 		std::unordered_map<std::string, int32> name_to_material_index;
 		int32 current_material_index = 0;
 
-		std::vector<SubmeshAsset> submeshes;
+		std::unordered_map<int32, per_material>& material_to_mesh = out.material_to_mesh;
 
-		std::unordered_map<int32, per_material> material_to_mesh;
-
-		std::vector<vec3> position_cache; position_cache.reserve(16);
-		std::vector<vec2> uv_cache; uv_cache.reserve(16);
-		std::vector<vec3> normal_cache; normal_cache.reserve(16);
+		std::vector<vec3>& corner_positions = out.corner_positions; corner_positions.reserve(1 << 16);
+		std::vector<vec2>& corner_uvs = out.corner_uvs; corner_uvs.reserve((flags & mesh_flag_load_uvs) ? (1 << 16) : 0);
+		std::vector<vec3>& corner_normals = out.corner_normals; corner_normals.reserve((flags & mesh_flag_load_normals) ? (1 << 16) : 0);
 
+		while (file.read_offset < file.size)
 		{
-			PROFILE("Parse OBJ");
+			sized_string token = read_string(file);
 
-			while (file.read_offset < file.size)
+			if (token == "mtllib")
 			{
-				sized_string token = read_string(file);
+				sized_string lib = read_string(file);
+				auto lib_materials = load_material_library(relative_filepath(lib, path));
+				for (auto& [name, mat] : lib_materials)
+				{
+					name_to_material_index[std::move(name)] = (int32)materials.size();
+					materials.push_back(std::move(mat));
+				}
+			}
+			else if (token == "v")
+			{
+				positions.push_back(read_vec3(file));
+			}
+			else if (token == "vn")
+			{
+				normals.push_back(read_vec3(file));
+			}
+			else if (token == "vt")
+			{
+				vec2 uv = read_vec2(file);
+				if (flags & mesh_flag_flip_uvs_vertically)
+				{
+					uv.y = 1.f - uv.y;
+				}
+				uvs.push_back(uv);
+			}
+			else if (token == "g")
+			{
+				sized_string name = read_string(file);
+			}
+			else if (token == "o")
+			{
+				sized_string name = read_string(file);
+			}
+			else if (token == "s")
+			{
+				int32 smoothing = read_int32(file);
+			}
+			else if (token == "usemtl")
+			{
+				sized_string mtl = read_string(file);
+				std::string name = name_to_string(mtl);
 
-				if (token == "mtllib")
+				auto it = name_to_material_index.find(name);
+				if (it != name_to_material_index.end())
 				{
-					sized_string lib = read_string(file);
-					auto lib_materials = load_material_library(relative_filepath(lib, path));
-					for (auto& [name, mat] : lib_materials)
+					current_material_index = it->second;
+				}
+				else
+				{
+					printf("Unrecognized material '%.*s'\n", mtl.length, mtl.str);
+				}
+			}
+			else if (token == "f")
+			{
+				int32 face_size = 0;
+				int32 first_corner = (int32)corner_positions.size();
+				while (file.read_offset < file.size && !is_end_of_line((char)file.content[file.read_offset]))
+				{
+					sized_string vertex_str = read_string(file, false);
+					if (vertex_str.length == 0)
 					{
-						name_to_material_index[std::move(name)] = (int32)materials.size();
-						materials.push_back(std::move(mat));
+						break;
 					}
+
+					obj_vertex_indices vertex_indices = read_vertex_indices(vertex_str);
+
+					int32 curr_num_positions = (int32)positions.size();
+					vertex_indices.position_index += (vertex_indices.position_index >= 0) ? 0 : curr_num_positions;
+					ASSERT(vertex_indices.position_index < curr_num_positions);
+					corner_positions.push_back(positions[vertex_indices.position_index]);
+
+					if (flags & mesh_flag_load_uvs)
+					{
+						int32 curr_num_uvs = (int32)uvs.size();
+						vertex_indices.uv_index += (vertex_indices.uv_index >= 0) ? 0 : curr_num_uvs;
+						ASSERT(vertex_indices.uv_index < curr_num_uvs);
+						corner_uvs.push_back(uvs[vertex_indices.uv_index]);
+					}
+
+					if (flags & mesh_flag_load_normals)
+					{
+						int32 curr_num_normals = (int32)normals.size();
+						vertex_indices.normal_index += (vertex_indices.normal_index >= 0) ? 0 : curr_num_normals;
+						ASSERT(vertex_indices.normal_index < curr_num_normals);
+						corner_normals.push_back(normals[vertex_indices.normal_index]);
+					}
+
+					++face_size;
 				}
-				else if (token == "v")
+
+				per_material& per_mat = material_to_mesh[current_material_index];
+				per_mat.material_index = current_material_index;
+				per_mat.addTriangles(first_corner, face_size);
+			}
+			else if (token.length == 0)
+			{
+				// Nothing
+			}
+			else
+			{
+				printf("Unrecognized start token '%.*s'\n", token.length, token.str);
+			}
+
+			discard_line(file);
+		}
+	}
+
+	// Parallel parser. The file is split into line-aligned chunks which are parsed independently. Everything which
+	// depends on the preceding chunks (relative indices, material libraries, the current material) is resolved while
+	// merging, in file order, so the result is identical to parse_obj_serial.
+	// Statements are only accepted if all their arguments are on the same line. The serial parser would continue on the
+	// next line in that case, so such files are rejected here and parsed serially instead.
+
+	static constexpr uint64 OBJ_CHUNK_SIZE = 1 << 20;
+
+	// Negative OBJ indices are relative to the number of elements read so far. Within a chunk they are stored relative
+	// to the chunk's first element and made absolute in the merge.
+	enum obj_relative_index
+	{
+		obj_relative_position = (1 << 0),
+		obj_relative_uv = (1 << 1),
+		obj_relative_normal = (1 << 2),
+	};
+
+	struct obj_corner
+	{
+		int32 position;
+		int32 uv;
+		int32 normal;
+		uint32 relative;
+	};
+
+	enum obj_statement_type
+	{
+		obj_statement_mtllib,
+		obj_statement_usemtl,
+		obj_statement_unrecognized,
+	};
+
+	// Statements which have to be executed in file order. 'first_face' is the number of faces in the chunk before it.
+	struct obj_statement
+	{
+		obj_statement_type type;
+		uint32 first_face;
+		sized_string argument;
+	};
+
+	struct obj_chunk
+	{
+		const char* begin;
+		const char* end;
+
+		std::vector<vec3> positions;
+		std::vector<vec2> uvs;
+		std::vector<vec3> normals;
+
+		std::vector<obj_corner> corners;
+		std::vector<uint32> face_sizes;
+		std::vector<obj_statement> statements;
+
+		bool valid = true;
+
+		// Set in the merge.
+		uint32 first_position = 0;
+		uint32 first_uv = 0;
+		uint32 first_normal = 0;
+		uint32 first_corner = 0;
+		std::vector<std::pair<uint32, int32>> material_ranges; // First face, material index.
+		std::unordered_map<int32, per_material> material_to_mesh;
+	};
+
+	struct obj_line
+	{
+		const char* p;
+		const char* end; // Position of the '\n' or the end of the chunk.
+
+		// Same as read_string, but returns an empty string instead of continuing on the next line.
+		sized_string next_token()
+		{
+			while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			{
+				++p;
+			}
+			if (p == end || *p == '#')
+			{
+				return {};
+			}
+			return read_token();
+		}
+
+		// Same as read_string with allow_line_skip == false. Stops at '\r' like the face loop of the serial parser.
+		sized_string next_face_token()
+		{
+			while (p < end && is_white_space_no_end_of_line(*p))
+			{
+				++p;
+			}
+			if (p == end || *p == '\r')
+			{
+				return {};
+			}
+			return read_token();
+		}
+
+		sized_string read_token()
+		{
+			const char* begin = p;
+			while (p < end && !is_whitespace(*p))
+			{
+				++p;
+			}
+			return sized_string(begin, (uint32)(p - begin));
+		}
+
+		bool read_floats(float* out, uint32 count)
+		{
+			for (uint32 i = 0; i < count; ++i)
+			{
+				sized_string token = next_token();
+				if (token.length == 0)
 				{
-					positions.push_back(read_vec3(file));
+					return false;
 				}
-				else if (token == "vn")
+				out[i] = parse_float(token.str, token.str + token.length);
+			}
+			return true;
+		}
+	};
+
+	static void parse_obj_chunk(obj_chunk& chunk, uint32 flags)
+	{
+		const char* p = chunk.begin;
+		while (p < chunk.end)
+		{
+			const char* line_end = (const char*)memchr(p, '\n', chunk.end - p);
+			if (!line_end)
+			{
+				line_end = chunk.end;
+			}
+
+			obj_line line = { p, line_end };
+			p = (line_end < chunk.end) ? line_end + 1 : line_end;
+
+			sized_string token = line.next_token();
+			if (token.length == 0)
+			{
+				// Empty line or comment.
+				continue;
+			}
+
+			bool valid = true;
+			if (token == "v" || token == "vn")
+			{
+				vec3 v;
+				valid = line.read_floats(v.data, 3);
+				(token.length == 1 ? chunk.positions : chunk.normals).push_back(v);
+			}
+			else if (token == "vt")
+			{
+				vec2 uv;
+				valid = line.read_floats(uv.data, 2);
+				if (flags & mesh_flag_flip_uvs_vertically)
 				{
-					normals.push_back(read_vec3(file));
+					uv.y = 1.f - uv.y;
 				}
-				else if (token == "vt")
+				chunk.uvs.push_back(uv);
+			}
+			else if (token == "g" || token == "o" || token == "s")
+			{
+				valid = line.next_token().length != 0;
+			}
+			else if (token == "mtllib" || token == "usemtl")
+			{
+				sized_string argument = line.next_token();
+				valid = argument.length != 0;
+				chunk.statements.push_back({ (token == "mtllib") ? obj_statement_mtllib : obj_statement_usemtl, (uint32)chunk.face_sizes.size(), argument });
+			}
+			else if (token == "f")
+			{
+				uint32 face_size = 0;
+				for (sized_string vertex_str = line.next_face_token(); vertex_str.length; vertex_str = line.next_face_token())
 				{
-					vec2 uv = read_vec2(file);
-					if (flags & mesh_flag_flip_uvs_vertically)
+					obj_vertex_indices indices = read_vertex_indices(vertex_str);
+
+					obj_corner corner = { indices.position_index, indices.uv_index, indices.normal_index, 0 };
+					if (corner.position < 0)
+					{
+						corner.position += (int32)chunk.positions.size();
+						corner.relative |= obj_relative_position;
+					}
+					if (corner.uv < 0)
+					{
+						corner.uv += (int32)chunk.uvs.size();
+						corner.relative |= obj_relative_uv;
+					}
+					if (corner.normal < 0)
 					{
-						uv.y = 1.f - uv.y;
+						corner.normal += (int32)chunk.normals.size();
+						corner.relative |= obj_relative_normal;
 					}
-					uvs.push_back(uv);
+					chunk.corners.push_back(corner);
+					++face_size;
 				}
-				else if (token == "g")
+				chunk.face_sizes.push_back(face_size);
+			}
+			else
+			{
+				chunk.statements.push_back({ obj_statement_unrecognized, (uint32)chunk.face_sizes.size(), token });
+			}
+
+			if (!valid)
+			{
+				chunk.valid = false;
+				return;
+			}
+		}
+	}
+
+	template <typename T_>
+	static bool gather_corner_attribute(const std::vector<T_>& values, int32 index, bool relative, uint32 chunk_first, T_& out)
+	{
+		int64 absolute = (int64)index + (relative ? chunk_first : 0);
+		if (absolute < 0 || absolute >= (int64)values.size())
+		{
+			return false;
+		}
+		out = values[absolute];
+		return true;
+	}
+
+	static bool parse_obj_parallel(const EntireFile& file, const fs::path& path, uint32 flags, obj_geometry& out)
+	{
+		PROFILE("Parse OBJ (parallel)");
+
+		const char* file_begin = (const char*)file.content;
+		const char* file_end = file_begin + file.size;
+
+		uint32 num_chunks = (uint32)max((file.size + OBJ_CHUNK_SIZE - 1) / OBJ_CHUNK_SIZE, (uint64)1);
+		std::vector<obj_chunk> chunks(num_chunks);
+
+		const char* chunk_begin = file_begin;
+		for (uint32 i = 0; i < num_chunks; ++i)
+		{
+			const char* chunk_end = file_end;
+			if (i + 1 < num_chunks)
+			{
+				const char* target = max(file_begin + (i + 1) * OBJ_CHUNK_SIZE, chunk_begin);
+				const char* new_line = (const char*)memchr(target, '\n', file_end - target);
+				chunk_end = new_line ? new_line + 1 : file_end;
+			}
+			chunks[i].begin = chunk_begin;
+			chunks[i].end = chunk_end;
+			chunk_begin = chunk_end;
+		}
+
+		parallel_for(low_priority_job_queue, num_chunks, 1, [&](uint32 i)
+		{
+			parse_obj_chunk(chunks[i], flags);
+		});
+
+		uint64 num_positions = 0, num_uvs = 0, num_normals = 0, num_corners = 0;
+		for (obj_chunk& chunk : chunks)
+		{
+			if (!chunk.valid)
+			{
+				return false;
+			}
+
+			chunk.first_position = (uint32)num_positions;
+			chunk.first_uv = (uint32)num_uvs;
+			chunk.first_normal = (uint32)num_normals;
+			chunk.first_corner = (uint32)num_corners;
+
+			num_positions += chunk.positions.size();
+			num_uvs += chunk.uvs.size();
+			num_normals += chunk.normals.size();
+			num_corners += chunk.corners.size();
+		}
+
+		if (max(max(num_positions, num_uvs), max(num_normals, num_corners)) > INT32_MAX)
+		{
+			return false;
+		}
+
+		std::vector<vec3> positions(num_positions);
+		std::vector<vec2> uvs(num_uvs);
+		std::vector<vec3> normals(num_normals);
+
+		parallel_for(low_priority_job_queue, num_chunks, 1, [&](uint32 i)
+		{
+			const obj_chunk& chunk = chunks[i];
+			std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.first_position);
+			std::copy(chunk.uvs.begin(), chunk.uvs.end(), uvs.begin() + chunk.first_uv);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.first_normal);
+		});
+
+		bool load_uvs = (flags & mesh_flag_load_uvs) != 0;
+		bool load_normals = (flags & mesh_flag_load_normals) != 0;
+
+		out.corner_positions.resize(num_corners);
+		out.corner_uvs.resize(load_uvs ? num_corners : 0);
+		out.corner_normals.resize(load_normals ? num_corners : 0);
+
+		// Indices which the serial parser would read out of bounds (it asserts) send the file down the serial path.
+		std::atomic<bool> indices_valid = true;
+		parallel_for(low_priority_job_queue, num_chunks, 1, [&](uint32 i)
+		{
+			const obj_chunk& chunk = chunks[i];
+			for (uint32 c = 0; c < (uint32)chunk.corners.size(); ++c)
+			{
+				const obj_corner& corner = chunk.corners[c];
+				uint32 index = chunk.first_corner + c;
+
+				bool valid = gather_corner_attribute(positions, corner.position, corner.relative & obj_relative_position, chunk.first_position, out.corner_positions[index]);
+				if (load_uvs)
 				{
-					sized_string name = read_string(file);
+					valid &= gather_corner_attribute(uvs, corner.uv, corner.relative & obj_relative_uv, chunk.first_uv, out.corner_uvs[index]);
 				}
-				else if (token == "o")
+				if (load_normals)
 				{
-					sized_string name = read_string(file);
+					valid &= gather_corner_attribute(normals, corner.normal, corner.relative & obj_relative_normal, chunk.first_normal, out.corner_normals[index]);
 				}
-				else if (token == "s")
+
+				if (!valid)
 				{
-					int32 smoothing = read_int32(file);
+					indices_valid = false;
+					return;
 				}
-				else if (token == "usemtl")
+			}
+		});
+
+		if (!indices_valid)
+		{
+			return false;
+		}
+
+		// Material libraries and 'usemtl' in file order. Nothing before this point has side effects, so falling back to the
+		// serial parser above is safe.
+		std::unordered_map<std::string, int32> name_to_material_index;
+		int32 current_material_index = 0;
+
+		for (obj_chunk& chunk : chunks)
+		{
+			chunk.material_ranges.push_back({ 0, current_material_index });
+
+			for (const obj_statement& statement : chunk.statements)
+			{
+				switch (statement.type)
 				{
-					sized_string mtl = read_string(file);
-					std::string name = name_to_string(mtl);
+				case obj_statement_mtllib:
+				{
+					auto lib_materials = load_material_library(relative_filepath(statement.argument, path));
+					for (auto& [name, mat] : lib_materials)
+					{
+						name_to_material_index[std::move(name)] = (int32)out.materials.size();
+						out.materials.push_back(std::move(mat));
+					}
+				} break;
 
-					auto it = name_to_material_index.find(name);
+				case obj_statement_usemtl:
+				{
+					auto it = name_to_material_index.find(name_to_string(statement.argument));
 					if (it != name_to_material_index.end())
 					{
 						current_material_index = it->second;
+						chunk.material_ranges.push_back({ statement.first_face, current_material_index });
 					}
 					else
 					{
-						printf("Unrecognized material '%.*s'\n", mtl.length, mtl.str);
-					}
-				}
-				else if (token == "f")
-				{
-					int32 face_size = 0;
-					while (file.read_offset < file.size && !is_end_of_line((char)file.content[file.read_offset]))
-					{
-						sized_string vertex_str = read_string(file, false);
-						if (vertex_str.length == 0)
-						{
-							break;
-						}
-
-						obj_vertex_indices vertex_indices = read_vertex_indices(vertex_str);
-
-						int32 curr_num_positions = (int32)positions.size();
-						vertex_indices.position_index += (vertex_indices.position_index >= 0) ? 0 : curr_num_positions;
-						ASSERT(vertex_indices.position_index < curr_num_positions);
-						position_cache.push_back(positions[vertex_indices.position_index]);
-
-						if (flags & mesh_flag_load_uvs)
-						{
-							int32 curr_num_uvs = (int32)uvs.size();
-							vertex_indices.uv_index += (vertex_indices.uv_index >= 0) ? 0 : curr_num_uvs;
-							ASSERT(vertex_indices.uv_index < curr_num_uvs);
-							uv_cache.push_back(uvs[vertex_indices.uv_index]);
-						}
-
-						if (flags & mesh_flag_load_normals)
-						{
-							int32 curr_num_normals = (int32)normals.size();
-							vertex_indices.normal_index += (vertex_indices.normal_index >= 0) ? 0 : curr_num_normals;
-							ASSERT(vertex_indices.normal_index < curr_num_normals);
-							normal_cache.push_back(normals[vertex_indices.normal_index]);
-						}
-
-						++face_size;
+						printf("Unrecognized material '%.*s'\n", statement.argument.length, statement.argument.str);
 					}
+				} break;
 
-					per_material& per_mat = material_to_mesh[current_material_index];
-					per_mat.sub.material_index = current_material_index;
-
-					per_mat.addTriangles(position_cache, uv_cache, normal_cache, {}, {}, {}, 0, face_size, submeshes);
-
-					position_cache.clear();
-					uv_cache.clear();
-					normal_cache.clear();
-				}
-				else if (token.length == 0)
+				case obj_statement_unrecognized:
 				{
-					// Nothing
+					printf("Unrecognized start token '%.*s'\n", statement.argument.length, statement.argument.str);
+				} break;
 				}
-				else
+			}
+		}
+
+		// Triangulate per chunk, then append the chunks' corner lists per material in chunk order. This is the order in
+		// which the serial parser adds them.
+		parallel_for(low_priority_job_queue, num_chunks, 1, [&](uint32 i)
+		{
+			obj_chunk& chunk = chunks[i];
+
+			uint32 first_corner = chunk.first_corner;
+			uint32 range = 0;
+			for (uint32 f = 0; f < (uint32)chunk.face_sizes.size(); ++f)
+			{
+				while (range + 1 < (uint32)chunk.material_ranges.size() && chunk.material_ranges[range + 1].first <= f)
 				{
-					printf("Unrecognized start token '%.*s'\n", token.length, token.str);
+					++range;
 				}
 
-				discard_line(file);
+				int32 material_index = chunk.material_ranges[range].second;
+				per_material& per_mat = chunk.material_to_mesh[material_index];
+				per_mat.material_index = material_index;
+				per_mat.addTriangles((int32)first_corner, (int32)chunk.face_sizes[f]);
+
+				first_corner += chunk.face_sizes[f];
+			}
+		});
+
+		for (const obj_chunk& chunk : chunks)
+		{
+			for (const auto& [material_index, per_mat] : chunk.material_to_mesh)
+			{
+				out.material_to_mesh[material_index].material_index = material_index;
 			}
 		}
 
-		for (auto& [i, per_mat] : material_to_mesh)
+		std::vector<per_material*> merged;
+		for (auto& [material_index, per_mat] : out.material_to_mesh)
+		{
+			merged.push_back(&per_mat);
+		}
+
+		parallel_for(low_priority_job_queue, (uint32)merged.size(), 1, [&](uint32 i)
+		{
+			per_material& target = *merged[i];
+
+			uint64 num_material_corners = 0;
+			for (const obj_chunk& chunk : chunks)
+			{
+				auto it = chunk.material_to_mesh.find(target.material_index);
+				num_material_corners += (it != chunk.material_to_mesh.end()) ? it->second.corners.size() : 0;
+			}
+
+			target.corners.reserve(num_material_corners);
+			for (const obj_chunk& chunk : chunks)
+			{
+				auto it = chunk.material_to_mesh.find(target.material_index);
+				if (it != chunk.material_to_mesh.end())
+				{
+					target.corners.insert(target.corners.end(), it->second.corners.begin(), it->second.corners.end());
+				}
+			}
+		});
+
+		return true;
+	}
+
+	ModelAsset loadOBJ(const fs::path& path, uint32 flags, bool parallel)
+	{
+		PROFILE("Loading OBJ");
+
+		EntireFile file = map_file(path, true);
+
+		obj_geometry geometry;
+		if (!parallel || !parse_obj_parallel(file, path, flags, geometry))
 		{
-			per_mat.flush(submeshes);
+			geometry = {};
+			file.read_offset = 0;
+			parse_obj_serial(file, path, flags, geometry);
 		}
 
+		corner_attributes attributes = {
+			geometry.corner_positions.data(),
+			!geometry.corner_uvs.empty() ? geometry.corner_uvs.data() : nullptr,
+			!geometry.corner_normals.empty() ? geometry.corner_normals.data() : nullptr,
+			nullptr,
+			nullptr,
+			nullptr,
+		};
+
+		std::vector<SubmeshAsset> submeshes;
+		flushPerMaterial(geometry.material_to_mesh, attributes, submeshes);
+
 		free_file(file);
 		generateNormalsAndTangents(submeshes, flags);
 
 		ModelAsset result;
 		result.flags = flags;
 		result.meshes.push_back({ path.filename().string(), std::move(submeshes), -1 });
-		result.materials = std::move(materials);
+		result.materials = std::move(geometry.materials);
 
 		return result;
 	}
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,1623 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#include "asset/texture_cooker.h"
+#include "asset/asset_cache.h"
+#include "asset/image.h"
+
+#include "core/job_system.h"
+#include "core/log.h"
+#include "core/simd.h"
+
+#include <DirectXTex/DirectXTex.h>
+
+#include <fstream>
+
+namespace era_engine
+{
+	// Flags which change the cooked texture. The others only affect how it is loaded.
+	static constexpr uint32 cookedImageLoadFlags = image_load_flags_noncolor | image_load_flags_compress
+		| image_load_flags_gen_mips_on_cpu | image_load_flags_gen_mips_on_gpu | image_load_flags_premultiply_alpha;
+
+	struct srgb_to_linear_table
+	{
+		float values[256];
+
+		srgb_to_linear_table()
+		{
+			for (uint32 i = 0; i < 256; ++i)
+			{
+				float c = i / 255.f;
+				values[i] = (c <= 0.04045f) ? (c / 12.92f) : powf((c + 0.055f) / 1.055f, 2.4f);
+			}
+		}
+	};
+
+	static const srgb_to_linear_table srgbToLinear;
+
+	static float clampf(float v, float l, float u)
+	{
+		return min(u, max(l, v));
+	}
+
+	// ----------------------------------------
+	// Mip generation.
+	// ----------------------------------------
+
+	// Levels are filtered as linear float RGBA, one pixel per SIMD vector.
+
+	static w4_float linearToSRGB(w4_float c)
+	{
+		w4_float low = c * 12.92f;
+		w4_float high = fmadd(pow(c, 1.f / 2.4f), 1.055f, -0.055f);
+		return if_then(c <= 0.0031308f, low, high);
+	}
+
+	static uint32 packRGBA8(w4_float c)
+	{
+		w4_int i = convert(clamp01(c) * 255.f);
+		__m128i packed = _mm_packus_epi16(_mm_packs_epi32(i.i, i.i), _mm_setzero_si128());
+		return (uint32)_mm_cvtsi128_si32(packed);
+	}
+
+	static void expandLevel(const uint8* rgba, uint32 width, uint32 height, bool srgb, bool premultiply, float* out)
+	{
+		parallel_for(low_priority_job_queue, height, 16, [&](uint32 y)
+		{
+			const uint8* src = rgba + (uint64)y * width * 4;
+			float* dst = out + (uint64)y * width * 4;
+
+			for (uint32 x = 0; x < width; ++x, src += 4, dst += 4)
+			{
+				float alpha = src[3] * (1.f / 255.f);
+
+				w4_float c = srgb
+					? w4_float(srgbToLinear.values[src[0]], srgbToLinear.values[src[1]], srgbToLinear.values[src[2]], alpha)
+					: w4_float(src[0], src[1], src[2], src[3]) * (1.f / 255.f);
+
+				if (premultiply)
+				{
+					c *= w4_float(alpha, alpha, alpha, 1.f);
+				}
+
+				c.store(dst);
+			}
+		});
+	}
+
+	// 2x2 box filter. Odd dimensions drop the last row or column.
+	static void downsampleLevel(const float* src, uint32 srcWidth, uint32 srcHeight, float* dst, uint32 dstWidth, uint32 dstHeight)
+	{
+		parallel_for(low_priority_job_queue, dstHeight, 8, [&](uint32 y)
+		{
+			const float* row0 = src + (uint64)min(2 * y, srcHeight - 1) * srcWidth * 4;
+			const float* row1 = src + (uint64)min(2 * y + 1, srcHeight - 1) * srcWidth * 4;
+			float* out = dst + (uint64)y * dstWidth * 4;
+
+			for (uint32 x = 0; x < dstWidth; ++x)
+			{
+				uint32 x0 = min(2 * x, srcWidth - 1) * 4;
+				uint32 x1 = min(2 * x + 1, srcWidth - 1) * 4;
+
+				w4_float sum = w4_float(row0 + x0) + w4_float(row0 + x1) + w4_float(row1 + x0) + w4_float(row1 + x1);
+				(sum * 0.25f).store(out + x * 4);
+			}
+		});
+	}
+
+	static void storeLevel(const float* src, uint32 width, uint32 height, bool srgb, uint8* out)
+	{
+		w4_float alphaLane = reinterpret(w4_int(0, 0, 0, -1));
+
+		parallel_for(low_priority_job_queue, height, 16, [&](uint32 y)
+		{
+			const float* row = src + (uint64)y * width * 4;
+			uint8* dst = out + (uint64)y * width * 4;
+
+			for (uint32 x = 0; x < width; ++x)
+			{
+				w4_float c = clamp01(w4_float(row + x * 4));
+				if (srgb)
+				{
+					c = if_then(alphaLane, c, linearToSRGB(c));
+				}
+
+				uint32 packed = packRGBA8(c);
+				memcpy(dst + x * 4, &packed, 4);
+			}
+		});
+	}
+
+	// ----------------------------------------
+	// Block encoding.
+	// ----------------------------------------
+
+	typedef uint8 color_block[16][4];
+
+	static void fetchBlock(const uint8* rgba, uint32 width, uint32 height, uint32 blockX, uint32 blockY, color_block& block)
+	{
+		// Partial blocks at the border of small mips repeat the last row or column.
+		for (uint32 y = 0; y < 4; ++y)
+		{
+			uint32 sy = min(blockY * 4 + y, height - 1);
+			for (uint32 x = 0; x < 4; ++x)
+			{
+				uint32 sx = min(blockX * 4 + x, width - 1);
+				memcpy(block[y * 4 + x], rgba + ((uint64)sy * width + sx) * 4, 4);
+			}
+		}
+	}
+
+	template <uint32 dims>
+	static void fitEndpointsToBoundingBox(const float (&points)[16][dims], float (&e0)[dims], float (&e1)[dims])
+	{
+		for (uint32 c = 0; c < dims; ++c)
+		{
+			float lo = points[0][c];
+			float hi = points[0][c];
+			for (uint32 i = 1; i < 16; ++i)
+			{
+				lo = min(lo, points[i][c]);
+				hi = max(hi, points[i][c]);
+			}
+
+			// Pull the endpoints in a bit, since the extreme colors are rarely hit exactly.
+			float inset = (hi - lo) / 16.f;
+			e0[c] = hi - inset;
+			e1[c] = lo + inset;
+		}
+	}
+
+	// Endpoints at the extremes of the points along their principal axis.
+	template <uint32 dims>
+	static void fitEndpointsToPrincipalAxis(const float (&points)[16][dims], float (&e0)[dims], float (&e1)[dims])
+	{
+		float mean[dims] = {};
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			for (uint32 c = 0; c < dims; ++c)
+			{
+				mean[c] += points[i][c] / 16.f;
+			}
+		}
+
+		float covariance[dims][dims] = {};
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			for (uint32 a = 0; a < dims; ++a)
+			{
+				for (uint32 b = a; b < dims; ++b)
+				{
+					covariance[a][b] += (points[i][a] - mean[a]) * (points[i][b] - mean[b]);
+				}
+			}
+		}
+		for (uint32 a = 0; a < dims; ++a)
+		{
+			for (uint32 b = 0; b < a; ++b)
+			{
+				covariance[a][b] = covariance[b][a];
+			}
+		}
+
+		// Power iteration, starting with the diagonal of the bounding box.
+		float bbE0[dims];
+		float bbE1[dims];
+		fitEndpointsToBoundingBox(points, bbE0, bbE1);
+
+		float axis[dims];
+		for (uint32 c = 0; c < dims; ++c)
+		{
+			axis[c] = bbE0[c] - bbE1[c] + 1e-3f;
+		}
+
+		for (uint32 iteration = 0; iteration < 8; ++iteration)
+		{
+			float next[dims] = {};
+			float largest = 0.f;
+			for (uint32 a = 0; a < dims; ++a)
+			{
+				for (uint32 b = 0; b < dims; ++b)
+				{
+					next[a] += covariance[a][b] * axis[b];
+				}
+				largest = max(largest, fabsf(next[a]));
+			}
+
+			if (largest < 1e-8f)
+			{
+				break;
+			}
+			for (uint32 c = 0; c < dims; ++c)
+			{
+				axis[c] = next[c] / largest;
+			}
+		}
+
+		float length = 0.f;
+		for (uint32 c = 0; c < dims; ++c)
+		{
+			length += axis[c] * axis[c];
+		}
+		length = sqrtf(length);
+
+		if (length < 1e-8f)
+		{
+			for (uint32 c = 0; c < dims; ++c)
+			{
+				e0[c] = e1[c] = mean[c];
+			}
+			return;
+		}
+
+		float tmin = FLT_MAX;
+		float tmax = -FLT_MAX;
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			float t = 0.f;
+			for (uint32 c = 0; c < dims; ++c)
+			{
+				t += (points[i][c] - mean[c]) * axis[c] / length;
+			}
+			tmin = min(tmin, t);
+			tmax = max(tmax, t);
+		}
+
+		for (uint32 c = 0; c < dims; ++c)
+		{
+			e0[c] = clampf(mean[c] + axis[c] / length * tmax, 0.f, 255.f);
+			e1[c] = clampf(mean[c] + axis[c] / length * tmin, 0.f, 255.f);
+		}
+	}
+
+	// Least squares endpoints for fixed interpolation weights. 'weights[i]' is the weight of e1 for point i.
+	template <uint32 dims>
+	static bool solveEndpoints(const float (&points)[16][dims], const float (&weights)[16], float (&e0)[dims], float (&e1)[dims])
+	{
+		float aa = 0.f, ab = 0.f, bb = 0.f;
+		float ax[dims] = {};
+		float bx[dims] = {};
+
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			float b = weights[i];
+			float a = 1.f - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (uint32 c = 0; c < dims; ++c)
+			{
+				ax[c] += a * points[i][c];
+				bx[c] += b * points[i][c];
+			}
+		}
+
+		float det = aa * bb - ab * ab;
+		if (fabsf(det) < 1e-6f)
+		{
+			return false;
+		}
+
+		for (uint32 c = 0; c < dims; ++c)
+		{
+			e0[c] = clampf((ax[c] * bb - bx[c] * ab) / det, 0.f, 255.f);
+			e1[c] = clampf((bx[c] * aa - ax[c] * ab) / det, 0.f, 255.f);
+		}
+		return true;
+	}
+
+	static uint32 getRefinementIterations(texture_cook_quality quality)
+	{
+		switch (quality)
+		{
+		case texture_cook_quality::FAST: return 0;
+		case texture_cook_quality::NORMAL: return 1;
+		default: return 3;
+		}
+	}
+
+	// BC1 color.
+
+	static uint16 packRGB565(const float (&c)[3])
+	{
+		uint32 r = (uint32)(clampf(c[0], 0.f, 255.f) * 31.f / 255.f + 0.5f);
+		uint32 g = (uint32)(clampf(c[1], 0.f, 255.f) * 63.f / 255.f + 0.5f);
+		uint32 b = (uint32)(clampf(c[2], 0.f, 255.f) * 31.f / 255.f + 0.5f);
+		return (uint16)((r << 11) | (g << 5) | b);
+	}
+
+	static void unpackRGB565(uint16 c, uint32 (&out)[3])
+	{
+		uint32 r = (c >> 11) & 31;
+		uint32 g = (c >> 5) & 63;
+		uint32 b = c & 31;
+		out[0] = (r << 3) | (r >> 2);
+		out[1] = (g << 2) | (g >> 4);
+		out[2] = (b << 3) | (b >> 2);
+	}
+
+	static void getBC1Palette(uint16 c0, uint16 c1, bool fourColors, uint32 (&palette)[4][4])
+	{
+		uint32 a[3], b[3];
+		unpackRGB565(c0, a);
+		unpackRGB565(c1, b);
+
+		for (uint32 c = 0; c < 3; ++c)
+		{
+			palette[0][c] = a[c];
+			palette[1][c] = b[c];
+			if (fourColors)
+			{
+				palette[2][c] = (2 * a[c] + b[c] + 1) / 3;
+				palette[3][c] = (a[c] + 2 * b[c] + 1) / 3;
+			}
+			else
+			{
+				palette[2][c] = (a[c] + b[c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+
+		palette[0][3] = palette[1][3] = palette[2][3] = 255;
+		palette[3][3] = fourColors ? 255 : 0;
+	}
+
+	// Weight of the second endpoint for each BC1 index.
+	static const float bc1Weights[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+
+	static float fitBC1Indices(const float (&colors)[16][3], uint16 c0, uint16 c1, uint32& outIndices)
+	{
+		uint32 palette[4][4];
+		getBC1Palette(c0, c1, true, palette);
+
+		float error = 0.f;
+		uint32 indices = 0;
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			float best = FLT_MAX;
+			uint32 bestIndex = 0;
+			for (uint32 j = 0; j < 4; ++j)
+			{
+				float dr = colors[i][0] - palette[j][0];
+				float dg = colors[i][1] - palette[j][1];
+				float db = colors[i][2] - palette[j][2];
+				float d = dr * dr + dg * dg + db * db;
+				if (d < best)
+				{
+					best = d;
+					bestIndex = j;
+				}
+			}
+			indices |= bestIndex << (2 * i);
+			error += best;
+		}
+
+		outIndices = indices;
+		return error;
+	}
+
+	static float tryBC1Endpoints(const float (&colors)[16][3], const float (&e0)[3], const float (&e1)[3], uint16& c0, uint16& c1, uint32& indices)
+	{
+		c0 = packRGB565(e0);
+		c1 = packRGB565(e1);
+
+		// c0 > c1 selects the four color mode. Equal endpoints always pick index 0, which is the same in both modes.
+		if (c0 < c1)
+		{
+			std::swap(c0, c1);
+		}
+		return fitBC1Indices(colors, c0, c1, indices);
+	}
+
+	static void encodeBC1(const color_block& block, texture_cook_quality quality, uint8* out)
+	{
+		float colors[16][3];
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			colors[i][0] = block[i][0];
+			colors[i][1] = block[i][1];
+			colors[i][2] = block[i][2];
+		}
+
+		float e0[3], e1[3];
+		if (quality == texture_cook_quality::FAST)
+		{
+			fitEndpointsToBoundingBox(colors, e0, e1);
+		}
+		else
+		{
+			fitEndpointsToPrincipalAxis(colors, e0, e1);
+		}
+
+		uint16 c0, c1;
+		uint32 indices;
+		float error = tryBC1Endpoints(colors, e0, e1, c0, c1, indices);
+
+		if (quality == texture_cook_quality::HIGH)
+		{
+			fitEndpointsToBoundingBox(colors, e0, e1);
+
+			uint16 b0, b1;
+			uint32 bIndices;
+			float bError = tryBC1Endpoints(colors, e0, e1, b0, b1, bIndices);
+			if (bError < error)
+			{
+				c0 = b0; c1 = b1; indices = bIndices; error = bError;
+			}
+		}
+
+		uint32 iterations = getRefinementIterations(quality);
+		for (uint32 iteration = 0; iteration < iterations && error > 0.f; ++iteration)
+		{
+			float weights[16];
+			for (uint32 i = 0; i < 16; ++i)
+			{
+				weights[i] = bc1Weights[(indices >> (2 * i)) & 3];
+			}
+			if (!solveEndpoints(colors, weights, e0, e1))
+			{
+				break;
+			}
+
+			uint16 r0, r1;
+			uint32 rIndices;
+			float rError = tryBC1Endpoints(colors, e0, e1, r0, r1, rIndices);
+			if (rError >= error)
+			{
+				break;
+			}
+			c0 = r0; c1 = r1; indices = rIndices; error = rError;
+		}
+
+		memcpy(out + 0, &c0, 2);
+		memcpy(out + 2, &c1, 2);
+		memcpy(out + 4, &indices, 4);
+	}
+
+	// BC4 single channel. Also used for BC3 alpha and both BC5 channels.
+
+	static void getBC4Palette(uint32 a0, uint32 a1, float (&palette)[8])
+	{
+		palette[0] = (float)a0;
+		palette[1] = (float)a1;
+		if (a0 > a1)
+		{
+			for (uint32 i = 1; i < 7; ++i)
+			{
+				palette[i + 1] = ((7 - i) * a0 + i * a1) / 7.f;
+			}
+		}
+		else
+		{
+			for (uint32 i = 1; i < 5; ++i)
+			{
+				palette[i + 1] = ((5 - i) * a0 + i * a1) / 5.f;
+			}
+			palette[6] = 0.f;
+			palette[7] = 255.f;
+		}
+	}
+
+	// Weight of the second endpoint for each index in the eight value mode.
+	static const float bc4Weights[8] = { 0.f, 1.f, 1.f / 7.f, 2.f / 7.f, 3.f / 7.f, 4.f / 7.f, 5.f / 7.f, 6.f / 7.f };
+
+	static float fitBC4Indices(const float (&values)[16][1], uint32 a0, uint32 a1, uint64& outIndices)
+	{
+		float palette[8];
+		getBC4Palette(a0, a1, palette);
+
+		float error = 0.f;
+		uint64 indices = 0;
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			float best = FLT_MAX;
+			uint64 bestIndex = 0;
+			for (uint32 j = 0; j < 8; ++j)
+			{
+				float d = (values[i][0] - palette[j]) * (values[i][0] - palette[j]);
+				if (d < best)
+				{
+					best = d;
+					bestIndex = j;
+				}
+			}
+			indices |= bestIndex << (3 * i);
+			error += best;
+		}
+
+		outIndices = indices;
+		return error;
+	}
+
+	static void encodeBC4(const color_block& block, uint32 channel, texture_cook_quality quality, uint8* out)
+	{
+		float values[16][1];
+		float lo = 255.f, hi = 0.f;
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			values[i][0] = block[i][channel];
+			lo = min(lo, values[i][0]);
+			hi = max(hi, values[i][0]);
+		}
+
+		uint32 a0 = (uint32)hi;
+		uint32 a1 = (uint32)lo;
+		uint64 indices = 0;
+		float error = fitBC4Indices(values, a0, a1, indices);
+
+		uint32 iterations = getRefinementIterations(quality);
+		for (uint32 iteration = 0; iteration < iterations && error > 0.f; ++iteration)
+		{
+			float weights[16];
+			for (uint32 i = 0; i < 16; ++i)
+			{
+				weights[i] = bc4Weights[(indices >> (3 * i)) & 7];
+			}
+
+			float e0[1], e1[1];
+			if (!solveEndpoints(values, weights, e0, e1))
+			{
+				break;
+			}
+
+			uint32 r0 = (uint32)(e0[0] + 0.5f);
+			uint32 r1 = (uint32)(e1[0] + 0.5f);
+			if (r0 < r1)
+			{
+				std::swap(r0, r1);
+			}
+			if (r0 == r1)
+			{
+				break;
+			}
+
+			uint64 rIndices;
+			float rError = fitBC4Indices(values, r0, r1, rIndices);
+			if (rError >= error)
+			{
+				break;
+			}
+			a0 = r0; a1 = r1; indices = rIndices; error = rError;
+		}
+
+		// The six value mode has exact 0 and 255, which helps blocks with a few fully black or white texels.
+		if (quality == texture_cook_quality::HIGH && error > 0.f && (lo == 0.f || hi == 255.f))
+		{
+			float innerLo = 255.f, innerHi = 0.f;
+			for (uint32 i = 0; i < 16; ++i)
+			{
+				if (values[i][0] > 0.f && values[i][0] < 255.f)
+				{
+					innerLo = min(innerLo, values[i][0]);
+					innerHi = max(innerHi, values[i][0]);
+				}
+			}
+
+			if (innerLo <= innerHi)
+			{
+				uint64 rIndices;
+				float rError = fitBC4Indices(values, (uint32)innerLo, (uint32)innerHi, rIndices);
+				if (rError < error)
+				{
+					a0 = (uint32)innerLo; a1 = (uint32)innerHi; indices = rIndices; error = rError;
+				}
+			}
+		}
+
+		out[0] = (uint8)a0;
+		out[1] = (uint8)a1;
+		for (uint32 i = 0; i < 6; ++i)
+		{
+			out[2 + i] = (uint8)(indices >> (8 * i));
+		}
+	}
+
+	// BC7 mode 6: one subset, 7 bit RGBA endpoints with a p-bit each and 4 bit indices. Used for all blocks.
+
+	static const uint32 bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	struct bc7_endpoint
+	{
+		uint8 color[4]; // 7 bits.
+		uint8 pbit;
+
+		uint32 get(uint32 c) const { return ((uint32)color[c] << 1) | pbit; }
+	};
+
+	static bc7_endpoint quantizeBC7Endpoint(const float (&c)[4])
+	{
+		bc7_endpoint best = {};
+		float bestError = FLT_MAX;
+		for (uint8 pbit = 0; pbit < 2; ++pbit)
+		{
+			bc7_endpoint e;
+			e.pbit = pbit;
+
+			float error = 0.f;
+			for (uint32 i = 0; i < 4; ++i)
+			{
+				e.color[i] = (uint8)clampf((c[i] - pbit) * 0.5f + 0.5f, 0.f, 127.f);
+				float d = (float)e.get(i) - c[i];
+				error += d * d;
+			}
+
+			if (error < bestError)
+			{
+				best = e;
+				bestError = error;
+			}
+		}
+		return best;
+	}
+
+	static float fitBC7Indices(const float (&pixels)[16][4], const bc7_endpoint& e0, const bc7_endpoint& e1, bool exhaustive, uint8 (&outIndices)[16])
+	{
+		float palette[16][4];
+		for (uint32 j = 0; j < 16; ++j)
+		{
+			for (uint32 c = 0; c < 4; ++c)
+			{
+				palette[j][c] = (float)(((64 - bc7Weights[j]) * e0.get(c) + bc7Weights[j] * e1.get(c) + 32) >> 6);
+			}
+		}
+
+		float dir[4];
+		float dirLengthSq = 0.f;
+		for (uint32 c = 0; c < 4; ++c)
+		{
+			dir[c] = (float)e1.get(c) - (float)e0.get(c);
+			dirLengthSq += dir[c] * dir[c];
+		}
+
+		float error = 0.f;
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			uint32 first = 0;
+			uint32 last = 15;
+			if (!exhaustive)
+			{
+				// The weights are almost uniform, so the projection onto the endpoint line is within one index of the best.
+				float t = 0.f;
+				if (dirLengthSq > 0.f)
+				{
+					for (uint32 c = 0; c < 4; ++c)
+					{
+						t += (pixels[i][c] - (float)e0.get(c)) * dir[c];
+					}
+					t /= dirLengthSq;
+				}
+				int32 guess = (int32)(clampf(t, 0.f, 1.f) * 15.f + 0.5f);
+				first = (uint32)max(guess - 1, 0);
+				last = (uint32)min(guess + 1, 15);
+			}
+
+			float best = FLT_MAX;
+			uint8 bestIndex = 0;
+			for (uint32 j = first; j <= last; ++j)
+			{
+				float d = 0.f;
+				for (uint32 c = 0; c < 4; ++c)
+				{
+					float delta = pixels[i][c] - palette[j][c];
+					d += delta * delta;
+				}
+				if (d < best)
+				{
+					best = d;
+					bestIndex = (uint8)j;
+				}
+			}
+			outIndices[i] = bestIndex;
+			error += best;
+		}
+		return error;
+	}
+
+	struct block_bit_writer
+	{
+		uint8* out;
+		uint32 bit = 0;
+
+		void write(uint32 value, uint32 numBits)
+		{
+			for (uint32 i = 0; i < numBits; ++i, ++bit)
+			{
+				out[bit >> 3] |= (uint8)(((value >> i) & 1) << (bit & 7));
+			}
+		}
+	};
+
+	struct block_bit_reader
+	{
+		const uint8* in;
+		uint32 bit = 0;
+
+		uint32 read(uint32 numBits)
+		{
+			uint32 value = 0;
+			for (uint32 i = 0; i < numBits; ++i, ++bit)
+			{
+				value |= (uint32)((in[bit >> 3] >> (bit & 7)) & 1) << i;
+			}
+			return value;
+		}
+	};
+
+	static float encodeBC7Mode6(const float (&pixels)[16][4], texture_cook_quality quality, uint8* out)
+	{
+		float e0[4], e1[4];
+		if (quality == texture_cook_quality::FAST)
+		{
+			fitEndpointsToBoundingBox(pixels, e0, e1);
+		}
+		else
+		{
+			fitEndpointsToPrincipalAxis(pixels, e0, e1);
+		}
+
+		bool exhaustive = (quality == texture_cook_quality::HIGH);
+
+		bc7_endpoint q0 = quantizeBC7Endpoint(e0);
+		bc7_endpoint q1 = quantizeBC7Endpoint(e1);
+		uint8 indices[16];
+		float error = fitBC7Indices(pixels, q0, q1, exhaustive, indices);
+
+		uint32 iterations = getRefinementIterations(quality);
+		for (uint32 iteration = 0; iteration < iterations && error > 0.f; ++iteration)
+		{
+			float weights[16];
+			for (uint32 i = 0; i < 16; ++i)
+			{
+				weights[i] = bc7Weights[indices[i]] / 64.f;
+			}
+			if (!solveEndpoints(pixels, weights, e0, e1))
+			{
+				break;
+			}
+
+			bc7_endpoint r0 = quantizeBC7Endpoint(e0);
+			bc7_endpoint r1 = quantizeBC7Endpoint(e1);
+			uint8 rIndices[16];
+			float rError = fitBC7Indices(pixels, r0, r1, exhaustive, rIndices);
+			if (rError >= error)
+			{
+				break;
+			}
+			q0 = r0; q1 = r1; error = rError;
+			memcpy(indices, rIndices, sizeof(indices));
+		}
+
+		// The most significant bit of the first index is implicitly 0.
+		if (indices[0] & 8)
+		{
+			std::swap(q0, q1);
+			for (uint32 i = 0; i < 16; ++i)
+			{
+				indices[i] = 15 - indices[i];
+			}
+		}
+
+		memset(out, 0, 16);
+		block_bit_writer writer = { out };
+		writer.write(1 << 6, 7);
+		for (uint32 c = 0; c < 4; ++c)
+		{
+			writer.write(q0.color[c], 7);
+			writer.write(q1.color[c], 7);
+		}
+		writer.write(q0.pbit, 1);
+		writer.write(q1.pbit, 1);
+		writer.write(indices[0], 3);
+		for (uint32 i = 1; i < 16; ++i)
+		{
+			writer.write(indices[i], 4);
+		}
+		return error;
+	}
+
+	// BC7 mode 5: one subset, 7 bit RGB and 8 bit alpha endpoints with separate 2 bit color and alpha indices. Better
+	// than mode 6 if alpha does not follow the color.
+
+	static const uint32 bc7Weights2[4] = { 0, 21, 43, 64 };
+
+	static uint32 expandBC7Component(uint32 value, uint32 bits)
+	{
+		return (bits == 8) ? value : ((value << (8 - bits)) | (value >> (2 * bits - 8)));
+	}
+
+	template <uint32 dims>
+	static float fitBC7Mode5Indices(const float (&points)[16][dims], const uint32 (&q0)[dims], const uint32 (&q1)[dims], uint32 bits, uint8 (&outIndices)[16])
+	{
+		float palette[4][dims];
+		for (uint32 j = 0; j < 4; ++j)
+		{
+			for (uint32 c = 0; c < dims; ++c)
+			{
+				uint32 a = expandBC7Component(q0[c], bits);
+				uint32 b = expandBC7Component(q1[c], bits);
+				palette[j][c] = (float)(((64 - bc7Weights2[j]) * a + bc7Weights2[j] * b + 32) >> 6);
+			}
+		}
+
+		float error = 0.f;
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			float best = FLT_MAX;
+			uint8 bestIndex = 0;
+			for (uint32 j = 0; j < 4; ++j)
+			{
+				float d = 0.f;
+				for (uint32 c = 0; c < dims; ++c)
+				{
+					float delta = points[i][c] - palette[j][c];
+					d += delta * delta;
+				}
+				if (d < best)
+				{
+					best = d;
+					bestIndex = (uint8)j;
+				}
+			}
+			outIndices[i] = bestIndex;
+			error += best;
+		}
+		return error;
+	}
+
+	template <uint32 dims>
+	static float encodeBC7Mode5Channels(const float (&points)[16][dims], texture_cook_quality quality, uint32 bits,
+		uint32 (&q0)[dims], uint32 (&q1)[dims], uint8 (&indices)[16])
+	{
+		float e0[dims], e1[dims];
+		if (quality == texture_cook_quality::FAST)
+		{
+			fitEndpointsToBoundingBox(points, e0, e1);
+		}
+		else
+		{
+			fitEndpointsToPrincipalAxis(points, e0, e1);
+		}
+
+		float scale = (float)((1 << bits) - 1) / 255.f;
+		auto quantize = [scale](const float (&e)[dims], uint32 (&q)[dims])
+		{
+			for (uint32 c = 0; c < dims; ++c)
+			{
+				q[c] = (uint32)(e[c] * scale + 0.5f);
+			}
+		};
+
+		quantize(e0, q0);
+		quantize(e1, q1);
+		float error = fitBC7Mode5Indices(points, q0, q1, bits, indices);
+
+		uint32 iterations = getRefinementIterations(quality);
+		for (uint32 iteration = 0; iteration < iterations && error > 0.f; ++iteration)
+		{
+			float weights[16];
+			for (uint32 i = 0; i < 16; ++i)
+			{
+				weights[i] = bc7Weights2[indices[i]] / 64.f;
+			}
+			if (!solveEndpoints(points, weights, e0, e1))
+			{
+				break;
+			}
+
+			uint32 r0[dims], r1[dims];
+			uint8 rIndices[16];
+			quantize(e0, r0);
+			quantize(e1, r1);
+			float rError = fitBC7Mode5Indices(points, r0, r1, bits, rIndices);
+			if (rError >= error)
+			{
+				break;
+			}
+			memcpy(q0, r0, sizeof(r0));
+			memcpy(q1, r1, sizeof(r1));
+			memcpy(indices, rIndices, sizeof(rIndices));
+			error = rError;
+		}
+
+		// The most significant bit of the first index is implicitly 0.
+		if (indices[0] & 2)
+		{
+			std::swap(q0, q1);
+			for (uint32 i = 0; i < 16; ++i)
+			{
+				indices[i] = 3 - indices[i];
+			}
+		}
+		return error;
+	}
+
+	static float encodeBC7Mode5(const float (&pixels)[16][4], texture_cook_quality quality, uint8* out)
+	{
+		float colors[16][3];
+		float alphas[16][1];
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			colors[i][0] = pixels[i][0];
+			colors[i][1] = pixels[i][1];
+			colors[i][2] = pixels[i][2];
+			alphas[i][0] = pixels[i][3];
+		}
+
+		uint32 c0[3], c1[3], a0[1], a1[1];
+		uint8 colorIndices[16], alphaIndices[16];
+		float error = encodeBC7Mode5Channels(colors, quality, 7, c0, c1, colorIndices)
+			+ encodeBC7Mode5Channels(alphas, quality, 8, a0, a1, alphaIndices);
+
+		memset(out, 0, 16);
+		block_bit_writer writer = { out };
+		writer.write(1 << 5, 6);
+		writer.write(0, 2); // No channel rotation.
+		for (uint32 c = 0; c < 3; ++c)
+		{
+			writer.write(c0[c], 7);
+			writer.write(c1[c], 7);
+		}
+		writer.write(a0[0], 8);
+		writer.write(a1[0], 8);
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			writer.write(colorIndices[i], i == 0 ? 1 : 2);
+		}
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			writer.write(alphaIndices[i], i == 0 ? 1 : 2);
+		}
+		return error;
+	}
+
+	static void encodeBC7(const color_block& block, texture_cook_quality quality, uint8* out)
+	{
+		float pixels[16][4];
+		bool constantAlpha = true;
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			for (uint32 c = 0; c < 4; ++c)
+			{
+				pixels[i][c] = block[i][c];
+			}
+			constantAlpha &= (block[i][3] == block[0][3]);
+		}
+
+		float error = encodeBC7Mode6(pixels, quality, out);
+		if (!constantAlpha && error > 0.f)
+		{
+			uint8 candidate[16];
+			if (encodeBC7Mode5(pixels, quality, candidate) < error)
+			{
+				memcpy(out, candidate, 16);
+			}
+		}
+	}
+
+	// ----------------------------------------
+	// Block decoding.
+	// ----------------------------------------
+
+	static void decodeBC1(const uint8* in, bool forceFourColors, color_block& out)
+	{
+		uint16 c0, c1;
+		uint32 indices;
+		memcpy(&c0, in + 0, 2);
+		memcpy(&c1, in + 2, 2);
+		memcpy(&indices, in + 4, 4);
+
+		uint32 palette[4][4];
+		getBC1Palette(c0, c1, forceFourColors || c0 > c1, palette);
+
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			uint32 index = (indices >> (2 * i)) & 3;
+			for (uint32 c = 0; c < 4; ++c)
+			{
+				out[i][c] = (uint8)palette[index][c];
+			}
+		}
+	}
+
+	static void decodeBC4(const uint8* in, uint32 channel, color_block& out)
+	{
+		float palette[8];
+		getBC4Palette(in[0], in[1], palette);
+
+		uint64 indices = 0;
+		for (uint32 i = 0; i < 6; ++i)
+		{
+			indices |= (uint64)in[2 + i] << (8 * i);
+		}
+
+		for (uint32 i = 0; i < 16; ++i)
+		{
+			out[i][channel] = (uint8)(palette[(indices >> (3 * i)) & 7] + 0.5f);
+		}
+	}
+
+	static bool decodeBC7(const uint8* in, color_block& out)
+	{
+		block_bit_reader reader = { in };
+
+		uint32 mode = 0;
+		while (mode < 8 && !reader.read(1))
+		{
+			++mode;
+		}
+
+		if (mode == 6)
+		{
+			bc7_endpoint e0, e1;
+			for (uint32 c = 0; c < 4; ++c)
+			{
+				e0.color[c] = (uint8)reader.read(7);
+				e1.color[c] = (uint8)reader.read(7);
+			}
+			e0.pbit = (uint8)reader.read(1);
+			e1.pbit = (uint8)reader.read(1);
+
+			for (uint32 i = 0; i < 16; ++i)
+			{
+				uint32 index = reader.read(i == 0 ? 3 : 4);
+				for (uint32 c = 0; c < 4; ++c)
+				{
+					out[i][c] = (uint8)(((64 - bc7Weights[index]) * e0.get(c) + bc7Weights[index] * e1.get(c) + 32) >> 6);
+				}
+			}
+			return true;
+		}
+
+		if (mode == 5)
+		{
+			uint32 rotation = reader.read(2);
+
+			uint32 e0[4], e1[4];
+			for (uint32 c = 0; c < 3; ++c)
+			{
+				e0[c] = expandBC7Component(reader.read(7), 7);
+				e1[c] = expandBC7Component(reader.read(7), 7);
+			}
+			e0[3] = reader.read(8);
+			e1[3] = reader.read(8);
+
+			uint32 colorIndices[16];
+			for (uint32 i = 0; i < 16; ++i)
+			{
+				colorIndices[i] = reader.read(i == 0 ? 1 : 2);
+			}
+
+			for (uint32 i = 0; i < 16; ++i)
+			{
+				uint32 alphaIndex = reader.read(i == 0 ? 1 : 2);
+				for (uint32 c = 0; c < 4; ++c)
+				{
+					uint32 weight = bc7Weights2[(c == 3) ? alphaIndex : colorIndices[i]];
+					out[i][c] = (uint8)(((64 - weight) * e0[c] + weight * e1[c] + 32) >> 6);
+				}
+				if (rotation)
+				{
+					std::swap(out[i][3], out[i][rotation - 1]);
+				}
+			}
+			return true;
+		}
+
+		return false;
+	}
+
+	// ----------------------------------------
+	// Cooking.
+	// ----------------------------------------
+
+	static uint32 getBlockSize(texture_cook_format format)
+	{
+		switch (format)
+		{
+		case texture_cook_format::BC1:
+		case texture_cook_format::BC4:
+			return 8;
+		case texture_cook_format::BC3:
+		case texture_cook_format::BC5:
+		case texture_cook_format::BC7:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	static DXGI_FORMAT getCookedFormat(texture_cook_format format, bool srgb)
+	{
+		switch (format)
+		{
+		case texture_cook_format::BC1: return srgb ? DXGI_FORMAT_BC1_UNORM_SRGB : DXGI_FORMAT_BC1_UNORM;
+		case texture_cook_format::BC3: return srgb ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC3_UNORM;
+		case texture_cook_format::BC4: return DXGI_FORMAT_BC4_UNORM;
+		case texture_cook_format::BC5: return DXGI_FORMAT_BC5_UNORM;
+		case texture_cook_format::BC7: return srgb ? DXGI_FORMAT_BC7_UNORM_SRGB : DXGI_FORMAT_BC7_UNORM;
+		default: return srgb ? DXGI_FORMAT_R8G8B8A8_UNORM_SRGB : DXGI_FORMAT_R8G8B8A8_UNORM;
+		}
+	}
+
+	static texture_cook_format getCookFormat(DXGI_FORMAT format)
+	{
+		switch (format)
+		{
+		case DXGI_FORMAT_BC1_UNORM:
+		case DXGI_FORMAT_BC1_UNORM_SRGB:
+			return texture_cook_format::BC1;
+		case DXGI_FORMAT_BC3_UNORM:
+		case DXGI_FORMAT_BC3_UNORM_SRGB:
+			return texture_cook_format::BC3;
+		case DXGI_FORMAT_BC4_UNORM:
+			return texture_cook_format::BC4;
+		case DXGI_FORMAT_BC5_UNORM:
+			return texture_cook_format::BC5;
+		case DXGI_FORMAT_BC7_UNORM:
+		case DXGI_FORMAT_BC7_UNORM_SRGB:
+			return texture_cook_format::BC7;
+		case DXGI_FORMAT_R8G8B8A8_UNORM:
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+			return texture_cook_format::RGBA8;
+		default:
+			return texture_cook_format::COUNT;
+		}
+	}
+
+	static texture_cook_format resolveFormat(texture_cook_format format, uint32 numChannels, const uint8* rgba, uint64 numPixels)
+	{
+		if (format != texture_cook_format::AUTO)
+		{
+			return format;
+		}
+
+		switch (numChannels)
+		{
+		case 1: return texture_cook_format::BC4;
+		case 2: return texture_cook_format::BC5;
+		}
+
+		for (uint64 i = 0; i < numPixels; ++i)
+		{
+			if (rgba[i * 4 + 3] != 255)
+			{
+				return texture_cook_format::BC3;
+			}
+		}
+		return texture_cook_format::BC1;
+	}
+
+	static void encodeBlock(texture_cook_format format, texture_cook_quality quality, const color_block& block, uint8* out)
+	{
+		switch (format)
+		{
+		case texture_cook_format::BC1:
+			encodeBC1(block, quality, out);
+			break;
+		case texture_cook_format::BC3:
+			encodeBC4(block, 3, quality, out);
+			encodeBC1(block, quality, out + 8);
+			break;
+		case texture_cook_format::BC4:
+			encodeBC4(block, 0, quality, out);
+			break;
+		case texture_cook_format::BC5:
+			encodeBC4(block, 0, quality, out);
+			encodeBC4(block, 1, quality, out + 8);
+			break;
+		case texture_cook_format::BC7:
+			encodeBC7(block, quality, out);
+			break;
+		default:
+			break;
+		}
+	}
+
+	texture_cook_options getTextureCookOptions(uint32 imageLoadFlags, texture_cook_quality quality)
+	{
+		texture_cook_options options;
+		options.format = (imageLoadFlags & image_load_flags_compress) ? texture_cook_format::AUTO : texture_cook_format::RGBA8;
+		options.quality = quality;
+		options.srgb = !(imageLoadFlags & image_load_flags_noncolor);
+		options.generate_mips = (imageLoadFlags & image_load_flags_gen_mips_on_cpu) && !(imageLoadFlags & image_load_flags_gen_mips_on_gpu);
+		options.premultiply_alpha = (imageLoadFlags & image_load_flags_premultiply_alpha) != 0;
+		return options;
+	}
+
+	bool cookTexture(const uint8* rgba, uint32 width, uint32 height, uint32 numChannels,
+		const texture_cook_options& options, cooked_texture& out)
+	{
+		if (!rgba || width == 0 || height == 0)
+		{
+			return false;
+		}
+
+		texture_cook_format format = resolveFormat(options.format, numChannels, rgba, (uint64)width * height);
+		if (getBlockSize(format) && (width % 4 != 0 || height % 4 != 0))
+		{
+			LOG_WARNING("Cannot compress %ux%u texture, since its dimensions are not a multiple of 4", width, height);
+			format = texture_cook_format::RGBA8;
+		}
+
+		bool srgb = options.srgb && format != texture_cook_format::BC4 && format != texture_cook_format::BC5;
+
+		uint32 numMips = 1;
+		if (options.generate_mips)
+		{
+			while ((max(width, height) >> numMips) > 0)
+			{
+				++numMips;
+			}
+		}
+
+		// Level 0 is used as is, unless alpha is premultiplied. All other levels are filtered in linear space.
+		std::vector<std::vector<uint8>> levels(numMips);
+		std::vector<const uint8*> levelPixels(numMips);
+		levelPixels[0] = rgba;
+
+		if (numMips > 1 || options.premultiply_alpha)
+		{
+			std::vector<float> current((uint64)width * height * 4);
+			std::vector<float> next;
+			expandLevel(rgba, width, height, srgb, options.premultiply_alpha, current.data());
+
+			if (options.premultiply_alpha)
+			{
+				levels[0].resize((uint64)width * height * 4);
+				storeLevel(current.data(), width, height, srgb, levels[0].data());
+				levelPixels[0] = levels[0].data();
+			}
+
+			uint32 levelWidth = width;
+			uint32 levelHeight = height;
+			for (uint32 mip = 1; mip < numMips; ++mip)
+			{
+				uint32 nextWidth = max(levelWidth / 2, 1u);
+				uint32 nextHeight = max(levelHeight / 2, 1u);
+
+				next.resize((uint64)nextWidth * nextHeight * 4);
+				downsampleLevel(current.data(), levelWidth, levelHeight, next.data(), nextWidth, nextHeight);
+
+				levels[mip].resize((uint64)nextWidth * nextHeight * 4);
+				storeLevel(next.data(), nextWidth, nextHeight, srgb, levels[mip].data());
+				levelPixels[mip] = levels[mip].data();
+
+				std::swap(current, next);
+				levelWidth = nextWidth;
+				levelHeight = nextHeight;
+			}
+		}
+
+		out.format = getCookedFormat(format, srgb);
+		out.width = width;
+		out.height = height;
+		out.premultiplied_alpha = options.premultiply_alpha;
+		out.mips.resize(numMips);
+
+		uint32 blockSize = getBlockSize(format);
+		uint64 totalSize = 0;
+		for (uint32 mip = 0; mip < numMips; ++mip)
+		{
+			cooked_texture_mip& m = out.mips[mip];
+			m.width = max(width >> mip, 1u);
+			m.height = max(height >> mip, 1u);
+			m.row_pitch = blockSize ? ((m.width + 3) / 4) * blockSize : m.width * 4;
+			m.offset = totalSize;
+			m.size = (uint64)m.row_pitch * (blockSize ? (m.height + 3) / 4 : m.height);
+			totalSize += m.size;
+		}
+		out.data.resize(totalSize);
+
+		for (uint32 mip = 0; mip < numMips; ++mip)
+		{
+			const cooked_texture_mip& m = out.mips[mip];
+			const uint8* pixels = levelPixels[mip];
+			uint8* dst = out.data.data() + m.offset;
+
+			if (!blockSize)
+			{
+				memcpy(dst, pixels, m.size);
+				continue;
+			}
+
+			uint32 blocksX = (m.width + 3) / 4;
+			uint32 blocksY = (m.height + 3) / 4;
+			texture_cook_quality quality = options.quality;
+
+			parallel_for(low_priority_job_queue, blocksY, 2, [&](uint32 blockY)
+			{
+				uint8* row = dst + (uint64)blockY * m.row_pitch;
+				for (uint32 blockX = 0; blockX < blocksX; ++blockX)
+				{
+					color_block block;
+					fetchBlock(pixels, m.width, m.height, blockX, blockY, block);
+					encodeBlock(format, quality, block, row + blockX * blockSize);
+				}
+			});
+		}
+
+		return true;
+	}
+
+	bool decodeCookedTexture(const cooked_texture& texture, uint32 mip, std::vector<uint8>& outRGBA)
+	{
+		texture_cook_format format = getCookFormat(texture.format);
+		if (mip >= (uint32)texture.mips.size() || format == texture_cook_format::COUNT)
+		{
+			return false;
+		}
+
+		const cooked_texture_mip& m = texture.mips[mip];
+		const uint8* src = texture.data.data() + m.offset;
+		outRGBA.resize((uint64)m.width * m.height * 4);
+
+		if (format == texture_cook_format::RGBA8)
+		{
+			memcpy(outRGBA.data(), src, outRGBA.size());
+			return true;
+		}
+
+		uint32 blockSize = getBlockSize(format);
+		uint32 blocksX = (m.width + 3) / 4;
+		uint32 blocksY = (m.height + 3) / 4;
+
+		for (uint32 blockY = 0; blockY < blocksY; ++blockY)
+		{
+			for (uint32 blockX = 0; blockX < blocksX; ++blockX)
+			{
+				const uint8* in = src + (uint64)blockY * m.row_pitch + blockX * blockSize;
+
+				color_block block;
+				memset(block, 0, sizeof(block));
+				for (uint32 i = 0; i < 16; ++i)
+				{
+					block[i][3] = 255;
+				}
+
+				switch (format)
+				{
+				case texture_cook_format::BC1:
+					decodeBC1(in, false, block);
+					break;
+				case texture_cook_format::BC3:
+					decodeBC1(in + 8, true, block);
+					decodeBC4(in, 3, block);
+					break;
+				case texture_cook_format::BC4:
+					decodeBC4(in, 0, block);
+					break;
+				case texture_cook_format::BC5:
+					decodeBC4(in, 0, block);
+					decodeBC4(in + 8, 1, block);
+					break;
+				case texture_cook_format::BC7:
+					if (!decodeBC7(in, block))
+					{
+						return false;
+					}
+					break;
+				default:
+					break;
+				}
+
+				for (uint32 y = 0; y < 4 && blockY * 4 + y < m.height; ++y)
+				{
+					for (uint32 x = 0; x < 4 && blockX * 4 + x < m.width; ++x)
+					{
+						memcpy(outRGBA.data() + ((uint64)(blockY * 4 + y) * m.width + blockX * 4 + x) * 4, block[y * 4 + x], 4);
+					}
+				}
+			}
+		}
+
+		return true;
+	}
+
+	// ----------------------------------------
+	// DDS output.
+	// ----------------------------------------
+
+	struct dds_pixel_format
+	{
+		uint32 size;
+		uint32 flags;
+		uint32 four_cc;
+		uint32 rgb_bit_count;
+		uint32 r_bit_mask;
+		uint32 g_bit_mask;
+		uint32 b_bit_mask;
+		uint32 a_bit_mask;
+	};
+
+	struct dds_header
+	{
+		uint32 size;
+		uint32 flags;
+		uint32 height;
+		uint32 width;
+		uint32 pitch_or_linear_size;
+		uint32 depth;
+		uint32 mip_map_count;
+		uint32 reserved1[11];
+		dds_pixel_format pixel_format;
+		uint32 caps;
+		uint32 caps2;
+		uint32 caps3;
+		uint32 caps4;
+		uint32 reserved2;
+	};
+
+	struct dds_header_dx10
+	{
+		uint32 dxgi_format;
+		uint32 resource_dimension;
+		uint32 misc_flag;
+		uint32 array_size;
+		uint32 misc_flags2;
+	};
+
+	static_assert(sizeof(dds_header) == 124);
+	static_assert(sizeof(dds_header_dx10) == 20);
+
+	bool writeCookedTextureToDDS(const cooked_texture& texture, const fs::path& path)
+	{
+		if (texture.mips.empty())
+		{
+			return false;
+		}
+
+		const uint32 DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PITCH = 0x8;
+		const uint32 DDSD_PIXELFORMAT = 0x1000, DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+		const uint32 DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+		const uint32 DDPF_FOURCC = 0x4;
+		const uint32 DDS_DIMENSION_TEXTURE2D = 3;
+		const uint32 DDS_ALPHA_MODE_PREMULTIPLIED = 2;
+
+		bool compressed = getBlockSize(getCookFormat(texture.format)) != 0;
+		uint32 numMips = (uint32)texture.mips.size();
+
+		dds_header header = {};
+		header.size = sizeof(dds_header);
+		header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT
+			| (compressed ? DDSD_LINEARSIZE : DDSD_PITCH);
+		header.height = texture.height;
+		header.width = texture.width;
+		header.pitch_or_linear_size = compressed ? (uint32)texture.mips[0].size : texture.mips[0].row_pitch;
+		header.mip_map_count = numMips;
+		header.pixel_format.size = sizeof(dds_pixel_format);
+		header.pixel_format.flags = DDPF_FOURCC;
+		header.pixel_format.four_cc = MAKEFOURCC('D', 'X', '1', '0');
+		header.caps = DDSCAPS_TEXTURE | (numMips > 1 ? (DDSCAPS_COMPLEX | DDSCAPS_MIPMAP) : 0);
+
+		dds_header_dx10 header10 = {};
+		header10.dxgi_format = texture.format;
+		header10.resource_dimension = DDS_DIMENSION_TEXTURE2D;
+		header10.array_size = 1;
+		header10.misc_flags2 = texture.premultiplied_alpha ? DDS_ALPHA_MODE_PREMULTIPLIED : 0;
+
+		std::ofstream stream(path, std::ios::binary);
+		if (!stream)
+		{
+			return false;
+		}
+
+		const uint32 magic = MAKEFOURCC('D', 'D', 'S', ' ');
+		stream.write((const char*)&magic, sizeof(magic));
+		stream.write((const char*)&header, sizeof(header));
+		stream.write((const char*)&header10, sizeof(header10));
+		stream.write((const char*)texture.data.data(), texture.data.size());
+
+		return (bool)stream;
+	}
+
+	// ----------------------------------------
+	// Sources and cache.
+	// ----------------------------------------
+
+	bool loadTextureSource(const fs::path& path, std::vector<uint8>& outRGBA, uint32& outWidth, uint32& outHeight, uint32& outNumChannels)
+	{
+		std::string extension = path.extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(),
+			[](char c) { return std::tolower(c); });
+
+		if (extension == ".hdr" || extension == ".dds" || extension == ".svg")
+		{
+			return false;
+		}
+
+		DirectX::TexMetadata metadata;
+		DirectX::ScratchImage image;
+		HRESULT result = (extension == ".tga")
+			? DirectX::LoadFromTGAFile(path.c_str(), &metadata, image)
+			: DirectX::LoadFromWICFile(path.c_str(), DirectX::WIC_FLAGS_FORCE_RGB, &metadata, image);
+		if (FAILED(result))
+		{
+			return false;
+		}
+
+		uint32 numChannels = getNumberOfChannels(metadata.format);
+		outNumChannels = numChannels ? numChannels : 4;
+
+		// The cooker applies the transfer function itself, so sRGB sources are read as raw bytes.
+		if (DirectX::IsSRGB(metadata.format))
+		{
+			metadata.format = DirectX::MakeTypelessUNORM(DirectX::MakeTypeless(metadata.format));
+			image.OverrideFormat(metadata.format);
+		}
+
+		if (metadata.format != DXGI_FORMAT_R8G8B8A8_UNORM)
+		{
+			DirectX::ScratchImage converted;
+			if (FAILED(DirectX::Convert(*image.GetImage(0, 0, 0), DXGI_FORMAT_R8G8B8A8_UNORM, DirectX::TEX_FILTER_DEFAULT, DirectX::TEX_THRESHOLD_DEFAULT, converted)))
+			{
+				return false;
+			}
+			image = std::move(converted);
+		}
+
+		const DirectX::Image* level = image.GetImage(0, 0, 0);
+		outWidth = (uint32)level->width;
+		outHeight = (uint32)level->height;
+		outRGBA.resize((uint64)outWidth * outHeight * 4);
+		for (uint32 y = 0; y < outHeight; ++y)
+		{
+			memcpy(outRGBA.data() + (uint64)y * outWidth * 4, level->pixels + y * level->rowPitch, outWidth * 4);
+		}
+
+		return true;
+	}
+
+	uint64 getCookedTextureCacheKey(uint64 contentHash, uint32 imageLoadFlags)
+	{
+		return contentHash ? get_asset_cache_key(contentHash, imageLoadFlags & cookedImageLoadFlags, TEXTURE_COOKER_VERSION) : 0;
+	}
+
+	bool findCookedTexture(const fs::path& path, uint32 imageLoadFlags, fs::path& outCachePath)
+	{
+		uint64 cacheKey = getCookedTextureCacheKey(hash_file_content(path), imageLoadFlags);
+		return cacheKey && find_asset_cache_entry(cacheKey, texture_cache_extension, outCachePath);
+	}
+
+	bool cookTextureToCache(const fs::path& path, uint32 imageLoadFlags, texture_cook_quality quality, bool force, fs::path& outCachePath)
+	{
+		uint64 cacheKey = getCookedTextureCacheKey(hash_file_content(path), imageLoadFlags);
+		if (!cacheKey)
+		{
+			LOG_WARNING("Could not read file '%ws'", path.c_str());
+			return false;
+		}
+
+		if (!force && find_asset_cache_entry(cacheKey, texture_cache_extension, outCachePath))
+		{
+			return true;
+		}
+
+		std::vector<uint8> rgba;
+		uint32 width, height, numChannels;
+		if (!loadTextureSource(path, rgba, width, height, numChannels))
+		{
+			return false;
+		}
+
+		cooked_texture texture;
+		if (!cookTexture(rgba.data(), width, height, numChannels, getTextureCookOptions(imageLoadFlags, quality), texture))
+		{
+			return false;
+		}
+
+		fs::path tempPath = begin_asset_cache_entry(cacheKey, texture_cache_extension);
+		if (!writeCookedTextureToDDS(texture, tempPath))
+		{
+			LOG_ERROR("Could not write cooked texture '%ws'", tempPath.c_str());
+			std::error_code ec;
+			fs::remove(tempPath, ec);
+			return false;
+		}
+		if (!commit_asset_cache_entry(tempPath, cacheKey, texture_cache_extension))
+		{
+			return false;
+		}
+
+		outCachePath = get_asset_cache_path(cacheKey, texture_cache_extension);
+		return true;
+	}
+}
@@ -0,0 +1,126 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#pragma once
+
+#include "core_api.h"
+
+#include <dx/d3dx12.h>
+
+namespace era_engine
+{
+	// CPU texture cooking: mip generation and block compression which need neither a GPU nor DirectXTex's compressors,
+	// so textures can be cooked on headless build machines. Both stages are split over the low priority job queue.
+	// Cooked textures are written as DDS into the asset cache, keyed by the source content and the load flags, where
+	// loadImageFromFile picks them up.
+
+	enum class texture_cook_format
+	{
+		AUTO,
+		BC1,
+		BC3,
+		BC4,
+		BC5,
+		BC7,
+		RGBA8,
+
+		COUNT,
+	};
+
+	static const char* texture_cook_format_names[] =
+	{
+		"Auto",
+		"BC1",
+		"BC3",
+		"BC4",
+		"BC5",
+		"BC7",
+		"RGBA8",
+	};
+
+	// Trades encoding time for quality. FAST fits block endpoints to the bounding box of the block's colors, NORMAL to
+	// their principal axis with one least squares refinement, HIGH refines further and tries more endpoint encodings.
+	enum class texture_cook_quality
+	{
+		FAST,
+		NORMAL,
+		HIGH,
+
+		COUNT,
+	};
+
+	static const char* texture_cook_quality_names[] =
+	{
+		"Fast",
+		"Normal",
+		"High",
+	};
+
+	struct texture_cook_options
+	{
+		// AUTO picks what the runtime loader would: BC4 for one channel, BC5 for two, BC1 for opaque and BC3 for
+		// translucent color. Block compression needs a top level whose dimensions are a multiple of 4, otherwise
+		// RGBA8 is written instead. BC7 only uses the single subset modes 5 and 6.
+		texture_cook_format format = texture_cook_format::AUTO;
+		texture_cook_quality quality = texture_cook_quality::NORMAL;
+
+		// sRGB textures are filtered in linear space and stored with an _SRGB format. BC4 and BC5 are always linear.
+		bool srgb = true;
+		bool generate_mips = true;
+		bool premultiply_alpha = false;
+	};
+
+	struct cooked_texture_mip
+	{
+		uint32 width;
+		uint32 height;
+		uint32 row_pitch; // Bytes per row of blocks for compressed formats.
+		uint64 offset;
+		uint64 size;
+	};
+
+	struct cooked_texture
+	{
+		DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+		uint32 width = 0;
+		uint32 height = 0;
+		bool premultiplied_alpha = false;
+
+		std::vector<cooked_texture_mip> mips;
+		std::vector<uint8> data;
+	};
+
+	// Bump whenever the cooker changes its output, so stale cache entries are not reused.
+	static constexpr uint32 TEXTURE_COOKER_VERSION = 1;
+	inline constexpr const char* texture_cache_extension = ".dds";
+
+	// Options matching the image_load_flags the runtime loader was given. Without image_load_flags_compress the texture
+	// is stored as RGBA8.
+	NODISCARD ERA_CORE_API texture_cook_options getTextureCookOptions(uint32 imageLoadFlags, texture_cook_quality quality = texture_cook_quality::NORMAL);
+
+	// 'rgba' is tightly packed 8 bit RGBA. 'numChannels' is the channel count of the source image (1 to 4) and only
+	// used to resolve texture_cook_format::AUTO. Blocks until the texture is cooked, helping with the jobs meanwhile.
+	ERA_CORE_API bool cookTexture(const uint8* rgba, uint32 width, uint32 height, uint32 numChannels,
+		const texture_cook_options& options, cooked_texture& out);
+
+	// Decodes one mip level back to tightly packed 8 bit RGBA, e.g. to measure the compression error. Only decodes
+	// what cookTexture writes, so BC7 blocks must use mode 5 or 6.
+	ERA_CORE_API bool decodeCookedTexture(const cooked_texture& texture, uint32 mip, std::vector<uint8>& outRGBA);
+
+	ERA_CORE_API bool writeCookedTextureToDDS(const cooked_texture& texture, const fs::path& path);
+
+	// Decodes a PNG, JPEG, TGA, ... with DirectXTex's CPU loaders and converts it to 8 bit RGBA. HDR and DDS sources
+	// are not supported, since they are either floating point or already cooked.
+	ERA_CORE_API bool loadTextureSource(const fs::path& path, std::vector<uint8>& outRGBA, uint32& outWidth, uint32& outHeight, uint32& outNumChannels);
+
+	// Returns 0 if the content hash is 0. Only flags that change the cooked texture are part of the key. The quality is
+	// not, since the runtime loader does not know it. Callers which change it must re-cook with 'force', as the asset
+	// compiler does.
+	NODISCARD ERA_CORE_API uint64 getCookedTextureCacheKey(uint64 contentHash, uint32 imageLoadFlags);
+
+	// Looks up the cooked texture for this source file and these load flags.
+	ERA_CORE_API bool findCookedTexture(const fs::path& path, uint32 imageLoadFlags, fs::path& outCachePath);
+
+	// Cooks the source file into the asset cache, unless an entry already exists and 'force' is false. Returns false if
+	// the source cannot be read or is not supported by loadTextureSource.
+	ERA_CORE_API bool cookTextureToCache(const fs::path& path, uint32 imageLoadFlags, texture_cook_quality quality, bool force, fs::path& outCachePath);
+}
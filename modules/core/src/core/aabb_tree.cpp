@@ -0,0 +1,596 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#include "core/aabb_tree.h"
+#include "core/job_system.h"
+
+namespace era_engine
+{
+	// Half the surface area, which is all the SAH needs.
+	static float area(const bounding_box& aabb)
+	{
+		vec3 d = aabb.maxCorner - aabb.minCorner;
+		return d.x * d.y + d.y * d.z + d.z * d.x;
+	}
+
+	static bounding_box unite(const bounding_box& a, const bounding_box& b)
+	{
+		return bounding_box::fromMinMax(
+			vec3(min(a.minCorner.x, b.minCorner.x), min(a.minCorner.y, b.minCorner.y), min(a.minCorner.z, b.minCorner.z)),
+			vec3(max(a.maxCorner.x, b.maxCorner.x), max(a.maxCorner.y, b.maxCorner.y), max(a.maxCorner.z, b.maxCorner.z)));
+	}
+
+	static bool contains(const bounding_box& outer, const bounding_box& inner)
+	{
+		return outer.minCorner.x <= inner.minCorner.x && outer.minCorner.y <= inner.minCorner.y && outer.minCorner.z <= inner.minCorner.z
+			&& outer.maxCorner.x >= inner.maxCorner.x && outer.maxCorner.y >= inner.maxCorner.y && outer.maxCorner.z >= inner.maxCorner.z;
+	}
+
+	uint32 dynamic_aabb_tree::insert(const bounding_box& aabb, uint64 userData)
+	{
+		uint32 leaf = allocateNode();
+
+		node& n = nodes[leaf];
+		n.aabb = aabb;
+		n.aabb.pad(vec3(margin));
+		n.userData = userData;
+		n.height = 0;
+		leafAABBs[leaf] = aabb;
+
+		insertLeaf(leaf);
+		++numLeaves;
+
+		return leaf;
+	}
+
+	void dynamic_aabb_tree::remove(uint32 proxy)
+	{
+		ASSERT(proxy < nodes.size() && nodes[proxy].height == 0);
+
+		removeLeaf(proxy);
+		freeNode(proxy);
+		--numLeaves;
+	}
+
+	bool dynamic_aabb_tree::move(uint32 proxy, const bounding_box& aabb, vec3 displacement)
+	{
+		ASSERT(proxy < nodes.size() && nodes[proxy].height == 0);
+
+		leafAABBs[proxy] = aabb;
+
+		bounding_box fat = aabb;
+		fat.pad(vec3(margin));
+
+		vec3 d = displacement * displacementMultiplier;
+		for (uint32 i = 0; i < 3; ++i)
+		{
+			if (d.data[i] < 0.f)
+			{
+				fat.minCorner.data[i] += d.data[i];
+			}
+			else
+			{
+				fat.maxCorner.data[i] += d.data[i];
+			}
+		}
+
+		const bounding_box& treeAABB = nodes[proxy].aabb;
+		if (contains(treeAABB, aabb))
+		{
+			// Still enclosed. Only update if the fat box has become much larger than needed, e.g. after the object
+			// stopped moving quickly.
+			bounding_box huge = fat;
+			huge.pad(vec3(4.f * margin));
+			if (contains(huge, treeAABB))
+			{
+				return false;
+			}
+		}
+
+		uint32 parent = nodes[proxy].parent;
+		if (parent == AABB_TREE_NULL_NODE)
+		{
+			nodes[proxy].aabb = fat;
+			return true;
+		}
+
+		// Refit in place while the leaf stays near its sibling. After larger jumps, refitting would bloat all
+		// ancestors, so the leaf is reinserted instead.
+		uint32 sibling = (nodes[parent].child1 == proxy) ? nodes[parent].child2 : nodes[parent].child1;
+		if (area(unite(nodes[sibling].aabb, fat)) <= 2.f * area(nodes[parent].aabb))
+		{
+			nodes[proxy].aabb = fat;
+			refitAncestors(parent);
+		}
+		else
+		{
+			removeLeaf(proxy);
+			nodes[proxy].aabb = fat;
+			insertLeaf(proxy);
+		}
+		return true;
+	}
+
+	void dynamic_aabb_tree::clear()
+	{
+		nodes.clear();
+		leafAABBs.clear();
+		root = AABB_TREE_NULL_NODE;
+		freeList = AABB_TREE_NULL_NODE;
+		numLeaves = 0;
+	}
+
+	float dynamic_aabb_tree::getAreaRatio() const
+	{
+		if (root == AABB_TREE_NULL_NODE)
+		{
+			return 0.f;
+		}
+
+		float totalArea = 0.f;
+		for (const node& n : nodes)
+		{
+			if (n.height > 0)
+			{
+				totalArea += area(n.aabb);
+			}
+		}
+
+		float rootArea = area(nodes[root].aabb);
+		return (rootArea > 0.f) ? totalArea / rootArea : 0.f;
+	}
+
+	bool dynamic_aabb_tree::validate() const
+	{
+		uint32 numFree = 0;
+		for (uint32 i = freeList; i != AABB_TREE_NULL_NODE; i = nodes[i].parent)
+		{
+			if (i >= nodes.size() || nodes[i].height != -1 || ++numFree > nodes.size())
+			{
+				return false;
+			}
+		}
+
+		if (root == AABB_TREE_NULL_NODE)
+		{
+			return numLeaves == 0 && numFree == nodes.size();
+		}
+
+		if (nodes[root].parent != AABB_TREE_NULL_NODE)
+		{
+			return false;
+		}
+
+		uint32 numReached = 0;
+		uint32 numLeavesReached = 0;
+
+		aabb_tree_stack stack;
+		stack.push(root);
+
+		while (!stack.empty())
+		{
+			uint32 index = stack.pop();
+			const node& n = nodes[index];
+
+			if (++numReached > nodes.size())
+			{
+				return false;
+			}
+
+			if (n.isLeaf())
+			{
+				if (n.height != 0 || !contains(n.aabb, leafAABBs[index]))
+				{
+					return false;
+				}
+				++numLeavesReached;
+				continue;
+			}
+
+			const node& c1 = nodes[n.child1];
+			const node& c2 = nodes[n.child2];
+
+			if (c1.parent != index || c2.parent != index
+				|| n.height != 1 + max(c1.height, c2.height)
+				|| !contains(n.aabb, c1.aabb) || !contains(n.aabb, c2.aabb))
+			{
+				return false;
+			}
+
+			stack.push(n.child1);
+			stack.push(n.child2);
+		}
+
+		return numLeavesReached == numLeaves && numReached + numFree == nodes.size();
+	}
+
+	aabb_tree_ray_hit dynamic_aabb_tree::raycastClosest(const ray& r, float maxDistance) const
+	{
+		aabb_tree_ray_hit hit;
+		raycast(r, maxDistance, [&hit](uint32 proxy, float distance)
+		{
+			if (distance < hit.distance)
+			{
+				hit.proxy = proxy;
+				hit.distance = distance;
+			}
+			return distance;
+		});
+		return hit;
+	}
+
+	// Queries are split into chunks, each collecting its hits into its own list. The lists are concatenated in chunk
+	// order, so the result does not depend on scheduling.
+	template <typename query_t>
+	static void batchQuery(uint32 count, aabb_tree_batch_result& out, const query_t& query)
+	{
+		const uint32 chunkSize = 64;
+
+		out.offsets.assign(count + 1, 0);
+		out.proxies.clear();
+
+		uint32 numChunks = (count + chunkSize - 1) / chunkSize;
+		std::vector<std::vector<uint32>> chunkHits(numChunks);
+
+		parallel_for(low_priority_job_queue, numChunks, 1, [&](uint32 chunk)
+		{
+			std::vector<uint32>& hits = chunkHits[chunk];
+
+			uint32 end = min((chunk + 1) * chunkSize, count);
+			for (uint32 i = chunk * chunkSize; i < end; ++i)
+			{
+				query(i, hits);
+				out.offsets[i + 1] = (uint32)hits.size();
+			}
+		});
+
+		uint32 base = 0;
+		for (uint32 chunk = 0; chunk < numChunks; ++chunk)
+		{
+			uint32 end = min((chunk + 1) * chunkSize, count);
+			for (uint32 i = chunk * chunkSize; i < end; ++i)
+			{
+				out.offsets[i + 1] += base;
+			}
+			base += (uint32)chunkHits[chunk].size();
+		}
+
+		out.proxies.reserve(base);
+		for (const std::vector<uint32>& hits : chunkHits)
+		{
+			out.proxies.insert(out.proxies.end(), hits.begin(), hits.end());
+		}
+	}
+
+	void dynamic_aabb_tree::batchQueryAABBs(const bounding_box* aabbs, uint32 count, aabb_tree_batch_result& out) const
+	{
+		batchQuery(count, out, [&](uint32 i, std::vector<uint32>& hits)
+		{
+			queryAABB(aabbs[i], [&hits](uint32 proxy) { hits.push_back(proxy); return true; });
+		});
+	}
+
+	void dynamic_aabb_tree::batchQuerySpheres(const bounding_sphere* spheres, uint32 count, aabb_tree_batch_result& out) const
+	{
+		batchQuery(count, out, [&](uint32 i, std::vector<uint32>& hits)
+		{
+			querySphere(spheres[i], [&hits](uint32 proxy) { hits.push_back(proxy); return true; });
+		});
+	}
+
+	void dynamic_aabb_tree::batchQueryFrustums(const camera_frustum_planes* frustums, uint32 count, aabb_tree_batch_result& out) const
+	{
+		batchQuery(count, out, [&](uint32 i, std::vector<uint32>& hits)
+		{
+			queryFrustum(frustums[i], [&hits](uint32 proxy) { hits.push_back(proxy); return true; });
+		});
+	}
+
+	void dynamic_aabb_tree::batchRaycastClosest(const ray* rays, uint32 count, float maxDistance, aabb_tree_ray_hit* outHits) const
+	{
+		parallel_for(low_priority_job_queue, count, 64, [&](uint32 i)
+		{
+			outHits[i] = raycastClosest(rays[i], maxDistance);
+		});
+	}
+
+	uint32 dynamic_aabb_tree::allocateNode()
+	{
+		uint32 index;
+		if (freeList != AABB_TREE_NULL_NODE)
+		{
+			index = freeList;
+			freeList = nodes[index].parent;
+		}
+		else
+		{
+			index = (uint32)nodes.size();
+			nodes.emplace_back();
+			leafAABBs.emplace_back();
+		}
+
+		node& n = nodes[index];
+		n.parent = AABB_TREE_NULL_NODE;
+		n.child1 = AABB_TREE_NULL_NODE;
+		n.child2 = AABB_TREE_NULL_NODE;
+		n.userData = 0;
+		n.height = 0;
+		return index;
+	}
+
+	void dynamic_aabb_tree::freeNode(uint32 index)
+	{
+		nodes[index].parent = freeList;
+		nodes[index].height = -1;
+		freeList = index;
+	}
+
+	uint32 dynamic_aabb_tree::findBestSibling(const bounding_box& aabb) const
+	{
+		// Branch and bound: the cost of making a node the sibling is the area of the new parent, plus the area every
+		// ancestor grows by. Below a node, the cost is at least the leaf's area plus that growth, so subtrees whose bound
+		// is not lower than the best cost so far are skipped.
+		struct candidate
+		{
+			uint32 index;
+			float inheritedCost;
+		};
+
+		float leafArea = area(aabb);
+
+		uint32 best = root;
+		float bestCost = area(unite(nodes[root].aabb, aabb));
+
+		std::vector<candidate> stack;
+		stack.reserve(64);
+		stack.push_back({ root, 0.f });
+
+		while (!stack.empty())
+		{
+			candidate c = stack.back();
+			stack.pop_back();
+
+			const node& n = nodes[c.index];
+
+			float directCost = area(unite(n.aabb, aabb));
+			float cost = directCost + c.inheritedCost;
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				best = c.index;
+			}
+
+			if (!n.isLeaf())
+			{
+				float inheritedCost = c.inheritedCost + directCost - area(n.aabb);
+				if (leafArea + inheritedCost < bestCost)
+				{
+					stack.push_back({ n.child1, inheritedCost });
+					stack.push_back({ n.child2, inheritedCost });
+				}
+			}
+		}
+
+		return best;
+	}
+
+	void dynamic_aabb_tree::insertLeaf(uint32 leaf)
+	{
+		if (root == AABB_TREE_NULL_NODE)
+		{
+			root = leaf;
+			nodes[leaf].parent = AABB_TREE_NULL_NODE;
+			return;
+		}
+
+		uint32 sibling = findBestSibling(nodes[leaf].aabb);
+		uint32 oldParent = nodes[sibling].parent;
+
+		uint32 newParent = allocateNode();
+		node& p = nodes[newParent];
+		p.parent = oldParent;
+		p.child1 = sibling;
+		p.child2 = leaf;
+		p.aabb = unite(nodes[sibling].aabb, nodes[leaf].aabb);
+		p.height = nodes[sibling].height + 1;
+
+		if (oldParent == AABB_TREE_NULL_NODE)
+		{
+			root = newParent;
+		}
+		else if (nodes[oldParent].child1 == sibling)
+		{
+			nodes[oldParent].child1 = newParent;
+		}
+		else
+		{
+			nodes[oldParent].child2 = newParent;
+		}
+
+		nodes[sibling].parent = newParent;
+		nodes[leaf].parent = newParent;
+
+		refitAncestors(newParent);
+	}
+
+	void dynamic_aabb_tree::removeLeaf(uint32 leaf)
+	{
+		if (leaf == root)
+		{
+			root = AABB_TREE_NULL_NODE;
+			return;
+		}
+
+		uint32 parent = nodes[leaf].parent;
+		uint32 grandParent = nodes[parent].parent;
+		uint32 sibling = (nodes[parent].child1 == leaf) ? nodes[parent].child2 : nodes[parent].child1;
+
+		freeNode(parent);
+
+		if (grandParent == AABB_TREE_NULL_NODE)
+		{
+			root = sibling;
+			nodes[sibling].parent = AABB_TREE_NULL_NODE;
+			return;
+		}
+
+		if (nodes[grandParent].child1 == parent)
+		{
+			nodes[grandParent].child1 = sibling;
+		}
+		else
+		{
+			nodes[grandParent].child2 = sibling;
+		}
+		nodes[sibling].parent = grandParent;
+
+		refitAncestors(grandParent);
+	}
+
+	void dynamic_aabb_tree::refitAncestors(uint32 index)
+	{
+		while (index != AABB_TREE_NULL_NODE)
+		{
+			rotate(index);
+
+			node& n = nodes[index];
+			n.aabb = unite(nodes[n.child1].aabb, nodes[n.child2].aabb);
+			n.height = 1 + max(nodes[n.child1].height, nodes[n.child2].height);
+
+			index = n.parent;
+		}
+	}
+
+	void dynamic_aabb_tree::rotate(uint32 index)
+	{
+		// Tries to swap one child with one of the other child's children. This leaves this node's box unchanged, but
+		// changes the box of the child which receives the swapped node. The swap which lowers that box's area the most
+		// is applied.
+		node& a = nodes[index];
+		if (a.height < 2)
+		{
+			return;
+		}
+
+		uint32 b = a.child1;
+		uint32 c = a.child2;
+
+		float bestGain = 0.f;
+		uint32 bestChild = AABB_TREE_NULL_NODE;      // Child of 'a', which moves down.
+		uint32 bestGrandChild = AABB_TREE_NULL_NODE; // Child of the other child, which moves up.
+
+		auto consider = [&](uint32 child, uint32 other)
+		{
+			const node& o = nodes[other];
+			if (o.isLeaf())
+			{
+				return;
+			}
+
+			float otherArea = area(o.aabb);
+
+			// Moving 'child' down in place of o.child1 leaves o with 'child' and o.child2, and vice versa.
+			float gain1 = otherArea - area(unite(nodes[child].aabb, nodes[o.child2].aabb));
+			float gain2 = otherArea - area(unite(nodes[child].aabb, nodes[o.child1].aabb));
+
+			if (gain1 > bestGain)
+			{
+				bestGain = gain1;
+				bestChild = child;
+				bestGrandChild = o.child1;
+			}
+			if (gain2 > bestGain)
+			{
+				bestGain = gain2;
+				bestChild = child;
+				bestGrandChild = o.child2;
+			}
+		};
+
+		consider(c, b);
+		consider(b, c);
+
+		if (bestChild == AABB_TREE_NULL_NODE)
+		{
+			return;
+		}
+
+		uint32 other = (bestChild == b) ? c : b;
+
+		if (a.child1 == bestChild)
+		{
+			a.child1 = bestGrandChild;
+		}
+		else
+		{
+			a.child2 = bestGrandChild;
+		}
+		nodes[bestGrandChild].parent = index;
+
+		node& o = nodes[other];
+		if (o.child1 == bestGrandChild)
+		{
+			o.child1 = bestChild;
+		}
+		else
+		{
+			o.child2 = bestChild;
+		}
+		nodes[bestChild].parent = other;
+
+		o.aabb = unite(nodes[o.child1].aabb, nodes[o.child2].aabb);
+		o.height = 1 + max(nodes[o.child1].height, nodes[o.child2].height);
+	}
+
+	bool dynamic_aabb_tree::rayVsAABB(vec3 origin, vec3 invDirection, const bounding_box& aabb, float maxDistance, float& outDistance)
+	{
+		float tx1 = (aabb.minCorner.x - origin.x) * invDirection.x;
+		float tx2 = (aabb.maxCorner.x - origin.x) * invDirection.x;
+		float ty1 = (aabb.minCorner.y - origin.y) * invDirection.y;
+		float ty2 = (aabb.maxCorner.y - origin.y) * invDirection.y;
+		float tz1 = (aabb.minCorner.z - origin.z) * invDirection.z;
+		float tz2 = (aabb.maxCorner.z - origin.z) * invDirection.z;
+
+		float tmin = max(max(min(tx1, tx2), min(ty1, ty2)), min(tz1, tz2));
+		float tmax = min(min(max(tx1, tx2), max(ty1, ty2)), max(tz1, tz2));
+
+		tmin = max(tmin, 0.f);
+
+		outDistance = tmin;
+		return tmin <= tmax && tmin <= maxDistance;
+	}
+
+	int32 dynamic_aabb_tree::classifyFrustum(const camera_frustum_planes& frustum, const bounding_box& aabb, uint32& planeMask)
+	{
+		for (uint32 i = 0; i < 6; ++i)
+		{
+			if (!(planeMask & (1 << i)))
+			{
+				continue;
+			}
+
+			const vec4& plane = frustum.planes[i];
+
+			// Corner furthest along the plane's normal. If it is outside, the whole box is.
+			vec3 p(
+				(plane.x < 0.f) ? aabb.minCorner.x : aabb.maxCorner.x,
+				(plane.y < 0.f) ? aabb.minCorner.y : aabb.maxCorner.y,
+				(plane.z < 0.f) ? aabb.minCorner.z : aabb.maxCorner.z);
+			if (signedDistanceToPlane(p, plane) < 0.f)
+			{
+				return -1;
+			}
+
+			// Opposite corner. If it is inside, the whole box is, and so are all children.
+			vec3 n(
+				(plane.x < 0.f) ? aabb.maxCorner.x : aabb.minCorner.x,
+				(plane.y < 0.f) ? aabb.maxCorner.y : aabb.minCorner.y,
+				(plane.z < 0.f) ? aabb.maxCorner.z : aabb.minCorner.z);
+			if (signedDistanceToPlane(n, plane) >= 0.f)
+			{
+				planeMask &= ~(1u << i);
+			}
+		}
+
+		return (planeMask == 0) ? 1 : 0;
+	}
+}
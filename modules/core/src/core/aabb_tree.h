@@ -0,0 +1,330 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#pragma once
+
+#include "core_api.h"
+
+#include "core/bounding_volumes.h"
+#include "core/camera.h"
+
+namespace era_engine
+{
+	// Dynamic bounding volume hierarchy over AABBs, for spatial queries over objects which are added, removed and moved
+	// at runtime. Leaves keep the object's box and a "fat" box, padded by a margin and the last displacement, so that
+	// small movements do not touch the tree. When a box leaves its fat box, the leaf is refit in place, or reinserted if
+	// it moved far. New leaves are placed next to the sibling with the lowest surface area heuristic (SAH) cost, found
+	// with a branch and bound search. After every structural change, the ancestors are refit and rotated wherever a
+	// rotation lowers their surface area.
+	//
+	// Queries test internal nodes against the fat boxes and leaves against the object's box, so they report exactly the
+	// objects whose box passes the test. Objects are identified by their proxy, which stays valid until removed.
+
+	static constexpr uint32 AABB_TREE_NULL_NODE = (uint32)-1;
+
+	struct aabb_tree_ray_hit
+	{
+		uint32 proxy = AABB_TREE_NULL_NODE;
+		float distance = FLT_MAX;
+	};
+
+	// Results of a batch query. The hits of query i are proxies[offsets[i]] to proxies[offsets[i + 1] - 1], in the
+	// order the single query would report them.
+	struct aabb_tree_batch_result
+	{
+		NODISCARD uint32 numHits(uint32 query) const { return offsets[query + 1] - offsets[query]; }
+		NODISCARD const uint32* hits(uint32 query) const { return proxies.data() + offsets[query]; }
+
+		std::vector<uint32> offsets;
+		std::vector<uint32> proxies;
+	};
+
+	// Traversal stack, which only allocates for unusually deep trees.
+	struct aabb_tree_stack
+	{
+		void push(uint32 node)
+		{
+			if (overflow.empty() && count < arraysize(fixed))
+			{
+				fixed[count++] = node;
+			}
+			else
+			{
+				overflow.push_back(node);
+			}
+		}
+
+		uint32 pop()
+		{
+			if (!overflow.empty())
+			{
+				uint32 node = overflow.back();
+				overflow.pop_back();
+				return node;
+			}
+			return fixed[--count];
+		}
+
+		NODISCARD bool empty() const { return count == 0 && overflow.empty(); }
+
+	private:
+		uint32 fixed[64];
+		uint32 count = 0;
+		std::vector<uint32> overflow;
+	};
+
+	struct ERA_CORE_API dynamic_aabb_tree
+	{
+		uint32 insert(const bounding_box& aabb, uint64 userData = 0);
+		void remove(uint32 proxy);
+
+		// 'displacement' is the movement since the last update. The fat box is extended in its direction, so objects
+		// moving at a steady speed need fewer updates. Returns true if the tree was changed.
+		bool move(uint32 proxy, const bounding_box& aabb, vec3 displacement = vec3(0.f));
+
+		void clear();
+
+		NODISCARD uint64 getUserData(uint32 proxy) const { return nodes[proxy].userData; }
+		NODISCARD const bounding_box& getAABB(uint32 proxy) const { return leafAABBs[proxy]; }
+		NODISCARD const bounding_box& getFatAABB(uint32 proxy) const { return nodes[proxy].aabb; }
+
+		NODISCARD uint32 size() const { return numLeaves; }
+		NODISCARD uint32 getHeight() const { return (root == AABB_TREE_NULL_NODE) ? 0 : (uint32)nodes[root].height; }
+
+		// Sum of the surface areas of all internal nodes, relative to the root's. Lower is better.
+		NODISCARD float getAreaRatio() const;
+
+		// Checks parent links, heights and that every node encloses its children. For tests.
+		NODISCARD bool validate() const;
+
+		// Callbacks take the proxy and return false to stop the query.
+		template <typename func_t> void queryAABB(const bounding_box& aabb, const func_t& callback) const;
+		template <typename func_t> void querySphere(const bounding_sphere& sphere, const func_t& callback) const;
+		template <typename func_t> void queryFrustum(const camera_frustum_planes& frustum, const func_t& callback) const;
+
+		// The callback takes the proxy and the distance at which the ray enters its box, and returns the new maximum
+		// distance. Return 'distance' to clip the ray to this box, the previous maximum to keep going, or 0 to stop.
+		// Nearer children are visited first.
+		template <typename func_t> void raycast(const ray& r, float maxDistance, const func_t& callback) const;
+
+		// Nearest box along the ray, within 'maxDistance'. Rays starting inside a box hit it at distance 0.
+		NODISCARD aabb_tree_ray_hit raycastClosest(const ray& r, float maxDistance = FLT_MAX) const;
+
+		// Run many independent queries in parallel over the low priority job queue. Blocks until all are done.
+		void batchQueryAABBs(const bounding_box* aabbs, uint32 count, aabb_tree_batch_result& out) const;
+		void batchQuerySpheres(const bounding_sphere* spheres, uint32 count, aabb_tree_batch_result& out) const;
+		void batchQueryFrustums(const camera_frustum_planes* frustums, uint32 count, aabb_tree_batch_result& out) const;
+		void batchRaycastClosest(const ray* rays, uint32 count, float maxDistance, aabb_tree_ray_hit* outHits) const;
+
+		// Padding of fat boxes, and how far ahead of the displacement they are extended.
+		float margin = 0.1f;
+		float displacementMultiplier = 2.f;
+
+	private:
+		struct node
+		{
+			NODISCARD bool isLeaf() const { return child1 == AABB_TREE_NULL_NODE; }
+
+			bounding_box aabb;
+			uint64 userData;
+			uint32 parent;
+			uint32 child1;
+			uint32 child2;
+			int32 height; // 0 for leaves, -1 for free nodes.
+		};
+
+		uint32 allocateNode();
+		void freeNode(uint32 index);
+
+		void insertLeaf(uint32 leaf);
+		void removeLeaf(uint32 leaf);
+		uint32 findBestSibling(const bounding_box& aabb) const;
+
+		// Refits the boxes and heights from 'index' up to the root, rotating where it pays off.
+		void refitAncestors(uint32 index);
+		void rotate(uint32 index);
+
+		static bool rayVsAABB(vec3 origin, vec3 invDirection, const bounding_box& aabb, float maxDistance, float& outDistance);
+		static int32 classifyFrustum(const camera_frustum_planes& frustum, const bounding_box& aabb, uint32& planeMask);
+
+		std::vector<node> nodes;
+		std::vector<bounding_box> leafAABBs; // Indexed by node, only valid for leaves.
+		uint32 root = AABB_TREE_NULL_NODE;
+		uint32 freeList = AABB_TREE_NULL_NODE;
+		uint32 numLeaves = 0;
+	};
+
+	template <typename func_t>
+	inline void dynamic_aabb_tree::queryAABB(const bounding_box& aabb, const func_t& callback) const
+	{
+		if (root == AABB_TREE_NULL_NODE)
+		{
+			return;
+		}
+
+		aabb_tree_stack stack;
+		stack.push(root);
+
+		while (!stack.empty())
+		{
+			uint32 index = stack.pop();
+			const node& n = nodes[index];
+
+			if (n.isLeaf())
+			{
+				if (aabbVsAABB(leafAABBs[index], aabb) && !callback(index))
+				{
+					return;
+				}
+			}
+			else if (aabbVsAABB(n.aabb, aabb))
+			{
+				stack.push(n.child2);
+				stack.push(n.child1);
+			}
+		}
+	}
+
+	template <typename func_t>
+	inline void dynamic_aabb_tree::querySphere(const bounding_sphere& sphere, const func_t& callback) const
+	{
+		if (root == AABB_TREE_NULL_NODE)
+		{
+			return;
+		}
+
+		aabb_tree_stack stack;
+		stack.push(root);
+
+		while (!stack.empty())
+		{
+			uint32 index = stack.pop();
+			const node& n = nodes[index];
+
+			if (n.isLeaf())
+			{
+				if (sphereVsAABB(sphere, leafAABBs[index]) && !callback(index))
+				{
+					return;
+				}
+			}
+			else if (sphereVsAABB(sphere, n.aabb))
+			{
+				stack.push(n.child2);
+				stack.push(n.child1);
+			}
+		}
+	}
+
+	template <typename func_t>
+	inline void dynamic_aabb_tree::queryFrustum(const camera_frustum_planes& frustum, const func_t& callback) const
+	{
+		if (root == AABB_TREE_NULL_NODE)
+		{
+			return;
+		}
+
+		// Planes which a node is completely inside of are not tested again below it. Subtrees completely inside all
+		// planes are reported without any further tests.
+		struct entry
+		{
+			uint32 index;
+			uint32 planeMask;
+		};
+
+		std::vector<entry> stack;
+		stack.reserve(64);
+		stack.push_back({ root, 0x3F });
+
+		while (!stack.empty())
+		{
+			entry e = stack.back();
+			stack.pop_back();
+
+			const node& n = nodes[e.index];
+			uint32 planeMask = e.planeMask;
+
+			if (planeMask != 0)
+			{
+				const bounding_box& aabb = n.isLeaf() ? leafAABBs[e.index] : n.aabb;
+				if (classifyFrustum(frustum, aabb, planeMask) < 0)
+				{
+					continue;
+				}
+			}
+
+			if (n.isLeaf())
+			{
+				if (!callback(e.index))
+				{
+					return;
+				}
+			}
+			else
+			{
+				stack.push_back({ n.child2, planeMask });
+				stack.push_back({ n.child1, planeMask });
+			}
+		}
+	}
+
+	template <typename func_t>
+	inline void dynamic_aabb_tree::raycast(const ray& r, float maxDistance, const func_t& callback) const
+	{
+		if (root == AABB_TREE_NULL_NODE)
+		{
+			return;
+		}
+
+		// Avoids 0 * inf for axis aligned rays.
+		auto safeInverse = [](float d) { return 1.f / ((abs(d) > 1e-20f) ? d : ((d < 0.f) ? -1e-20f : 1e-20f)); };
+		vec3 invDirection(safeInverse(r.direction.x), safeInverse(r.direction.y), safeInverse(r.direction.z));
+
+		float distance;
+		if (!rayVsAABB(r.origin, invDirection, nodes[root].aabb, maxDistance, distance))
+		{
+			return;
+		}
+
+		aabb_tree_stack stack;
+		stack.push(root);
+
+		while (!stack.empty())
+		{
+			uint32 index = stack.pop();
+			const node& n = nodes[index];
+
+			if (n.isLeaf())
+			{
+				if (rayVsAABB(r.origin, invDirection, leafAABBs[index], maxDistance, distance))
+				{
+					maxDistance = callback(index, distance);
+					if (maxDistance <= 0.f)
+					{
+						return;
+					}
+				}
+				continue;
+			}
+
+			float distance1, distance2;
+			bool hit1 = rayVsAABB(r.origin, invDirection, nodes[n.child1].aabb, maxDistance, distance1);
+			bool hit2 = rayVsAABB(r.origin, invDirection, nodes[n.child2].aabb, maxDistance, distance2);
+
+			if (hit1 && hit2)
+			{
+				// The nearer child is popped first.
+				bool firstIsNearer = distance1 <= distance2;
+				stack.push(firstIsNearer ? n.child2 : n.child1);
+				stack.push(firstIsNearer ? n.child1 : n.child2);
+			}
+			else if (hit1)
+			{
+				stack.push(n.child1);
+			}
+			else if (hit2)
+			{
+				stack.push(n.child2);
+			}
+		}
+	}
+}
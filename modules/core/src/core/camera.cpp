@@ -300,39 +300,24 @@ namespace era_engine
 
 	NODISCARD bool camera_frustum_planes::cullModelSpaceAABB(const bounding_box& aabb, const mat4& transform) const
 	{
-		// TODO: Transform planes instead of AABB?
-
-		vec4 worldSpaceCorners[] =
-		{
-			transform * vec4(aabb.minCorner.x, aabb.minCorner.y, aabb.minCorner.z, 1.f),
-			transform * vec4(aabb.maxCorner.x, aabb.minCorner.y, aabb.minCorner.z, 1.f),
-			transform * vec4(aabb.minCorner.x, aabb.maxCorner.y, aabb.minCorner.z, 1.f),
-			transform * vec4(aabb.maxCorner.x, aabb.maxCorner.y, aabb.minCorner.z, 1.f),
-			transform * vec4(aabb.minCorner.x, aabb.minCorner.y, aabb.maxCorner.z, 1.f),
-			transform * vec4(aabb.maxCorner.x, aabb.minCorner.y, aabb.maxCorner.z, 1.f),
-			transform * vec4(aabb.minCorner.x, aabb.maxCorner.y, aabb.maxCorner.z, 1.f),
-			transform * vec4(aabb.maxCorner.x, aabb.maxCorner.y, aabb.maxCorner.z, 1.f),
-		};
+		// Transform the planes to model space instead of the eight corners to world space. dot(plane, M * p) equals
+		// dot(transpose(M) * plane, p), so this culls exactly the same boxes.
+		mat4 transposed = transpose(transform);
 
 		for (uint32 i = 0; i < 6; ++i)
 		{
-			vec4 plane = planes[i];
-
-			bool inside = false;
-
-			for (uint32 j = 0; j < 8; ++j)
+			vec4 plane = transposed * planes[i];
+			vec4 vertex(
+				(plane.x < 0.f) ? aabb.minCorner.x : aabb.maxCorner.x,
+				(plane.y < 0.f) ? aabb.minCorner.y : aabb.maxCorner.y,
+				(plane.z < 0.f) ? aabb.minCorner.z : aabb.maxCorner.z,
+				1.f
+			);
+			if (dot(plane, vertex) <= 0.f)
 			{
-				if (dot(plane, worldSpaceCorners[j]) > 0.f)
-				{
-					inside = true;
-					break;
-				}
-			}
-
-			if (!inside)
 				return true;
+			}
 		}
-
 		return false;
 	}
 }
\ No newline at end of file
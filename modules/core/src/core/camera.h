@@ -34,7 +34,7 @@ namespace era_engine
 		vec3 eye;
 	};
 
-	union camera_frustum_planes
+	union ERA_CORE_API camera_frustum_planes
 	{
 		camera_frustum_planes() {};
 
@@ -140,5 +140,5 @@ namespace era_engine
 		(cy, "Cy")
 	);
 
-	camera_frustum_planes getWorldSpaceFrustumPlanes(const mat4& viewProj);
+	ERA_CORE_API camera_frustum_planes getWorldSpaceFrustumPlanes(const mat4& viewProj);
 }
\ No newline at end of file
@@ -209,4 +209,123 @@ namespace era_engine
 		std::cerr << "GJK ERROR 2\n";
 		return gjk_unexpected_error;
 	}
+	void epa_polytope::initialize(const vec3& a, const vec3& b, const vec3& c, const vec3& d)
+	{
+		vertices.clear();
+		faces.clear();
+
+		vertices.push_back(a);
+		vertices.push_back(b);
+		vertices.push_back(c);
+		vertices.push_back(d);
+
+		vec3 center = (a + b + c + d) * 0.25f;
+
+		const uint32 indices[4][3] = { { 0, 1, 2 }, { 0, 3, 1 }, { 0, 2, 3 }, { 1, 3, 2 } };
+		for (uint32 i = 0; i < 4; ++i)
+		{
+			uint32 i0 = indices[i][0];
+			uint32 i1 = indices[i][1];
+			uint32 i2 = indices[i][2];
+
+			// Wind all faces so that they face away from the center.
+			vec3 n = cross(vertices[i1] - vertices[i0], vertices[i2] - vertices[i0]);
+			if (dot(n, vertices[i0] - center) < 0.f)
+			{
+				std::swap(i1, i2);
+			}
+			addFace(i0, i1, i2);
+		}
+	}
+
+	int32 epa_polytope::getClosestFace() const
+	{
+		int32 result = -1;
+		float minDistance = FLT_MAX;
+		for (uint32 i = 0; i < (uint32)faces.size(); ++i)
+		{
+			if (faces[i].distance < minDistance)
+			{
+				minDistance = faces[i].distance;
+				result = (int32)i;
+			}
+		}
+		return result;
+	}
+
+	bool epa_polytope::expand(const vec3& p)
+	{
+		horizon.clear();
+
+		for (uint32 i = 0; i < (uint32)faces.size();)
+		{
+			const face& f = faces[i];
+			if (f.distance != FLT_MAX && dot(f.normal, p - vertices[f.a]) > 0.f)
+			{
+				addHorizonEdge(f.a, f.b);
+				addHorizonEdge(f.b, f.c);
+				addHorizonEdge(f.c, f.a);
+
+				faces[i] = faces.back();
+				faces.pop_back();
+			}
+			else
+			{
+				++i;
+			}
+		}
+
+		if (horizon.empty())
+		{
+			return false;
+		}
+
+		uint32 index = (uint32)vertices.size();
+		vertices.push_back(p);
+
+		for (const edge& e : horizon)
+		{
+			addFace(e.a, e.b, index);
+		}
+
+		return true;
+	}
+
+	void epa_polytope::addFace(uint32 a, uint32 b, uint32 c)
+	{
+		face f;
+		f.a = a;
+		f.b = b;
+		f.c = c;
+
+		vec3 n = cross(vertices[b] - vertices[a], vertices[c] - vertices[a]);
+		float sqLength = squared_length(n);
+		if (sqLength > 1e-12f)
+		{
+			f.normal = n / sqrt(sqLength);
+			f.distance = dot(f.normal, vertices[a]);
+		}
+		else
+		{
+			f.normal = vec3(0.f);
+			f.distance = FLT_MAX;
+		}
+
+		faces.push_back(f);
+	}
+
+	void epa_polytope::addHorizonEdge(uint32 a, uint32 b)
+	{
+		// An edge shared by two removed faces appears once in each direction and is not on the horizon.
+		for (uint32 i = 0; i < (uint32)horizon.size(); ++i)
+		{
+			if (horizon[i].a == b && horizon[i].b == a)
+			{
+				horizon[i] = horizon.back();
+				horizon.pop_back();
+				return;
+			}
+		}
+		horizon.push_back({ a, b });
+	}
 }
\ No newline at end of file
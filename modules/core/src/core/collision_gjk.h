@@ -5,6 +5,7 @@
 #include "core_api.h"
 
 #include "core/bounding_volumes.h"
+#include "core/bounding_volumes_simd.h"
 
 namespace era_engine
 {
@@ -229,4 +230,451 @@ namespace era_engine
 
 		return true;
 	}
+
+	// Expanding polytope algorithm. Finds how deep two intersecting shapes penetrate, starting from the tetrahedron around
+	// the origin which gjkIntersectionTest returns. The polytope is grown towards the face closest to the origin until the
+	// support point in its direction is no farther away than EPA_TOLERANCE.
+
+	static constexpr float EPA_TOLERANCE = 0.0001f;
+
+	struct gjk_penetration
+	{
+		vec3 normal; // Points from shape A to shape B. Moving B by normal * penetrationDepth separates the shapes.
+		float penetrationDepth;
+	};
+
+	struct ERA_CORE_API epa_polytope
+	{
+		struct face
+		{
+			uint32 a, b, c; // Counter clockwise, seen from outside.
+			vec3 normal;
+			float distance; // To the origin. FLT_MAX for degenerate faces.
+		};
+
+		void initialize(const vec3& a, const vec3& b, const vec3& c, const vec3& d);
+
+		// Returns -1 if all faces are degenerate.
+		NODISCARD int32 getClosestFace() const;
+
+		// Replaces all faces which can see p by a fan around p. Returns false if no face can see p.
+		bool expand(const vec3& p);
+
+		std::vector<vec3> vertices;
+		std::vector<face> faces;
+
+	private:
+		struct edge
+		{
+			uint32 a, b;
+		};
+
+		void addFace(uint32 a, uint32 b, uint32 c);
+		void addHorizonEdge(uint32 a, uint32 b);
+
+		std::vector<edge> horizon;
+	};
+
+	// Returns false if the search did not converge within maxIterations. outPenetration then holds the best estimate.
+	template <typename shapeA_t, typename shapeB_t>
+	static bool epaPenetration(const shapeA_t& shapeA, const shapeB_t& shapeB, const gjk_simplex& simplex, gjk_penetration& outPenetration, uint32 maxIterations = 128)
+	{
+		ASSERT(simplex.numPoints == 4);
+
+		epa_polytope polytope;
+		polytope.initialize(simplex.a.minkowski, simplex.b.minkowski, simplex.c.minkowski, simplex.d.minkowski);
+
+		outPenetration.normal = vec3(0.f, 1.f, 0.f);
+		outPenetration.penetrationDepth = 0.f;
+
+		for (uint32 i = 0; i < maxIterations; ++i)
+		{
+			int32 closest = polytope.getClosestFace();
+			if (closest < 0)
+				return false;
+
+			vec3 normal = polytope.faces[closest].normal;
+			float distance = polytope.faces[closest].distance;
+
+			outPenetration.normal = normal;
+			outPenetration.penetrationDepth = distance;
+
+			vec3 p = support(shapeA, shapeB, normal).minkowski;
+			if (dot(p, normal) - distance < EPA_TOLERANCE)
+				return true;
+
+			if (!polytope.expand(p))
+				return true;
+		}
+
+		return false;
+	}
+
+	// Batched GJK. Tests one independent shape pair per SIMD lane. All lanes take the same steps as gjkIntersectionTest,
+	// with the branches of the simplex update turned into masked selects, until every lane has a result. Only the
+	// Minkowski points of the simplex are tracked.
+
+	template <typename simd_t>
+	struct wN_sphere_support_fn
+	{
+		wN_vec3<simd_t> operator()(const wN_vec3<simd_t>& dir) const
+		{
+			// Not normalize, which uses an approximate reciprocal square root.
+			return dir * (s.radius / sqrt(squared_length(dir))) + s.center;
+		}
+
+		const wN_bounding_sphere<simd_t>& s;
+	};
+
+	template <typename simd_t>
+	struct wN_capsule_support_fn
+	{
+		wN_vec3<simd_t> operator()(const wN_vec3<simd_t>& dir) const
+		{
+			simd_t distA = dot(dir, c.positionA);
+			simd_t distB = dot(dir, c.positionB);
+			wN_vec3<simd_t> fartherPoint = if_then(distA > distB, c.positionA, c.positionB);
+			return dir * (c.radius / sqrt(squared_length(dir))) + fartherPoint;
+		}
+
+		const wN_bounding_capsule<simd_t>& c;
+	};
+
+	template <typename simd_t>
+	struct wN_aabb_support_fn
+	{
+		wN_vec3<simd_t> operator()(const wN_vec3<simd_t>& dir) const
+		{
+			return wN_vec3<simd_t>(
+				if_then(dir.x < 0.f, b.minCorner.x, b.maxCorner.x),
+				if_then(dir.y < 0.f, b.minCorner.y, b.maxCorner.y),
+				if_then(dir.z < 0.f, b.minCorner.z, b.maxCorner.z)
+			);
+		}
+
+		const wN_bounding_box<simd_t>& b;
+	};
+
+	template <typename simd_t>
+	struct wN_obb_support_fn
+	{
+		wN_vec3<simd_t> operator()(wN_vec3<simd_t> dir) const
+		{
+			dir = conjugate(b.rotation) * dir;
+			wN_vec3<simd_t> r(
+				if_then(dir.x < 0.f, -b.radius.x, b.radius.x),
+				if_then(dir.y < 0.f, -b.radius.y, b.radius.y),
+				if_then(dir.z < 0.f, -b.radius.z, b.radius.z)
+			);
+
+			return b.center + b.rotation * r;
+		}
+
+		const wN_bounding_oriented_box<simd_t>& b;
+	};
+
+	template <typename simd_t>
+	struct wN_gjk_simplex
+	{
+		wN_vec3<simd_t> a, b, c, d; // Minkowski points. Where the shapes intersect, a-d enclose the origin.
+	};
+
+	template <typename simd_t, typename shapeA_t, typename shapeB_t>
+	static wN_vec3<simd_t> support(const shapeA_t& a, const shapeB_t& b, const wN_vec3<simd_t>& dir)
+	{
+		return a(dir) - b(-dir);
+	}
+
+	template <typename simd_t>
+	static inline wN_vec3<simd_t> crossABA(const wN_vec3<simd_t>& a, const wN_vec3<simd_t>& b)
+	{
+		return cross(cross(a, b), a);
+	}
+
+	// Returns the lane mask of the intersecting pairs. Lanes which take more than maxIterations steps count as not
+	// intersecting. The scalar version has no such limit, but never needs more than a handful of steps in practice.
+	template <typename simd_t, typename shapeA_t, typename shapeB_t>
+	static auto gjkIntersectionTest(const shapeA_t& shapeA, const shapeB_t& shapeB, wN_gjk_simplex<simd_t>& outSimplex, uint32 maxIterations = 64)
+	{
+		typedef wN_vec3<simd_t> vec3_t;
+		typedef decltype(simd_t::zero() < simd_t::zero()) mask_t;
+
+		wN_gjk_simplex<simd_t>& s = outSimplex;
+
+		vec3_t dir(simd_t(1.f), simd_t(0.1f), simd_t(-0.2f)); // Arbitrary.
+
+		// First point.
+		s.c = support(shapeA, shapeB, dir);
+		mask_t active = dot(s.c, dir) >= 0.f;
+
+		// Second point.
+		dir = -s.c;
+		s.b = support(shapeA, shapeB, dir);
+		active &= dot(s.b, dir) >= 0.f;
+
+		s.a = s.d = s.b;
+		dir = crossABA(s.c - s.b, -s.b);
+
+		mask_t hit = simd_t::zero() < 0.f;
+		mask_t tetrahedron = simd_t::zero() < 0.f; // Else triangle case.
+
+		for (uint32 iteration = 0; iteration < maxIterations && any_true(active); ++iteration)
+		{
+			active &= ~(squared_length(dir) < 0.0001f);
+
+			vec3_t a = support(shapeA, shapeB, dir);
+			active &= ~(dot(a, dir) < 0.f);
+
+			vec3_t ao = -a;
+			vec3_t ab = s.b - a;
+			vec3_t ac = s.c - a;
+			vec3_t ad = s.d - a;
+
+			mask_t triangleLanes = active & ~tetrahedron;
+			mask_t tetrahedronLanes = active & tetrahedron;
+
+			// Triangle case.
+			vec3_t triABC = cross(ab, ac);
+
+			mask_t triLineAB = triangleLanes & (dot(ao, cross(ab, triABC)) > 0.f);
+			mask_t triLineAC = triangleLanes & ~triLineAB & (dot(ao, cross(triABC, ac)) > 0.f);
+			mask_t triLineLanes = triLineAB | triLineAC;
+			mask_t triAbove = triangleLanes & ~triLineLanes & (dot(ao, triABC) >= 0.f);
+			mask_t triBelow = triangleLanes & ~triLineLanes & ~triAbove & (dot(ao, -triABC) >= 0.f);
+			mask_t triError = triangleLanes & ~(triLineLanes | triAbove | triBelow);
+
+			// Tetrahedron case.
+			vec3_t bcd = cross(s.c - s.b, s.d - s.b);
+			mask_t tetError = tetrahedronLanes & ((dot(bcd, dir) > 0.00001f) | (dot(bcd, s.b) < -0.00001f));
+
+			// Normals of faces (point outside).
+			vec3_t abc = cross(ac, ab);
+			vec3_t abd = cross(ab, ad);
+			vec3_t adc = cross(ad, ac);
+
+			mask_t valid = tetrahedronLanes & ~tetError;
+			mask_t overABC = valid & (dot(abc, ao) > 0.f);
+			mask_t overABD = valid & (dot(abd, ao) > 0.f);
+			mask_t overADC = valid & (dot(adc, ao) > 0.f);
+
+			mask_t overAll = overABC & overABD & overADC;
+			tetError |= overAll;
+			mask_t tetStop = valid & ~(overABC | overABD | overADC);
+
+			mask_t edgeABC_AB = dot(cross(abc, ab), ao) > 0.f;
+			mask_t edgeAC_ABC = dot(cross(ac, abc), ao) > 0.f;
+			mask_t edgeABD_AD = dot(cross(abd, ad), ao) > 0.f;
+			mask_t edgeAB_ABD = dot(cross(ab, abd), ao) > 0.f;
+			mask_t edgeADC_AC = dot(cross(adc, ac), ao) > 0.f;
+			mask_t edgeAD_ADC = dot(cross(ad, adc), ao) > 0.f;
+
+			// Entry points of the scalar version's branches. Two faces seen from the origin pick one of them.
+			mask_t overABC_ABD = overABC & overABD & ~overAll;
+			mask_t overABD_ADC = overABD & overADC & ~overAll;
+			mask_t overADC_ABC = overADC & overABC & ~overAll;
+
+			mask_t enterABC1 = (overABC & ~overABD & ~overADC) | (overADC_ABC & edgeADC_AC);
+			mask_t enterABD1 = (overABD & ~overABC & ~overADC) | (overABC_ABD & edgeABC_AB);
+			mask_t enterADC1 = (overADC & ~overABC & ~overABD) | (overABD_ADC & edgeABD_AD);
+			mask_t enterABC2 = (enterABC1 | overABC_ABD) & ~edgeABC_AB;
+			mask_t enterABD2 = (enterABD1 | overABD_ADC) & ~edgeABD_AD;
+			mask_t enterADC2 = (enterADC1 | overADC_ABC) & ~edgeADC_AC;
+
+			mask_t tetLineAB = (enterABC1 & edgeABC_AB) | (enterABD2 & edgeAB_ABD);
+			mask_t tetLineAC = (enterABC2 & edgeAC_ABC) | (enterADC1 & edgeADC_AC);
+			mask_t tetLineDA = enterABD1 & edgeABD_AD; // New line: b = d, c = a.
+			mask_t tetLineAD = enterADC2 & edgeAD_ADC; // New line: b = a, c = d.
+			mask_t tetABC = enterABC2 & ~edgeAC_ABC;
+			mask_t tetABD = enterABD2 & ~edgeAB_ABD;
+			mask_t tetADC = enterADC2 & ~edgeAD_ADC;
+
+			// Apply. The cases are exclusive, lanes which are done or hit match none of them.
+			mask_t bToA = triLineAC | triAbove | triBelow | tetLineAC | tetLineAD | tetADC;
+			mask_t cToA = triLineAB | tetLineAB | tetLineDA | tetABD;
+			vec3_t newB = if_then(bToA, a, if_then(tetLineDA, s.d, s.b));
+			vec3_t newC = if_then(cToA, a, if_then(triBelow, s.b, if_then(tetLineAD, s.d, s.c)));
+			vec3_t newD = if_then(triAbove, s.b, if_then(triBelow, s.c, if_then(tetABC, a, s.d)));
+			s.b = newB;
+			s.c = newC;
+			s.d = newD;
+
+			dir = if_then(triLineAB | tetLineAB, crossABA(ab, ao), dir);
+			dir = if_then(triLineAC | tetLineAC, crossABA(ac, ao), dir);
+			dir = if_then(tetLineDA | tetLineAD, crossABA(ad, ao), dir);
+			dir = if_then(triAbove, triABC, dir);
+			dir = if_then(triBelow, -triABC, dir);
+			dir = if_then(tetABC, abc, dir);
+			dir = if_then(tetABD, abd, dir);
+			dir = if_then(tetADC, adc, dir);
+
+			tetrahedron = (tetrahedron & ~(tetLineAB | tetLineAC | tetLineDA | tetLineAD)) | triAbove | triBelow;
+
+			mask_t tetHit = tetStop & ~tetError;
+			s.a = if_then(tetHit, a, s.a);
+			hit |= tetHit;
+			active &= ~(tetHit | tetError | triError);
+		}
+
+		return hit;
+	}
+
+	// Loads up to simd_t's width of scalar shapes into the lanes of a wN shape. Unused lanes repeat the last shape.
+	template <typename shape_t>
+	struct gjk_shape_traits;
+
+	template <typename simd_t, typename shape_t, typename func_t>
+	static simd_t gatherGJKLanes(const shape_t* shapes, uint32 count, const func_t& get)
+	{
+		constexpr uint32 width = sizeof(simd_t) / sizeof(float);
+		float values[width];
+		for (uint32 i = 0; i < width; ++i)
+		{
+			values[i] = get(shapes[min(i, count - 1)]);
+		}
+		return simd_t(values);
+	}
+
+	template <typename simd_t, typename shape_t, typename func_t>
+	static wN_vec3<simd_t> gatherGJKLanesVec3(const shape_t* shapes, uint32 count, const func_t& get)
+	{
+		return wN_vec3<simd_t>(
+			gatherGJKLanes<simd_t>(shapes, count, [&get](const shape_t& s) { return get(s).x; }),
+			gatherGJKLanes<simd_t>(shapes, count, [&get](const shape_t& s) { return get(s).y; }),
+			gatherGJKLanes<simd_t>(shapes, count, [&get](const shape_t& s) { return get(s).z; }));
+	}
+
+	template <>
+	struct gjk_shape_traits<bounding_sphere>
+	{
+		typedef sphere_support_fn support_fn;
+		template <typename simd_t> using wN_shape = wN_bounding_sphere<simd_t>;
+		template <typename simd_t> using wN_support_fn = wN_sphere_support_fn<simd_t>;
+
+		template <typename simd_t>
+		static wN_shape<simd_t> load(const bounding_sphere* shapes, uint32 count)
+		{
+			return {
+				gatherGJKLanesVec3<simd_t>(shapes, count, [](const bounding_sphere& s) { return s.center; }),
+				gatherGJKLanes<simd_t>(shapes, count, [](const bounding_sphere& s) { return s.radius; }) };
+		}
+	};
+
+	template <>
+	struct gjk_shape_traits<bounding_capsule>
+	{
+		typedef capsule_support_fn support_fn;
+		template <typename simd_t> using wN_shape = wN_bounding_capsule<simd_t>;
+		template <typename simd_t> using wN_support_fn = wN_capsule_support_fn<simd_t>;
+
+		template <typename simd_t>
+		static wN_shape<simd_t> load(const bounding_capsule* shapes, uint32 count)
+		{
+			return {
+				gatherGJKLanesVec3<simd_t>(shapes, count, [](const bounding_capsule& c) { return c.positionA; }),
+				gatherGJKLanesVec3<simd_t>(shapes, count, [](const bounding_capsule& c) { return c.positionB; }),
+				gatherGJKLanes<simd_t>(shapes, count, [](const bounding_capsule& c) { return c.radius; }) };
+		}
+	};
+
+	template <>
+	struct gjk_shape_traits<bounding_box>
+	{
+		typedef aabb_support_fn support_fn;
+		template <typename simd_t> using wN_shape = wN_bounding_box<simd_t>;
+		template <typename simd_t> using wN_support_fn = wN_aabb_support_fn<simd_t>;
+
+		template <typename simd_t>
+		static wN_shape<simd_t> load(const bounding_box* shapes, uint32 count)
+		{
+			return {
+				gatherGJKLanesVec3<simd_t>(shapes, count, [](const bounding_box& b) { return b.minCorner; }),
+				gatherGJKLanesVec3<simd_t>(shapes, count, [](const bounding_box& b) { return b.maxCorner; }) };
+		}
+	};
+
+	template <>
+	struct gjk_shape_traits<bounding_oriented_box>
+	{
+		typedef obb_support_fn support_fn;
+		template <typename simd_t> using wN_shape = wN_bounding_oriented_box<simd_t>;
+		template <typename simd_t> using wN_support_fn = wN_obb_support_fn<simd_t>;
+
+		template <typename simd_t>
+		static wN_shape<simd_t> load(const bounding_oriented_box* shapes, uint32 count)
+		{
+			wN_shape<simd_t> result;
+			result.center = gatherGJKLanesVec3<simd_t>(shapes, count, [](const bounding_oriented_box& b) { return b.center; });
+			result.radius = gatherGJKLanesVec3<simd_t>(shapes, count, [](const bounding_oriented_box& b) { return b.radius; });
+			result.rotation.x = gatherGJKLanes<simd_t>(shapes, count, [](const bounding_oriented_box& b) { return b.rotation.x; });
+			result.rotation.y = gatherGJKLanes<simd_t>(shapes, count, [](const bounding_oriented_box& b) { return b.rotation.y; });
+			result.rotation.z = gatherGJKLanes<simd_t>(shapes, count, [](const bounding_oriented_box& b) { return b.rotation.z; });
+			result.rotation.w = gatherGJKLanes<simd_t>(shapes, count, [](const bounding_oriented_box& b) { return b.rotation.w; });
+			return result;
+		}
+	};
+
+	// Tests shapesA[i] against shapesB[i] for all i < count, w_float's width of pairs at a time. Shapes can be
+	// bounding_sphere, bounding_capsule, bounding_box or bounding_oriented_box. If outPenetrations is set, the penetration
+	// of each intersecting pair is computed with epaPenetration, one pair at a time. Entries of pairs which do not
+	// intersect are left untouched. Runs on the calling thread; split large batches across jobs.
+	template <typename shapeA_t, typename shapeB_t>
+	static void gjkIntersectionTestBatch(const shapeA_t* shapesA, const shapeB_t* shapesB, uint32 count, bool* outIntersects, gjk_penetration* outPenetrations = nullptr)
+	{
+		typedef gjk_shape_traits<shapeA_t> traits_a;
+		typedef gjk_shape_traits<shapeB_t> traits_b;
+
+		constexpr uint32 width = sizeof(w_float) / sizeof(float);
+
+		for (uint32 first = 0; first < count; first += width)
+		{
+			uint32 numLanes = min(width, count - first);
+
+			typename traits_a::template wN_shape<w_float> a = traits_a::template load<w_float>(shapesA + first, numLanes);
+			typename traits_b::template wN_shape<w_float> b = traits_b::template load<w_float>(shapesB + first, numLanes);
+
+			wN_gjk_simplex<w_float> simplex;
+			int mask = to_bit_mask(gjkIntersectionTest(
+				typename traits_a::template wN_support_fn<w_float>{ a },
+				typename traits_b::template wN_support_fn<w_float>{ b },
+				simplex));
+
+			for (uint32 lane = 0; lane < numLanes; ++lane)
+			{
+				outIntersects[first + lane] = (mask >> lane) & 1;
+			}
+
+			if (!outPenetrations || !(mask & ((1 << numLanes) - 1)))
+			{
+				continue;
+			}
+
+			wN_vec3<w_float>* points[4] = { &simplex.a, &simplex.b, &simplex.c, &simplex.d };
+			float lanes[4][3][width];
+			for (uint32 p = 0; p < 4; ++p)
+			{
+				points[p]->store(lanes[p][0], lanes[p][1], lanes[p][2]);
+			}
+
+			for (uint32 lane = 0; lane < numLanes; ++lane)
+			{
+				if (!((mask >> lane) & 1))
+				{
+					continue;
+				}
+
+				gjk_simplex s;
+				gjk_support_point* sp[4] = { &s.a, &s.b, &s.c, &s.d };
+				for (uint32 p = 0; p < 4; ++p)
+				{
+					sp[p]->minkowski = vec3(lanes[p][0][lane], lanes[p][1][lane], lanes[p][2][lane]);
+				}
+				s.numPoints = 4;
+
+				epaPenetration(
+					typename traits_a::support_fn{ shapesA[first + lane] },
+					typename traits_b::support_fn{ shapesB[first + lane] },
+					s, outPenetrations[first + lane]);
+			}
+		}
+	}
 }
\ No newline at end of file
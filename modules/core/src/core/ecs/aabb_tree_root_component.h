@@ -0,0 +1,57 @@
+#pragma once
+
+#include "core_api.h"
+
+#include "core/aabb_tree.h"
+
+#include "ecs/component.h"
+
+#include <unordered_map>
+
+namespace era_engine
+{
+	struct multi_mesh;
+
+	// Spatial index over all entities with a TransformComponent and a loaded MeshComponent, by their world space mesh
+	// bounds. Kept in sync by the AABBTreeSystem before rendering, so queries made before that see last frame's bounds.
+	class ERA_CORE_API AABBTreeRootComponent final : public Component
+	{
+	public:
+		AABBTreeRootComponent() = default;
+		AABBTreeRootComponent(ref<Entity::EcsData> _data);
+
+		~AABBTreeRootComponent() override;
+
+		// Append the entities whose bounds pass the test.
+		void query_aabb(const bounding_box& aabb, std::vector<Entity::Handle>& out) const;
+		void query_sphere(const bounding_sphere& sphere, std::vector<Entity::Handle>& out) const;
+		void query_frustum(const camera_frustum_planes& frustum, std::vector<Entity::Handle>& out) const;
+
+		// Entity with the nearest bounds along the ray, or Entity::NullHandle.
+		Entity::Handle raycast_closest(const ray& r, float max_distance = FLT_MAX, float* out_distance = nullptr) const;
+
+		// For the results of the tree's own queries, e.g. the batched ones.
+		Entity::Handle get_entity_handle(uint32 proxy) const;
+
+		uint32 get_proxy(Entity::Handle handle) const;
+
+		dynamic_aabb_tree tree;
+
+		ERA_VIRTUAL_REFLECT(Component)
+
+	private:
+		struct Entry
+		{
+			uint32 proxy;
+			trs transform;
+			const multi_mesh* mesh;
+			uint64 frame;
+		};
+
+		std::unordered_map<Entity::Handle, Entry> entries;
+		uint64 frame = 0;
+
+		friend class AABBTreeSystem;
+	};
+
+}
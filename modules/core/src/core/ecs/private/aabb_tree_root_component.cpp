@@ -0,0 +1,77 @@
+#include "core/ecs/aabb_tree_root_component.h"
+
+#include <rttr/registration>
+
+namespace era_engine
+{
+
+	RTTR_REGISTRATION
+	{
+		using namespace rttr;
+		registration::class_<AABBTreeRootComponent>("AABBTreeRootComponent")
+			.constructor<ref<Entity::EcsData>>();
+	}
+
+	AABBTreeRootComponent::AABBTreeRootComponent(ref<Entity::EcsData> _data)
+		: Component(_data)
+	{
+	}
+
+	AABBTreeRootComponent::~AABBTreeRootComponent()
+	{
+	}
+
+	void AABBTreeRootComponent::query_aabb(const bounding_box& aabb, std::vector<Entity::Handle>& out) const
+	{
+		tree.queryAABB(aabb, [this, &out](uint32 proxy)
+		{
+			out.push_back(get_entity_handle(proxy));
+			return true;
+		});
+	}
+
+	void AABBTreeRootComponent::query_sphere(const bounding_sphere& sphere, std::vector<Entity::Handle>& out) const
+	{
+		tree.querySphere(sphere, [this, &out](uint32 proxy)
+		{
+			out.push_back(get_entity_handle(proxy));
+			return true;
+		});
+	}
+
+	void AABBTreeRootComponent::query_frustum(const camera_frustum_planes& frustum, std::vector<Entity::Handle>& out) const
+	{
+		tree.queryFrustum(frustum, [this, &out](uint32 proxy)
+		{
+			out.push_back(get_entity_handle(proxy));
+			return true;
+		});
+	}
+
+	Entity::Handle AABBTreeRootComponent::raycast_closest(const ray& r, float max_distance, float* out_distance) const
+	{
+		aabb_tree_ray_hit hit = tree.raycastClosest(r, max_distance);
+		if (hit.proxy == AABB_TREE_NULL_NODE)
+		{
+			return Entity::NullHandle;
+		}
+
+		if (out_distance)
+		{
+			*out_distance = hit.distance;
+		}
+		return get_entity_handle(hit.proxy);
+	}
+
+	Entity::Handle AABBTreeRootComponent::get_entity_handle(uint32 proxy) const
+	{
+		return static_cast<Entity::Handle>(tree.getUserData(proxy));
+	}
+
+	uint32 AABBTreeRootComponent::get_proxy(Entity::Handle handle) const
+	{
+		auto it = entries.find(handle);
+		return (it != entries.end()) ? it->second.proxy : AABB_TREE_NULL_NODE;
+	}
+
+}
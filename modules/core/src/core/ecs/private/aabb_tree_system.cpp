@@ -0,0 +1,108 @@
+#include "core/ecs/private/aabb_tree_system.h"
+#include "core/ecs/aabb_tree_root_component.h"
+#include "core/frustum_culling.h"
+#include "core/cpu_profiling.h"
+
+#include "ecs/base_components/transform_component.h"
+#include "ecs/rendering/mesh_component.h"
+#include "ecs/update_groups.h"
+
+#include <rttr/policy.h>
+#include <rttr/registration>
+
+namespace era_engine
+{
+	RTTR_REGISTRATION
+	{
+		using namespace rttr;
+
+		registration::class_<AABBTreeSystem>("AABBTreeSystem")
+			.constructor<World*>()(policy::ctor::as_raw_ptr, metadata("Tag", std::string("base")))
+			.method("update", &AABBTreeSystem::update)(metadata("update_group", update_types::BEFORE_RENDER));
+	}
+
+	static bool transformChanged(const trs& a, const trs& b)
+	{
+		return !(a.position == b.position && a.rotation == b.rotation && a.scale == b.scale);
+	}
+
+	AABBTreeSystem::AABBTreeSystem(World* _world)
+		: System(_world)
+	{
+		aabb_tree_rc = world->add_root_component<AABBTreeRootComponent>();
+		ASSERT(aabb_tree_rc != nullptr);
+	}
+
+	AABBTreeSystem::~AABBTreeSystem()
+	{
+	}
+
+	void AABBTreeSystem::init()
+	{
+	}
+
+	void AABBTreeSystem::update(float dt)
+	{
+		CPU_PROFILE_BLOCK("Update AABB tree");
+
+		dynamic_aabb_tree& tree = aabb_tree_rc->tree;
+		auto& entries = aabb_tree_rc->entries;
+		uint64 frame = ++aabb_tree_rc->frame;
+
+		// Transforms have no change notifications, so the last synced transform is kept per entity and compared.
+		for (auto [handle, transform, mesh] : world->group(components_group<TransformComponent, MeshComponent>).each())
+		{
+			if (!mesh.mesh || (mesh.mesh->loadState.load() != AssetLoadState::LOADED))
+			{
+				continue;
+			}
+
+			const trs& t = transform.transform;
+
+			auto it = entries.find(handle);
+			if (it == entries.end())
+			{
+				bounding_box aabb = getWorldSpaceAABB(mesh.mesh->aabb, t);
+				uint32 proxy = tree.insert(aabb, (uint64)entt::to_integral(handle));
+				entries.emplace(handle, AABBTreeRootComponent::Entry{ proxy, t, mesh.mesh.get(), frame });
+				continue;
+			}
+
+			AABBTreeRootComponent::Entry& entry = it->second;
+			entry.frame = frame;
+
+			if (entry.mesh != mesh.mesh.get() || transformChanged(entry.transform, t))
+			{
+				bounding_box aabb = getWorldSpaceAABB(mesh.mesh->aabb, t);
+
+				// Movements larger than the object itself are treated as teleports, which should not stretch the fat box.
+				vec3 displacement = t.position - entry.transform.position;
+				vec3 extent = aabb.maxCorner - aabb.minCorner;
+				if (squared_length(displacement) > squared_length(extent))
+				{
+					displacement = vec3(0.f);
+				}
+
+				tree.move(entry.proxy, aabb, displacement);
+
+				entry.transform = t;
+				entry.mesh = mesh.mesh.get();
+			}
+		}
+
+		// Entities which were destroyed, lost a component or whose mesh is not loaded anymore.
+		for (auto it = entries.begin(); it != entries.end();)
+		{
+			if (it->second.frame != frame)
+			{
+				tree.remove(it->second.proxy);
+				it = entries.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "ecs/system.h"
+
+namespace era_engine
+{
+
+	class AABBTreeRootComponent;
+
+	class AABBTreeSystem final : public System
+	{
+	public:
+		AABBTreeSystem(World* _world);
+		~AABBTreeSystem();
+
+		void init() override;
+		void update(float dt) override;
+
+		ERA_VIRTUAL_REFLECT(System)
+
+	private:
+		AABBTreeRootComponent* aabb_tree_rc = nullptr;
+	};
+}
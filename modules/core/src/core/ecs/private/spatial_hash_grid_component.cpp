@@ -0,0 +1,24 @@
+#include "core/ecs/spatial_hash_grid_component.h"
+
+#include <rttr/registration>
+
+namespace era_engine
+{
+
+	RTTR_REGISTRATION
+	{
+		using namespace rttr;
+		registration::class_<SpatialHashGridComponent>("SpatialHashGridComponent")
+			.constructor<ref<Entity::EcsData>>();
+	}
+
+	SpatialHashGridComponent::SpatialHashGridComponent(ref<Entity::EcsData> _data)
+		: Component(_data)
+	{
+	}
+
+	SpatialHashGridComponent::~SpatialHashGridComponent()
+	{
+	}
+
+}
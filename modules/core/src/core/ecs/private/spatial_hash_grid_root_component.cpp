@@ -0,0 +1,79 @@
+#include "core/ecs/spatial_hash_grid_root_component.h"
+
+#include <rttr/registration>
+
+namespace era_engine
+{
+
+	RTTR_REGISTRATION
+	{
+		using namespace rttr;
+		registration::class_<SpatialHashGridRootComponent>("SpatialHashGridRootComponent")
+			.constructor<ref<Entity::EcsData>>()
+			.property("cell_size", &SpatialHashGridRootComponent::get_cell_size, &SpatialHashGridRootComponent::set_cell_size);
+	}
+
+	SpatialHashGridRootComponent::SpatialHashGridRootComponent(ref<Entity::EcsData> _data)
+		: Component(_data)
+	{
+	}
+
+	SpatialHashGridRootComponent::~SpatialHashGridRootComponent()
+	{
+	}
+
+	void SpatialHashGridRootComponent::set_cell_size(float cell_size)
+	{
+		grid.setCellSize(cell_size);
+	}
+
+	float SpatialHashGridRootComponent::get_cell_size() const
+	{
+		return grid.getCellSize();
+	}
+
+	void SpatialHashGridRootComponent::query_radius(vec3 center, float radius, std::vector<Entity::Handle>& out) const
+	{
+		std::vector<uint32> result;
+		grid.queryRadius(center, radius, result);
+		for (uint32 object : result)
+		{
+			out.push_back(entities[object]);
+		}
+	}
+
+	void SpatialHashGridRootComponent::query_neighbors(Entity::Handle handle, float radius, std::vector<Entity::Handle>& out) const
+	{
+		uint32 object = get_object(handle);
+		if (object == (uint32)-1)
+		{
+			return;
+		}
+
+		std::vector<uint32> result;
+		grid.queryNeighbors(object, radius, result);
+		for (uint32 neighbor : result)
+		{
+			out.push_back(entities[neighbor]);
+		}
+	}
+
+	Entity::Handle SpatialHashGridRootComponent::get_entity_handle(uint32 object) const
+	{
+		return entities[object];
+	}
+
+	uint32 SpatialHashGridRootComponent::get_object(Entity::Handle handle) const
+	{
+		uint32 index = (uint32)entt::to_entity(handle);
+		if (index >= objects.size())
+		{
+			return (uint32)-1;
+		}
+
+		// Entries of entities which were not in the last rebuild are not cleared, but point to another entity or past the end.
+		uint32 object = objects[index];
+		return (object < entities.size() && entities[object] == handle) ? object : (uint32)-1;
+	}
+
+}
@@ -0,0 +1,66 @@
+#include "core/ecs/private/spatial_hash_grid_system.h"
+#include "core/ecs/spatial_hash_grid_root_component.h"
+#include "core/ecs/spatial_hash_grid_component.h"
+#include "core/cpu_profiling.h"
+
+#include "ecs/base_components/transform_component.h"
+#include "ecs/update_groups.h"
+
+#include <rttr/policy.h>
+#include <rttr/registration>
+
+namespace era_engine
+{
+	RTTR_REGISTRATION
+	{
+		using namespace rttr;
+
+		registration::class_<SpatialHashGridSystem>("SpatialHashGridSystem")
+			.constructor<World*>()(policy::ctor::as_raw_ptr, metadata("Tag", std::string("base")))
+			.method("update", &SpatialHashGridSystem::update)(metadata("update_group", update_types::BEFORE_RENDER));
+	}
+
+	SpatialHashGridSystem::SpatialHashGridSystem(World* _world)
+		: System(_world)
+	{
+		spatial_hash_grid_rc = world->add_root_component<SpatialHashGridRootComponent>();
+		ASSERT(spatial_hash_grid_rc != nullptr);
+	}
+
+	SpatialHashGridSystem::~SpatialHashGridSystem()
+	{
+	}
+
+	void SpatialHashGridSystem::init()
+	{
+	}
+
+	void SpatialHashGridSystem::update(float dt)
+	{
+		CPU_PROFILE_BLOCK("Update spatial hash grid");
+
+		auto& entities = spatial_hash_grid_rc->entities;
+		auto& objects = spatial_hash_grid_rc->objects;
+		auto& positions = spatial_hash_grid_rc->positions;
+
+		entities.clear();
+		positions.clear();
+
+		// Everything moves, so there is nothing to gain from tracking changes.
+		for (auto [handle, transform, tag] : world->group(components_group<TransformComponent, SpatialHashGridComponent>).each())
+		{
+			uint32 index = (uint32)entt::to_entity(handle);
+			if (index >= objects.size())
+			{
+				objects.resize(index + 1, (uint32)-1);
+			}
+			objects[index] = (uint32)entities.size();
+
+			entities.push_back(handle);
+			positions.push_back(transform.transform.position);
+		}
+
+		spatial_hash_grid_rc->grid.rebuild(positions.data(), (uint32)positions.size());
+	}
+
+}
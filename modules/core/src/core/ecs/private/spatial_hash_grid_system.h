@@ -0,0 +1,24 @@
+#pragma once
+
+#include "ecs/system.h"
+
+namespace era_engine
+{
+
+	class SpatialHashGridRootComponent;
+
+	class SpatialHashGridSystem final : public System
+	{
+	public:
+		SpatialHashGridSystem(World* _world);
+		~SpatialHashGridSystem();
+
+		void init() override;
+		void update(float dt) override;
+
+		ERA_VIRTUAL_REFLECT(System)
+
+	private:
+		SpatialHashGridRootComponent* spatial_hash_grid_rc = nullptr;
+	};
+}
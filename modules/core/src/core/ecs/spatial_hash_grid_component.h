@@ -0,0 +1,22 @@
+#pragma once
+
+#include "core_api.h"
+
+#include "ecs/component.h"
+
+namespace era_engine
+{
+
+	// Tags the entity for the world's spatial hash grid, at its transform's position. See SpatialHashGridRootComponent.
+	class ERA_CORE_API SpatialHashGridComponent final : public Component
+	{
+	public:
+		SpatialHashGridComponent() = default;
+		SpatialHashGridComponent(ref<Entity::EcsData> _data);
+
+		~SpatialHashGridComponent() override;
+
+		ERA_VIRTUAL_REFLECT(Component)
+	};
+
+}
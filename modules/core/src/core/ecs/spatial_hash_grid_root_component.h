@@ -0,0 +1,49 @@
+#pragma once
+
+#include "core_api.h"
+
+#include "core/spatial_hash_grid.h"
+
+#include "ecs/component.h"
+
+namespace era_engine
+{
+
+	// Spatial hash grid over the positions of all entities with a TransformComponent and a SpatialHashGridComponent.
+	// Rebuilt from scratch by the SpatialHashGridSystem before rendering, so queries made before that see last frame's
+	// positions, and entities tagged since then are not found.
+	class ERA_CORE_API SpatialHashGridRootComponent final : public Component
+	{
+	public:
+		SpatialHashGridRootComponent() = default;
+		SpatialHashGridRootComponent(ref<Entity::EcsData> _data);
+
+		~SpatialHashGridRootComponent() override;
+
+		// Per world. Queries are cheapest for radii up to about the cell size. Takes effect on the next rebuild.
+		void set_cell_size(float cell_size);
+		float get_cell_size() const;
+
+		// Append the entities closer than 'radius' to the center, or to the entity itself, which is not reported.
+		void query_radius(vec3 center, float radius, std::vector<Entity::Handle>& out) const;
+		void query_neighbors(Entity::Handle handle, float radius, std::vector<Entity::Handle>& out) const;
+
+		// For the results of the grid's own queries, e.g. the batched ones.
+		Entity::Handle get_entity_handle(uint32 object) const;
+
+		// Index of the entity in the grid, or -1 if it was not in the last rebuild.
+		uint32 get_object(Entity::Handle handle) const;
+
+		spatial_hash_grid grid;
+
+		ERA_VIRTUAL_REFLECT(Component)
+
+	private:
+		std::vector<Entity::Handle> entities; // By object.
+		std::vector<uint32> objects; // By entity index, may be stale.
+		std::vector<vec3> positions;
+
+		friend class SpatialHashGridSystem;
+	};
+
+}
@@ -0,0 +1,136 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#include "core/frustum_culling.h"
+#include "core/job_system.h"
+#include "core/memory.h"
+
+namespace era_engine
+{
+	void world_space_bounds::resize(uint32 count)
+	{
+		uint32 padded = align_to(count, FRUSTUM_CULLING_SIMD_WIDTH);
+
+		minX.resize(padded, 0.f); minY.resize(padded, 0.f); minZ.resize(padded, 0.f);
+		maxX.resize(padded, 0.f); maxY.resize(padded, 0.f); maxZ.resize(padded, 0.f);
+
+		this->count = count;
+	}
+
+	void world_space_bounds::set(uint32 index, const bounding_box& aabb)
+	{
+		ASSERT(index < count);
+
+		minX[index] = aabb.minCorner.x; minY[index] = aabb.minCorner.y; minZ[index] = aabb.minCorner.z;
+		maxX[index] = aabb.maxCorner.x; maxY[index] = aabb.maxCorner.y; maxZ[index] = aabb.maxCorner.z;
+	}
+
+	bounding_box world_space_bounds::get(uint32 index) const
+	{
+		ASSERT(index < count);
+
+		return bounding_box::fromMinMax(vec3(minX[index], minY[index], minZ[index]), vec3(maxX[index], maxY[index], maxZ[index]));
+	}
+
+	wN_bounding_box<w_float> world_space_bounds::load(uint32 index) const
+	{
+		ASSERT(index % FRUSTUM_CULLING_SIMD_WIDTH == 0 && index < minX.size());
+
+		return wN_bounding_box<w_float>::fromMinMax(
+			wN_vec3<w_float>(w_float(&minX[index]), w_float(&minY[index]), w_float(&minZ[index])),
+			wN_vec3<w_float>(w_float(&maxX[index]), w_float(&maxY[index]), w_float(&maxZ[index])));
+	}
+
+	bounding_box getWorldSpaceAABB(const bounding_box& aabb, const trs& transform)
+	{
+		vec3 center = aabb.getCenter() * transform.scale;
+		vec3 radius = aabb.getRadius() * vec3(abs(transform.scale.x), abs(transform.scale.y), abs(transform.scale.z));
+
+		// Each world space extent is the model space extents projected onto that axis.
+		mat3 r = quaternion_to_mat3(transform.rotation);
+		vec3 worldRadius(
+			abs(r.m00) * radius.x + abs(r.m01) * radius.y + abs(r.m02) * radius.z,
+			abs(r.m10) * radius.x + abs(r.m11) * radius.y + abs(r.m12) * radius.z,
+			abs(r.m20) * radius.x + abs(r.m21) * radius.y + abs(r.m22) * radius.z);
+
+		return bounding_box::fromCenterRadius(r * center + transform.position, worldRadius);
+	}
+
+	// 'begin' must be a multiple of the SIMD width. Returns the number of indices written.
+	static uint32 cullRange(const camera_frustum_planes& frustum, const world_space_bounds& bounds, uint32 begin, uint32 end, uint32* outVisibleIndices)
+	{
+		w_float planeX[6], planeY[6], planeZ[6], planeW[6];
+		for (uint32 p = 0; p < 6; ++p)
+		{
+			planeX[p] = frustum.planes[p].x;
+			planeY[p] = frustum.planes[p].y;
+			planeZ[p] = frustum.planes[p].z;
+			planeW[p] = frustum.planes[p].w;
+		}
+
+		uint32 numVisible = 0;
+		for (uint32 i = begin; i < end; i += FRUSTUM_CULLING_SIMD_WIDTH)
+		{
+			wN_bounding_box<w_float> box = bounds.load(i);
+
+			// Test the corner furthest along each plane's normal. The plane's signs are the same for all lanes, so the
+			// corner is picked per plane, not per lane.
+			int culledMask = 0;
+			for (uint32 p = 0; p < 6; ++p)
+			{
+				const vec4& plane = frustum.planes[p];
+				w_float x = (plane.x < 0.f) ? box.minCorner.x : box.maxCorner.x;
+				w_float y = (plane.y < 0.f) ? box.minCorner.y : box.maxCorner.y;
+				w_float z = (plane.z < 0.f) ? box.minCorner.z : box.maxCorner.z;
+
+				w_float distance = fmadd(planeX[p], x, fmadd(planeY[p], y, fmadd(planeZ[p], z, planeW[p])));
+				culledMask |= to_bit_mask(distance < w_float(0.f));
+			}
+
+			uint32 numLanes = min(end - i, FRUSTUM_CULLING_SIMD_WIDTH);
+			uint32 visibleMask = ~(uint32)culledMask & ((1u << numLanes) - 1);
+
+			unsigned long lane;
+			while (_BitScanForward(&lane, visibleMask))
+			{
+				outVisibleIndices[numVisible++] = i + lane;
+				visibleMask &= visibleMask - 1;
+			}
+		}
+		return numVisible;
+	}
+
+	uint32 cullWorldSpaceAABBs(const camera_frustum_planes& frustum, const world_space_bounds& bounds, uint32* outVisibleIndices)
+	{
+		return cullRange(frustum, bounds, 0, bounds.size(), outVisibleIndices);
+	}
+
+	uint32 cullWorldSpaceAABBsParallel(const camera_frustum_planes& frustum, const world_space_bounds& bounds, uint32* outVisibleIndices, uint32 minChunkSize)
+	{
+		const uint32 maxChunks = 256;
+
+		uint32 count = bounds.size();
+		uint32 chunkSize = align_to(max(max(minChunkSize, 1u), (count + maxChunks - 1) / maxChunks), FRUSTUM_CULLING_SIMD_WIDTH);
+		uint32 numChunks = (count + chunkSize - 1) / chunkSize;
+		if (numChunks <= 1)
+		{
+			return cullRange(frustum, bounds, 0, count, outVisibleIndices);
+		}
+
+		// Each chunk writes to its own range of the output, which is compacted afterwards.
+		uint32 numVisiblePerChunk[maxChunks];
+		parallel_for(low_priority_job_queue, numChunks, 1, [&](uint32 chunk)
+		{
+			uint32 begin = chunk * chunkSize;
+			uint32 end = min(begin + chunkSize, count);
+			numVisiblePerChunk[chunk] = cullRange(frustum, bounds, begin, end, outVisibleIndices + begin);
+		});
+
+		uint32 numVisible = numVisiblePerChunk[0];
+		for (uint32 chunk = 1; chunk < numChunks; ++chunk)
+		{
+			memmove(outVisibleIndices + numVisible, outVisibleIndices + chunk * chunkSize, numVisiblePerChunk[chunk] * sizeof(uint32));
+			numVisible += numVisiblePerChunk[chunk];
+		}
+		return numVisible;
+	}
+}
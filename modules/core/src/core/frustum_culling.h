@@ -0,0 +1,53 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#pragma once
+
+#include "core_api.h"
+
+#include "core/camera.h"
+#include "core/bounding_volumes_simd.h"
+
+namespace era_engine
+{
+	// Batched frustum culling. World space AABBs are kept in structure of arrays layout, so that one iteration of the
+	// culling loop tests w_float's width of boxes against all six planes. Large arrays are split into chunks over the
+	// low priority job queue. The result is a compact, ascending list of the visible indices.
+
+	static constexpr uint32 FRUSTUM_CULLING_SIMD_WIDTH = sizeof(w_float) / sizeof(float);
+
+	struct ERA_CORE_API world_space_bounds
+	{
+		// Keeps the contents. The arrays are padded to a multiple of FRUSTUM_CULLING_SIMD_WIDTH, padding is never
+		// reported as visible.
+		void resize(uint32 count);
+		void clear() { resize(0); }
+
+		void set(uint32 index, const bounding_box& aabb);
+		NODISCARD bounding_box get(uint32 index) const;
+
+		// Loads the boxes [index, index + FRUSTUM_CULLING_SIMD_WIDTH). 'index' must be a multiple of the width.
+		NODISCARD wN_bounding_box<w_float> load(uint32 index) const;
+
+		NODISCARD uint32 size() const { return count; }
+
+		std::vector<float> minX, minY, minZ;
+		std::vector<float> maxX, maxY, maxZ;
+
+	private:
+		uint32 count = 0;
+	};
+
+	// Conservative world space AABB of a transformed model space AABB. Transforms center and extents instead of the
+	// eight corners.
+	NODISCARD ERA_CORE_API bounding_box getWorldSpaceAABB(const bounding_box& aabb, const trs& transform);
+
+	// Both return the number of visible boxes and write their indices to 'outVisibleIndices', which needs room for
+	// bounds.size() indices. A box is visible unless it lies completely outside one of the planes, like in
+	// camera_frustum_planes::cullWorldSpaceAABB.
+	ERA_CORE_API uint32 cullWorldSpaceAABBs(const camera_frustum_planes& frustum, const world_space_bounds& bounds, uint32* outVisibleIndices);
+
+	// Same as above, split into chunks of at least 'minChunkSize' boxes, which are culled in parallel and concatenated
+	// in order afterwards. Blocks until all chunks are done.
+	ERA_CORE_API uint32 cullWorldSpaceAABBsParallel(const camera_frustum_planes& frustum, const world_space_bounds& bounds, uint32* outVisibleIndices,
+		uint32 minChunkSize = 4096);
+}
@@ -101,4 +101,80 @@ namespace std
 		}
 	};
 #endif
-}
\ No newline at end of file
+}
+
+namespace era_engine
+{
+	// 64-bit XXH64 of a byte range. Used for content-addressed caches, so the output must stay stable across versions.
+	inline uint64 hash_bytes(const void* data, uint64 size, uint64 seed = 0)
+	{
+		constexpr uint64 prime1 = 0x9E3779B185EBCA87ull;
+		constexpr uint64 prime2 = 0xC2B2AE3D27D4EB4Full;
+		constexpr uint64 prime3 = 0x165667B19E3779F9ull;
+		constexpr uint64 prime4 = 0x85EBCA77C2B2AE63ull;
+		constexpr uint64 prime5 = 0x27D4EB2F165667C5ull;
+
+		auto rotl = [](uint64 x, int r) { return (x << r) | (x >> (64 - r)); };
+		auto read64 = [](const uint8* p) { uint64 v; memcpy(&v, p, sizeof(v)); return v; };
+		auto read32 = [](const uint8* p) { uint32 v; memcpy(&v, p, sizeof(v)); return v; };
+		auto round = [&](uint64 acc, uint64 input) { acc += input * prime2; acc = rotl(acc, 31); return acc * prime1; };
+		auto merge = [&](uint64 acc, uint64 val) { acc ^= round(0, val); return acc * prime1 + prime4; };
+
+		const uint8* p = (const uint8*)data;
+		const uint8* end = p + size;
+
+		uint64 h;
+		if (size >= 32)
+		{
+			uint64 v1 = seed + prime1 + prime2;
+			uint64 v2 = seed + prime2;
+			uint64 v3 = seed;
+			uint64 v4 = seed - prime1;
+
+			const uint8* limit = end - 32;
+			do
+			{
+				v1 = round(v1, read64(p)); p += 8;
+				v2 = round(v2, read64(p)); p += 8;
+				v3 = round(v3, read64(p)); p += 8;
+				v4 = round(v4, read64(p)); p += 8;
+			} while (p <= limit);
+
+			h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+			h = merge(h, v1);
+			h = merge(h, v2);
+			h = merge(h, v3);
+			h = merge(h, v4);
+		}
+		else
+		{
+			h = seed + prime5;
+		}
+
+		h += size;
+
+		for (; p + 8 <= end; p += 8)
+		{
+			h ^= round(0, read64(p));
+			h = rotl(h, 27) * prime1 + prime4;
+		}
+		if (p + 4 <= end)
+		{
+			h ^= (uint64)read32(p) * prime1;
+			h = rotl(h, 23) * prime2 + prime3;
+			p += 4;
+		}
+		for (; p < end; ++p)
+		{
+			h ^= (uint64)(*p) * prime5;
+			h = rotl(h, 11) * prime1;
+		}
+
+		h ^= h >> 33;
+		h *= prime2;
+		h ^= h >> 29;
+		h *= prime3;
+		h ^= h >> 32;
+		return h;
+	}
+}
@@ -82,7 +82,11 @@ namespace era_engine
 
     int32 JobQueue::allocate_job()
     {
-        return (int32)(next_free_job++ & index_mask);
+        int32 handle = (int32)(next_free_job++ & index_mask);
+
+        // The ring wrapped onto a job which has not finished yet. Too many jobs are alive at once.
+        ASSERT(all_jobs[handle].num_unfinished_jobs == 0);
+        return handle;
     }
 
     void JobQueue::finish_job(int32 handle)
@@ -170,4 +174,10 @@ namespace era_engine
         main_thread_job_queue.wait_for_completion();
     }
 
+    uint32& get_parallel_for_depth()
+    {
+        static thread_local uint32 depth = 0;
+        return depth;
+    }
+
 }
\ No newline at end of file
@@ -21,7 +21,7 @@ namespace era_engine
     template <typename Data_>
     using JobFunction = void (*)(Data_&, JobHandle);
 
-    struct JobQueue
+    struct ERA_CORE_API JobQueue
     {
         struct JobQueueEntry
         {
@@ -103,10 +103,64 @@ namespace era_engine
         std::mutex wake_mutex;
     };
 
-    extern JobQueue high_priority_job_queue;
-    extern JobQueue low_priority_job_queue;
-    extern JobQueue main_thread_job_queue;
+    extern ERA_CORE_API JobQueue high_priority_job_queue;
+    extern ERA_CORE_API JobQueue low_priority_job_queue;
+    extern ERA_CORE_API JobQueue main_thread_job_queue;
 
-    void initialize_job_system();
-    void execute_main_thread_jobs();
+    ERA_CORE_API void initialize_job_system();
+    ERA_CORE_API void execute_main_thread_jobs();
+
+    // Number of parallel_for batches the calling thread is currently executing, including batches it picked up while
+    // waiting for another loop.
+    ERA_CORE_API uint32& get_parallel_for_depth();
+
+    // Calls func(i) for every i in [0, count) on the given queue and blocks until all calls have returned.
+    // The range is split into at most 'max_batches' jobs, because the job ring buffer has a fixed capacity.
+    // Called from inside another parallel_for, the loop runs serially on the calling thread. Nested loops would each keep
+    // up to 'max_batches' jobs alive while waiting, which quickly exceeds the ring buffer.
+    template <typename Func_>
+    void parallel_for(JobQueue& queue, uint32 count, uint32 min_batch_size, const Func_& func, uint32 max_batches = 256)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        uint32 batch_size = max(max(min_batch_size, 1u), (count + max_batches - 1) / max_batches);
+        if (batch_size >= count || get_parallel_for_depth() > 0)
+        {
+            for (uint32 i = 0; i < count; ++i)
+            {
+                func(i);
+            }
+            return;
+        }
+
+        struct parallel_for_data
+        {
+            const Func_* func;
+            uint32 begin;
+            uint32 end;
+        };
+
+        JobHandle root = queue.createJob<parallel_for_data>([](parallel_for_data& data, JobHandle) {}, { &func, 0, 0 });
+
+        for (uint32 begin = 0; begin < count; begin += batch_size)
+        {
+            parallel_for_data data = { &func, begin, min(begin + batch_size, count) };
+            queue.createJob<parallel_for_data>([](parallel_for_data& data, JobHandle)
+                {
+                    uint32& depth = get_parallel_for_depth();
+                    ++depth;
+                    for (uint32 i = data.begin; i < data.end; ++i)
+                    {
+                        (*data.func)(i);
+                    }
+                    --depth;
+                }, data, root).submit_now();
+        }
+
+        root.submit_now();
+        root.wait_for_completion();
+    }
 }
\ No newline at end of file
@@ -1,49 +1,363 @@
 // Copyright (c) 2023-present Eldar Muradov. All rights reserved.
 
 #include "core/nearest_neighbor.h"
+#include "core/bounding_volumes.h"
+#include "core/job_system.h"
 
 #include <nanoflann/nanoflann.hpp>
 
 namespace era_engine
 {
-    PointCloud::PointCloud(vec3* _positions, uint32 _num_positions)
+    struct point_cloud_shard;
+
+    using kd_tree_t = nanoflann::KDTreeSingleIndexAdaptor<
+        nanoflann::L2_Simple_Adaptor<float, point_cloud_shard>,
+        point_cloud_shard, 3, uint32>;
+
+    struct point_cloud_shard
+    {
+        inline size_t kdtree_get_point_count() const { return points.size(); }
+        inline float kdtree_get_pt(const size_t idx, const size_t dim) const { return points[idx].data[dim]; }
+        template <typename BBOX> bool kdtree_get_bbox(BBOX& bb) const { return false; }
+
+        std::vector<vec3> points;
+        std::vector<uint32> indices; // Index of each point in the cloud.
+        bounding_box aabb;
+        std::unique_ptr<kd_tree_t> tree;
+    };
+
+    struct point_cloud_index
     {
-        using kd_tree_t = nanoflann::KDTreeSingleIndexAdaptor<
-            nanoflann::L2_Simple_Adaptor<float, PointCloud>,
-            PointCloud, 3>;
+        std::vector<std::unique_ptr<point_cloud_shard>> shards;
+        std::vector<uint32> pending; // Inserted points which are not in a shard yet.
+    };
 
-        positions = _positions;
-        num_positions = _num_positions;
+    // Collects the k closest points over all shards, sorted by distance. Shards report their local indices.
+    struct knn_result_set
+    {
+        bool addPoint(float dist, uint32 local_index)
+        {
+            add(dist, shard_indices[local_index]);
+            return true;
+        }
 
-        index = new kd_tree_t(3, *this, { 10 });
+        void add(float dist, uint32 point)
+        {
+            if (count == k && dist >= results[k - 1].squared_distance)
+            {
+                return;
+            }
+
+            uint32 i = (count < k) ? count++ : k - 1;
+            for (; i > 0 && results[i - 1].squared_distance > dist; --i)
+            {
+                results[i] = results[i - 1];
+            }
+            results[i] = { point, dist };
+        }
+
+        float worstDist() const { return (count < k) ? FLT_MAX : results[k - 1].squared_distance; }
+        bool full() const { return count == k; }
+
+        NearestNeighborQueryResult* results;
+        uint32 k;
+        uint32 count = 0;
+        const uint32* shard_indices = nullptr;
+    };
+
+    struct radius_result_set
+    {
+        bool addPoint(float dist, uint32 local_index)
+        {
+            add(dist, shard_indices[local_index]);
+            return true;
+        }
+
+        void add(float dist, uint32 point)
+        {
+            if (dist < squared_radius)
+            {
+                results.push_back({ point, dist });
+            }
+        }
+
+        float worstDist() const { return squared_radius; }
+        bool full() const { return true; }
+
+        std::vector<NearestNeighborQueryResult>& results;
+        float squared_radius;
+        const uint32* shard_indices = nullptr;
+    };
+
+    static float squared_distance_to_aabb(vec3 p, const bounding_box& aabb)
+    {
+        float result = 0.f;
+        for (uint32 axis = 0; axis < 3; ++axis)
+        {
+            float d = max(aabb.minCorner.data[axis] - p.data[axis], 0.f) + max(p.data[axis] - aabb.maxCorner.data[axis], 0.f);
+            result += d * d;
+        }
+        return result;
     }
 
-    PointCloud::~PointCloud()
+    // Searches the shard closest to the query first, then all others which may still contain closer points.
+    template <typename result_set_t>
+    static void search_shards(const point_cloud_index& index, const std::vector<vec3>& positions, vec3 query, result_set_t& result)
     {
-        using kd_tree_t = nanoflann::KDTreeSingleIndexAdaptor<
-            nanoflann::L2_Simple_Adaptor<float, PointCloud>,
-            PointCloud, 3>;
+        const auto& shards = index.shards;
+
+        uint32 first = 0;
+        float first_distance = FLT_MAX;
+        for (uint32 i = 0; i < (uint32)shards.size(); ++i)
+        {
+            float d = squared_distance_to_aabb(query, shards[i]->aabb);
+            if (d < first_distance)
+            {
+                first_distance = d;
+                first = i;
+            }
+        }
+
+        for (uint32 i = 0; i < (uint32)shards.size(); ++i)
+        {
+            uint32 s = (i == 0) ? first : ((i == first) ? 0 : i);
+            const point_cloud_shard& shard = *shards[s];
+            if (squared_distance_to_aabb(query, shard.aabb) >= result.worstDist())
+            {
+                continue;
+            }
 
-        kd_tree_t* _index = (kd_tree_t*)index;
+            result.shard_indices = shard.indices.data();
+            shard.tree->findNeighbors(result, &query.data[0]);
+        }
+
+        for (uint32 point : index.pending)
+        {
+            result.add(squared_length(positions[point] - query), point);
+        }
+    }
+
+    PointCloud::PointCloud()
+    {
+        index = new point_cloud_index;
+    }
+
+    PointCloud::PointCloud(const vec3* _positions, uint32 _num_positions)
+        : PointCloud()
+    {
+        build(_positions, _num_positions);
+    }
+
+    PointCloud::~PointCloud()
+    {
+        point_cloud_index* _index = (point_cloud_index*)index;
 
         delete _index;
     }
 
+    void PointCloud::build(const vec3* _positions, uint32 _num_positions)
+    {
+        positions.assign(_positions, _positions + _num_positions);
+        rebuild();
+    }
+
+    void PointCloud::insert(vec3 position)
+    {
+        insert(&position, 1);
+    }
+
+    void PointCloud::insert(const vec3* _positions, uint32 count)
+    {
+        point_cloud_index* _index = (point_cloud_index*)index;
+
+        uint32 first = (uint32)positions.size();
+        positions.insert(positions.end(), _positions, _positions + count);
+        for (uint32 i = 0; i < count; ++i)
+        {
+            _index->pending.push_back(first + i);
+        }
+
+        if (_index->pending.size() >= POINT_CLOUD_INSERT_BATCH_SIZE)
+        {
+            build_shards(_index->pending);
+            _index->pending.clear();
+        }
+    }
+
+    void PointCloud::rebuild()
+    {
+        point_cloud_index* _index = (point_cloud_index*)index;
+
+        _index->shards.clear();
+        _index->pending.clear();
+
+        std::vector<uint32> indices(positions.size());
+        for (uint32 i = 0; i < (uint32)indices.size(); ++i)
+        {
+            indices[i] = i;
+        }
+        build_shards(indices);
+    }
+
+    void PointCloud::build_shards(std::vector<uint32>& indices)
+    {
+        point_cloud_index* _index = (point_cloud_index*)index;
+
+        struct index_range
+        {
+            uint32 begin, end;
+        };
+
+        if (indices.empty())
+        {
+            return;
+        }
+
+        // Median splits along the longest axis, one level of the hierarchy at a time, until all ranges fit in a shard.
+        std::vector<index_range> ranges = { { 0, (uint32)indices.size() } };
+        while (indices.size() > POINT_CLOUD_SHARD_SIZE * ranges.size())
+        {
+            std::vector<index_range> next(ranges.size() * 2);
+            parallel_for(low_priority_job_queue, (uint32)ranges.size(), 1, [&](uint32 i)
+            {
+                index_range r = ranges[i];
+
+                bounding_box aabb = bounding_box::negativeInfinity();
+                for (uint32 j = r.begin; j < r.end; ++j)
+                {
+                    aabb.grow(positions[indices[j]]);
+                }
+
+                vec3 extent = aabb.maxCorner - aabb.minCorner;
+                uint32 axis = (extent.x > extent.y) ? ((extent.x > extent.z) ? 0 : 2) : ((extent.y > extent.z) ? 1 : 2);
+
+                uint32 mid = r.begin + (r.end - r.begin) / 2;
+                std::nth_element(indices.begin() + r.begin, indices.begin() + mid, indices.begin() + r.end, [this, axis](uint32 a, uint32 b)
+                {
+                    return positions[a].data[axis] < positions[b].data[axis];
+                });
+
+                next[i * 2 + 0] = { r.begin, mid };
+                next[i * 2 + 1] = { mid, r.end };
+            });
+            ranges = std::move(next);
+        }
+
+        uint32 first_shard = (uint32)_index->shards.size();
+        _index->shards.resize(first_shard + ranges.size());
+
+        parallel_for(low_priority_job_queue, (uint32)ranges.size(), 1, [&](uint32 i)
+        {
+            index_range r = ranges[i];
+
+            auto shard = std::make_unique<point_cloud_shard>();
+            shard->indices.assign(indices.begin() + r.begin, indices.begin() + r.end);
+            shard->points.resize(shard->indices.size());
+            shard->aabb = bounding_box::negativeInfinity();
+            for (uint32 j = 0; j < (uint32)shard->indices.size(); ++j)
+            {
+                shard->points[j] = positions[shard->indices[j]];
+                shard->aabb.grow(shard->points[j]);
+            }
+
+            shard->tree = std::make_unique<kd_tree_t>(3, *shard, nanoflann::KDTreeSingleIndexAdaptorParams(10));
+            _index->shards[first_shard + i] = std::move(shard);
+        });
+    }
+
     NearestNeighborQueryResult PointCloud::nearest_neighbor_index(vec3 query) const
     {
-        using kd_tree_t = nanoflann::KDTreeSingleIndexAdaptor<
-            nanoflann::L2_Simple_Adaptor<float, PointCloud>,
-            PointCloud, 3>;
+        NearestNeighborQueryResult result = { (uint32)-1, FLT_MAX };
+        k_nearest_neighbors(query, 1, &result);
+        return result;
+    }
+
+    uint32 PointCloud::k_nearest_neighbors(vec3 query, uint32 k, NearestNeighborQueryResult* out) const
+    {
+        if (k == 0)
+        {
+            return 0;
+        }
+
+        knn_result_set result = { out, k };
+        search_shards(*(const point_cloud_index*)index, positions, query, result);
+        return result.count;
+    }
+
+    uint32 PointCloud::radius_neighbors(vec3 query, float radius, std::vector<NearestNeighborQueryResult>& out) const
+    {
+        out.clear();
+
+        radius_result_set result = { out, radius * radius };
+        search_shards(*(const point_cloud_index*)index, positions, query, result);
+
+        // Shards are visited in an order which depends on the query.
+        std::sort(out.begin(), out.end(), [](const NearestNeighborQueryResult& a, const NearestNeighborQueryResult& b)
+        {
+            return (a.squared_distance != b.squared_distance) ? (a.squared_distance < b.squared_distance) : (a.index < b.index);
+        });
+
+        return (uint32)out.size();
+    }
+
+    void PointCloud::nearest_neighbor_batch(const vec3* queries, uint32 count, NearestNeighborQueryResult* out) const
+    {
+        parallel_for(low_priority_job_queue, count, 64, [&](uint32 i)
+        {
+            out[i] = nearest_neighbor_index(queries[i]);
+        });
+    }
+
+    uint32 PointCloud::k_nearest_neighbors_batch(const vec3* queries, uint32 count, uint32 k, NearestNeighborQueryResult* out) const
+    {
+        parallel_for(low_priority_job_queue, count, 64, [&](uint32 i)
+        {
+            k_nearest_neighbors(queries[i], k, out + (uint64)i * k);
+        });
+        return min(k, size());
+    }
+
+    void PointCloud::radius_neighbors_batch(const vec3* queries, uint32 count, float radius, NearestNeighborBatchResult& out) const
+    {
+        // Queries are split into chunks, each collecting its results into its own list. The lists are concatenated in
+        // chunk order, so the result does not depend on scheduling.
+        const uint32 chunk_size = 64;
+
+        out.offsets.assign(count + 1, 0);
+        out.results.clear();
+
+        uint32 num_chunks = (count + chunk_size - 1) / chunk_size;
+        std::vector<std::vector<NearestNeighborQueryResult>> chunk_results(num_chunks);
 
-        kd_tree_t* _index = (kd_tree_t*)index;
+        parallel_for(low_priority_job_queue, num_chunks, 1, [&](uint32 chunk)
+        {
+            std::vector<NearestNeighborQueryResult>& results = chunk_results[chunk];
+            std::vector<NearestNeighborQueryResult> neighbors;
 
-        size_t result_index = 0;
-        float squared_distance = 0.0f;
-        nanoflann::KNNResultSet<float> result_set(1);
-        result_set.init(&result_index, &squared_distance);
+            uint32 end = min((chunk + 1) * chunk_size, count);
+            for (uint32 i = chunk * chunk_size; i < end; ++i)
+            {
+                radius_neighbors(queries[i], radius, neighbors);
+                results.insert(results.end(), neighbors.begin(), neighbors.end());
+                out.offsets[i + 1] = (uint32)results.size();
+            }
+        });
 
-        _index->findNeighbors(result_set, &query.data[0]);
+        uint32 base = 0;
+        for (uint32 chunk = 0; chunk < num_chunks; ++chunk)
+        {
+            uint32 end = min((chunk + 1) * chunk_size, count);
+            for (uint32 i = chunk * chunk_size; i < end; ++i)
+            {
+                out.offsets[i + 1] += base;
+            }
+            base += (uint32)chunk_results[chunk].size();
+        }
 
-        return { (uint32)result_index, squared_distance };
+        out.results.reserve(base);
+        for (const std::vector<NearestNeighborQueryResult>& results : chunk_results)
+        {
+            out.results.insert(out.results.end(), results.begin(), results.end());
+        }
     }
-}
\ No newline at end of file
+}
@@ -8,28 +8,76 @@
 
 namespace era_engine
 {
+	// Points are split into spatially disjoint shards of at most this many points, each with its own KD-tree. Splitting
+	// and building the trees run in parallel over the low priority job queue.
+	static constexpr uint32 POINT_CLOUD_SHARD_SIZE = 1 << 14;
+
+	// Inserted points are searched linearly until there are this many of them, then they get a shard of their own.
+	static constexpr uint32 POINT_CLOUD_INSERT_BATCH_SIZE = 1024;
+
 	struct ERA_CORE_API NearestNeighborQueryResult
 	{
 		uint32 index;
 		float squared_distance;
 	};
 
+	// Results of a batch radius query. The neighbors of query i are results[offsets[i]] to results[offsets[i + 1] - 1],
+	// in the order the single query would report them.
+	struct ERA_CORE_API NearestNeighborBatchResult
+	{
+		NODISCARD uint32 num_results(uint32 query) const { return offsets[query + 1] - offsets[query]; }
+		NODISCARD const NearestNeighborQueryResult* get_results(uint32 query) const { return results.data() + offsets[query]; }
+
+		std::vector<uint32> offsets;
+		std::vector<NearestNeighborQueryResult> results;
+	};
+
+	// Point indices are the order in which the points were added, first by build, then by insert. Queries are thread safe
+	// with respect to each other, but not to build, insert and rebuild.
 	class ERA_CORE_API PointCloud
 	{
 	public:
-		PointCloud(vec3* _positions, uint32 _num_positions);
+		PointCloud();
+		PointCloud(const vec3* _positions, uint32 _num_positions);
 		~PointCloud();
 
+		PointCloud(const PointCloud&) = delete;
+		PointCloud& operator=(const PointCloud&) = delete;
+
+		// Replaces all points. The positions are copied.
+		void build(const vec3* _positions, uint32 _num_positions);
+
+		void insert(vec3 position);
+		void insert(const vec3* _positions, uint32 count);
+
+		// Shards built from inserted points may overlap the others and slow down queries. This splits all points anew.
+		void rebuild();
+
+		NODISCARD uint32 size() const { return (uint32)positions.size(); }
+		NODISCARD vec3 get_position(uint32 point) const { return positions[point]; }
+
+		// Returns index -1 and FLT_MAX if the cloud is empty.
 		NearestNeighborQueryResult nearest_neighbor_index(vec3 query) const;
 
-		inline size_t kdtree_get_point_count() const { return num_positions; }
-		inline float kdtree_get_pt(const size_t idx, const size_t dim) const { return positions[idx].data[dim]; }
-		template <typename BBOX> bool kdtree_get_bbox(BBOX& bb) const { return false; }
+		// Writes the min(k, size()) nearest points to 'out', closest first, and returns their number.
+		uint32 k_nearest_neighbors(vec3 query, uint32 k, NearestNeighborQueryResult* out) const;
+
+		// Replaces the contents of 'out' with all points closer than 'radius', closest first. Returns their number.
+		uint32 radius_neighbors(vec3 query, float radius, std::vector<NearestNeighborQueryResult>& out) const;
+
+		// Batch versions of the queries above. Queries are split over the low priority job queue. Blocks until done.
+		void nearest_neighbor_batch(const vec3* queries, uint32 count, NearestNeighborQueryResult* out) const;
+
+		// The results of query i are written to out[i * k]. Returns min(k, size()), the number of results per query.
+		uint32 k_nearest_neighbors_batch(const vec3* queries, uint32 count, uint32 k, NearestNeighborQueryResult* out) const;
+
+		void radius_neighbors_batch(const vec3* queries, uint32 count, float radius, NearestNeighborBatchResult& out) const;
 
-		uint32 num_positions = 0;
+	private:
+		void build_shards(std::vector<uint32>& indices);
 
-		vec3* positions = nullptr;
-		void* index = nullptr;;
+		std::vector<vec3> positions;
+		void* index = nullptr;
 	};
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,463 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#include "core/occlusion_culling.h"
+#include "core/job_system.h"
+
+namespace era_engine
+{
+	// Occludees whose nearest point is within this factor of an occluder's depth count as in front of it. Keeps objects
+	// from being culled by occluders lying on their own bounds, e.g. box occluders matching the mesh's AABB.
+	static constexpr float DEPTH_TOLERANCE = 1.0001f;
+
+	static constexpr uint32 MIN_ROWS_PER_BAND = 16;
+	static constexpr uint32 MAX_BANDS = 32;
+
+	ref<occluder_mesh> createOccluderMesh(const vec3* positions, uint32 numPositions, const uint32* indices, uint32 numIndices)
+	{
+		ASSERT(numIndices % 3 == 0);
+
+		ref<occluder_mesh> result = make_ref<occluder_mesh>();
+		result->positions.assign(positions, positions + numPositions);
+		result->indices.assign(indices, indices + numIndices);
+
+		result->aabb = bounding_box::negativeInfinity();
+		for (uint32 i = 0; i < numPositions; ++i)
+		{
+			result->aabb.grow(positions[i]);
+		}
+		return result;
+	}
+
+	ref<occluder_mesh> createBoxOccluderMesh(const bounding_box& aabb)
+	{
+		vec3 positions[8];
+		for (uint32 i = 0; i < 8; ++i)
+		{
+			positions[i] = vec3(
+				(i & 1) ? aabb.maxCorner.x : aabb.minCorner.x,
+				(i & 2) ? aabb.maxCorner.y : aabb.minCorner.y,
+				(i & 4) ? aabb.maxCorner.z : aabb.minCorner.z);
+		}
+
+		// Winding does not matter, occluders are rasterized double sided.
+		const uint32 indices[] =
+		{
+			0, 2, 3, 0, 3, 1, // -Z
+			4, 5, 7, 4, 7, 6, // +Z
+			0, 4, 6, 0, 6, 2, // -X
+			1, 3, 7, 1, 7, 5, // +X
+			0, 1, 5, 0, 5, 4, // -Y
+			2, 6, 7, 2, 7, 3, // +Y
+		};
+
+		return createOccluderMesh(positions, 8, indices, arraysize(indices));
+	}
+
+	void software_occlusion_buffer::initialize(uint32 width, uint32 height)
+	{
+		this->width = align_to(max(width, 1u), OCCLUSION_TILE_WIDTH);
+		this->height = align_to(max(height, 1u), OCCLUSION_TILE_HEIGHT);
+		numTilesX = this->width / OCCLUSION_TILE_WIDTH;
+
+		depth.assign(this->width * this->height, 0.f);
+		tileMinDepth.assign(numTilesX * (this->height / OCCLUSION_TILE_HEIGHT), 0.f);
+	}
+
+	void software_occlusion_buffer::beginFrame(const mat4& viewProj, float nearPlane)
+	{
+		ASSERT(width > 0 && height > 0);
+
+		this->viewProj = viewProj;
+		this->nearPlane = nearPlane;
+
+		occluders.clear();
+		stats = {};
+
+		std::fill(depth.begin(), depth.end(), 0.f);
+		std::fill(tileMinDepth.begin(), tileMinDepth.end(), 0.f);
+	}
+
+	void software_occlusion_buffer::addOccluder(const occluder_mesh& mesh, const mat4& transform)
+	{
+		occluders.push_back({ &mesh, transform });
+	}
+
+	vec2 software_occlusion_buffer::toScreen(const vec4& clip) const
+	{
+		float invW = 1.f / clip.w;
+		return vec2(
+			(clip.x * invW * 0.5f + 0.5f) * (float)width,
+			(0.5f - clip.y * invW * 0.5f) * (float)height);
+	}
+
+	void software_occlusion_buffer::addScreenTriangle(const vec4& a, const vec4& b, const vec4& c, std::vector<screen_triangle>& out) const
+	{
+		vec2 p[3] = { toScreen(a), toScreen(b), toScreen(c) };
+		float z[3] = { 1.f / a.w, 1.f / b.w, 1.f / c.w };
+
+		float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+		if (abs(area) < 1e-8f)
+		{
+			return;
+		}
+
+		// Double sided: flip back facing triangles, so that the inside is where all edge functions are positive.
+		if (area < 0.f)
+		{
+			std::swap(p[1], p[2]);
+			std::swap(z[1], z[2]);
+			area = -area;
+		}
+
+		float minX = min(p[0].x, min(p[1].x, p[2].x));
+		float maxX = max(p[0].x, max(p[1].x, p[2].x));
+		float minY = min(p[0].y, min(p[1].y, p[2].y));
+		float maxY = max(p[0].y, max(p[1].y, p[2].y));
+
+		// Pixels whose centers lie within the bounds. Clamped in float first, since clipped vertices can project far
+		// outside the buffer.
+		screen_triangle tri;
+		tri.minX = (int32)ceil(clamp(minX - 0.5f, 0.f, (float)width));
+		tri.maxX = (int32)floor(clamp(maxX - 0.5f, -1.f, (float)width - 1.f));
+		tri.minY = (int32)ceil(clamp(minY - 0.5f, 0.f, (float)height));
+		tri.maxY = (int32)floor(clamp(maxY - 0.5f, -1.f, (float)height - 1.f));
+		if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+		{
+			return;
+		}
+
+		// Edge i is opposite of vertex i, so its normalized value is vertex i's barycentric coordinate.
+		float invArea = 1.f / area;
+		tri.depthPlane = vec3(0.f);
+		for (uint32 i = 0; i < 3; ++i)
+		{
+			const vec2& from = p[(i + 1) % 3];
+			const vec2& to = p[(i + 2) % 3];
+
+			float ex = from.y - to.y;
+			float ey = to.x - from.x;
+			tri.edges[i] = vec3(ex, ey, -(ex * from.x + ey * from.y));
+			tri.depthPlane += tri.edges[i] * (z[i] * invArea);
+		}
+
+		out.push_back(tri);
+	}
+
+	void software_occlusion_buffer::setupTriangles(const occluder& o, std::vector<screen_triangle>& out) const
+	{
+		const occluder_mesh& mesh = *o.mesh;
+		mat4 m = viewProj * o.transform;
+
+		uint32 numTriangles = (uint32)mesh.indices.size() / 3;
+		for (uint32 t = 0; t < numTriangles; ++t)
+		{
+			vec4 v[3];
+			uint32 inFront = 0;
+			for (uint32 i = 0; i < 3; ++i)
+			{
+				v[i] = m * vec4(mesh.positions[mesh.indices[t * 3 + i]], 1.f);
+				inFront += (v[i].w >= nearPlane);
+			}
+
+			if (inFront == 0)
+			{
+				continue;
+			}
+			if (inFront == 3)
+			{
+				addScreenTriangle(v[0], v[1], v[2], out);
+				continue;
+			}
+
+			// Clip against the near plane. A triangle becomes a triangle or a quad.
+			vec4 clipped[4];
+			uint32 numClipped = 0;
+			for (uint32 i = 0; i < 3; ++i)
+			{
+				const vec4& a = v[i];
+				const vec4& b = v[(i + 1) % 3];
+				bool aInFront = a.w >= nearPlane;
+				bool bInFront = b.w >= nearPlane;
+
+				if (aInFront)
+				{
+					clipped[numClipped++] = a;
+				}
+				if (aInFront != bInFront)
+				{
+					float t = (nearPlane - a.w) / (b.w - a.w);
+					clipped[numClipped++] = lerp(a, b, t);
+				}
+			}
+
+			for (uint32 i = 2; i < numClipped; ++i)
+			{
+				addScreenTriangle(clipped[0], clipped[i - 1], clipped[i], out);
+			}
+		}
+	}
+
+	void software_occlusion_buffer::rasterizeBand(uint32 beginRow, uint32 endRow)
+	{
+		const w_float laneOffsets(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+		const w_float zero = w_float::zero();
+
+		static_assert(OCCLUSION_TILE_WIDTH == 8, "Lane offsets assume 8 lanes.");
+
+		for (const screen_triangle& tri : triangles)
+		{
+			int32 y0 = max(tri.minY, (int32)beginRow);
+			int32 y1 = min(tri.maxY, (int32)endRow - 1);
+			if (y0 > y1)
+			{
+				continue;
+			}
+
+			int32 x0 = tri.minX & ~(int32)(OCCLUSION_TILE_WIDTH - 1);
+			float fx0 = (float)x0;
+
+			// Per lane values at the first pixel of a row, and the step to the next group of lanes.
+			w_float e0Lane = fmadd(w_float(tri.edges[0].x), laneOffsets + w_float(fx0), w_float(tri.edges[0].z));
+			w_float e1Lane = fmadd(w_float(tri.edges[1].x), laneOffsets + w_float(fx0), w_float(tri.edges[1].z));
+			w_float e2Lane = fmadd(w_float(tri.edges[2].x), laneOffsets + w_float(fx0), w_float(tri.edges[2].z));
+			w_float zLane = fmadd(w_float(tri.depthPlane.x), laneOffsets + w_float(fx0), w_float(tri.depthPlane.z));
+
+			w_float e0Step = tri.edges[0].x * (float)OCCLUSION_TILE_WIDTH;
+			w_float e1Step = tri.edges[1].x * (float)OCCLUSION_TILE_WIDTH;
+			w_float e2Step = tri.edges[2].x * (float)OCCLUSION_TILE_WIDTH;
+			w_float zStep = tri.depthPlane.x * (float)OCCLUSION_TILE_WIDTH;
+
+			for (int32 y = y0; y <= y1; ++y)
+			{
+				float cy = (float)y + 0.5f;
+				w_float e0 = e0Lane + w_float(tri.edges[0].y * cy);
+				w_float e1 = e1Lane + w_float(tri.edges[1].y * cy);
+				w_float e2 = e2Lane + w_float(tri.edges[2].y * cy);
+				w_float z = zLane + w_float(tri.depthPlane.y * cy);
+
+				float* row = depth.data() + y * width;
+
+				// Lanes outside of the triangle's bounds are outside of the triangle, so they need no extra mask.
+				for (int32 x = x0; x <= tri.maxX; x += OCCLUSION_TILE_WIDTH)
+				{
+					auto inside = (e0 >= zero) & (e1 >= zero) & (e2 >= zero);
+					if (any_true(inside))
+					{
+						w_float d(row + x);
+						d = if_then(inside, maximum(d, z), d);
+						d.store(row + x);
+					}
+
+					e0 += e0Step;
+					e1 += e1Step;
+					e2 += e2Step;
+					z += zStep;
+				}
+			}
+		}
+
+		// Farthest pixel per tile.
+		for (uint32 tileY = beginRow / OCCLUSION_TILE_HEIGHT; tileY < endRow / OCCLUSION_TILE_HEIGHT; ++tileY)
+		{
+			const float* rows = depth.data() + tileY * OCCLUSION_TILE_HEIGHT * width;
+			for (uint32 tileX = 0; tileX < numTilesX; ++tileX)
+			{
+				w_float m(rows + tileX * OCCLUSION_TILE_WIDTH);
+				for (uint32 r = 1; r < OCCLUSION_TILE_HEIGHT; ++r)
+				{
+					m = minimum(m, w_float(rows + r * width + tileX * OCCLUSION_TILE_WIDTH));
+				}
+
+				float lanes[OCCLUSION_TILE_WIDTH];
+				m.store(lanes);
+
+				float tileMin = lanes[0];
+				for (uint32 i = 1; i < OCCLUSION_TILE_WIDTH; ++i)
+				{
+					tileMin = min(tileMin, lanes[i]);
+				}
+				tileMinDepth[tileY * numTilesX + tileX] = tileMin;
+			}
+		}
+	}
+
+	void software_occlusion_buffer::rasterizeOccluders()
+	{
+		uint32 numOccluders = (uint32)occluders.size();
+		if (numOccluders == 0)
+		{
+			return;
+		}
+
+		if (trianglesPerOccluder.size() < numOccluders)
+		{
+			trianglesPerOccluder.resize(numOccluders);
+		}
+
+		parallel_for(low_priority_job_queue, numOccluders, 4, [&](uint32 i)
+		{
+			trianglesPerOccluder[i].clear();
+			setupTriangles(occluders[i], trianglesPerOccluder[i]);
+		});
+
+		triangles.clear();
+		for (uint32 i = 0; i < numOccluders; ++i)
+		{
+			triangles.insert(triangles.end(), trianglesPerOccluder[i].begin(), trianglesPerOccluder[i].end());
+		}
+
+		stats.numOccluders = numOccluders;
+		stats.numTriangles = (uint32)triangles.size();
+
+		// Bands are disjoint sets of tile rows, so they need no synchronization. Every band walks all triangles, but
+		// skips those outside of it after one comparison.
+		uint32 bandHeight = align_to(max(MIN_ROWS_PER_BAND, (height + MAX_BANDS - 1) / MAX_BANDS), OCCLUSION_TILE_HEIGHT);
+		uint32 numBands = (height + bandHeight - 1) / bandHeight;
+
+		parallel_for(low_priority_job_queue, numBands, 1, [&](uint32 band)
+		{
+			uint32 beginRow = band * bandHeight;
+			uint32 endRow = min(beginRow + bandHeight, height);
+			rasterizeBand(beginRow, endRow);
+		});
+	}
+
+	bool software_occlusion_buffer::isVisible(const bounding_box& aabb) const
+	{
+		static_assert(OCCLUSION_TILE_WIDTH == 8, "One lane per box corner.");
+
+		const vec3& lo = aabb.minCorner;
+		const vec3& hi = aabb.maxCorner;
+		w_float x(lo.x, hi.x, lo.x, hi.x, lo.x, hi.x, lo.x, hi.x);
+		w_float y(lo.y, lo.y, hi.y, hi.y, lo.y, lo.y, hi.y, hi.y);
+		w_float z(lo.z, lo.z, lo.z, lo.z, hi.z, hi.z, hi.z, hi.z);
+
+		const mat4& m = viewProj;
+		w_float clipW = fmadd(w_float(m.m30), x, fmadd(w_float(m.m31), y, fmadd(w_float(m.m32), z, w_float(m.m33))));
+		if (any_true(clipW < w_float(nearPlane)))
+		{
+			return true;
+		}
+
+		w_float clipX = fmadd(w_float(m.m00), x, fmadd(w_float(m.m01), y, fmadd(w_float(m.m02), z, w_float(m.m03))));
+		w_float clipY = fmadd(w_float(m.m10), x, fmadd(w_float(m.m11), y, fmadd(w_float(m.m12), z, w_float(m.m13))));
+
+		w_float invW = w_float(1.f) / clipW;
+		w_float screenX = fmadd(clipX * invW, w_float(0.5f * width), w_float(0.5f * width));
+		w_float screenY = fmadd(clipY * invW, w_float(-0.5f * height), w_float(0.5f * height));
+
+		float sx[8], sy[8], sz[8];
+		screenX.store(sx);
+		screenY.store(sy);
+		invW.store(sz);
+
+		float minX = sx[0], maxX = sx[0], minY = sy[0], maxY = sy[0], nearest = sz[0];
+		for (uint32 i = 1; i < 8; ++i)
+		{
+			minX = min(minX, sx[i]); maxX = max(maxX, sx[i]);
+			minY = min(minY, sy[i]); maxY = max(maxY, sy[i]);
+			nearest = max(nearest, sz[i]);
+		}
+
+		if (maxX < 0.f || maxY < 0.f || minX >= (float)width || minY >= (float)height)
+		{
+			// Off screen. Not occluded, the frustum test is responsible for these.
+			return true;
+		}
+
+		// All pixels touched by the projected box, plus one. Occluders cover pixels whose centers they contain, so they may
+		// overhang their silhouette by up to a pixel.
+		int32 x0 = (int32)max(minX - 1.f, 0.f);
+		int32 x1 = (int32)min(maxX + 1.f, (float)width - 1.f);
+		int32 y0 = (int32)max(minY - 1.f, 0.f);
+		int32 y1 = (int32)min(maxY + 1.f, (float)height - 1.f);
+
+		nearest *= DEPTH_TOLERANCE;
+		w_float nearestW(nearest);
+
+		for (int32 tileY = y0 / (int32)OCCLUSION_TILE_HEIGHT; tileY <= y1 / (int32)OCCLUSION_TILE_HEIGHT; ++tileY)
+		{
+			for (int32 tileX = x0 / (int32)OCCLUSION_TILE_WIDTH; tileX <= x1 / (int32)OCCLUSION_TILE_WIDTH; ++tileX)
+			{
+				if (tileMinDepth[tileY * numTilesX + tileX] > nearest)
+				{
+					continue;
+				}
+
+				// The tile is not completely in front of the box, but the part the box covers may be.
+				int32 tileLeft = tileX * (int32)OCCLUSION_TILE_WIDTH;
+				int32 laneBegin = max(x0 - tileLeft, 0);
+				int32 laneEnd = min(x1 - tileLeft, (int32)OCCLUSION_TILE_WIDTH - 1);
+				int laneMask = ((1 << (laneEnd + 1)) - 1) & ~((1 << laneBegin) - 1);
+
+				int32 rowBegin = max(y0, tileY * (int32)OCCLUSION_TILE_HEIGHT);
+				int32 rowEnd = min(y1, tileY * (int32)OCCLUSION_TILE_HEIGHT + (int32)OCCLUSION_TILE_HEIGHT - 1);
+				for (int32 row = rowBegin; row <= rowEnd; ++row)
+				{
+					w_float d(depth.data() + row * width + tileLeft);
+					if (to_bit_mask(d <= nearestW) & laneMask)
+					{
+						return true;
+					}
+				}
+			}
+		}
+
+		return false;
+	}
+
+	static uint32 cullRange(const software_occlusion_buffer& buffer, const world_space_bounds& bounds, const uint32* indices, uint32 begin, uint32 end,
+		uint32* outVisible)
+	{
+		uint32 numVisible = 0;
+		for (uint32 i = begin; i < end; ++i)
+		{
+			uint32 index = indices[i];
+			if (buffer.isVisible(bounds.get(index)))
+			{
+				outVisible[numVisible++] = index;
+			}
+		}
+		return numVisible;
+	}
+
+	uint32 software_occlusion_buffer::cullAABBs(const world_space_bounds& bounds, const uint32* indices, uint32 count, uint32* outVisible) const
+	{
+		const uint32 minChunkSize = 512;
+		const uint32 maxChunks = 256;
+
+		if (!hasOccluders())
+		{
+			if (outVisible != indices)
+			{
+				memmove(outVisible, indices, count * sizeof(uint32));
+			}
+			return count;
+		}
+
+		uint32 chunkSize = max(minChunkSize, (count + maxChunks - 1) / maxChunks);
+		uint32 numChunks = (count + chunkSize - 1) / chunkSize;
+		if (numChunks <= 1)
+		{
+			return cullRange(*this, bounds, indices, 0, count, outVisible);
+		}
+
+		// Each chunk compacts into its own range of the output, which never runs ahead of its input range, so the
+		// output may alias the input. The ranges are concatenated afterwards.
+		uint32 numVisiblePerChunk[maxChunks];
+		parallel_for(low_priority_job_queue, numChunks, 1, [&](uint32 chunk)
+		{
+			uint32 begin = chunk * chunkSize;
+			uint32 end = min(begin + chunkSize, count);
+			numVisiblePerChunk[chunk] = cullRange(*this, bounds, indices, begin, end, outVisible + begin);
+		});
+
+		uint32 numVisible = numVisiblePerChunk[0];
+		for (uint32 chunk = 1; chunk < numChunks; ++chunk)
+		{
+			memmove(outVisible + numVisible, outVisible + chunk * chunkSize, numVisiblePerChunk[chunk] * sizeof(uint32));
+			numVisible += numVisiblePerChunk[chunk];
+		}
+		return numVisible;
+	}
+}
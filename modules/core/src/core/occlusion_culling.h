@@ -0,0 +1,115 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#pragma once
+
+#include "core_api.h"
+
+#include "core/frustum_culling.h"
+
+namespace era_engine
+{
+	// Software occlusion culling. A small set of occluder meshes is rasterized on the CPU into a low resolution depth
+	// buffer, against which the world space AABBs of potential occludees are tested. Everything runs on the CPU, so it
+	// works without a GPU.
+	//
+	// The buffer stores 1/w, which is linear in screen space and independent of the projection's depth convention, so it
+	// works for finite, infinite and reversed projections alike. Larger values are closer, 0 means no occluder. Pixels are
+	// rasterized w_float's width at a time, with edge functions evaluated at pixel centers. The buffer is split into tiles
+	// of one SIMD row by OCCLUSION_TILE_HEIGHT rows, each of which keeps the depth of its farthest pixel. Occludees are
+	// tested against the tiles first and only fall back to the pixels of tiles which are not conclusive.
+	//
+	// Occluders must lie inside the objects they stand for, e.g. a coarse LOD or a box inside a building, otherwise
+	// objects behind them may be culled although they are visible.
+
+	static constexpr uint32 OCCLUSION_TILE_WIDTH = sizeof(w_float) / sizeof(float);
+	static constexpr uint32 OCCLUSION_TILE_HEIGHT = 4;
+
+	struct occluder_mesh
+	{
+		std::vector<vec3> positions;
+		std::vector<uint32> indices; // Triangle list.
+		bounding_box aabb;
+	};
+
+	NODISCARD ERA_CORE_API ref<occluder_mesh> createOccluderMesh(const vec3* positions, uint32 numPositions, const uint32* indices, uint32 numIndices);
+	NODISCARD ERA_CORE_API ref<occluder_mesh> createBoxOccluderMesh(const bounding_box& aabb);
+
+	struct software_occlusion_stats
+	{
+		uint32 numOccluders = 0;
+		uint32 numTriangles = 0; // After near plane clipping and removal of degenerate and off-screen triangles.
+	};
+
+	struct ERA_CORE_API software_occlusion_buffer
+	{
+		// The width is rounded up to OCCLUSION_TILE_WIDTH, the height to OCCLUSION_TILE_HEIGHT. Clears the buffer.
+		void initialize(uint32 width, uint32 height);
+
+		// Clears the buffer and removes all occluders. 'viewProj' must be a perspective projection, 'nearPlane' its near
+		// plane distance. Occluder geometry in front of it is clipped.
+		void beginFrame(const mat4& viewProj, float nearPlane);
+
+		// The mesh must stay alive until rasterizeOccluders returns.
+		void addOccluder(const occluder_mesh& mesh, const mat4& transform);
+
+		// Transforms, clips and rasterizes all occluders added since beginFrame, and builds the tile depths. Horizontal
+		// bands of the buffer are rasterized in parallel over the low priority job queue. Blocks until done.
+		void rasterizeOccluders();
+
+		// Conservative: returns false only if the box is completely behind the rasterized occluders. Boxes crossing the
+		// near plane are always visible. Thread safe after rasterizeOccluders.
+		NODISCARD bool isVisible(const bounding_box& aabb) const;
+
+		// Keeps the entries of 'indices' whose box in 'bounds' passes isVisible, in order. 'outVisible' may be 'indices'.
+		// Returns the number of visible entries. Large inputs are tested in parallel.
+		uint32 cullAABBs(const world_space_bounds& bounds, const uint32* indices, uint32 count, uint32* outVisible) const;
+
+		NODISCARD bool hasOccluders() const { return !occluders.empty(); }
+
+		NODISCARD uint32 getWidth() const { return width; }
+		NODISCARD uint32 getHeight() const { return height; }
+
+		// 1/w of the closest occluder at this pixel, 0 if there is none. Row 0 is the top of the screen.
+		NODISCARD float getDepth(uint32 x, uint32 y) const { return depth[y * width + x]; }
+
+		NODISCARD const software_occlusion_stats& getStats() const { return stats; }
+
+	private:
+		struct occluder
+		{
+			const occluder_mesh* mesh;
+			mat4 transform;
+		};
+
+		// Edge functions and depth plane of a triangle, in pixels. A pixel center (x, y) is inside if all three
+		// edge[i].x * x + edge[i].y * y + edge[i].z are non-negative. Its 1/w is depthPlane.x * x + depthPlane.y * y +
+		// depthPlane.z.
+		struct screen_triangle
+		{
+			vec3 edges[3];
+			vec3 depthPlane;
+			int32 minX, minY, maxX, maxY; // Inclusive pixel bounds, clamped to the buffer.
+		};
+
+		void setupTriangles(const occluder& o, std::vector<screen_triangle>& out) const;
+		void addScreenTriangle(const vec4& a, const vec4& b, const vec4& c, std::vector<screen_triangle>& out) const;
+		void rasterizeBand(uint32 beginRow, uint32 endRow);
+
+		NODISCARD vec2 toScreen(const vec4& clip) const;
+
+		std::vector<float> depth;         // Per pixel, row major.
+		std::vector<float> tileMinDepth;  // Per tile, the farthest pixel of the tile.
+		uint32 width = 0;
+		uint32 height = 0;
+		uint32 numTilesX = 0;
+
+		mat4 viewProj;
+		float nearPlane = 0.1f;
+
+		std::vector<occluder> occluders;
+		std::vector<std::vector<screen_triangle>> trianglesPerOccluder;
+		std::vector<screen_triangle> triangles;
+
+		software_occlusion_stats stats;
+	};
+}
@@ -0,0 +1,329 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#include "core/spatial_hash_grid.h"
+#include "core/bounding_volumes_simd.h"
+#include "core/job_system.h"
+#include "core/threading.h"
+
+namespace era_engine
+{
+	static constexpr uint32 SPATIAL_HASH_GRID_SIMD_WIDTH = sizeof(w_float) / sizeof(float);
+
+	// Objects or buckets per job of the rebuild passes.
+	static constexpr uint32 SPATIAL_HASH_GRID_BLOCK_SIZE = 1 << 14;
+
+	static int32 getCellCoordinate(float x, float invCellSize)
+	{
+		// Keeps the conversion defined for positions far outside any sensible world.
+		return (int32)clamp(floor(x * invCellSize), -1e9f, 1e9f);
+	}
+
+	static uint32 hashCell(int32 x, int32 y, int32 z, uint32 bucketMask)
+	{
+		// Teschner et al., "Optimized Spatial Hashing for Collision Detection of Deformable Objects".
+		return (((uint32)x * 73856093u) ^ ((uint32)y * 19349663u) ^ ((uint32)z * 83492791u)) & bucketMask;
+	}
+
+	// In place, over blocks in parallel.
+	static void exclusivePrefixSum(uint32* values, uint32 count)
+	{
+		uint32 numBlocks = bucketize(count, SPATIAL_HASH_GRID_BLOCK_SIZE);
+		std::vector<uint32> blockSums(numBlocks);
+
+		parallel_for(low_priority_job_queue, numBlocks, 1, [&](uint32 block)
+		{
+			uint32 end = min((block + 1) * SPATIAL_HASH_GRID_BLOCK_SIZE, count);
+			uint32 sum = 0;
+			for (uint32 i = block * SPATIAL_HASH_GRID_BLOCK_SIZE; i < end; ++i)
+			{
+				sum += values[i];
+			}
+			blockSums[block] = sum;
+		});
+
+		uint32 base = 0;
+		for (uint32& sum : blockSums)
+		{
+			uint32 blockSum = sum;
+			sum = base;
+			base += blockSum;
+		}
+
+		parallel_for(low_priority_job_queue, numBlocks, 1, [&](uint32 block)
+		{
+			uint32 end = min((block + 1) * SPATIAL_HASH_GRID_BLOCK_SIZE, count);
+			uint32 sum = blockSums[block];
+			for (uint32 i = block * SPATIAL_HASH_GRID_BLOCK_SIZE; i < end; ++i)
+			{
+				uint32 value = values[i];
+				values[i] = sum;
+				sum += value;
+			}
+		});
+	}
+
+	void spatial_hash_grid::setCellSize(float size)
+	{
+		ASSERT(size > 0.f);
+		cellSize = size;
+	}
+
+	void spatial_hash_grid::rebuild(const vec3* _positions, uint32 count)
+	{
+		uint32 numBuckets = align_to_power_of_two(max(count, 64u));
+		uint32 numObjectBlocks = bucketize(count, SPATIAL_HASH_GRID_BLOCK_SIZE);
+		uint32 numBucketBlocks = bucketize(numBuckets, SPATIAL_HASH_GRID_BLOCK_SIZE);
+
+		invCellSize = 1.f / cellSize;
+		bucketMask = numBuckets - 1;
+
+		positions.resize(count);
+		objectBuckets.resize(count);
+		sortedObjects.resize(count);
+		sortedX.resize(count + SPATIAL_HASH_GRID_SIMD_WIDTH, 0.f);
+		sortedY.resize(count + SPATIAL_HASH_GRID_SIMD_WIDTH, 0.f);
+		sortedZ.resize(count + SPATIAL_HASH_GRID_SIMD_WIDTH, 0.f);
+
+		// One extra entry, which ends up as the total.
+		bucketOffsets.assign(numBuckets + 1, 0);
+		bucketCursors.resize(numBuckets);
+
+		// Count the objects per bucket.
+		parallel_for(low_priority_job_queue, numObjectBlocks, 1, [&](uint32 block)
+		{
+			uint32 end = min((block + 1) * SPATIAL_HASH_GRID_BLOCK_SIZE, count);
+			for (uint32 i = block * SPATIAL_HASH_GRID_BLOCK_SIZE; i < end; ++i)
+			{
+				vec3 p = _positions[i];
+				positions[i] = p;
+
+				uint32 bucket = hashCell(getCellCoordinate(p.x, invCellSize), getCellCoordinate(p.y, invCellSize),
+					getCellCoordinate(p.z, invCellSize), bucketMask);
+				objectBuckets[i] = bucket;
+				atomic_increment(bucketOffsets[bucket]);
+			}
+		});
+
+		exclusivePrefixSum(bucketOffsets.data(), numBuckets + 1);
+
+		parallel_for(low_priority_job_queue, numBucketBlocks, 1, [&](uint32 block)
+		{
+			uint32 begin = block * SPATIAL_HASH_GRID_BLOCK_SIZE;
+			uint32 end = min(begin + SPATIAL_HASH_GRID_BLOCK_SIZE, numBuckets);
+			memcpy(bucketCursors.data() + begin, bucketOffsets.data() + begin, (end - begin) * sizeof(uint32));
+		});
+
+		// Scatter. Objects land in their bucket in whatever order the jobs reach them.
+		parallel_for(low_priority_job_queue, numObjectBlocks, 1, [&](uint32 block)
+		{
+			uint32 end = min((block + 1) * SPATIAL_HASH_GRID_BLOCK_SIZE, count);
+			for (uint32 i = block * SPATIAL_HASH_GRID_BLOCK_SIZE; i < end; ++i)
+			{
+				sortedObjects[atomic_increment(bucketCursors[objectBuckets[i]])] = i;
+			}
+		});
+
+		// Buckets hold few objects, so sorting them restores a deterministic order cheaply. Then copy the positions.
+		parallel_for(low_priority_job_queue, numBucketBlocks, 1, [&](uint32 block)
+		{
+			uint32 end = min((block + 1) * SPATIAL_HASH_GRID_BLOCK_SIZE, numBuckets);
+			for (uint32 bucket = block * SPATIAL_HASH_GRID_BLOCK_SIZE; bucket < end; ++bucket)
+			{
+				uint32 first = bucketOffsets[bucket];
+				uint32 last = bucketOffsets[bucket + 1];
+
+				for (uint32 i = first + 1; i < last; ++i)
+				{
+					uint32 object = sortedObjects[i];
+					uint32 j = i;
+					for (; j > first && sortedObjects[j - 1] > object; --j)
+					{
+						sortedObjects[j] = sortedObjects[j - 1];
+					}
+					sortedObjects[j] = object;
+				}
+
+				for (uint32 i = first; i < last; ++i)
+				{
+					vec3 p = positions[sortedObjects[i]];
+					sortedX[i] = p.x;
+					sortedY[i] = p.y;
+					sortedZ[i] = p.z;
+				}
+			}
+		});
+	}
+
+	void spatial_hash_grid::queryRadius(vec3 center, float radius, std::vector<uint32>& out) const
+	{
+		query(center, radius, (uint32)-1, out);
+	}
+
+	void spatial_hash_grid::queryNeighbors(uint32 object, float radius, std::vector<uint32>& out) const
+	{
+		query(positions[object], radius, object, out);
+	}
+
+	void spatial_hash_grid::query(vec3 center, float radius, uint32 exclude, std::vector<uint32>& out) const
+	{
+		uint32 count = size();
+		if (count == 0 || !(radius > 0.f))
+		{
+			return;
+		}
+
+		// Cells are selected with a little slack, so that rounding never skips the cell of an object within the radius.
+		float gridCellSize = 1.f / invCellSize;
+		float searchRadius = radius + gridCellSize * 1e-3f;
+
+		int32 minX = getCellCoordinate(center.x - searchRadius, invCellSize);
+		int32 minY = getCellCoordinate(center.y - searchRadius, invCellSize);
+		int32 minZ = getCellCoordinate(center.z - searchRadius, invCellSize);
+		int32 maxX = getCellCoordinate(center.x + searchRadius, invCellSize);
+		int32 maxY = getCellCoordinate(center.y + searchRadius, invCellSize);
+		int32 maxZ = getCellCoordinate(center.z + searchRadius, invCellSize);
+
+		uint64 numCells = (uint64)((int64)maxX - minX + 1) * (uint64)((int64)maxY - minY + 1) * (uint64)((int64)maxZ - minZ + 1);
+
+		// Radii much larger than the cell size touch about every bucket anyway.
+		if (numCells > bucketMask + 1)
+		{
+			scan(center, radius, 0, count, exclude, out);
+			return;
+		}
+
+		uint32 fixedBuckets[64];
+		std::vector<uint32> allocatedBuckets;
+		uint32* buckets = fixedBuckets;
+		if (numCells > arraysize(fixedBuckets))
+		{
+			allocatedBuckets.resize(numCells);
+			buckets = allocatedBuckets.data();
+		}
+
+		// Buckets of the cells which overlap the sphere.
+		float squaredSearchRadius = searchRadius * searchRadius;
+		uint32 numBuckets = 0;
+		for (int32 z = minZ; z <= maxZ; ++z)
+		{
+			float dz = max(max(z * gridCellSize - center.z, center.z - (z + 1) * gridCellSize), 0.f);
+			for (int32 y = minY; y <= maxY; ++y)
+			{
+				float dy = max(max(y * gridCellSize - center.y, center.y - (y + 1) * gridCellSize), 0.f);
+				for (int32 x = minX; x <= maxX; ++x)
+				{
+					float dx = max(max(x * gridCellSize - center.x, center.x - (x + 1) * gridCellSize), 0.f);
+					if (dx * dx + dy * dy + dz * dz < squaredSearchRadius)
+					{
+						buckets[numBuckets++] = hashCell(x, y, z, bucketMask);
+					}
+				}
+			}
+		}
+
+		// Different cells may share a bucket, which must only be scanned once. Sorting also scans the buckets in memory
+		// order.
+		std::sort(buckets, buckets + numBuckets);
+		numBuckets = (uint32)(std::unique(buckets, buckets + numBuckets) - buckets);
+
+		for (uint32 i = 0; i < numBuckets; ++i)
+		{
+			uint32 begin = bucketOffsets[buckets[i]];
+			uint32 end = bucketOffsets[buckets[i] + 1];
+			if (begin != end)
+			{
+				scan(center, radius, begin, end, exclude, out);
+			}
+		}
+	}
+
+	void spatial_hash_grid::scan(vec3 center, float radius, uint32 begin, uint32 end, uint32 exclude, std::vector<uint32>& out) const
+	{
+		w_float centerX = center.x;
+		w_float centerY = center.y;
+		w_float centerZ = center.z;
+		w_float squaredRadius = radius * radius;
+
+		for (uint32 i = begin; i < end; i += SPATIAL_HASH_GRID_SIMD_WIDTH)
+		{
+			w_float dx = w_float(sortedX.data() + i) - centerX;
+			w_float dy = w_float(sortedY.data() + i) - centerY;
+			w_float dz = w_float(sortedZ.data() + i) - centerZ;
+			w_float squaredDistance = fmadd(dx, dx, fmadd(dy, dy, dz * dz));
+
+			uint32 numLanes = min(end - i, SPATIAL_HASH_GRID_SIMD_WIDTH);
+			uint32 mask = (uint32)to_bit_mask(squaredDistance < squaredRadius) & ((1u << numLanes) - 1);
+
+			unsigned long lane;
+			while (_BitScanForward(&lane, mask))
+			{
+				uint32 object = sortedObjects[i + lane];
+				if (object != exclude)
+				{
+					out.push_back(object);
+				}
+				mask &= mask - 1;
+			}
+		}
+	}
+
+	template <typename query_t>
+	static void runBatchQuery(uint32 count, spatial_hash_grid_batch_result& out, const query_t& query)
+	{
+		// Queries are split into chunks, each collecting its results into its own list. The lists are concatenated in
+		// chunk order, so the result does not depend on scheduling.
+		const uint32 chunkSize = 64;
+
+		out.offsets.assign(count + 1, 0);
+		out.objects.clear();
+
+		uint32 numChunks = bucketize(count, chunkSize);
+		std::vector<std::vector<uint32>> chunkResults(numChunks);
+
+		parallel_for(low_priority_job_queue, numChunks, 1, [&](uint32 chunk)
+		{
+			std::vector<uint32>& results = chunkResults[chunk];
+
+			uint32 end = min((chunk + 1) * chunkSize, count);
+			for (uint32 i = chunk * chunkSize; i < end; ++i)
+			{
+				query(i, results);
+				out.offsets[i + 1] = (uint32)results.size();
+			}
+		});
+
+		uint32 base = 0;
+		for (uint32 chunk = 0; chunk < numChunks; ++chunk)
+		{
+			uint32 end = min((chunk + 1) * chunkSize, count);
+			for (uint32 i = chunk * chunkSize; i < end; ++i)
+			{
+				out.offsets[i + 1] += base;
+			}
+			base += (uint32)chunkResults[chunk].size();
+		}
+
+		out.objects.reserve(base);
+		for (const std::vector<uint32>& results : chunkResults)
+		{
+			out.objects.insert(out.objects.end(), results.begin(), results.end());
+		}
+	}
+
+	void spatial_hash_grid::batchQueryRadius(const vec3* centers, uint32 count, float radius, spatial_hash_grid_batch_result& out) const
+	{
+		runBatchQuery(count, out, [&](uint32 i, std::vector<uint32>& results)
+		{
+			queryRadius(centers[i], radius, results);
+		});
+	}
+
+	void spatial_hash_grid::batchQueryNeighbors(float radius, spatial_hash_grid_batch_result& out) const
+	{
+		runBatchQuery(size(), out, [&](uint32 i, std::vector<uint32>& results)
+		{
+			queryNeighbors(i, radius, results);
+		});
+	}
+
+}
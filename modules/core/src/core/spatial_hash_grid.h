@@ -0,0 +1,77 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#pragma once
+
+#include "core_api.h"
+
+#include "core/math.h"
+
+namespace era_engine
+{
+	// Uniform grid over points, for proximity queries between many small objects which all move every frame, e.g. boids,
+	// debris, audio emitters or perception targets. Keeping a BVH fitted to those costs more than building this from
+	// scratch, so there is no incremental update: rebuild is a parallel counting sort of all objects by their cell.
+	//
+	// Cells are hashed into a table with at least as many buckets as objects, so the grid is unbounded and its memory is
+	// proportional to the object count. Objects of different cells may share a bucket. Queries filter them out along with
+	// everything else outside the radius, testing w_float's width of objects at a time. Queries are cheapest for radii up
+	// to about the cell size.
+
+	// Results of a batch query. The objects found by query i are objects[offsets[i]] to objects[offsets[i + 1] - 1], in
+	// the order the single query would report them.
+	struct spatial_hash_grid_batch_result
+	{
+		NODISCARD uint32 numResults(uint32 query) const { return offsets[query + 1] - offsets[query]; }
+		NODISCARD const uint32* results(uint32 query) const { return objects.data() + offsets[query]; }
+
+		std::vector<uint32> offsets;
+		std::vector<uint32> objects;
+	};
+
+	// Objects are identified by their index in the positions passed to the last rebuild. Queries are thread safe with
+	// respect to each other, but not to rebuild. Results are in an order which only depends on the positions, not on
+	// scheduling.
+	struct ERA_CORE_API spatial_hash_grid
+	{
+		// Takes effect on the next rebuild.
+		void setCellSize(float size);
+		NODISCARD float getCellSize() const { return cellSize; }
+
+		// Replaces all objects. The positions are copied. Runs over the low priority job queue and blocks until done.
+		void rebuild(const vec3* positions, uint32 count);
+
+		NODISCARD uint32 size() const { return (uint32)positions.size(); }
+		NODISCARD vec3 getPosition(uint32 object) const { return positions[object]; }
+
+		// Append the objects closer than 'radius' to the center, or to the object itself, which is not reported.
+		void queryRadius(vec3 center, float radius, std::vector<uint32>& out) const;
+		void queryNeighbors(uint32 object, float radius, std::vector<uint32>& out) const;
+
+		// Batch versions of the queries above. Queries are split over the low priority job queue. Blocks until done.
+		void batchQueryRadius(const vec3* centers, uint32 count, float radius, spatial_hash_grid_batch_result& out) const;
+
+		// Neighbors of every object, query i being object i.
+		void batchQueryNeighbors(float radius, spatial_hash_grid_batch_result& out) const;
+
+	private:
+		void query(vec3 center, float radius, uint32 exclude, std::vector<uint32>& out) const;
+		void scan(vec3 center, float radius, uint32 begin, uint32 end, uint32 exclude, std::vector<uint32>& out) const;
+
+		float cellSize = 1.f;
+
+		// Of the last rebuild.
+		float invCellSize = 1.f;
+		uint32 bucketMask = 0;
+
+		std::vector<vec3> positions;
+		std::vector<uint32> objectBuckets;
+
+		// Objects of bucket b are sortedObjects[bucketOffsets[b]] to sortedObjects[bucketOffsets[b + 1] - 1], ascending.
+		// Their positions are in the same order in sortedX, sortedY and sortedZ, which are padded by the SIMD width.
+		std::vector<uint32> bucketOffsets;
+		std::vector<uint32> bucketCursors;
+		std::vector<uint32> sortedObjects;
+		std::vector<float> sortedX, sortedY, sortedZ;
+	};
+
+}
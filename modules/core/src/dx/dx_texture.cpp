@@ -18,6 +18,7 @@
 namespace era_engine
 {
 	static void initializeTexture(ref<dx_texture> result, D3D12_RESOURCE_DESC textureDesc, D3D12_SUBRESOURCE_DATA* subresourceData, uint32 numSubresources, D3D12_RESOURCE_STATES initialState = D3D12_RESOURCE_STATE_COMMON, bool mipUAVs = false);
+	static void retire(dx_resource resource, dx_descriptor_allocation srvUavAllocation, dx_descriptor_allocation rtvAllocation, dx_descriptor_allocation dsvAllocation);
 
 	static void uploadImageToGPU(ref<dx_texture> result, DirectX::ScratchImage& scratchImage, D3D12_RESOURCE_DESC& textureDesc, uint32 flags)
 	{
@@ -70,14 +71,30 @@ namespace era_engine
 		result->loadState.store(AssetLoadState::LOADED, std::memory_order_release);
 	}
 
-	NODISCARD static ref<dx_texture> loadTextureInternal(const fs::path& path, AssetHandle handle, uint32 flags,
-		bool async, JobHandle parentJob)
+	static uint32 getTextureLoadFlags(uint32 flags)
 	{
 		if (flags & image_load_flags_gen_mips_on_gpu)
 		{
 			flags &= ~image_load_flags_gen_mips_on_cpu;
 			flags |= image_load_flags_allocate_full_mipchain;
 		}
+		return flags;
+	}
+
+	// Bound in place of textures which are still loading.
+	static void initializePlaceholderTexture(dx_texture& result)
+	{
+		result.width = 1;
+		result.height = 1;
+		result.depth = 1;
+		result.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		result.defaultSRV = render_resources::nullTextureSRV;
+	}
+
+	NODISCARD static ref<dx_texture> loadTextureInternal(const fs::path& path, AssetHandle handle, uint32 flags,
+		bool async, JobHandle parentJob)
+	{
+		flags = getTextureLoadFlags(flags);
 
 		if (!async)
 		{
@@ -102,11 +119,7 @@ namespace era_engine
 		else
 		{
 			ref<dx_texture> result = make_ref<dx_texture>();
-			result->width = 1;
-			result->height = 1;
-			result->depth = 1;
-			result->format = DXGI_FORMAT_R8G8B8A8_UNORM;
-			result->defaultSRV = render_resources::nullTextureSRV;
+			initializePlaceholderTexture(*result);
 			result->handle = handle;
 			result->flags = flags;
 			result->loadState = AssetLoadState::LOADING;
@@ -234,6 +247,9 @@ namespace era_engine
 	}
 
 	static std::unordered_map<texture_key, weakref<dx_texture>> textureCache;
+
+	// Streamed textures may be unloaded again and have no load job, so they are never handed out by the job loaders.
+	static std::unordered_map<texture_key, weakref<dx_texture>> streamedTextureCache;
 	static std::mutex mutex;
 
 	static ref<dx_texture> loadTextureFromFileAndHandle(const fs::path& filename, AssetHandle handle, uint32 flags,
@@ -283,6 +299,132 @@ namespace era_engine
 		return loadTextureFromFileAndHandle(sceneFilename, handle, flags, true, parentJob);
 	}
 
+	// The I/O stage loads the image, from the DDS cache if there is one, the decode stage uploads it to the GPU.
+	struct texture_streaming_asset : streaming_asset
+	{
+		texture_streaming_asset(const weakref<dx_texture>& texture, const fs::path& path, uint32 flags)
+			: texture(texture), path(path), flags(flags)
+		{
+			std::error_code ec;
+			estimatedSize = fs::file_size(path, ec);
+		}
+
+		uint64 read() override
+		{
+			ref<dx_texture> result = texture.lock();
+			if (!result)
+			{
+				return 0;
+			}
+
+			result->loadState = AssetLoadState::LOADING;
+
+			bool loaded = (path.extension() == ".svg")
+				? loadSVGFromFile(path, flags, scratchImage, textureDesc)
+				: loadImageFromFile(path, flags, scratchImage, textureDesc);
+			if (!loaded)
+			{
+				result->loadState = AssetLoadState::UNLOADED;
+				return 0;
+			}
+
+			return max((uint64)scratchImage.GetPixelsSize(), 1ull);
+		}
+
+		uint64 decode(JobHandle job) override
+		{
+			uint64 residentBytes = 0;
+			if (ref<dx_texture> result = texture.lock())
+			{
+				uploadImageToGPU(result, scratchImage, textureDesc, flags);
+				result->loadState.store(AssetLoadState::LOADED, std::memory_order_release);
+				residentBytes = max((uint64)scratchImage.GetPixelsSize(), 1ull);
+			}
+			scratchImage.Release();
+
+			return residentBytes;
+		}
+
+		void release() override
+		{
+			scratchImage.Release();
+
+			// Resources are retired through the dx context, so frames in flight keep them alive. Materials keep pointing
+			// to the texture, which shows the placeholder until it is streamed in again.
+			if (ref<dx_texture> result = texture.lock())
+			{
+				retire(result->resource, result->srvUavAllocation, result->rtvAllocation, result->dsvAllocation);
+				if (result->allocation)
+				{
+					dxContext.retire(result->allocation);
+				}
+
+				result->resource.Reset();
+				result->allocation = 0;
+				result->srvUavAllocation = {};
+				result->rtvAllocation = {};
+				result->dsvAllocation = {};
+				initializePlaceholderTexture(*result);
+				result->loadState = AssetLoadState::UNLOADED;
+			}
+		}
+
+		uint64 estimate_read_size() const override
+		{
+			return estimatedSize;
+		}
+
+		weakref<dx_texture> texture;
+		fs::path path;
+		uint32 flags;
+
+		DirectX::ScratchImage scratchImage;
+		D3D12_RESOURCE_DESC textureDesc;
+		uint64 estimatedSize = 0;
+	};
+
+	ref<dx_texture> streamTextureFromFile(const fs::path& filename, float priority, uint32 flags)
+	{
+		if (!isAssetStreamingInitialized())
+		{
+			return loadTextureFromFileAsync(filename, flags);
+		}
+
+		fs::path path = filename.lexically_normal().make_preferred();
+		if (!fs::exists(path))
+		{
+			return nullptr;
+		}
+
+		AssetHandle handle = getAssetHandleFromPath(path);
+		texture_key key = { handle, flags };
+
+		Lock lock{ mutex };
+
+		weakref<dx_texture>& entry = streamedTextureCache[key];
+		ref<dx_texture> result = entry.lock();
+		if (result)
+		{
+			if (result->stream)
+			{
+				setStreamingPriority(result->stream, priority);
+			}
+			return result;
+		}
+
+		result = make_ref<dx_texture>();
+		initializePlaceholderTexture(*result);
+		result->handle = handle;
+		result->flags = getTextureLoadFlags(flags);
+		result->loadState = AssetLoadState::UNLOADED;
+		entry = result;
+
+		ref<texture_streaming_asset> asset = make_ref<texture_streaming_asset>(result, path, result->flags);
+		result->stream = requestStreaming(std::hash<texture_key>()(key), asset, priority);
+
+		return result;
+	}
+
 	ref<dx_texture> loadTextureFromMemory(const void* ptr, uint32 size, image_format imageFormat, const fs::path& cacheFilename, uint32 flags)
 	{
 		return loadTextureFromMemoryInternal(ptr, size, imageFormat, cacheFilename, flags);
@@ -1065,6 +1207,11 @@ namespace era_engine
 
 	dx_texture::~dx_texture()
 	{
+		if (stream)
+		{
+			cancelStreaming(stream);
+		}
+
 		retire(resource, srvUavAllocation, rtvAllocation, dsvAllocation);
 		if (allocation)
 		{
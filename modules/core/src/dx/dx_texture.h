@@ -10,6 +10,7 @@
 #include "dx/dx_descriptor_allocation.h"
 
 #include "asset/asset.h"
+#include "asset/asset_streaming.h"
 #include "asset/image.h"
 
 namespace era_engine
@@ -58,6 +59,10 @@ namespace era_engine
 
 		std::atomic<AssetLoadState> loadState = AssetLoadState::LOADED;
 		JobHandle loadJob;
+
+		// Set for textures loaded through streamTextureFromFile. Evicted textures show the placeholder and go back to
+		// UNLOADED.
+		ref<streaming_request> stream;
 	};
 
 	struct dx_texture_atlas
@@ -152,6 +157,12 @@ namespace era_engine
 	ERA_CORE_API ref<dx_texture> loadTextureFromFileAsync(const fs::path& filename, uint32 flags = image_load_flags_default, JobHandle parentJob = {});
 	ERA_CORE_API ref<dx_texture> loadTextureFromHandleAsync(AssetHandle handle, uint32 flags = image_load_flags_default, JobHandle parentJob = {});
 
+	// Loads the texture through the asset streaming service, ordered by 'priority' (lower first). The texture may be
+	// evicted again when the streaming budget is exceeded, so callers mark it as used every frame with
+	// markStreamedAssetUsed(texture->stream, priority). Falls back to loadTextureFromFileAsync if the service is not running.
+	// Streamed textures are cached apart from the loadTexture* functions, which never return a texture that may be evicted.
+	ERA_CORE_API ref<dx_texture> streamTextureFromFile(const fs::path& filename, float priority, uint32 flags = image_load_flags_default);
+
 	ERA_CORE_API ref<dx_texture> loadTextureFromMemory(const void* ptr, uint32 size, image_format imageFormat, const fs::path& cacheFilename, uint32 flags = image_load_flags_default);
 	ERA_CORE_API ref<dx_texture> loadVolumeTextureFromDirectory(const fs::path& dirname, uint32 flags = image_load_flags_compress | image_load_flags_cache_to_dds | image_load_flags_noncolor);
 
@@ -98,6 +98,14 @@ namespace era_engine
 			internal_data->native_registry->remove<Component_>(internal_data->entity_handle);
 		}
 
+		// Announces an in-place change of the component to the registry's update observers, e.g. the renderer's static
+		// scene cache.
+		template <typename Component_>
+		void patch_component()
+		{
+			internal_data->native_registry->patch<Component_>(internal_data->entity_handle);
+		}
+
 		template <typename Component_>
 		bool has_component() const
 		{
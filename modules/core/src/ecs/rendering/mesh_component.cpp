@@ -41,7 +41,10 @@ namespace era_engine
 
 	Entity MeshUtils::load_entity_mesh_from_file_async(ref<World> world, const fs::path& filename, uint32 flags, mesh_load_callback cb, JobHandle parent_job)
 	{
-		ref<multi_mesh> mesh = loadMeshFromFileAsync(filename, flags, parent_job, cb);
+		// Callers which wait for a parent job expect the mesh to be loaded by then, which only the job path guarantees.
+		ref<multi_mesh> mesh = (parent_job.index == -1)
+			? streamMeshFromFile(filename, 0.f, flags, cb)
+			: loadMeshFromFileAsync(filename, flags, parent_job, cb);
 		Entity entity = world->create_entity();
 		entity.add_component<MeshComponent>(mesh, false);
 		return entity;
@@ -49,7 +52,9 @@ namespace era_engine
 
 	Entity MeshUtils::load_entity_mesh_from_handle_async(ref<World> world, AssetHandle handle, uint32 flags, mesh_load_callback cb, JobHandle parent_job)
 	{
-		ref<multi_mesh> mesh = loadMeshFromHandleAsync(handle, flags, parent_job, cb);
+		ref<multi_mesh> mesh = (parent_job.index == -1)
+			? streamMeshFromHandle(handle, 0.f, flags, cb)
+			: loadMeshFromHandleAsync(handle, flags, parent_job, cb);
 		Entity entity = world->create_entity();
 		entity.add_component<MeshComponent>(mesh, false);
 		return entity;
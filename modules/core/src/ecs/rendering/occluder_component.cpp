@@ -0,0 +1,23 @@
+#include "ecs/rendering/occluder_component.h"
+
+#include <rttr/registration>
+
+namespace era_engine
+{
+	RTTR_REGISTRATION
+	{
+		using namespace rttr;
+		rttr::registration::class_<OccluderComponent>("OccluderComponent")
+			.constructor<ref<Entity::EcsData>, ref<occluder_mesh>>()
+			.property("mesh", &OccluderComponent::mesh);
+	}
+
+	OccluderComponent::OccluderComponent(ref<Entity::EcsData> _data, ref<occluder_mesh> _mesh)
+		: Component(_data), mesh(_mesh)
+	{
+	}
+
+	OccluderComponent::~OccluderComponent()
+	{
+	}
+}
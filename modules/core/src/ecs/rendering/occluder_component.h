@@ -0,0 +1,23 @@
+#pragma once
+
+#include "core_api.h"
+#include "ecs/component.h"
+
+#include "core/occlusion_culling.h"
+
+namespace era_engine
+{
+	// Marks the entity's transform as carrying occluder geometry for software occlusion culling of the main camera. The
+	// geometry must lie inside whatever the entity renders, e.g. a coarse LOD or a box inside a building's walls.
+	class ERA_CORE_API OccluderComponent : public Component
+	{
+	public:
+		OccluderComponent(ref<Entity::EcsData> _data, ref<occluder_mesh> _mesh);
+		virtual ~OccluderComponent();
+
+		ERA_VIRTUAL_REFLECT(Component)
+
+	public:
+		ref<occluder_mesh> mesh;
+	};
+}
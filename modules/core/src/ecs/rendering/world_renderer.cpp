@@ -1,14 +1,19 @@
 #include "ecs/rendering/world_renderer.h"
 #include "ecs/rendering/mesh_component.h"
+#include "ecs/rendering/occluder_component.h"
 #include "ecs/base_components/base_components.h"
 
 #include "core/cpu_profiling.h"
 #include "core/string.h"
+#include "core/frustum_culling.h"
+#include "core/occlusion_culling.h"
+#include "core/job_system.h"
 
 #include "rendering/pbr.h"
 #include "rendering/depth_prepass.h"
 #include "rendering/outline.h"
 #include "rendering/shadow_map.h"
+#include "rendering/shadow_map_cache.h"
 
 #include "asset/pbr_material_desc.h"
 
@@ -33,14 +38,19 @@ namespace era_engine
 		return aabb.contains(s.center) || sphereVsAABB(s, aabb);
 	}
 
+	static bool isRenderable(const MeshComponent& mesh)
+	{
+		return mesh.mesh && !mesh.is_hidden && (mesh.mesh->loadState.load() == AssetLoadState::LOADED);
+	}
+
 	static bool shouldRender(const camera_frustum_planes& frustum, const MeshComponent& mesh, const TransformComponent& transform)
 	{
-		return mesh.mesh && !mesh.is_hidden && (mesh.mesh->loadState.load() == AssetLoadState::LOADED) && ((mesh.mesh->aabb.maxCorner.x == mesh.mesh->aabb.minCorner.x) || !frustum.cullModelSpaceAABB(mesh.mesh->aabb, transform.transform));
+		return isRenderable(mesh) && ((mesh.mesh->aabb.maxCorner.x == mesh.mesh->aabb.minCorner.x) || !frustum.cullModelSpaceAABB(mesh.mesh->aabb, transform.transform));
 	}
 
 	static bool shouldRender(const bounding_sphere& frustum, const MeshComponent& mesh, const TransformComponent& transform)
 	{
-		return mesh.mesh && !mesh.is_hidden && (mesh.mesh->loadState.load() == AssetLoadState::LOADED) && ((mesh.mesh->aabb.maxCorner.x == mesh.mesh->aabb.minCorner.x) || shouldRender(frustum, mesh.mesh->aabb, transform.transform));
+		return isRenderable(mesh) && ((mesh.mesh->aabb.maxCorner.x == mesh.mesh->aabb.minCorner.x) || shouldRender(frustum, mesh.mesh->aabb, transform.transform));
 	}
 
 	static bool shouldRender(const light_frustum& frustum, const MeshComponent& mesh, const TransformComponent& transform)
@@ -48,6 +58,264 @@ namespace era_engine
 		return (frustum.type == light_frustum_standard) ? shouldRender(frustum.frustum, mesh, transform) : shouldRender(frustum.sphere, mesh, transform);
 	}
 
+	static constexpr uint32 MAX_RENDERED_MESH_LODS = 8;
+
+	// Screen space LOD selection for the main camera. Shadow passes always use LOD 0.
+	struct lod_selection
+	{
+		vec3 cameraPosition;
+		float pixelsPerUnitAtDistance1;
+		float maxPixelError = 1.f;
+	};
+
+	static lod_selection getLodSelection(const render_camera& camera)
+	{
+		camera_projection_extents extents = camera.getProjectionExtents();
+
+		lod_selection result;
+		result.cameraPosition = camera.position;
+		result.pixelsPerUnitAtDistance1 = camera.height / (extents.top + extents.bottom);
+		return result;
+	}
+
+	static uint32 selectLod(const lod_selection& lod, const multi_mesh& mesh, const trs& transform)
+	{
+		if (mesh.lodErrors.empty())
+		{
+			return 0;
+		}
+
+		// Errors are in object space, so scale them like the mesh. Measure from the closest point of the bounding sphere.
+		float scale = max(transform.scale.x, max(transform.scale.y, transform.scale.z));
+		vec3 center = transform.position + transform.rotation * (mesh.aabb.getCenter() * transform.scale);
+		float radius = length(mesh.aabb.getRadius()) * scale;
+		float distance = max(length(center - lod.cameraPosition) - radius, 0.01f);
+
+		uint32 result = selectMeshLod(mesh, lod.pixelsPerUnitAtDistance1 * scale / distance, lod.maxPixelError);
+		return min(result, MAX_RENDERED_MESH_LODS - 1);
+	}
+
+	// Keeps streamed meshes and material textures in view of the camera or of a shadow map resident, or queues them
+	// again, closest first.
+	static void markStreamedMeshUsed(const multi_mesh& mesh, float priority)
+	{
+		if (mesh.stream)
+		{
+			markStreamedAssetUsed(mesh.stream, priority);
+		}
+
+		// Submeshes are only complete once the mesh is loaded.
+		if (mesh.loadState.load(std::memory_order_acquire) != AssetLoadState::LOADED)
+		{
+			return;
+		}
+
+		for (const submesh& sm : mesh.submeshes)
+		{
+			if (sm.material)
+			{
+				markStreamedMaterialUsed(*sm.material, priority);
+			}
+		}
+	}
+
+	// Called for meshes which passed the frustum test.
+	static void markStreamedMeshUsed(vec3 cameraPosition, const MeshComponent& mesh, const TransformComponent& transform)
+	{
+		if (!mesh.mesh || mesh.is_hidden)
+		{
+			return;
+		}
+
+		markStreamedMeshUsed(*mesh.mesh, length(transform.transform.position - cameraPosition));
+	}
+
+	// A group's entities and their world space bounds, gathered once per frame and culled against the main camera and
+	// every shadow frustum.
+	struct culling_group
+	{
+		Entity::Handle* entities = nullptr;
+		world_space_bounds bounds;
+	};
+
+	// Meshes without bounds are never culled. These are meshes which were never loaded and have no bounds yet (so that
+	// streamed ones are always requested), and meshes with flat bounds.
+	static bounding_box getCullingBounds(const bounding_box& aabb, const trs& transform)
+	{
+		if (aabb.minCorner.x >= aabb.maxCorner.x)
+		{
+			return bounding_box::everything();
+		}
+		return getWorldSpaceAABB(aabb, transform);
+	}
+
+	static bounding_box getCullingBounds(const MeshComponent& mesh, const TransformComponent& transform)
+	{
+		if (!mesh.mesh)
+		{
+			return bounding_box::fromMinMax(transform.transform.position, transform.transform.position);
+		}
+		return getCullingBounds(mesh.mesh->aabb, transform.transform);
+	}
+
+	template <typename group_t>
+	static void gatherCullingGroup(group_t group, Allocator& arena, culling_group& out)
+	{
+		uint32 groupSize = (uint32)group.size();
+
+		out.entities = arena.allocate<Entity::Handle>(groupSize);
+		out.bounds.resize(groupSize);
+
+		uint32 index = 0;
+		for (Entity::Handle entityHandle : group)
+		{
+			out.entities[index++] = entityHandle;
+		}
+
+		parallel_for(low_priority_job_queue, groupSize, 1024, [&](uint32 i)
+		{
+			auto [transform, mesh] = group.get<TransformComponent, MeshComponent>(out.entities[i]);
+			out.bounds.set(i, getCullingBounds(mesh, transform));
+		});
+	}
+
+	// Writes the indices (into culling_group::entities) of the entities which pass the frustum test and returns their
+	// count. Renderability is checked by the caller.
+	template <typename group_t>
+	static uint32 cullGroup(group_t group, const culling_group& cg, const light_frustum& frustum, uint32* outIndices)
+	{
+		if (frustum.type == light_frustum_standard)
+		{
+			return cullWorldSpaceAABBsParallel(frustum.frustum, cg.bounds, outIndices);
+		}
+
+		uint32 numVisible = 0;
+		for (uint32 i = 0; i < cg.bounds.size(); ++i)
+		{
+			auto [transform, mesh] = group.get<TransformComponent, MeshComponent>(cg.entities[i]);
+			if (shouldRender(frustum.sphere, mesh, transform))
+			{
+				outIndices[numVisible++] = i;
+			}
+		}
+		return numVisible;
+	}
+
+	// Software occlusion culling of the main camera. The buffer is kept in the world's registry context and rebuilt every
+	// frame from the occluders with the largest projected size.
+	static constexpr uint32 OCCLUSION_BUFFER_WIDTH = 320;
+	static constexpr uint32 MAX_OCCLUDERS = 64;
+
+	// Returns null if there is nothing to occlude with, so callers can skip the test.
+	static const software_occlusion_buffer* rasterizeOccluders(World* world, const render_camera& camera, const camera_frustum_planes& frustum)
+	{
+		CPU_PROFILE_BLOCK("Rasterize occluders");
+
+		struct occluder_candidate
+		{
+			float size;
+			const occluder_mesh* mesh;
+			mat4 transform;
+		};
+
+		std::vector<occluder_candidate> candidates;
+		for (auto [entityHandle, transform, occluder] : world->group(components_group<TransformComponent, OccluderComponent>).each())
+		{
+			if (!occluder.mesh)
+				continue;
+
+			bounding_box aabb = getWorldSpaceAABB(occluder.mesh->aabb, transform.transform);
+			if (frustum.cullWorldSpaceAABB(aabb))
+				continue;
+
+			// Squared radius over squared distance, proportional to the projected area.
+			vec3 radius = aabb.getRadius();
+			float distanceSq = max(squared_length(aabb.getCenter() - camera.position), 1e-4f);
+			candidates.push_back({ squared_length(radius) / distanceSq, occluder.mesh.get(), trs_to_mat4(transform.transform) });
+		}
+
+		if (candidates.empty())
+		{
+			return nullptr;
+		}
+
+		if (candidates.size() > MAX_OCCLUDERS)
+		{
+			std::nth_element(candidates.begin(), candidates.begin() + MAX_OCCLUDERS, candidates.end(),
+				[](const occluder_candidate& a, const occluder_candidate& b) { return a.size > b.size; });
+			candidates.resize(MAX_OCCLUDERS);
+		}
+
+		auto& context = world->get_registry().ctx();
+		software_occlusion_buffer* buffer = context.find<software_occlusion_buffer>();
+		if (!buffer)
+		{
+			buffer = &context.emplace<software_occlusion_buffer>();
+		}
+
+		uint32 height = max(OCCLUSION_BUFFER_WIDTH * camera.height / max(camera.width, 1u), 1u);
+		if (buffer->getWidth() != OCCLUSION_BUFFER_WIDTH || buffer->getHeight() != align_to(height, OCCLUSION_TILE_HEIGHT))
+		{
+			buffer->initialize(OCCLUSION_BUFFER_WIDTH, height);
+		}
+
+		buffer->beginFrame(camera.viewProj, camera.nearPlane);
+		for (const occluder_candidate& candidate : candidates)
+		{
+			buffer->addOccluder(*candidate.mesh, candidate.transform);
+		}
+		buffer->rasterizeOccluders();
+
+		CPU_PROFILE_STAT("Occluders", buffer->getStats().numOccluders);
+		CPU_PROFILE_STAT("Occluder triangles", buffer->getStats().numTriangles);
+
+		return buffer;
+	}
+
+	static const submesh_info& getLodSubmesh(const submesh& sm, uint32 lod)
+	{
+		return (lod == 0 || sm.lods.empty()) ? sm.info : sm.lods[min(lod, (uint32)sm.lods.size()) - 1];
+	}
+
+	// Copies one mesh's instances from the CPU staging arrays to the GPU buffers, grouped by LOD (counting sort, stable
+	// within a LOD). Writes the per LOD ranges, relative to the mesh's range, and returns the number of LODs.
+	static uint32 scatterInstancesByLod(const offset_count& oc, const mat4* transforms, const uint32* objectIDs, const uint8* lods,
+		mat4* gpuTransforms, mat4* gpuPrevFrameTransforms, uint32* gpuObjectIDs, offset_count* outRanges)
+	{
+		uint32 counts[MAX_RENDERED_MESH_LODS] = {};
+		for (uint32 i = oc.offset; i < oc.offset + oc.count; ++i)
+		{
+			++counts[lods[i]];
+		}
+
+		uint32 numLods = 0;
+		uint32 offset = 0;
+		for (uint32 l = 0; l < MAX_RENDERED_MESH_LODS; ++l)
+		{
+			outRanges[l] = { offset, 0 };
+			offset += counts[l];
+			if (counts[l])
+			{
+				numLods = l + 1;
+			}
+		}
+
+		for (uint32 i = oc.offset; i < oc.offset + oc.count; ++i)
+		{
+			offset_count& range = outRanges[lods[i]];
+			uint32 index = oc.offset + range.offset + range.count++;
+
+			gpuTransforms[index] = transforms[i];
+			if (gpuPrevFrameTransforms)
+			{
+				gpuPrevFrameTransforms[index] = transforms[i];
+			}
+			gpuObjectIDs[index] = objectIDs[i];
+		}
+
+		return numLods;
+	}
+
 	template <typename group_t>
 	std::unordered_map<multi_mesh*, offset_count> getOffsetsPerMesh(group_t group)
 	{
@@ -75,7 +343,10 @@ namespace era_engine
 		return ocPerMesh;
 	}
 
-	static void addToRenderPass(PbrMaterialShader shader, const pbr_render_data& data, const depth_prepass_data& depthPrepassData,
+	// Alpha tested geometry is drawn after solid geometry, so that more of it fails the depth test early.
+	static constexpr uint32 ALPHA_CUTOUT_SORT_LAYER = 1;
+
+	static void addToRenderPass(PbrMaterialShader shader, const pbr_render_data& data, const depth_prepass_data& depthPrepassData, float depth,
 		opaque_render_pass* opaqueRenderPass, transparent_render_pass* transparentRenderPass)
 	{
 		switch (shader)
@@ -85,23 +356,23 @@ namespace era_engine
 		{
 			if (shader == pbr_material_shader_default)
 			{
-				opaqueRenderPass->renderObject<pbr_pipeline::opaque>(data);
-				opaqueRenderPass->renderDepthOnly<depth_prepass_pipeline::single_sided>(depthPrepassData);
+				opaqueRenderPass->renderObject<pbr_pipeline::opaque>(data, depth);
+				opaqueRenderPass->renderDepthOnly<depth_prepass_pipeline::single_sided>(depthPrepassData, depth);
 			}
 			else
 			{
-				opaqueRenderPass->renderObject<pbr_pipeline::opaque_double_sided>(data);
-				opaqueRenderPass->renderDepthOnly<depth_prepass_pipeline::double_sided>(depthPrepassData);
+				opaqueRenderPass->renderObject<pbr_pipeline::opaque_double_sided>(data, depth);
+				opaqueRenderPass->renderDepthOnly<depth_prepass_pipeline::double_sided>(depthPrepassData, depth);
 			}
 		} break;
 		case pbr_material_shader_alpha_cutout:
 		{
-			opaqueRenderPass->renderObject<pbr_pipeline::opaque_double_sided>(data);
-			opaqueRenderPass->renderDepthOnly<depth_prepass_pipeline::alpha_cutout>(depthPrepassData);
+			opaqueRenderPass->renderObject<pbr_pipeline::opaque_double_sided>(data, depth, ALPHA_CUTOUT_SORT_LAYER);
+			opaqueRenderPass->renderDepthOnly<depth_prepass_pipeline::alpha_cutout>(depthPrepassData, depth, ALPHA_CUTOUT_SORT_LAYER);
 		} break;
 		case pbr_material_shader_transparent:
 		{
-			transparentRenderPass->renderObject<pbr_pipeline::transparent>(data);
+			transparentRenderPass->renderObject<pbr_pipeline::transparent>(data, depth);
 		} break;
 		}
 	}
@@ -174,69 +445,360 @@ namespace era_engine
 		}
 	}
 
+	// Persistent render data of the static group's renderable STATIC instances, kept in the world's registry context and
+	// shared by the main camera and all shadow passes. Instances are sorted by mesh, so each mesh owns one contiguous
+	// range of slots. Added and removed components, and those announced with Entity::patch_component, invalidate the
+	// cache through the registry's signals. Components are also changed in place without a notification (physics,
+	// scripts, loaders), so each frame every entity's transform and mesh are still compared against the cache. This only
+	// reads components, the group's order is not compared.
+	struct static_scene_cache
+	{
+		static constexpr uint32 INVALID_SLOT = UINT32_MAX;
+
+		struct mesh_range
+		{
+			ref<multi_mesh> mesh; // Keeps the mesh alive until the next rebuild.
+			bounding_box aabb;
+			uint32 offset;
+			uint32 count;
+		};
+
+		// The group's entities in iteration order at build time, with their slot or INVALID_SLOT.
+		struct group_entry
+		{
+			Entity::Handle entity;
+			uint32 slot;
+		};
+
+		NODISCARD uint32 size() const { return (uint32)entities.size(); }
+
+		std::vector<group_entry> groupEntries;
+		std::vector<mesh_range> meshRanges;
+
+		// Per slot.
+		std::vector<Entity::Handle> entities;
+		std::vector<multi_mesh*> meshes;
+		std::vector<trs> transforms;
+		std::vector<mat4> worldMatrices;
+		world_space_bounds bounds;
+
+		// Entities of the group which are not cached, but may still need their streamed mesh marked as used.
+		std::vector<Entity::Handle> uncachedEntities;
+
+		bool valid = false;
+	};
+
+	// A run of visible instances of one mesh range, 'oc' is relative to the compacted visible instances.
+	struct static_instance_run
+	{
+		uint32 range;
+		offset_count oc;
+	};
+
+	static bool isStaticInstance(const MeshComponent& mesh, const TransformComponent& transform)
+	{
+		return isRenderable(mesh) && (transform.type != TransformComponent::DYNAMIC);
+	}
+
+	// Bitwise, member by member, since trs has a vtable and padding.
+	static bool sameTransform(const trs& a, const trs& b)
+	{
+		return memcmp(&a.rotation, &b.rotation, sizeof(quat)) == 0
+			&& memcmp(&a.position, &b.position, sizeof(vec3)) == 0
+			&& memcmp(&a.scale, &b.scale, sizeof(vec3)) == 0;
+	}
+
+	static void invalidateStaticSceneCache(entt::registry& registry, entt::entity entity)
+	{
+		registry.ctx().get<static_scene_cache>().valid = false;
+	}
+
+	template <typename component_t>
+	static void connectStaticSceneCacheInvalidation(entt::registry& registry)
+	{
+		registry.on_construct<component_t>().template connect<&invalidateStaticSceneCache>();
+		registry.on_destroy<component_t>().template connect<&invalidateStaticSceneCache>();
+		registry.on_update<component_t>().template connect<&invalidateStaticSceneCache>();
+	}
+
+	static static_scene_cache& getStaticSceneCache(World* world)
+	{
+		entt::registry& registry = world->get_registry();
+		static_scene_cache* cache = registry.ctx().find<static_scene_cache>();
+		if (!cache)
+		{
+			cache = &registry.ctx().emplace<static_scene_cache>();
+
+			connectStaticSceneCacheInvalidation<TransformComponent>(registry);
+			connectStaticSceneCacheInvalidation<MeshComponent>(registry);
+			connectStaticSceneCacheInvalidation<animation::AnimationComponent>(registry);
+			connectStaticSceneCacheInvalidation<TreeComponent>(registry);
+		}
+		return *cache;
+	}
+
 	template <typename group_t>
-	static void renderStaticObjectsToMainCamera(group_t group, std::unordered_map<multi_mesh*, offset_count> ocPerMesh,
-		const camera_frustum_planes& frustum, Allocator& arena, Entity::Handle selectedObjectID,
-		opaque_render_pass* opaqueRenderPass, transparent_render_pass* transparentRenderPass, ldr_render_pass* ldrRenderPass)
+	static bool isStaticSceneCacheValid(const static_scene_cache& cache, group_t group)
 	{
-		uint32 groupSize = (uint32)group.size();
+		if (!cache.valid)
+		{
+			return false;
+		}
 
-		dx_allocation transformAllocation = dxContext.allocateDynamicBuffer(groupSize * sizeof(mat4), 4);
-		mat4* transforms = (mat4*)transformAllocation.cpuPtr;
+		// Streamed meshes can be unloaded and reloaded with different bounds.
+		for (const static_scene_cache::mesh_range& range : cache.meshRanges)
+		{
+			if (range.mesh->loadState.load() != AssetLoadState::LOADED || memcmp(&range.aabb, &range.mesh->aabb, sizeof(bounding_box)) != 0)
+			{
+				return false;
+			}
+		}
 
-		dx_allocation objectIDAllocation = dxContext.allocateDynamicBuffer(groupSize * sizeof(uint32), 4);
-		uint32* objectIDs = (uint32*)objectIDAllocation.cpuPtr;
+		// Cached instances which moved, became DYNAMIC, were hidden or changed their mesh.
+		for (uint32 slot = 0; slot < cache.size(); ++slot)
+		{
+			auto [transform, mesh] = group.get<TransformComponent, MeshComponent>(cache.entities[slot]);
+			if (!isStaticInstance(mesh, transform) || (mesh.mesh.get() != cache.meshes[slot]) || !sameTransform(cache.transforms[slot], transform.transform))
+			{
+				return false;
+			}
+		}
+
+		// Uncached entities which became STATIC, or whose mesh finished loading or was unhidden.
+		for (Entity::Handle entityHandle : cache.uncachedEntities)
+		{
+			auto [transform, mesh] = group.get<TransformComponent, MeshComponent>(entityHandle);
+			if (isStaticInstance(mesh, transform))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	template <typename group_t>
+	static void rebuildStaticSceneCache(static_scene_cache& cache, group_t group)
+	{
+		CPU_PROFILE_BLOCK("Rebuild static scene cache");
+
+		cache.groupEntries.clear();
+		cache.meshRanges.clear();
+		cache.uncachedEntities.clear();
+
+		std::unordered_map<multi_mesh*, uint32> rangePerMesh;
 
 		for (auto [entityHandle, transform, mesh] : group.each())
 		{
-			if (!shouldRender(frustum, mesh, transform))
+			if (!isStaticInstance(mesh, transform))
+			{
+				cache.groupEntries.push_back({ entityHandle, static_scene_cache::INVALID_SLOT });
+				cache.uncachedEntities.push_back(entityHandle);
 				continue;
+			}
+
+			auto [it, inserted] = rangePerMesh.try_emplace(mesh.mesh.get(), (uint32)cache.meshRanges.size());
+			if (inserted)
+			{
+				cache.meshRanges.push_back({ mesh.mesh, mesh.mesh->aabb, 0, 0 });
+			}
+
+			// Temporarily the range index, resolved to a slot below.
+			cache.groupEntries.push_back({ entityHandle, it->second });
+			++cache.meshRanges[it->second].count;
+		}
+
+		uint32 numInstances = 0;
+		for (static_scene_cache::mesh_range& range : cache.meshRanges)
+		{
+			range.offset = numInstances;
+			numInstances += range.count;
+			range.count = 0;
+		}
 
-			if (transform.type == TransformComponent::DYNAMIC)
+		cache.entities.resize(numInstances);
+		cache.meshes.resize(numInstances);
+		cache.transforms.resize(numInstances);
+		cache.worldMatrices.resize(numInstances);
+		cache.bounds.resize(numInstances);
+
+		for (static_scene_cache::group_entry& entry : cache.groupEntries)
+		{
+			if (entry.slot == static_scene_cache::INVALID_SLOT)
+			{
 				continue;
+			}
 
-			const dx_mesh& dxMesh = mesh.mesh->mesh;
+			static_scene_cache::mesh_range& range = cache.meshRanges[entry.slot];
+			entry.slot = range.offset + range.count++;
 
-			offset_count& oc = ocPerMesh.at(mesh.mesh.get());
+			cache.entities[entry.slot] = entry.entity;
+			cache.meshes[entry.slot] = range.mesh.get();
+			cache.transforms[entry.slot] = group.get<TransformComponent>(entry.entity).transform;
+		}
 
-			uint32 index = oc.offset + oc.count;
-			transforms[index] = trs_to_mat4(transform.transform);
-			objectIDs[index] = (uint32)entityHandle;
+		parallel_for(low_priority_job_queue, numInstances, 1024, [&](uint32 slot)
+		{
+			cache.worldMatrices[slot] = trs_to_mat4(cache.transforms[slot]);
+			cache.bounds.set(slot, getCullingBounds(cache.meshes[slot]->aabb, cache.transforms[slot]));
+		});
 
-			++oc.count;
+		cache.valid = true;
+	}
 
-			if (entityHandle == selectedObjectID)
+	static bool isInShadowFrustum(const shadow_passes& shadow, const bounding_box& bounds)
+	{
+		for (uint32 i = 0; i < shadow.numShadowRenderPasses; ++i)
+		{
+			const light_frustum& frustum = shadow.shadowRenderPasses[i].frustum;
+			bool visible = (frustum.type == light_frustum_standard)
+				? !frustum.frustum.cullWorldSpaceAABB(bounds)
+				: (bounds.contains(frustum.sphere.center) || sphereVsAABB(frustum.sphere, bounds));
+			if (visible)
 			{
-				for (auto& sm : mesh.mesh->submeshes)
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Streamed meshes which are not cached yet, because they are still loading, must be requested when in view of the
+	// camera or of a shadow map.
+	template <typename group_t>
+	static void markUncachedStreamedMeshesUsed(group_t group, const static_scene_cache& cache, const camera_frustum_planes& frustum, const shadow_passes& shadow,
+		const lod_selection& lodSelection)
+	{
+		for (Entity::Handle entityHandle : cache.uncachedEntities)
+		{
+			auto [transform, mesh] = group.get<TransformComponent, MeshComponent>(entityHandle);
+			if (!mesh.mesh || !mesh.mesh->stream)
+			{
+				continue;
+			}
+
+			bounding_box bounds = getCullingBounds(mesh, transform);
+			if (!frustum.cullWorldSpaceAABB(bounds) || isInShadowFrustum(shadow, bounds))
+			{
+				markStreamedMeshUsed(lodSelection.cameraPosition, mesh, transform);
+			}
+		}
+	}
+
+	// Splits the visible slots, which are ascending and therefore grouped by mesh, into one run per mesh range. Returns
+	// the number of runs.
+	static uint32 getStaticInstanceRuns(const static_scene_cache& cache, const uint32* visible, uint32 numVisible, static_instance_run* outRuns)
+	{
+		uint32 numRuns = 0;
+		uint32 range = 0;
+		for (uint32 v = 0; v < numVisible; ++v)
+		{
+			uint32 slot = visible[v];
+			if (numRuns > 0 && slot < cache.meshRanges[range].offset + cache.meshRanges[range].count)
+			{
+				++outRuns[numRuns - 1].oc.count;
+				continue;
+			}
+
+			while (slot >= cache.meshRanges[range].offset + cache.meshRanges[range].count)
+			{
+				++range;
+			}
+			outRuns[numRuns++] = { range, { v, 1 } };
+		}
+		return numRuns;
+	}
+
+	// Marks each run's mesh once, with the distance to its closest visible instance.
+	static void markStreamedRunsUsed(const static_scene_cache& cache, const static_instance_run* runs, uint32 numRuns, const uint32* visible, vec3 cameraPosition)
+	{
+		for (uint32 r = 0; r < numRuns; ++r)
+		{
+			float distance = FLT_MAX;
+			for (uint32 v = runs[r].oc.offset; v < runs[r].oc.offset + runs[r].oc.count; ++v)
+			{
+				distance = min(distance, length(cache.transforms[visible[v]].position - cameraPosition));
+			}
+			markStreamedMeshUsed(*cache.meshRanges[runs[r].range].mesh, distance);
+		}
+	}
+
+	static uint32 cullStaticScene(const static_scene_cache& cache, const light_frustum& frustum, uint32* outVisible)
+	{
+		if (frustum.type == light_frustum_standard)
+		{
+			return cullWorldSpaceAABBsParallel(frustum.frustum, cache.bounds, outVisible);
+		}
+
+		uint32 numVisible = 0;
+		for (const static_scene_cache::mesh_range& range : cache.meshRanges)
+		{
+			bool flat = range.aabb.maxCorner.x == range.aabb.minCorner.x;
+			for (uint32 slot = range.offset; slot < range.offset + range.count; ++slot)
+			{
+				if (flat || shouldRender(frustum.sphere, range.aabb, cache.transforms[slot]))
 				{
-					renderOutline(ldrRenderPass, transforms[index], dxMesh.vertexBuffer, dxMesh.indexBuffer, sm.info);
+					outVisible[numVisible++] = slot;
 				}
 			}
 		}
+		return numVisible;
+	}
 
-		D3D12_GPU_VIRTUAL_ADDRESS transformsAddress = transformAllocation.gpuPtr;
-		D3D12_GPU_VIRTUAL_ADDRESS objectIDAddress = objectIDAllocation.gpuPtr;
+	// Draws are recorded in parallel, in chunks of consecutive mesh runs. Each chunk records into its own recording pass,
+	// selected by the chunk index, and the recording passes are merged in chunk order afterwards.
+	static constexpr uint32 MAX_RECORDING_SLOTS = 16;
+	static constexpr uint32 MIN_RUNS_PER_RECORDING_SLOT = 8;
 
-		uint32 numDrawCalls = 0;
+	static uint32 getNumRecordingSlots(uint32 numRuns)
+	{
+		return clamp((numRuns + MIN_RUNS_PER_RECORDING_SLOT - 1) / MIN_RUNS_PER_RECORDING_SLOT, 1u, MAX_RECORDING_SLOTS);
+	}
 
-		for (auto& [mesh, oc] : ocPerMesh)
+	static uint32 recordStaticRunToMainCamera(const static_scene_cache& cache, const static_instance_run& run, const uint32* visible, const lod_selection& lodSelection,
+		mat4* transforms, uint32* objectIDs, uint8* lods, mat4* gpuTransforms, uint32* gpuObjectIDs,
+		D3D12_GPU_VIRTUAL_ADDRESS transformsAddress, D3D12_GPU_VIRTUAL_ADDRESS objectIDAddress,
+		opaque_render_pass* opaqueRenderPass, transparent_render_pass* transparentRenderPass)
+	{
+		const offset_count& oc = run.oc;
+		multi_mesh* mesh = cache.meshRanges[run.range].mesh.get();
+
+		// All instances of the run are sorted by the nearest one.
+		float depth = FLT_MAX;
+
+		for (uint32 v = oc.offset; v < oc.offset + oc.count; ++v)
 		{
-			if (oc.count == 0)
-				continue;
+			uint32 slot = visible[v];
+			transforms[v] = cache.worldMatrices[slot];
+			objectIDs[v] = (uint32)cache.entities[slot];
+			lods[v] = (uint8)selectLod(lodSelection, *mesh, cache.transforms[slot]);
 
-			D3D12_GPU_VIRTUAL_ADDRESS baseM = transformsAddress + (oc.offset * sizeof(mat4));
-			D3D12_GPU_VIRTUAL_ADDRESS baseObjectID = objectIDAddress + (oc.offset * sizeof(uint32));
+			depth = min(depth, length(cache.transforms[slot].position - lodSelection.cameraPosition));
+		}
+
+		offset_count lodRanges[MAX_RENDERED_MESH_LODS];
+		uint32 numLods = scatterInstancesByLod(oc, transforms, objectIDs, lods, gpuTransforms, nullptr, gpuObjectIDs, lodRanges);
 
-			const dx_mesh& dxMesh = mesh->mesh;
+		const dx_mesh& dxMesh = mesh->mesh;
 
-			if (!dxMesh.indexBuffer || !dxMesh.vertexBuffer.positions)
+		if (!dxMesh.indexBuffer || !dxMesh.vertexBuffer.positions)
+			return 0;
+
+		uint32 numDrawCalls = 0;
+
+		for (uint32 lod = 0; lod < numLods; ++lod)
+		{
+			const offset_count& range = lodRanges[lod];
+			if (range.count == 0)
 				continue;
 
+			D3D12_GPU_VIRTUAL_ADDRESS baseM = transformsAddress + ((oc.offset + range.offset) * sizeof(mat4));
+			D3D12_GPU_VIRTUAL_ADDRESS baseObjectID = objectIDAddress + ((oc.offset + range.offset) * sizeof(uint32));
+
 			pbr_render_data data;
 			data.transformPtr = baseM;
 			data.vertexBuffer = dxMesh.vertexBuffer;
 			data.indexBuffer = dxMesh.indexBuffer;
-			data.numInstances = oc.count;
+			data.numInstances = range.count;
 
 			depth_prepass_data depthPrepassData;
 			depthPrepassData.transformPtr = baseM;
@@ -245,81 +807,245 @@ namespace era_engine
 			depthPrepassData.vertexBuffer = dxMesh.vertexBuffer;
 			depthPrepassData.prevFrameVertexBuffer = dxMesh.vertexBuffer.positions;
 			depthPrepassData.indexBuffer = dxMesh.indexBuffer;
-			depthPrepassData.numInstances = oc.count;
+			depthPrepassData.numInstances = range.count;
 
 			for (auto& sm : mesh->submeshes)
 			{
-				data.submesh = sm.info;
+				data.submesh = getLodSubmesh(sm, lod);
 				data.material = sm.material;
 
 				depthPrepassData.submesh = data.submesh;
 				depthPrepassData.alphaCutoutTextureSRV = (sm.material && sm.material->albedo) ? sm.material->albedo->defaultSRV : dx_cpu_descriptor_handle{};
 
-				addToRenderPass(sm.material->shader, data, depthPrepassData, opaqueRenderPass, transparentRenderPass);
+				addToRenderPass(sm.material->shader, data, depthPrepassData, depth, opaqueRenderPass, transparentRenderPass);
+
+				++numDrawCalls;
+			}
+		}
+
+		return numDrawCalls;
+	}
+
+	static void renderStaticObjectsToMainCamera(const static_scene_cache& cache, const camera_frustum_planes& frustum, const software_occlusion_buffer* occlusion,
+		const lod_selection& lodSelection, Allocator& arena, Entity::Handle selectedObjectID,
+		opaque_render_pass* opaqueRenderPass, transparent_render_pass* transparentRenderPass, ldr_render_pass* ldrRenderPass)
+	{
+		MemoryMarker marker = arena.get_marker();
+
+		uint32* visible = arena.allocate<uint32>(cache.size());
+		uint32 numVisible = cullWorldSpaceAABBsParallel(frustum, cache.bounds, visible);
+		if (occlusion)
+		{
+			uint32 numInFrustum = numVisible;
+			numVisible = occlusion->cullAABBs(cache.bounds, visible, numVisible, visible);
+			CPU_PROFILE_STAT("Static instances occluded", numInFrustum - numVisible);
+		}
+		if (numVisible == 0)
+		{
+			arena.reset_to_marker(marker);
+			return;
+		}
+
+		static_instance_run* runs = arena.allocate<static_instance_run>((uint32)cache.meshRanges.size());
+		uint32 numRuns = getStaticInstanceRuns(cache, visible, numVisible, runs);
+
+		// Streaming requests and outlines go to shared state, so they are handled here and not in the recording jobs.
+		markStreamedRunsUsed(cache, runs, numRuns, visible, lodSelection.cameraPosition);
+
+		for (uint32 r = 0; r < numRuns; ++r)
+		{
+			const multi_mesh& mesh = *cache.meshRanges[runs[r].range].mesh;
+			for (uint32 v = runs[r].oc.offset; v < runs[r].oc.offset + runs[r].oc.count; ++v)
+			{
+				uint32 slot = visible[v];
+
+				if (cache.entities[slot] == selectedObjectID)
+				{
+					for (auto& sm : mesh.submeshes)
+					{
+						renderOutline(ldrRenderPass, cache.worldMatrices[slot], mesh.mesh.vertexBuffer, mesh.mesh.indexBuffer, sm.info);
+					}
+				}
+			}
+		}
+
+		dx_allocation transformAllocation = dxContext.allocateDynamicBuffer(numVisible * sizeof(mat4), 4);
+		mat4* gpuTransforms = (mat4*)transformAllocation.cpuPtr;
+
+		dx_allocation objectIDAllocation = dxContext.allocateDynamicBuffer(numVisible * sizeof(uint32), 4);
+		uint32* gpuObjectIDs = (uint32*)objectIDAllocation.cpuPtr;
+
+		// Staged on the CPU, because instances are regrouped by LOD before they go to the (write-combined) GPU buffers.
+		mat4* transforms = arena.allocate<mat4>(numVisible);
+		uint32* objectIDs = arena.allocate<uint32>(numVisible);
+		uint8* lods = arena.allocate<uint8>(numVisible);
+
+		D3D12_GPU_VIRTUAL_ADDRESS transformsAddress = transformAllocation.gpuPtr;
+		D3D12_GPU_VIRTUAL_ADDRESS objectIDAddress = objectIDAllocation.gpuPtr;
+
+		uint32 numSlots = getNumRecordingSlots(numRuns);
+		uint32 runsPerSlot = (numRuns + numSlots - 1) / numSlots;
+
+		opaqueRenderPass->begin_recording(numSlots);
+		transparentRenderPass->begin_recording(numSlots);
+
+		uint32 numDrawCallsPerSlot[MAX_RECORDING_SLOTS] = {};
 
-				++numDrawCalls;
+		parallel_for(low_priority_job_queue, numSlots, 1, [&](uint32 slot)
+		{
+			opaque_render_pass& opaque = opaqueRenderPass->get_recording_pass(slot);
+			transparent_render_pass& transparent = transparentRenderPass->get_recording_pass(slot);
+
+			uint32 end = min((slot + 1) * runsPerSlot, numRuns);
+			for (uint32 r = slot * runsPerSlot; r < end; ++r)
+			{
+				numDrawCallsPerSlot[slot] += recordStaticRunToMainCamera(cache, runs[r], visible, lodSelection, transforms, objectIDs, lods,
+					gpuTransforms, gpuObjectIDs, transformsAddress, objectIDAddress, &opaque, &transparent);
 			}
+		});
+
+		opaqueRenderPass->merge_recording();
+		transparentRenderPass->merge_recording();
+
+		uint32 numDrawCalls = 0;
+		for (uint32 slot = 0; slot < numSlots; ++slot)
+		{
+			numDrawCalls += numDrawCallsPerSlot[slot];
 		}
 
+		arena.reset_to_marker(marker);
+
 		CPU_PROFILE_STAT("Static draw calls", numDrawCalls);
 	}
 
-	template <typename group_t>
-	static void renderStaticObjectsToShadowMap(group_t group, std::unordered_map<multi_mesh*, offset_count> ocPerMesh,
-		const light_frustum& frustum, Allocator& arena, shadow_render_pass_base* shadowRenderPass)
+	static void recordStaticRunToShadowMap(const static_scene_cache& cache, const static_instance_run& run, D3D12_GPU_VIRTUAL_ADDRESS transformsAddress,
+		bool isPointLight, shadow_render_pass_base* shadowRenderPass)
 	{
-		uint32 groupSize = (uint32)group.size();
+		const offset_count& oc = run.oc;
+		multi_mesh* mesh = cache.meshRanges[run.range].mesh.get();
 
-		dx_allocation transformAllocation = dxContext.allocateDynamicBuffer(groupSize * sizeof(mat4), 4);
-		mat4* transforms = (mat4*)transformAllocation.cpuPtr;
+		D3D12_GPU_VIRTUAL_ADDRESS baseM = transformsAddress + (oc.offset * sizeof(mat4));
 
-		for (auto [entityHandle, transform, mesh] : group.each())
-		{
-			if (!shouldRender(frustum, mesh, transform))
-				continue;
+		const dx_mesh& dxMesh = mesh->mesh;
 
-			if (transform.type == TransformComponent::DYNAMIC)
-				continue;
+		if (!dxMesh.indexBuffer || !dxMesh.vertexBuffer.positions)
+			return;
 
-			const dx_mesh& dxMesh = mesh.mesh->mesh;
+		shadow_render_data data;
+		data.transformPtr = baseM;
+		data.vertexBuffer = dxMesh.vertexBuffer.positions;
+		data.indexBuffer = dxMesh.indexBuffer;
+		data.numInstances = oc.count;
 
-			offset_count& oc = ocPerMesh.at(mesh.mesh.get());
+		for (auto& sm : mesh->submeshes)
+		{
+			data.submesh = sm.info;
+			addToStaticRenderPass(sm.material->shader, data, shadowRenderPass, isPointLight);
+		}
+	}
 
-			uint32 index = oc.offset + oc.count;
-			transforms[index] = trs_to_mat4(transform.transform);
+	struct static_shadow_pass_work
+	{
+		uint32* visible;
+		uint32 numVisible;
+		static_instance_run* runs;
+		uint32 numRuns;
+		uint32 runsPerSlot;
+		mat4* transforms;
+		D3D12_GPU_VIRTUAL_ADDRESS transformsAddress;
+	};
+
+	struct static_shadow_recording_job
+	{
+		uint32 pass;
+		uint32 slot;
+	};
 
-			++oc.count;
+	// All shadow passes are culled at once, then all their chunks are recorded at once. Only the GPU allocations, which
+	// are not thread safe, and the streaming requests are made in between, on this thread.
+	static void renderStaticObjectsToShadowMaps(const static_scene_cache& cache, shadow_passes& shadow, vec3 cameraPosition, Allocator& arena)
+	{
+		uint32 numPasses = shadow.numShadowRenderPasses;
+		if (numPasses == 0 || cache.size() == 0)
+		{
+			return;
 		}
 
-		D3D12_GPU_VIRTUAL_ADDRESS transformsAddress = transformAllocation.gpuPtr;
+		MemoryMarker marker = arena.get_marker();
 
-		for (auto& [mesh, oc] : ocPerMesh)
+		static_shadow_pass_work* work = arena.allocate<static_shadow_pass_work>(numPasses);
+		for (uint32 i = 0; i < numPasses; ++i)
 		{
-			if (oc.count == 0)
-				continue;
+			work[i].visible = arena.allocate<uint32>(cache.size());
+			work[i].runs = arena.allocate<static_instance_run>((uint32)cache.meshRanges.size());
+		}
 
-			D3D12_GPU_VIRTUAL_ADDRESS baseM = transformsAddress + (oc.offset * sizeof(mat4));
+		parallel_for(low_priority_job_queue, numPasses, 1, [&](uint32 i)
+		{
+			work[i].numVisible = cullStaticScene(cache, shadow.shadowRenderPasses[i].frustum, work[i].visible);
+			work[i].numRuns = getStaticInstanceRuns(cache, work[i].visible, work[i].numVisible, work[i].runs);
+		});
 
-			const dx_mesh& dxMesh = mesh->mesh;
+		uint32 numJobs = 0;
+		for (uint32 i = 0; i < numPasses; ++i)
+		{
+			markStreamedRunsUsed(cache, work[i].runs, work[i].numRuns, work[i].visible, cameraPosition);
 
-			if (!dxMesh.indexBuffer || !dxMesh.vertexBuffer.positions)
-				continue;
+			uint32 numSlots = getNumRecordingSlots(work[i].numRuns);
+			work[i].runsPerSlot = (work[i].numRuns + numSlots - 1) / numSlots;
+			shadow.shadowRenderPasses[i].pass->begin_recording(numSlots);
 
-			shadow_render_data data;
-			data.transformPtr = baseM;
-			data.vertexBuffer = dxMesh.vertexBuffer.positions;
-			data.indexBuffer = dxMesh.indexBuffer;
-			data.numInstances = oc.count;
+			if (work[i].numVisible)
+			{
+				dx_allocation transformAllocation = dxContext.allocateDynamicBuffer(work[i].numVisible * sizeof(mat4), 4);
+				work[i].transforms = (mat4*)transformAllocation.cpuPtr;
+				work[i].transformsAddress = transformAllocation.gpuPtr;
+				numJobs += numSlots;
+			}
+		}
 
-			for (auto& sm : mesh->submeshes)
+		static_shadow_recording_job* jobs = arena.allocate<static_shadow_recording_job>(numJobs);
+		uint32 jobIndex = 0;
+		for (uint32 i = 0; i < numPasses; ++i)
+		{
+			if (work[i].numVisible)
+			{
+				for (uint32 slot = 0; slot < getNumRecordingSlots(work[i].numRuns); ++slot)
+				{
+					jobs[jobIndex++] = { i, slot };
+				}
+			}
+		}
+
+		parallel_for(low_priority_job_queue, numJobs, 1, [&](uint32 j)
+		{
+			const static_shadow_pass_work& w = work[jobs[j].pass];
+			const shadow_pass& pass = shadow.shadowRenderPasses[jobs[j].pass];
+			shadow_render_pass_base& recordingPass = pass.pass->get_recording_pass(jobs[j].slot);
+
+			uint32 end = min((jobs[j].slot + 1) * w.runsPerSlot, w.numRuns);
+			for (uint32 r = jobs[j].slot * w.runsPerSlot; r < end; ++r)
 			{
-				data.submesh = sm.info;
-				addToStaticRenderPass(sm.material->shader, data, shadowRenderPass, frustum.type == light_frustum_sphere);
+				const offset_count& oc = w.runs[r].oc;
+				for (uint32 v = oc.offset; v < oc.offset + oc.count; ++v)
+				{
+					w.transforms[v] = cache.worldMatrices[w.visible[v]];
+				}
+
+				recordStaticRunToShadowMap(cache, w.runs[r], w.transformsAddress, pass.frustum.type == light_frustum_sphere, &recordingPass);
 			}
+		});
+
+		for (uint32 i = 0; i < numPasses; ++i)
+		{
+			shadow.shadowRenderPasses[i].pass->merge_recording();
 		}
+
+		arena.reset_to_marker(marker);
 	}
 
-	static void renderStaticObjects(World* world, const camera_frustum_planes& frustum, Allocator& arena, Entity::Handle selectedObjectID,
+	static void renderStaticObjects(World* world, const camera_frustum_planes& frustum, const software_occlusion_buffer* occlusion, const lod_selection& lodSelection,
+		Allocator& arena, Entity::Handle selectedObjectID,
 		opaque_render_pass* opaqueRenderPass, transparent_render_pass* transparentRenderPass, ldr_render_pass* ldrRenderPass, shadow_passes& shadow)
 	{
 		CPU_PROFILE_BLOCK("Static objects");
@@ -333,34 +1059,145 @@ namespace era_engine
 			components_group<TransformComponent, MeshComponent>,
 			specialized_components{});
 
-		std::unordered_map<multi_mesh*, offset_count> ocPerMesh = getOffsetsPerMesh(group);
+		static_scene_cache& cache = getStaticSceneCache(world);
+		if (!isStaticSceneCacheValid(cache, group))
+		{
+			rebuildStaticSceneCache(cache, group);
+		}
 
-		renderStaticObjectsToMainCamera(group, ocPerMesh, frustum, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass);
+		markUncachedStreamedMeshesUsed(group, cache, frustum, shadow, lodSelection);
 
-		for (uint32 i = 0; i < shadow.numShadowRenderPasses; ++i)
+		renderStaticObjectsToMainCamera(cache, frustum, occlusion, lodSelection, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass);
+		renderStaticObjectsToShadowMaps(cache, shadow, lodSelection.cameraPosition, arena);
+	}
+
+	// The instances of one mesh in the dynamic group's per-mesh ranges.
+	struct dynamic_mesh_instances
+	{
+		multi_mesh* mesh;
+		offset_count oc;
+	};
+
+	// Returns the number of meshes with at least one instance. Recording chunks are consecutive meshes of this list.
+	static uint32 getDynamicMeshInstances(const std::unordered_map<multi_mesh*, offset_count>& ocPerMesh, dynamic_mesh_instances* outMeshes)
+	{
+		uint32 numMeshes = 0;
+		for (auto& [mesh, oc] : ocPerMesh)
 		{
-			auto& pass = shadow.shadowRenderPasses[i];
-			renderStaticObjectsToShadowMap(group, ocPerMesh, pass.frustum, arena, pass.pass);
+			if (oc.count)
+			{
+				outMeshes[numMeshes++] = { mesh, oc };
+			}
+		}
+		return numMeshes;
+	}
+
+	static uint32 recordDynamicMeshToMainCamera(const dynamic_mesh_instances& instances, const float* depths,
+		const mat4* transforms, const uint32* objectIDs, const uint8* lods, mat4* gpuTransforms, mat4* gpuPrevFrameTransforms, uint32* gpuObjectIDs,
+		D3D12_GPU_VIRTUAL_ADDRESS transformsAddress, D3D12_GPU_VIRTUAL_ADDRESS prevFrameTransformsAddress, D3D12_GPU_VIRTUAL_ADDRESS objectIDAddress,
+		opaque_render_pass* opaqueRenderPass, transparent_render_pass* transparentRenderPass)
+	{
+		const offset_count& oc = instances.oc;
+		multi_mesh* mesh = instances.mesh;
+
+		// All instances of a mesh are sorted by the nearest one.
+		float depth = FLT_MAX;
+		for (uint32 i = oc.offset; i < oc.offset + oc.count; ++i)
+		{
+			depth = min(depth, depths[i]);
+		}
+
+		offset_count lodRanges[MAX_RENDERED_MESH_LODS];
+		uint32 numLods = scatterInstancesByLod(oc, transforms, objectIDs, lods, gpuTransforms, gpuPrevFrameTransforms, gpuObjectIDs, lodRanges);
+
+		const dx_mesh& dxMesh = mesh->mesh;
+
+		if (!dxMesh.indexBuffer || !dxMesh.vertexBuffer.positions)
+			return 0;
+
+		uint32 numDrawCalls = 0;
+
+		for (uint32 lod = 0; lod < numLods; ++lod)
+		{
+			const offset_count& range = lodRanges[lod];
+			if (range.count == 0)
+				continue;
+
+			D3D12_GPU_VIRTUAL_ADDRESS baseM = transformsAddress + ((oc.offset + range.offset) * sizeof(mat4));
+			D3D12_GPU_VIRTUAL_ADDRESS prevBaseM = prevFrameTransformsAddress + ((oc.offset + range.offset) * sizeof(mat4));
+			D3D12_GPU_VIRTUAL_ADDRESS baseObjectID = objectIDAddress + ((oc.offset + range.offset) * sizeof(uint32));
+
+			pbr_render_data data;
+			data.transformPtr = baseM;
+			data.vertexBuffer = dxMesh.vertexBuffer;
+			data.indexBuffer = dxMesh.indexBuffer;
+			data.numInstances = range.count;
+
+			depth_prepass_data depthPrepassData;
+			depthPrepassData.transformPtr = baseM;
+			depthPrepassData.prevFrameTransformPtr = prevBaseM;
+			depthPrepassData.objectIDPtr = baseObjectID;
+			depthPrepassData.vertexBuffer = dxMesh.vertexBuffer;
+			depthPrepassData.prevFrameVertexBuffer = dxMesh.vertexBuffer.positions;
+			depthPrepassData.indexBuffer = dxMesh.indexBuffer;
+			depthPrepassData.numInstances = range.count;
+
+			for (auto& sm : mesh->submeshes)
+			{
+				data.submesh = getLodSubmesh(sm, lod);
+				data.material = sm.material;
+
+				depthPrepassData.submesh = data.submesh;
+				depthPrepassData.alphaCutoutTextureSRV = (sm.material && sm.material->albedo) ? sm.material->albedo->defaultSRV : dx_cpu_descriptor_handle{};
+
+				addToRenderPass(sm.material->shader, data, depthPrepassData, depth, opaqueRenderPass, transparentRenderPass);
+
+				++numDrawCalls;
+			}
 		}
+
+		return numDrawCalls;
 	}
 
 	template <typename group_t>
-	static void renderDynamicObjectsToMainCamera(group_t group, std::unordered_map<multi_mesh*, offset_count> ocPerMesh,
-		const camera_frustum_planes& frustum, Allocator& arena, Entity::Handle selectedObjectID,
+	static void renderDynamicObjectsToMainCamera(group_t group, const culling_group& cg, std::unordered_map<multi_mesh*, offset_count> ocPerMesh,
+		const camera_frustum_planes& frustum, const software_occlusion_buffer* occlusion, const lod_selection& lodSelection, Allocator& arena, Entity::Handle selectedObjectID,
 		opaque_render_pass* opaqueRenderPass, transparent_render_pass* transparentRenderPass, ldr_render_pass* ldrRenderPass)
 	{
 		uint32 groupSize = (uint32)group.size();
 
 		dx_allocation transformAllocation = dxContext.allocateDynamicBuffer(groupSize * sizeof(mat4) * 2, 4);
-		mat4* transforms = (mat4*)transformAllocation.cpuPtr;
-		mat4* prevFrameTransforms = transforms + groupSize;
+		mat4* gpuTransforms = (mat4*)transformAllocation.cpuPtr;
+		mat4* gpuPrevFrameTransforms = gpuTransforms + groupSize;
 
 		dx_allocation objectIDAllocation = dxContext.allocateDynamicBuffer(groupSize * sizeof(uint32), 4);
-		uint32* objectIDs = (uint32*)objectIDAllocation.cpuPtr;
+		uint32* gpuObjectIDs = (uint32*)objectIDAllocation.cpuPtr;
 
-		for (auto [entityHandle, transform, mesh] : group.each())
+		MemoryMarker marker = arena.get_marker();
+		mat4* transforms = arena.allocate<mat4>(groupSize);
+		uint32* objectIDs = arena.allocate<uint32>(groupSize);
+		uint8* lods = arena.allocate<uint8>(groupSize);
+		float* depths = arena.allocate<float>(groupSize);
+
+		uint32* visible = arena.allocate<uint32>(groupSize);
+		uint32 numVisible = cullWorldSpaceAABBsParallel(frustum, cg.bounds, visible);
+		if (occlusion)
 		{
-			if (!shouldRender(frustum, mesh, transform))
+			uint32 numInFrustum = numVisible;
+			numVisible = occlusion->cullAABBs(cg.bounds, visible, numVisible, visible);
+			CPU_PROFILE_STAT("Dynamic instances occluded", numInFrustum - numVisible);
+		}
+
+		// Streaming requests and outlines go to shared state, so instances are gathered here and only the draws are
+		// recorded in parallel.
+		for (uint32 v = 0; v < numVisible; ++v)
+		{
+			Entity::Handle entityHandle = cg.entities[visible[v]];
+			auto [transform, mesh] = group.get<TransformComponent, MeshComponent>(entityHandle);
+
+			markStreamedMeshUsed(lodSelection.cameraPosition, mesh, transform);
+
+			if (!isRenderable(mesh))
 				continue;
 
 			if (transform.type != TransformComponent::DYNAMIC)
@@ -372,8 +1209,9 @@ namespace era_engine
 
 			uint32 index = oc.offset + oc.count;
 			transforms[index] = trs_to_mat4(transform.transform);
-			prevFrameTransforms[index] = trs_to_mat4(transform.transform);
 			objectIDs[index] = (uint32)entityHandle;
+			lods[index] = (uint8)selectLod(lodSelection, *mesh.mesh, transform.transform);
+			depths[index] = length(transform.transform.position - lodSelection.cameraPosition);
 
 			++oc.count;
 
@@ -386,70 +1224,99 @@ namespace era_engine
 			}
 		}
 
+		dynamic_mesh_instances* meshes = arena.allocate<dynamic_mesh_instances>((uint32)ocPerMesh.size());
+		uint32 numMeshes = getDynamicMeshInstances(ocPerMesh, meshes);
+		if (numMeshes == 0)
+		{
+			arena.reset_to_marker(marker);
+			return;
+		}
+
 		D3D12_GPU_VIRTUAL_ADDRESS transformsAddress = transformAllocation.gpuPtr;
 		D3D12_GPU_VIRTUAL_ADDRESS prevFrameTransformsAddress = transformAllocation.gpuPtr + (groupSize * sizeof(mat4));
 		D3D12_GPU_VIRTUAL_ADDRESS objectIDAddress = objectIDAllocation.gpuPtr;
 
-		uint32 numDrawCalls = 0;
+		uint32 numSlots = getNumRecordingSlots(numMeshes);
+		uint32 meshesPerSlot = (numMeshes + numSlots - 1) / numSlots;
 
-		for (auto& [mesh, oc] : ocPerMesh)
+		opaqueRenderPass->begin_recording(numSlots);
+		transparentRenderPass->begin_recording(numSlots);
+
+		uint32 numDrawCallsPerSlot[MAX_RECORDING_SLOTS] = {};
+
+		parallel_for(low_priority_job_queue, numSlots, 1, [&](uint32 slot)
 		{
-			if (oc.count == 0)
-				continue;
+			opaque_render_pass& opaque = opaqueRenderPass->get_recording_pass(slot);
+			transparent_render_pass& transparent = transparentRenderPass->get_recording_pass(slot);
 
-			D3D12_GPU_VIRTUAL_ADDRESS baseM = transformsAddress + (oc.offset * sizeof(mat4));
-			D3D12_GPU_VIRTUAL_ADDRESS prevBaseM = prevFrameTransformsAddress + (oc.offset * sizeof(mat4));
-			D3D12_GPU_VIRTUAL_ADDRESS baseObjectID = objectIDAddress + (oc.offset * sizeof(uint32));
+			uint32 end = min((slot + 1) * meshesPerSlot, numMeshes);
+			for (uint32 m = slot * meshesPerSlot; m < end; ++m)
+			{
+				numDrawCallsPerSlot[slot] += recordDynamicMeshToMainCamera(meshes[m], depths, transforms, objectIDs, lods,
+					gpuTransforms, gpuPrevFrameTransforms, gpuObjectIDs, transformsAddress, prevFrameTransformsAddress, objectIDAddress, &opaque, &transparent);
+			}
+		});
 
-			const dx_mesh& dxMesh = mesh->mesh;
+		opaqueRenderPass->merge_recording();
+		transparentRenderPass->merge_recording();
 
-			if (!dxMesh.indexBuffer || !dxMesh.vertexBuffer.positions)
-				continue;
+		uint32 numDrawCalls = 0;
+		for (uint32 slot = 0; slot < numSlots; ++slot)
+		{
+			numDrawCalls += numDrawCallsPerSlot[slot];
+		}
 
-			pbr_render_data data;
-			data.transformPtr = baseM;
-			data.vertexBuffer = dxMesh.vertexBuffer;
-			data.indexBuffer = dxMesh.indexBuffer;
-			data.numInstances = oc.count;
+		arena.reset_to_marker(marker);
 
-			depth_prepass_data depthPrepassData;
-			depthPrepassData.transformPtr = baseM;
-			depthPrepassData.prevFrameTransformPtr = prevBaseM;
-			depthPrepassData.objectIDPtr = baseObjectID;
-			depthPrepassData.vertexBuffer = dxMesh.vertexBuffer;
-			depthPrepassData.prevFrameVertexBuffer = dxMesh.vertexBuffer.positions;
-			depthPrepassData.indexBuffer = dxMesh.indexBuffer;
-			depthPrepassData.numInstances = oc.count;
+		CPU_PROFILE_STAT("Dynamic draw calls", numDrawCalls);
+	}
 
-			for (auto& sm : mesh->submeshes)
-			{
-				data.submesh = sm.info;
-				data.material = sm.material;
+	static void recordDynamicMeshToShadowMap(const dynamic_mesh_instances& instances, D3D12_GPU_VIRTUAL_ADDRESS transformsAddress,
+		bool isPointLight, shadow_render_pass_base* shadowRenderPass)
+	{
+		const offset_count& oc = instances.oc;
+		multi_mesh* mesh = instances.mesh;
 
-				depthPrepassData.submesh = data.submesh;
-				depthPrepassData.alphaCutoutTextureSRV = (sm.material && sm.material->albedo) ? sm.material->albedo->defaultSRV : dx_cpu_descriptor_handle{};
+		D3D12_GPU_VIRTUAL_ADDRESS baseM = transformsAddress + (oc.offset * sizeof(mat4));
 
-				addToRenderPass(sm.material->shader, data, depthPrepassData, opaqueRenderPass, transparentRenderPass);
+		const dx_mesh& dxMesh = mesh->mesh;
 
-				++numDrawCalls;
-			}
-		}
+		if (!dxMesh.indexBuffer || !dxMesh.vertexBuffer.positions)
+			return;
 
-		CPU_PROFILE_STAT("Dynamic draw calls", numDrawCalls);
+		shadow_render_data data;
+		data.transformPtr = baseM;
+		data.vertexBuffer = dxMesh.vertexBuffer.positions;
+		data.indexBuffer = dxMesh.indexBuffer;
+		data.numInstances = oc.count;
+
+		for (auto& sm : mesh->submeshes)
+		{
+			data.submesh = sm.info;
+			addToDynamicRenderPass(sm.material->shader, data, shadowRenderPass, isPointLight);
+		}
 	}
 
 	template <typename group_t>
-	static void renderDynamicObjectsToShadowMap(group_t group, std::unordered_map<multi_mesh*, offset_count> ocPerMesh,
-		const light_frustum& frustum, Allocator& arena, shadow_render_pass_base* shadowRenderPass)
+	static void renderDynamicObjectsToShadowMap(group_t group, const culling_group& cg, std::unordered_map<multi_mesh*, offset_count> ocPerMesh,
+		const light_frustum& frustum, vec3 cameraPosition, Allocator& arena, shadow_render_pass_base* shadowRenderPass)
 	{
 		uint32 groupSize = (uint32)group.size();
 
 		dx_allocation transformAllocation = dxContext.allocateDynamicBuffer(groupSize * sizeof(mat4), 4);
 		mat4* transforms = (mat4*)transformAllocation.cpuPtr;
 
-		for (auto [entityHandle, transform, mesh] : group.each())
+		MemoryMarker marker = arena.get_marker();
+		uint32* visible = arena.allocate<uint32>(groupSize);
+		uint32 numVisible = cullGroup(group, cg, frustum, visible);
+
+		for (uint32 v = 0; v < numVisible; ++v)
 		{
-			if (!shouldRender(frustum, mesh, transform))
+			auto [transform, mesh] = group.get<TransformComponent, MeshComponent>(cg.entities[visible[v]]);
+
+			markStreamedMeshUsed(cameraPosition, mesh, transform);
+
+			if (!isRenderable(mesh))
 				continue;
 
 			if (transform.type != TransformComponent::DYNAMIC)
@@ -466,35 +1333,40 @@ namespace era_engine
 			++oc.count;
 		}
 
-		D3D12_GPU_VIRTUAL_ADDRESS transformsAddress = transformAllocation.gpuPtr;
-
-		for (auto& [mesh, oc] : ocPerMesh)
+		dynamic_mesh_instances* meshes = arena.allocate<dynamic_mesh_instances>((uint32)ocPerMesh.size());
+		uint32 numMeshes = getDynamicMeshInstances(ocPerMesh, meshes);
+		if (numMeshes == 0)
 		{
-			if (oc.count == 0)
-				continue;
+			arena.reset_to_marker(marker);
+			return;
+		}
 
-			D3D12_GPU_VIRTUAL_ADDRESS baseM = transformsAddress + (oc.offset * sizeof(mat4));
+		D3D12_GPU_VIRTUAL_ADDRESS transformsAddress = transformAllocation.gpuPtr;
+		bool isPointLight = frustum.type == light_frustum_sphere;
 
-			const dx_mesh& dxMesh = mesh->mesh;
+		uint32 numSlots = getNumRecordingSlots(numMeshes);
+		uint32 meshesPerSlot = (numMeshes + numSlots - 1) / numSlots;
 
-			if (!dxMesh.indexBuffer || !dxMesh.vertexBuffer.positions)
-				continue;
+		shadowRenderPass->begin_recording(numSlots);
 
-			shadow_render_data data;
-			data.transformPtr = baseM;
-			data.vertexBuffer = dxMesh.vertexBuffer.positions;
-			data.indexBuffer = dxMesh.indexBuffer;
-			data.numInstances = oc.count;
+		parallel_for(low_priority_job_queue, numSlots, 1, [&](uint32 slot)
+		{
+			shadow_render_pass_base& recordingPass = shadowRenderPass->get_recording_pass(slot);
 
-			for (auto& sm : mesh->submeshes)
+			uint32 end = min((slot + 1) * meshesPerSlot, numMeshes);
+			for (uint32 m = slot * meshesPerSlot; m < end; ++m)
 			{
-				data.submesh = sm.info;
-				addToDynamicRenderPass(sm.material->shader, data, shadowRenderPass, frustum.type == light_frustum_sphere);
+				recordDynamicMeshToShadowMap(meshes[m], transformsAddress, isPointLight, &recordingPass);
 			}
-		}
+		});
+
+		shadowRenderPass->merge_recording();
+
+		arena.reset_to_marker(marker);
 	}
 
-	static void renderDynamicObjects(World* world, const camera_frustum_planes& frustum, Allocator& arena, Entity::Handle selectedObjectID,
+	static void renderDynamicObjects(World* world, const camera_frustum_planes& frustum, const software_occlusion_buffer* occlusion, const lod_selection& lodSelection,
+		Allocator& arena, Entity::Handle selectedObjectID,
 		opaque_render_pass* opaqueRenderPass, transparent_render_pass* transparentRenderPass, ldr_render_pass* ldrRenderPass, shadow_passes& shadow)
 	{
 		CPU_PROFILE_BLOCK("Dynamic objects");
@@ -504,16 +1376,80 @@ namespace era_engine
 			components_group<animation::AnimationComponent>);
 
 		std::unordered_map<multi_mesh*, offset_count> ocPerMesh = getOffsetsPerMesh(group);
-		renderDynamicObjectsToMainCamera(group, ocPerMesh, frustum, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass);
+
+		MemoryMarker marker = arena.get_marker();
+		culling_group cg;
+		gatherCullingGroup(group, arena, cg);
+
+		renderDynamicObjectsToMainCamera(group, cg, ocPerMesh, frustum, occlusion, lodSelection, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass);
 
 		for (uint32 i = 0; i < shadow.numShadowRenderPasses; ++i)
 		{
 			auto& pass = shadow.shadowRenderPasses[i];
-			renderDynamicObjectsToShadowMap(group, ocPerMesh, pass.frustum, arena, pass.pass);
+			renderDynamicObjectsToShadowMap(group, cg, ocPerMesh, pass.frustum, lodSelection.cameraPosition, arena, pass.pass);
+		}
+
+		arena.reset_to_marker(marker);
+	}
+
+	template <typename group_t>
+	static void recordAnimatedObject(group_t group, Entity::Handle entityHandle, uint32 index, vec3 cameraPosition,
+		D3D12_GPU_VIRTUAL_ADDRESS transformsAddress, D3D12_GPU_VIRTUAL_ADDRESS prevFrameTransformsAddress, D3D12_GPU_VIRTUAL_ADDRESS objectIDAddress,
+		opaque_render_pass* opaqueRenderPass, transparent_render_pass* transparentRenderPass, const shadow_passes& shadow, uint32 slot)
+	{
+		auto [transform, mesh, anim] = group.get<TransformComponent, MeshComponent, animation::AnimationComponent>(entityHandle);
+
+		D3D12_GPU_VIRTUAL_ADDRESS baseM = transformsAddress + (index * sizeof(mat4));
+		D3D12_GPU_VIRTUAL_ADDRESS prevBaseM = prevFrameTransformsAddress + (index * sizeof(mat4));
+		D3D12_GPU_VIRTUAL_ADDRESS baseObjectID = objectIDAddress + (index * sizeof(uint32));
+
+		const dx_mesh& dxMesh = mesh.mesh->mesh;
+
+		float depth = length(transform.transform.position - cameraPosition);
+
+		pbr_render_data data;
+		data.transformPtr = baseM;
+		data.vertexBuffer = anim.current_vertex_buffer;
+		data.indexBuffer = dxMesh.indexBuffer;
+		data.numInstances = 1;
+
+		depth_prepass_data depthPrepassData;
+		depthPrepassData.transformPtr = baseM;
+		depthPrepassData.prevFrameTransformPtr = prevBaseM;
+		depthPrepassData.objectIDPtr = baseObjectID;
+		depthPrepassData.vertexBuffer = anim.current_vertex_buffer;
+		depthPrepassData.prevFrameVertexBuffer = anim.prev_frame_vertex_buffer.positions ? anim.prev_frame_vertex_buffer.positions : anim.current_vertex_buffer.positions;
+		depthPrepassData.indexBuffer = dxMesh.indexBuffer;
+		depthPrepassData.numInstances = 1;
+
+		for (auto& sm : mesh.mesh->submeshes)
+		{
+			data.submesh = sm.info;
+			data.material = sm.material;
+
+			data.submesh.baseVertex -= mesh.mesh->submeshes[0].info.baseVertex; // Vertex buffer from skinning already points to first vertex.
+
+			depthPrepassData.submesh = data.submesh;
+			depthPrepassData.alphaCutoutTextureSRV = (sm.material && sm.material->albedo) ? sm.material->albedo->defaultSRV : dx_cpu_descriptor_handle{};
+
+			addToRenderPass(sm.material->shader, data, depthPrepassData, depth, opaqueRenderPass, transparentRenderPass);
+
+			shadow_render_data shadowData;
+			shadowData.transformPtr = baseM;
+			shadowData.vertexBuffer = anim.current_vertex_buffer.positions;
+			shadowData.indexBuffer = dxMesh.indexBuffer;
+			shadowData.submesh = data.submesh;
+			shadowData.numInstances = 1;
+
+			for (uint32 i = 0; i < shadow.numShadowRenderPasses; ++i)
+			{
+				auto& pass = shadow.shadowRenderPasses[i];
+				addToDynamicRenderPass(sm.material->shader, shadowData, &pass.pass->get_recording_pass(slot), pass.frustum.type == light_frustum_sphere);
+			}
 		}
 	}
 
-	static void renderAnimatedObjects(World* world, const camera_frustum_planes& frustum, Allocator& arena, Entity::Handle selectedObjectID,
+	static void renderAnimatedObjects(World* world, const camera_frustum_planes& frustum, vec3 cameraPosition, Allocator& arena, Entity::Handle selectedObjectID,
 		opaque_render_pass* opaqueRenderPass, transparent_render_pass* transparentRenderPass, ldr_render_pass* ldrRenderPass, shadow_passes& shadow)
 	{
 		CPU_PROFILE_BLOCK("Animated objects");
@@ -534,70 +1470,76 @@ namespace era_engine
 		D3D12_GPU_VIRTUAL_ADDRESS prevFrameTransformsAddress = transformAllocation.gpuPtr + (groupSize * sizeof(mat4));
 		D3D12_GPU_VIRTUAL_ADDRESS objectIDAddress = objectIDAllocation.gpuPtr;
 
-		uint32 index = 0;
+		MemoryMarker marker = arena.get_marker();
+		Entity::Handle* instances = arena.allocate<Entity::Handle>(groupSize);
+
+		// Streaming requests and outlines go to shared state, so instances are gathered here and only the draws are
+		// recorded in parallel, one chunk of consecutive instances per recording slot.
+		uint32 numInstances = 0;
 		for (auto [entityHandle, transform, mesh, anim] : group.each())
 		{
+			// Not culled, since the mesh is drawn into every shadow map.
+			markStreamedMeshUsed(cameraPosition, mesh, transform);
+
 			if (!mesh.mesh || mesh.is_hidden || (mesh.mesh->loadState.load() != AssetLoadState::LOADED))
 				continue;
 
+			uint32 index = numInstances++;
+			instances[index] = entityHandle;
+
 			transforms[index] = trs_to_mat4(transform.transform);
 			prevFrameTransforms[index] = trs_to_mat4(transform.transform); //TODO
 			objectIDs[index] = (uint32)entityHandle;
 
-			D3D12_GPU_VIRTUAL_ADDRESS baseM = transformsAddress + (index * sizeof(mat4));
-			D3D12_GPU_VIRTUAL_ADDRESS prevBaseM = prevFrameTransformsAddress + (index * sizeof(mat4));
-			D3D12_GPU_VIRTUAL_ADDRESS baseObjectID = objectIDAddress + (index * sizeof(uint32));
-
-			const dx_mesh& dxMesh = mesh.mesh->mesh;
-
-			pbr_render_data data;
-			data.transformPtr = baseM;
-			data.vertexBuffer = anim.current_vertex_buffer;
-			data.indexBuffer = dxMesh.indexBuffer;
-			data.numInstances = 1;
-
-			depth_prepass_data depthPrepassData;
-			depthPrepassData.transformPtr = baseM;
-			depthPrepassData.prevFrameTransformPtr = prevBaseM;
-			depthPrepassData.objectIDPtr = baseObjectID;
-			depthPrepassData.vertexBuffer = anim.current_vertex_buffer;
-			depthPrepassData.prevFrameVertexBuffer = anim.prev_frame_vertex_buffer.positions ? anim.prev_frame_vertex_buffer.positions : anim.current_vertex_buffer.positions;
-			depthPrepassData.indexBuffer = dxMesh.indexBuffer;
-			depthPrepassData.numInstances = 1;
-
-			for (auto& sm : mesh.mesh->submeshes)
+			if (entityHandle == selectedObjectID)
 			{
-				data.submesh = sm.info;
-				data.material = sm.material;
-
-				data.submesh.baseVertex -= mesh.mesh->submeshes[0].info.baseVertex; // Vertex buffer from skinning already points to first vertex.
+				const dx_mesh& dxMesh = mesh.mesh->mesh;
+				for (auto& sm : mesh.mesh->submeshes)
+				{
+					submesh_info submesh = sm.info;
+					submesh.baseVertex -= mesh.mesh->submeshes[0].info.baseVertex;
+					renderOutline(ldrRenderPass, transforms[index], anim.current_vertex_buffer, dxMesh.indexBuffer, submesh);
+				}
+			}
+		}
 
-				depthPrepassData.submesh = data.submesh;
-				depthPrepassData.alphaCutoutTextureSRV = (sm.material && sm.material->albedo) ? sm.material->albedo->defaultSRV : dx_cpu_descriptor_handle{};
+		if (numInstances == 0)
+		{
+			arena.reset_to_marker(marker);
+			return;
+		}
 
-				addToRenderPass(sm.material->shader, data, depthPrepassData, opaqueRenderPass, transparentRenderPass);
+		uint32 numSlots = getNumRecordingSlots(numInstances);
+		uint32 instancesPerSlot = (numInstances + numSlots - 1) / numSlots;
 
-				shadow_render_data shadowData;
-				shadowData.transformPtr = baseM;
-				shadowData.vertexBuffer = anim.current_vertex_buffer.positions;
-				shadowData.indexBuffer = dxMesh.indexBuffer;
-				shadowData.submesh = data.submesh;
-				shadowData.numInstances = 1;
+		opaqueRenderPass->begin_recording(numSlots);
+		transparentRenderPass->begin_recording(numSlots);
+		for (uint32 i = 0; i < shadow.numShadowRenderPasses; ++i)
+		{
+			shadow.shadowRenderPasses[i].pass->begin_recording(numSlots);
+		}
 
-				for (uint32 i = 0; i < shadow.numShadowRenderPasses; ++i)
-				{
-					auto& pass = shadow.shadowRenderPasses[i];
-					addToDynamicRenderPass(sm.material->shader, shadowData, pass.pass, pass.frustum.type == light_frustum_sphere);
-				}
+		parallel_for(low_priority_job_queue, numSlots, 1, [&](uint32 slot)
+		{
+			opaque_render_pass& opaque = opaqueRenderPass->get_recording_pass(slot);
+			transparent_render_pass& transparent = transparentRenderPass->get_recording_pass(slot);
 
-				if (entityHandle == selectedObjectID)
-				{
-					renderOutline(ldrRenderPass, transforms[index], anim.current_vertex_buffer, dxMesh.indexBuffer, data.submesh);
-				}
+			uint32 end = min((slot + 1) * instancesPerSlot, numInstances);
+			for (uint32 i = slot * instancesPerSlot; i < end; ++i)
+			{
+				recordAnimatedObject(group, instances[i], i, cameraPosition, transformsAddress, prevFrameTransformsAddress, objectIDAddress,
+					&opaque, &transparent, shadow, slot);
 			}
+		});
 
-			++index;
+		opaqueRenderPass->merge_recording();
+		transparentRenderPass->merge_recording();
+		for (uint32 i = 0; i < shadow.numShadowRenderPasses; ++i)
+		{
+			shadow.shadowRenderPasses[i].pass->merge_recording();
 		}
+
+		arena.reset_to_marker(marker);
 	}
 
 	static void renderTerrain(const render_camera& camera, World* world, Allocator& arena, Entity::Handle selectedObjectID,
@@ -747,7 +1689,7 @@ namespace era_engine
 		//	depthPrepassData.numInstances = 1;
 		//	depthPrepassData.alphaCutoutTextureSRV = (clothMaterial && clothMaterial->albedo) ? clothMaterial->albedo->defaultSRV : dx_cpu_descriptor_handle{};
 
-		//	addToRenderPass(clothMaterial->shader, data, depthPrepassData, opaqueRenderPass, transparentRenderPass);
+		//	addToRenderPass(clothMaterial->shader, data, depthPrepassData, 0.f, opaqueRenderPass, transparentRenderPass);
 
 		//	if (sunShadowRenderPass)
 		//	{
@@ -783,7 +1725,7 @@ namespace era_engine
 		sunShadowRenderPass->copyFromStaticCache = !command.renderStaticGeometry;
 	}
 
-	static void setupSpotShadowPasses(World* world, scene_lighting& lighting, bool invalidateShadowMapCache)
+	static void setupSpotShadowPasses(const render_camera& camera, World* world, scene_lighting& lighting, bool invalidateShadowMapCache)
 	{
 		uint32 numSpotLights = world->number_of_components_of_type<SpotLightComponent>();
 		if (numSpotLights)
@@ -797,9 +1739,16 @@ namespace era_engine
 
 				if (sl.castsShadow && lighting.numSpotShadowRenderPasses < lighting.maxNumSpotShadowRenderPasses)
 				{
+					float priority = getShadowMapPriority(camera, cb.position, cb.maxDistance, sl.shadowPriority);
+					auto [command, si] = determineSpotShadowInfo(cb, (uint32)entityHandle, sl.shadowMapResolution, priority, invalidateShadowMapCache);
+					if (command.viewports[0].size == 0)
+					{
+						*slPtr++ = cb;
+						continue;
+					}
+
 					cb.shadowInfoIndex = lighting.numSpotShadowRenderPasses++;
 
-					auto [command, si] = determineSpotShadowInfo(cb, (uint32)entityHandle, sl.shadowMapResolution, invalidateShadowMapCache);
 					spot_shadow_render_pass& pass = lighting.spotShadowRenderPasses[cb.shadowInfoIndex];
 
 					pass.copyFromStaticCache = !command.renderStaticGeometry;
@@ -817,7 +1766,7 @@ namespace era_engine
 		}
 	}
 
-	static void setupPointShadowPasses(World* world, scene_lighting& lighting, bool invalidateShadowMapCache)
+	static void setupPointShadowPasses(const render_camera& camera, World* world, scene_lighting& lighting, bool invalidateShadowMapCache)
 	{
 		uint32 numPointLights = world->number_of_components_of_type<PointLightComponent>();
 		if (numPointLights)
@@ -831,9 +1780,16 @@ namespace era_engine
 
 				if (pl.castsShadow && lighting.numPointShadowRenderPasses < lighting.maxNumPointShadowRenderPasses)
 				{
+					float priority = getShadowMapPriority(camera, cb.position, cb.radius, pl.shadowPriority);
+					auto [command, si] = determinePointShadowInfo(cb, (uint32)entityHandle, pl.shadowMapResolution, priority, invalidateShadowMapCache);
+					if (command.viewports[0].size == 0 || command.viewports[1].size == 0)
+					{
+						*plPtr++ = cb;
+						continue;
+					}
+
 					cb.shadowInfoIndex = lighting.numPointShadowRenderPasses++;
 
-					auto [command, si] = determinePointShadowInfo(cb, (uint32)entityHandle, pl.shadowMapResolution, invalidateShadowMapCache);
 					point_shadow_render_pass& pass = lighting.pointShadowRenderPasses[cb.shadowInfoIndex];
 
 					pass.copyFromStaticCache0 = !command.renderStaticGeometry;
@@ -858,9 +1814,10 @@ namespace era_engine
 	{
 		CPU_PROFILE_BLOCK("Submit scene render commands");
 
+		beginShadowMapAllocationFrame();
 		setupSunShadowPass(sun, sunShadowRenderPass, invalidateShadowMapCache);
-		setupSpotShadowPasses(world, lighting, invalidateShadowMapCache);
-		setupPointShadowPasses(world, lighting, invalidateShadowMapCache);
+		setupSpotShadowPasses(camera, world, lighting, invalidateShadowMapCache);
+		setupPointShadowPasses(camera, world, lighting, invalidateShadowMapCache);
 
 		shadow_passes staticShadowPasses = {};
 		shadow_passes dynamicShadowPasses = {};
@@ -914,10 +1871,14 @@ namespace era_engine
 		bool sunRenderStaticGeometry = !sunShadowRenderPass->copyFromStaticCache;
 
 		camera_frustum_planes frustum = camera.getWorldSpaceFrustumPlanes();
+		lod_selection lodSelection = getLodSelection(camera);
+
+		// Only the main camera's instances are tested against occluders. Shadow passes see the scene from elsewhere.
+		const software_occlusion_buffer* occlusion = rasterizeOccluders(world, camera, frustum);
 
-		renderStaticObjects(world, frustum, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, staticShadowPasses);
-		renderDynamicObjects(world, frustum, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, dynamicShadowPasses);
-		renderAnimatedObjects(world, frustum, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, dynamicShadowPasses);
+		renderStaticObjects(world, frustum, occlusion, lodSelection, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, staticShadowPasses);
+		renderDynamicObjects(world, frustum, occlusion, lodSelection, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, dynamicShadowPasses);
+		renderAnimatedObjects(world, frustum, lodSelection.cameraPosition, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, dynamicShadowPasses);
 		renderTerrain(camera, world, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, sunRenderStaticGeometry ? sunShadowRenderPass : 0,
 			computePass, dt);
 		renderTrees(world, frustum, arena, selectedObjectID, opaqueRenderPass, transparentRenderPass, ldrRenderPass, sunShadowRenderPass, dt);
@@ -877,6 +877,8 @@ namespace era_engine
 					//if (physics::px_cloth_component* cloth = selectedEntity.getComponentIfExists<physics::px_cloth_component>())
 					//	cloth->translate(selectedEntity.getComponent<transform_component>().position);
 
+					selectedEntity.patch_component<TransformComponent>();
+
 					updateSelectedEntityUIRotation();
 					inputCaptured = true;
 					objectMovedByGizmo = true;
@@ -13,6 +13,7 @@
 #include "window/dx_window.h"
 
 #include "asset/file_registry.h"
+#include "asset/asset_streaming.h"
 
 #include "editor/file_browser.h"
 #include "editor/asset_editor_panel.h"
@@ -100,6 +101,16 @@ namespace era_engine
 			{
 				ImGui::EndMenu();
 			}
+			if (ImGui::BeginMenu("Streaming"))
+			{
+				asset_streaming_stats stats = getAssetStreamingStats();
+				ImGui::Text("Queued: %u, reading: %u, decoding: %u", stats.queued, stats.reading, stats.decoding);
+				ImGui::Text("In flight: %.1f MB", stats.bytes_in_flight / (1024.f * 1024.f));
+				ImGui::Text("Resident: %u (%.1f / %.1f MB)", stats.resident, stats.resident_bytes / (1024.f * 1024.f), stats.memory_budget / (1024.f * 1024.f));
+				ImGui::Text("Completed: %llu, failed: %llu, canceled: %llu, evicted: %llu", stats.completed, stats.failed, stats.canceled, stats.evicted);
+				ImGui::Text("Latency p50/p90/p99: %.1f / %.1f / %.1f ms", stats.latency_p50, stats.latency_p90, stats.latency_p99);
+				ImGui::EndMenu();
+			}
 			ImGui::EndMainMenuBar();
 		}
 
@@ -195,6 +206,7 @@ namespace era_engine
 	{
 		initialize_job_system();
 		initializeFileRegistry();
+		initializeAssetStreaming();
 
 		initializeRenderUtils();
 
@@ -263,6 +275,7 @@ namespace era_engine
 			}
 
 			execute_main_thread_jobs();
+			updateAssetStreaming();
 
 			fileBrowser.draw();
 
@@ -284,6 +297,8 @@ void Engine::terminate()
 {
 	dxContext.flushApplication();
 
+	shutdownAssetStreaming();
+
 	dxContext.quit();
 
 	instance_object = nullptr;
@@ -6,10 +6,14 @@
 
 #include "core/hash.h"
 #include "core/string.h"
+#include "core/log.h"
 
+#include "asset/bin.h"
 #include "asset/file_registry.h"
 #include "asset/model_asset.h"
 
+#include <future>
+
 namespace era_engine
 {
 	struct mesh_key
@@ -36,15 +40,29 @@ namespace std
 
 namespace era_engine
 {
-	static void meshLoaderThread(ref<multi_mesh> result, const fs::path& sceneFilename, uint32 flags, const mesh_load_callback& cb,
-		bool async, JobHandle parentJob)
+	// Geometry is copied straight from the mapped cache file into the builder. The cache stores vertices in the
+	// builder's layout, so this is a plain memcpy per submesh.
+	static void buildMeshFromView(const ref<multi_mesh>& result, BinModelView& asset, const fs::path& sceneFilename, uint32 flags,
+		const mesh_load_callback& cb, bool async, JobHandle parentJob)
 	{
 		using namespace animation;
 
 		result->aabb = bounding_box::negativeInfinity();
 
-		ModelAsset asset = load_3d_model_from_file(sceneFilename);
-		mesh_builder builder(flags | mesh_creation_flags_with_skin);
+		// Only switch the whole index buffer to 32 bit if some submesh actually needs it.
+		mesh_index_type indexType = mesh_index_uint16;
+		for (auto& mesh : asset.meshes)
+		{
+			for (auto& sub : mesh.submeshes)
+			{
+				if (sub.index_type == mesh_index_uint32)
+				{
+					indexType = mesh_index_uint32;
+				}
+			}
+		}
+
+		mesh_builder builder(flags | mesh_creation_flags_with_skin, indexType);
 
 		for (auto& mesh : asset.meshes)
 		{
@@ -73,9 +91,21 @@ namespace era_engine
 					material = createPBRMaterialAsync(materialDesc, parentJob);
 				}
 
-				bounding_box aabb;
-				builder.pushMesh(sub, 1.f, &aabb);
-				result->submeshes.push_back({ builder.endSubmesh(), aabb, trs::identity, material, mesh.name });
+				builder.pushPreformatted(sub.positions, sub.others, bin_gpu_vertex_flags, sub.colors, sub.num_vertices, sub.triangles, sub.index_type, sub.num_triangles);
+				bounding_box aabb = sub.aabb;
+				submesh& added = result->submeshes.emplace_back(submesh{ builder.endSubmesh(), aabb, trs::identity, material, mesh.name });
+
+				for (uint32 l = 0; l < (uint32)sub.lods.size(); ++l)
+				{
+					const BinLodView& lod = sub.lods[l];
+					added.lods.push_back(builder.pushLod(added.info, lod.triangles, sub.index_type, lod.num_triangles));
+
+					if (result->lodErrors.size() <= l)
+					{
+						result->lodErrors.push_back(0.f);
+					}
+					result->lodErrors[l] = max(result->lodErrors[l], lod.error);
+				}
 
 				result->aabb.grow(aabb.minCorner);
 				result->aabb.grow(aabb.maxCorner);
@@ -87,8 +117,11 @@ namespace era_engine
 		AnimationSkeleton& animation_skeleton = result->animation_skeleton;
 		animation_skeleton.skeleton = &result->skeleton;
 
+		// Streamed meshes keep their skeleton and clips when they are evicted, because components point into them.
+		bool hasAnimationData = !skeleton.joints.empty() || !animation_skeleton.clips.empty();
+
 		// Load skeleton
-		if (!asset.skeletons.empty()/* && flags & mesh_creation_flags_with_skin*/)
+		if (!hasAnimationData && !asset.skeletons.empty()/* && flags & mesh_creation_flags_with_skin*/)
 		{
 			SkeletonAsset& in = asset.skeletons.front();
 
@@ -97,6 +130,11 @@ namespace era_engine
 			skeleton.analyze_joints(builder.getPositions(), (uint8*)builder.getOthers() + builder.getSkinOffset(), builder.getOthersSize(), builder.getNumVertices());
 		}
 
+		if (hasAnimationData)
+		{
+			asset.animations.clear();
+		}
+
 		// Load animations
 		for (auto& anim : asset.animations)
 		{
@@ -136,19 +174,35 @@ namespace era_engine
 		result->loadState.store(AssetLoadState::LOADED, std::memory_order_release);
 	}
 
-	static ref<multi_mesh> loadMeshFromFileInternal(const fs::path& sceneFilename, AssetHandle handle, uint32 flags, const mesh_load_callback& cb,
+	static void meshLoaderThread(ref<multi_mesh> result, const fs::path& sceneFilename, uint32 flags, const mesh_load_callback& cb,
 		bool async, JobHandle parentJob)
 	{
-		ref<multi_mesh> result = make_ref<multi_mesh>();
-		result->handle = handle;
-		result->flags = flags;
-		result->loadState = AssetLoadState::LOADING;
+		BinModelView asset;
+		if (!load_3d_model_view_from_file(sceneFilename, asset))
+		{
+			LOG_WARNING("Could not load mesh '%ws'", sceneFilename.c_str());
+		}
+
+		buildMeshFromView(result, asset, sceneFilename, flags, cb, async, parentJob);
+	}
 
+	uint32 selectMeshLod(const multi_mesh& mesh, float pixelsPerUnit, float maxPixelError)
+	{
+		uint32 lod = 0;
+		while (lod < (uint32)mesh.lodErrors.size() && mesh.lodErrors[lod] * pixelsPerUnit <= maxPixelError)
+		{
+			++lod;
+		}
+		return lod;
+	}
+
+	static void loadMeshFromFileInternal(const ref<multi_mesh>& result, const fs::path& sceneFilename, uint32 flags, const mesh_load_callback& cb,
+		bool async, JobHandle parentJob)
+	{
 		if (!async)
 		{
 			meshLoaderThread(result, sceneFilename, flags, cb, false, {});
 			result->loadJob = {};
-			return result;
 		}
 		else
 		{
@@ -171,8 +225,6 @@ namespace era_engine
 			job.submit_now();
 
 			result->loadJob = job;
-
-			return result;
 		}
 	}
 
@@ -181,8 +233,18 @@ namespace era_engine
 		return a.handle == b.handle && a.flags == b.flags;
 	}
 
-	static std::unordered_map<mesh_key, weakref<multi_mesh>> meshCache;
+	// Guards the tables below, but is never held while a mesh is being loaded.
 	static std::mutex mutex;
+	static std::unordered_map<mesh_key, weakref<multi_mesh>> meshCache;
+
+	// Streamed meshes may be unloaded again and have no load job, so they are never handed out by the job loaders, whose
+	// callers wait for loadJob and expect a loaded mesh.
+	static std::unordered_map<mesh_key, weakref<multi_mesh>> streamedMeshCache;
+
+	// Synchronous loads which are currently running. Other synchronous requests for the same key wait on these
+	// instead of loading the mesh a second time. Asynchronous loads don't need an entry: their callers get the mesh
+	// in the LOADING state right away and poll loadState.
+	static std::unordered_map<mesh_key, std::shared_future<void>> meshLoadsInFlight;
 
 	static ref<multi_mesh> loadMeshFromFileAndHandle(const fs::path& filename, AssetHandle handle, uint32 flags, const mesh_load_callback& cb,
 		bool async = false, JobHandle parentJob = {})
@@ -192,12 +254,60 @@ namespace era_engine
 
 		mesh_key key = { handle, flags };
 
-		std::lock_guard _lock{mutex};
-		ref<multi_mesh> result = { meshCache[key].lock(), {} };
-		if (!result)
+		ref<multi_mesh> result;
+		bool loadHere = false;
+		std::shared_future<void> inFlight;
+		std::promise<void> loaded;
+
 		{
-			result = loadMeshFromFileInternal(filename, handle, flags, cb, async, parentJob);
-			meshCache[key] = result;
+			std::lock_guard _lock{ mutex };
+
+			weakref<multi_mesh>& entry = meshCache[key];
+			result = entry.lock();
+
+			if (result)
+			{
+				auto it = meshLoadsInFlight.find(key);
+				if (it != meshLoadsInFlight.end())
+				{
+					inFlight = it->second;
+				}
+			}
+			else
+			{
+				result = make_ref<multi_mesh>();
+				result->handle = handle;
+				result->flags = flags;
+				result->loadState = AssetLoadState::LOADING;
+				entry = result;
+				loadHere = true;
+
+				if (!async)
+				{
+					meshLoadsInFlight[key] = loaded.get_future().share();
+				}
+			}
+		}
+
+		if (!loadHere)
+		{
+			// Already loaded, or being loaded by someone else. Synchronous callers expect a finished mesh.
+			if (inFlight.valid() && !async)
+			{
+				inFlight.wait();
+			}
+			return result;
+		}
+
+		loadMeshFromFileInternal(result, filename, flags, cb, async, parentJob);
+
+		if (!async)
+		{
+			{
+				std::lock_guard _lock{ mutex };
+				meshLoadsInFlight.erase(key);
+			}
+			loaded.set_value();
 		}
 
 		return result;
@@ -230,4 +340,145 @@ namespace era_engine
 		fs::path sceneFilename = getPathFromAssetHandle(handle);
 		return loadMeshFromFileAndHandle(sceneFilename, handle, flags, cb, true, parentJob);
 	}
+
+	// The I/O stage maps the cache file and pulls it into memory, the decode stage builds the GPU mesh from it.
+	struct mesh_streaming_asset : streaming_asset
+	{
+		mesh_streaming_asset(const weakref<multi_mesh>& mesh, const fs::path& path, uint32 flags, const mesh_load_callback& cb)
+			: mesh(mesh), path(path), flags(flags), cb(cb)
+		{
+			std::error_code ec;
+			estimatedSize = fs::file_size(path, ec);
+		}
+
+		uint64 read() override
+		{
+			ref<multi_mesh> result = mesh.lock();
+			if (!result)
+			{
+				return 0;
+			}
+
+			result->loadState = AssetLoadState::LOADING;
+			if (!load_3d_model_view_from_file(path, view))
+			{
+				LOG_WARNING("Could not load mesh '%ws'", path.c_str());
+				result->loadState = AssetLoadState::UNLOADED;
+				return 0;
+			}
+
+			// Touch every page, so that the decode stage never waits for the disk.
+			const volatile uint8* content = view.file.content;
+			uint8 sum = 0;
+			for (uint64 i = 0; i < view.file.size; i += 4096)
+			{
+				sum += content[i];
+			}
+
+			return max(view.file.size, 1ull);
+		}
+
+		uint64 decode(JobHandle job) override
+		{
+			ref<multi_mesh> result = mesh.lock();
+			if (result)
+			{
+				// No parent job, so that the material textures are streamed as well.
+				buildMeshFromView(result, view, path, flags, cb, true, {});
+			}
+			view = BinModelView();
+
+			if (!result)
+			{
+				return 0;
+			}
+
+			uint64 residentBytes = 1;
+			if (result->mesh.vertexBuffer.positions) { residentBytes += result->mesh.vertexBuffer.positions->totalSize; }
+			if (result->mesh.vertexBuffer.others) { residentBytes += result->mesh.vertexBuffer.others->totalSize; }
+			if (result->mesh.indexBuffer) { residentBytes += result->mesh.indexBuffer->totalSize; }
+			return residentBytes;
+		}
+
+		void release() override
+		{
+			view = BinModelView();
+
+			// Buffers are retired through the dx context, so frames in flight keep them alive.
+			if (ref<multi_mesh> result = mesh.lock())
+			{
+				result->loadState = AssetLoadState::UNLOADED;
+				result->mesh = {};
+				result->submeshes.clear();
+				result->lodErrors.clear();
+			}
+		}
+
+		uint64 estimate_read_size() const override
+		{
+			return estimatedSize;
+		}
+
+		weakref<multi_mesh> mesh;
+		fs::path path;
+		uint32 flags;
+		mesh_load_callback cb;
+
+		BinModelView view;
+		uint64 estimatedSize = 0;
+	};
+
+	static ref<multi_mesh> streamMeshFromFileAndHandle(const fs::path& path, AssetHandle handle, float priority, uint32 flags, const mesh_load_callback& cb)
+	{
+		if (!isAssetStreamingInitialized())
+		{
+			return loadMeshFromFileAndHandle(path, handle, flags, cb, true);
+		}
+
+		if (!fs::exists(path))
+		{
+			return nullptr;
+		}
+
+		mesh_key key = { handle, flags };
+
+		std::lock_guard _lock{ mutex };
+
+		weakref<multi_mesh>& entry = streamedMeshCache[key];
+		ref<multi_mesh> result = entry.lock();
+		if (result)
+		{
+			if (result->stream)
+			{
+				setStreamingPriority(result->stream, priority);
+			}
+			return result;
+		}
+
+		result = make_ref<multi_mesh>();
+		result->handle = handle;
+		result->flags = flags;
+		result->loadState = AssetLoadState::UNLOADED;
+		result->aabb = bounding_box::negativeInfinity();
+		entry = result;
+
+		ref<mesh_streaming_asset> asset = make_ref<mesh_streaming_asset>(result, path, flags, cb);
+		result->stream = requestStreaming(std::hash<mesh_key>()(key), asset, priority);
+
+		return result;
+	}
+
+	ref<multi_mesh> streamMeshFromFile(const fs::path& filename, float priority, uint32 flags, const mesh_load_callback& cb)
+	{
+		fs::path path = filename.lexically_normal().make_preferred();
+
+		AssetHandle handle = getAssetHandleFromPath(path);
+		return streamMeshFromFileAndHandle(path, handle, priority, flags, cb);
+	}
+
+	ref<multi_mesh> streamMeshFromHandle(AssetHandle handle, float priority, uint32 flags, const mesh_load_callback& cb)
+	{
+		fs::path sceneFilename = getPathFromAssetHandle(handle);
+		return streamMeshFromFileAndHandle(sceneFilename, handle, priority, flags, cb);
+	}
 }
\ No newline at end of file
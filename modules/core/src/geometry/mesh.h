@@ -6,6 +6,7 @@
 #include "core/bounding_volumes.h"
 
 #include "asset/asset.h"
+#include "asset/asset_streaming.h"
 #include "asset/pbr_material_desc.h"
 
 #include "animation/animation.h"
@@ -24,23 +25,43 @@ namespace era_engine
 
 		ref<pbr_material> material;
 		std::string name;
+
+		std::vector<submesh_info> lods; // LOD 1 and up. Index ranges into the same vertices as 'info'.
 	};
 
 	struct multi_mesh
 	{
+		~multi_mesh()
+		{
+			if (stream)
+			{
+				cancelStreaming(stream);
+			}
+		}
+
 		std::vector<submesh> submeshes;
 		animation::Skeleton skeleton;
 		animation::AnimationSkeleton animation_skeleton;
 		dx_mesh mesh;
 		bounding_box aabb = { vec3(0.f), vec3(0.f) };
 
+		// Object space error of LOD 1 and up, maximum over all submeshes. Submeshes with fewer levels clamp to their last one.
+		std::vector<float> lodErrors;
+
 		AssetHandle handle;
 		uint32 flags;
 
 		std::atomic<AssetLoadState> loadState = AssetLoadState::LOADED;
 		JobHandle loadJob;
+
+		// Set for meshes loaded through streamMeshFromFile. Evicted meshes keep their bounds and go back to UNLOADED.
+		ref<streaming_request> stream;
 	};
 
+	// Returns the coarsest LOD whose error stays below 'maxPixelError' pixels. 'pixelsPerUnit' is the projected size of one
+	// object space unit at the mesh's distance.
+	ERA_CORE_API uint32 selectMeshLod(const multi_mesh& mesh, float pixelsPerUnit, float maxPixelError = 1.f);
+
 	using mesh_load_callback = std::function<void(mesh_builder& builder, std::vector<submesh>& submeshes, const bounding_box& boundingBox)>;
 
 	ERA_CORE_API ref<multi_mesh> loadMeshFromFile(const fs::path& filename, uint32 flags = mesh_creation_flags_default, const mesh_load_callback& cb = nullptr);
@@ -48,6 +69,14 @@ namespace era_engine
 	ERA_CORE_API ref<multi_mesh> loadMeshFromFileAsync(const fs::path& filename, uint32 flags = mesh_creation_flags_default, JobHandle parentJob = {}, const mesh_load_callback& cb = nullptr);
 	ERA_CORE_API ref<multi_mesh> loadMeshFromHandleAsync(AssetHandle handle, uint32 flags = mesh_creation_flags_default, JobHandle parentJob = {}, const mesh_load_callback& cb = nullptr);
 
+	// Loads the mesh through the asset streaming service: the cache file is read on an I/O thread, ordered by 'priority'
+	// (lower first, e.g. the distance to the camera), and the mesh may be evicted again when the streaming budget is
+	// exceeded. Callers mark the mesh as used every frame with markStreamedAssetUsed(mesh->stream, priority).
+	// Falls back to loadMeshFromFileAsync if the service is not running. The material textures are streamed as well.
+	// Streamed meshes are cached apart from the loadMesh* functions, which never return a mesh that may be evicted.
+	ERA_CORE_API ref<multi_mesh> streamMeshFromFile(const fs::path& filename, float priority, uint32 flags = mesh_creation_flags_default, const mesh_load_callback& cb = nullptr);
+	ERA_CORE_API ref<multi_mesh> streamMeshFromHandle(AssetHandle handle, float priority, uint32 flags = mesh_creation_flags_default, const mesh_load_callback& cb = nullptr);
+
 	// Same functions but with different default flags (includes skin).
 	inline ref<multi_mesh> loadAnimatedMeshFromFile(const fs::path& filename, uint32 flags = mesh_creation_flags_animated, const mesh_load_callback& cb = nullptr)
 	{
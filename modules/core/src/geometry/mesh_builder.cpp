@@ -1317,11 +1317,99 @@ namespace era_engine
 		const bool flipWindingOrder = false;
 		for (uint32 i = 0; i < numFaces; ++i)
 		{
-			const indexed_triangle16& tri = mesh.triangles[i];
+			const indexed_triangle32& tri = mesh.triangles[i];
 			pushTriangle(tri.a, tri.b, tri.c);
 		}
 	}
 
+	void mesh_builder::pushPreformatted(const vec3* positions, const uint8* others, uint32 othersFlags, const uint32* colors, uint32 numVertices,
+		const void* triangles, mesh_index_type trianglesIndexType, uint32 numTriangles)
+	{
+		auto [positionPtr, othersPtr, indexPtr, indexOffset] = beginPrimitive(numVertices, numTriangles);
+
+		memcpy(positionPtr, positions, sizeof(vec3) * numVertices);
+
+		othersFlags &= ~mesh_creation_flags_with_positions;
+		uint32 ownOthersFlags = vertexFlags & ~mesh_creation_flags_with_positions;
+
+		if (othersFlags == ownOthersFlags && !colors)
+		{
+			memcpy(othersPtr, others, (uint64)othersSize * numVertices);
+		}
+		else
+		{
+			vertex_info srcInfo = getVertexInfo(othersFlags);
+
+			struct attribute
+			{
+				uint32 flag;
+				uint32 size;
+			};
+
+			const attribute attributes[] =
+			{
+				{ mesh_creation_flags_with_uvs, sizeof(vec2) },
+				{ mesh_creation_flags_with_normals, sizeof(vec3) },
+				{ mesh_creation_flags_with_tangents, sizeof(vec3) },
+				{ mesh_creation_flags_with_skin, sizeof(SkinningWeights) },
+				{ mesh_creation_flags_with_colors, sizeof(uint32) },
+			};
+
+			for (uint32 i = 0; i < numVertices; ++i)
+			{
+				const uint8* src = others + (uint64)i * srcInfo.othersSize;
+				for (const attribute& attr : attributes)
+				{
+					bool inSource = (othersFlags & attr.flag) != 0;
+					if (vertexFlags & attr.flag)
+					{
+						if (attr.flag == mesh_creation_flags_with_colors && colors)
+						{
+							memcpy(othersPtr, &colors[i], sizeof(uint32));
+						}
+						else if (inSource)
+						{
+							memcpy(othersPtr, src, attr.size);
+						}
+						else
+						{
+							memset(othersPtr, 0, attr.size);
+						}
+						othersPtr += attr.size;
+					}
+					if (inSource)
+					{
+						src += attr.size;
+					}
+				}
+			}
+		}
+
+		if (indexType == trianglesIndexType && indexOffset == 0)
+		{
+			memcpy(indexPtr, triangles, (uint64)indexSize * 3 * numTriangles);
+			return;
+		}
+
+		const bool flipWindingOrder = false;
+		if (trianglesIndexType == mesh_index_uint16)
+		{
+			for (uint32 i = 0; i < numTriangles; ++i)
+			{
+				const indexed_triangle16& tri = ((const indexed_triangle16*)triangles)[i];
+				pushTriangle(tri.a, tri.b, tri.c);
+			}
+		}
+		else
+		{
+			for (uint32 i = 0; i < numTriangles; ++i)
+			{
+				const indexed_triangle32& tri = ((const indexed_triangle32*)triangles)[i];
+				pushTriangle(tri.a, tri.b, tri.c);
+			}
+		}
+	}
+
 	submesh_info mesh_builder::endSubmesh()
 	{
 		uint32 firstVertex = totalNumVertices;
@@ -1354,6 +1442,54 @@ namespace era_engine
 		return result;
 	}
 
+	submesh_info mesh_builder::pushLod(const submesh_info& lod0, const void* triangles, mesh_index_type trianglesIndexType, uint32 numTriangles)
+	{
+		ASSERT(numVerticesInCurrentSubmesh == 0);
+
+		uint8* indexPtr = (uint8*)indexArena.allocate(indexSize * 3 * numTriangles);
+		const uint32 indexOffset = 0;
+
+		if (indexType == trianglesIndexType)
+		{
+			memcpy(indexPtr, triangles, (uint64)indexSize * 3 * numTriangles);
+		}
+		else
+		{
+			const bool flipWindingOrder = false;
+			for (uint32 i = 0; i < numTriangles; ++i)
+			{
+				if (trianglesIndexType == mesh_index_uint16)
+				{
+					const indexed_triangle16& tri = ((const indexed_triangle16*)triangles)[i];
+					pushTriangle(tri.a, tri.b, tri.c);
+				}
+				else
+				{
+					const indexed_triangle32& tri = ((const indexed_triangle32*)triangles)[i];
+					pushTriangle(tri.a, tri.b, tri.c);
+				}
+			}
+		}
+
+		submesh_info result;
+		result.firstIndex = totalNumTriangles * 3;
+		result.numIndices = numTriangles * 3;
+		result.baseVertex = lod0.baseVertex;
+		result.numVertices = lod0.numVertices;
+
+		totalNumTriangles += numTriangles;
+
+		uint32 alignedNumTriangles = align_to(totalNumTriangles, 8);
+		uint32 missing = alignedNumTriangles - totalNumTriangles;
+		if (missing > 0)
+		{
+			indexArena.allocate(indexSize * 3 * missing);
+		}
+		totalNumTriangles = alignedNumTriangles;
+
+		return result;
+	}
+
 	dx_mesh mesh_builder::createDXMesh()
 	{
 		if (numVerticesInCurrentSubmesh > 0)
@@ -184,8 +184,17 @@ namespace era_engine
 
 		void pushMesh(const struct SubmeshAsset& mesh, float scale, bounding_box* aabb = 0);
 
+		// Pushes vertices that are already interleaved. If 'othersFlags' matches this builder's layout, the data is copied
+		// as-is, otherwise attributes are rearranged and missing ones are zeroed. 'colors' may be null.
+		// 'triangles' points to indexed_triangle16 or indexed_triangle32 elements, as given by 'trianglesIndexType'.
+		void pushPreformatted(const vec3* positions, const uint8* others, uint32 othersFlags, const uint32* colors, uint32 numVertices,
+			const void* triangles, mesh_index_type trianglesIndexType, uint32 numTriangles);
+
 		submesh_info endSubmesh();
 
+		// Appends a coarser index list for the submesh which was just ended. The returned range shares the vertices of 'lod0'.
+		submesh_info pushLod(const submesh_info& lod0, const void* triangles, mesh_index_type trianglesIndexType, uint32 numTriangles);
+
 		dx_mesh createDXMesh();
 
 		NODISCARD vec3* getPositions() { return (vec3*)positionArena.base(); }
@@ -221,20 +221,29 @@ namespace era_engine
 			transparentRenderPass.sort();
 			renderer_holder_rc->ldrRenderPass->sort();
 
+			int32 numShadowStateChangesAvoided = 0;
+
 			for (uint32 i = 0; i < sunShadowRenderPass.numCascades; ++i)
 			{
 				sunShadowRenderPass.cascades[i].sort();
+				numShadowStateChangesAvoided += sunShadowRenderPass.cascades[i].getNumStateChangesAvoided();
 			}
 
 			for (uint32 i = 0; i < numSpotLightShadowPasses; ++i)
 			{
 				spotShadowRenderPasses[i].sort();
+				numShadowStateChangesAvoided += spotShadowRenderPasses[i].getNumStateChangesAvoided();
 			}
 
 			for (uint32 i = 0; i < numPointLightShadowPasses; ++i)
 			{
 				pointShadowRenderPasses[i].sort();
+				numShadowStateChangesAvoided += pointShadowRenderPasses[i].getNumStateChangesAvoided();
 			}
+
+			CPU_PROFILE_STAT("Opaque state changes avoided", opaqueRenderPass.getNumStateChangesAvoided());
+			CPU_PROFILE_STAT("Transparent state changes avoided", transparentRenderPass.getNumStateChangesAvoided());
+			CPU_PROFILE_STAT("Shadow state changes avoided", numShadowStateChangesAvoided);
 		}
 
 		renderer->submitRenderPass(&opaqueRenderPass);
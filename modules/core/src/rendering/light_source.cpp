@@ -135,7 +135,8 @@ namespace era_engine
 			.property("intensity", &PointLightComponent::intensity)
 			.property("radius", &PointLightComponent::radius)
 			.property("castsShadow", &PointLightComponent::castsShadow)
-			.property("shadowMapResolution", &PointLightComponent::shadowMapResolution);
+			.property("shadowMapResolution", &PointLightComponent::shadowMapResolution)
+			.property("shadowPriority", &PointLightComponent::shadowPriority);
 
 		rttr::registration::class_<SpotLightComponent>("SpotLightComponent")
 			.constructor<>()
@@ -145,7 +146,8 @@ namespace era_engine
 			.property("innerAngle", &SpotLightComponent::innerAngle)
 			.property("outerAngle", &SpotLightComponent::outerAngle)
 			.property("castsShadow", &SpotLightComponent::castsShadow)
-			.property("shadowMapResolution", &SpotLightComponent::shadowMapResolution);
+			.property("shadowMapResolution", &SpotLightComponent::shadowMapResolution)
+			.property("shadowPriority", &SpotLightComponent::shadowPriority);
 	}
 
 	PointLightComponent::PointLightComponent(ref<Entity::EcsData> _data, const vec3& _color, float _intensity, float _radius, bool _castsShadow, uint32 _shadowMapResolution)
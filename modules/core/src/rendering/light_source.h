@@ -64,6 +64,9 @@ namespace era_engine
 
 		uint32 shadowMapResolution{};
 
+		// Relative importance of the light's shadow map, scaled by its screen coverage when the shadow atlas is full.
+		float shadowPriority = 1.f;
+
 		bool castsShadow{};
 	};
 
@@ -87,6 +90,9 @@ namespace era_engine
 
 		uint32 shadowMapResolution;
 
+		// Relative importance of the light's shadow map, scaled by its screen coverage when the shadow atlas is full.
+		float shadowPriority = 1.f;
+
 		bool castsShadow;
 	};
 
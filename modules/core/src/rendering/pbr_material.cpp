@@ -76,6 +76,16 @@ namespace era_engine
 		return sp;
 	}
 
+	static ref<dx_texture> loadMaterialTextureAsync(const fs::path& filename, uint32 flags, JobHandle parentJob)
+	{
+		// Callers which wait for a parent job expect the textures to be loaded by then, which only the job path guarantees.
+		if (parentJob.index == -1 && isAssetStreamingInitialized())
+		{
+			return streamTextureFromFile(filename, 0.f, flags);
+		}
+		return loadTextureFromFileAsync(filename, flags, parentJob);
+	}
+
 	ref<pbr_material> createPBRMaterialAsync(const PbrMaterialDesc& desc, JobHandle parentJob)
 	{
 		std::lock_guard lock{ mutex };
@@ -85,10 +95,10 @@ namespace era_engine
 		{
 			ref<pbr_material> material = make_ref<pbr_material>();
 
-			if (!desc.albedo.empty()) material->albedo = loadTextureFromFileAsync(desc.albedo, desc.albedo_flags, parentJob);
-			if (!desc.normal.empty()) material->normal = loadTextureFromFileAsync(desc.normal, desc.normal_flags, parentJob);
-			if (!desc.roughness.empty()) material->roughness = loadTextureFromFileAsync(desc.roughness, desc.roughness_flags, parentJob);
-			if (!desc.metallic.empty()) material->metallic = loadTextureFromFileAsync(desc.metallic, desc.metallic_flags, parentJob);
+			if (!desc.albedo.empty()) material->albedo = loadMaterialTextureAsync(desc.albedo, desc.albedo_flags, parentJob);
+			if (!desc.normal.empty()) material->normal = loadMaterialTextureAsync(desc.normal, desc.normal_flags, parentJob);
+			if (!desc.roughness.empty()) material->roughness = loadMaterialTextureAsync(desc.roughness, desc.roughness_flags, parentJob);
+			if (!desc.metallic.empty()) material->metallic = loadMaterialTextureAsync(desc.metallic, desc.metallic_flags, parentJob);
 			material->emission = desc.emission;
 			material->albedoTint = desc.albedo_tint;
 			material->roughnessOverride = desc.roughness_override;
@@ -103,6 +113,22 @@ namespace era_engine
 		return sp;
 	}
 
+	static void markStreamedTextureUsed(const ref<dx_texture>& texture, float priority)
+	{
+		if (texture && texture->stream)
+		{
+			markStreamedAssetUsed(texture->stream, priority);
+		}
+	}
+
+	void markStreamedMaterialUsed(const pbr_material& material, float priority)
+	{
+		markStreamedTextureUsed(material.albedo, priority);
+		markStreamedTextureUsed(material.normal, priority);
+		markStreamedTextureUsed(material.roughness, priority);
+		markStreamedTextureUsed(material.metallic, priority);
+	}
+
 	ref<pbr_material> getDefaultPBRMaterial()
 	{
 		static ref<pbr_material> material = createPBRMaterial({});
@@ -38,6 +38,9 @@ namespace era_engine
 	};
 
 	ERA_CORE_API ref<pbr_material> createPBRMaterial(const PbrMaterialDesc& desc);
+	// Without a parent job, the textures are loaded through the asset streaming service if it is running.
 	ERA_CORE_API ref<pbr_material> createPBRMaterialAsync(const PbrMaterialDesc& desc, JobHandle parentJob = {});
+	// Protects the material's streamed textures from eviction in the current frame, see markStreamedAssetUsed.
+	ERA_CORE_API void markStreamedMaterialUsed(const pbr_material& material, float priority);
 	ERA_CORE_API ref<pbr_material> getDefaultPBRMaterial();
 }
\ No newline at end of file
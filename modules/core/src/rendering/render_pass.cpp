@@ -0,0 +1,20 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#include "rendering/render_pass.h"
+
+#include "core/log.h"
+
+namespace era_engine
+{
+	uint32 allocateRenderPipelineSortID()
+	{
+		static std::atomic<uint32> nextID = 0;
+
+		uint32 id = nextID++;
+		if (id == render_sort_key::PIPELINE_MASK + 1)
+		{
+			LOG_WARNING("More than %u pipelines are sorted, their sort ids wrap around", (uint32)render_sort_key::PIPELINE_MASK + 1);
+		}
+		return id & (uint32)render_sort_key::PIPELINE_MASK;
+	}
+}
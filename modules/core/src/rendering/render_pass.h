@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include "core_api.h"
+
 #include "core/math.h"
 #include "core/cpu_profiling.h"
 
@@ -12,49 +14,197 @@
 
 namespace era_engine
 {
-	struct opaque_render_pass
+	ERA_CORE_API uint32 allocateRenderPipelineSortID();
+
+	// Packed 64 bit sort keys, most significant field first. Passes sort their commands by the whole key, so the layout
+	// decides the draw order:
+	//   Opaque:      | layer (4) | pipeline (12) | material (20) | depth (28) |
+	//   Transparent: | layer (4) | inverted depth (28) | pipeline (12) | material (20) |
+	// Opaque commands are grouped by pipeline and material, and drawn front to back within a group. Transparent commands
+	// are drawn back to front. Lower layers are drawn first.
+	struct render_sort_key
+	{
+		static constexpr uint32 LAYER_BITS = 4;
+		static constexpr uint32 PIPELINE_BITS = 12;
+		static constexpr uint32 MATERIAL_BITS = 20;
+		static constexpr uint32 DEPTH_BITS = 28;
+
+		static constexpr uint64 LAYER_MASK = (1ull << LAYER_BITS) - 1;
+		static constexpr uint64 PIPELINE_MASK = (1ull << PIPELINE_BITS) - 1;
+		static constexpr uint64 MATERIAL_MASK = (1ull << MATERIAL_BITS) - 1;
+		static constexpr uint64 DEPTH_MASK = (1ull << DEPTH_BITS) - 1;
+
+		static constexpr uint32 LAYER_SHIFT = 64 - LAYER_BITS;
+		static constexpr uint32 OPAQUE_PIPELINE_SHIFT = LAYER_SHIFT - PIPELINE_BITS;
+		static constexpr uint32 OPAQUE_MATERIAL_SHIFT = OPAQUE_PIPELINE_SHIFT - MATERIAL_BITS;
+		static constexpr uint32 TRANSPARENT_DEPTH_SHIFT = LAYER_SHIFT - DEPTH_BITS;
+		static constexpr uint32 TRANSPARENT_PIPELINE_SHIFT = TRANSPARENT_DEPTH_SHIFT - PIPELINE_BITS;
+
+		// A pipeline state change is a change in the layer or pipeline fields, i.e. a call to the pipeline's setup.
+		static constexpr uint64 OPAQUE_PIPELINE_STATE_MASK = (LAYER_MASK << LAYER_SHIFT) | (PIPELINE_MASK << OPAQUE_PIPELINE_SHIFT);
+		static constexpr uint64 TRANSPARENT_PIPELINE_STATE_MASK = (LAYER_MASK << LAYER_SHIFT) | (PIPELINE_MASK << TRANSPARENT_PIPELINE_SHIFT);
+
+		NODISCARD static uint64 opaque(uint32 layer, uint32 pipeline, uint32 material, float depth)
+		{
+			return ((layer & LAYER_MASK) << LAYER_SHIFT)
+				| ((pipeline & PIPELINE_MASK) << OPAQUE_PIPELINE_SHIFT)
+				| ((material & MATERIAL_MASK) << OPAQUE_MATERIAL_SHIFT)
+				| quantizeDepth(depth);
+		}
+
+		NODISCARD static uint64 transparent(uint32 layer, uint32 pipeline, uint32 material, float depth)
+		{
+			return ((layer & LAYER_MASK) << LAYER_SHIFT)
+				| ((DEPTH_MASK - quantizeDepth(depth)) << TRANSPARENT_DEPTH_SHIFT)
+				| ((pipeline & PIPELINE_MASK) << TRANSPARENT_PIPELINE_SHIFT)
+				| (material & MATERIAL_MASK);
+		}
+
+		// The bit pattern of a non-negative float grows with its value, so the top bits below the sign bit are a
+		// monotonic quantization, with the same relative precision at any distance. Negative depths map to 0.
+		NODISCARD static uint64 quantizeDepth(float depth)
+		{
+			depth = (depth > 0.f) ? depth : 0.f;
+
+			uint32 bits;
+			memcpy(&bits, &depth, sizeof(float));
+			return bits >> (31 - DEPTH_BITS);
+		}
+
+		// Materials have no ids, so their address is hashed. A collision only costs grouping, not correctness.
+		NODISCARD static uint32 materialID(const void* material)
+		{
+			return material ? (uint32)(((uint64)material * 0x9E3779B97F4A7C15ull) >> (64 - MATERIAL_BITS)) : 0;
+		}
+
+		template <typename render_data_t>
+		NODISCARD static uint32 materialID(const render_data_t& renderData)
+		{
+			if constexpr (requires(const render_data_t& data) { data.material.get(); })
+			{
+				return materialID((const void*)renderData.material.get());
+			}
+			else
+			{
+				return 0;
+			}
+		}
+
+		// Dense ids in order of first use, unlike the setup function's address. Each module instantiates its own id, so
+		// a pipeline used from two modules may end up with two ids, which only costs grouping.
+		template <typename pipeline_t>
+		NODISCARD static uint32 pipelineID()
+		{
+			static const uint32 id = allocateRenderPipelineSortID();
+			return id;
+		}
+	};
+
+	// Lets several jobs record into one pass at once. Each job records into its own recording pass, picked by a slot
+	// which the caller derives from the work (e.g. the index of a chunk), never from the thread. merge_recording then
+	// appends the recording passes in slot order, so the merged commands do not depend on scheduling and are the same as
+	// if the chunks had been recorded one after another.
+	template <typename pass_t>
+	struct parallel_recording_pass
+	{
+		// Not thread safe. Call before the jobs start.
+		void begin_recording(uint32 numSlots)
+		{
+			while (recordingPasses.size() < numSlots)
+			{
+				recordingPasses.push_back(std::make_unique<pass_t>());
+			}
+			numRecordingSlots = numSlots;
+		}
+
+		NODISCARD pass_t& get_recording_pass(uint32 slot)
+		{
+			ASSERT(slot < numRecordingSlots);
+			return *recordingPasses[slot];
+		}
+
+		// Not thread safe. Call after all jobs are done.
+		void merge_recording()
+		{
+			pass_t& self = static_cast<pass_t&>(*this);
+			for (uint32 i = 0; i < numRecordingSlots; ++i)
+			{
+				self.append(*recordingPasses[i]);
+			}
+			numRecordingSlots = 0;
+		}
+
+	protected:
+		// Merged commands live in the recording passes' memory, so these are reset after the pass itself.
+		void reset_recording()
+		{
+			for (auto& recordingPass : recordingPasses)
+			{
+				recordingPass->reset();
+			}
+			numRecordingSlots = 0;
+		}
+
+		std::vector<std::unique_ptr<pass_t>> recordingPasses;
+		uint32 numRecordingSlots = 0;
+	};
+
+	struct opaque_render_pass : parallel_recording_pass<opaque_render_pass>
 	{
 		void sort()
 		{
 			CPU_PROFILE_BLOCK("Sort opaque render passes");
 
-			pass.sort();
-			depthPrepass.sort();
+			pass.sort(render_sort_key::OPAQUE_PIPELINE_STATE_MASK);
+			depthPrepass.sort(render_sort_key::OPAQUE_PIPELINE_STATE_MASK);
 		}
 
 		void reset()
 		{
 			pass.clear();
 			depthPrepass.clear();
+			reset_recording();
+		}
+
+		void append(opaque_render_pass& other)
+		{
+			pass.append(other.pass);
+			depthPrepass.append(other.depthPrepass);
+		}
+
+		NODISCARD int32 getNumStateChangesAvoided() const
+		{
+			return pass.getNumStateChangesAvoided() + depthPrepass.getNumStateChangesAvoided();
 		}
 
+		// 'depth' is the distance to the camera, used to draw front to back.
 		template <typename pipeline_t, typename render_data_t>
-		void renderObject(const render_data_t& renderData)
+		void renderObject(const render_data_t& renderData, float depth = 0.f, uint32 layer = 0)
 		{
-			uint64 sortKey = (uint64)pipeline_t::setup;
+			uint64 sortKey = render_sort_key::opaque(layer, render_sort_key::pipelineID<pipeline_t>(), render_sort_key::materialID(renderData), depth);
 			pass.emplace_back<pipeline_t, render_data_t>(sortKey, renderData);
 		}
 
 		template <typename pipeline_t, typename render_data_t,
 			class = typename std::enable_if_t<!std::is_lvalue_reference_v<render_data_t>>>
-		void renderObject(render_data_t&& renderData)
+		void renderObject(render_data_t&& renderData, float depth = 0.f, uint32 layer = 0)
 		{
-			uint64 sortKey = (uint64)pipeline_t::setup;
+			uint64 sortKey = render_sort_key::opaque(layer, render_sort_key::pipelineID<pipeline_t>(), render_sort_key::materialID(renderData), depth);
 			pass.emplace_back<pipeline_t, render_data_t>(sortKey, std::move(renderData));
 		}
 
 		template <typename pipeline_t, typename render_data_t>
-		void renderDepthOnly(const render_data_t& renderData)
+		void renderDepthOnly(const render_data_t& renderData, float depth = 0.f, uint32 layer = 0)
 		{
-			uint64 sortKey = (uint64)pipeline_t::setup;
+			uint64 sortKey = render_sort_key::opaque(layer, render_sort_key::pipelineID<pipeline_t>(), 0, depth);
 			depthPrepass.emplace_back<pipeline_t, render_data_t>(sortKey, renderData);
 		}
 
 		template <typename pipeline_t, typename render_data_t,
 			class = typename std::enable_if_t<!std::is_lvalue_reference_v<render_data_t>>>
-		void renderDepthOnly(render_data_t&& renderData)
+		void renderDepthOnly(render_data_t&& renderData, float depth = 0.f, uint32 layer = 0)
 		{
-			uint64 sortKey = (uint64)pipeline_t::setup;
+			uint64 sortKey = render_sort_key::opaque(layer, render_sort_key::pipelineID<pipeline_t>(), 0, depth);
 			depthPrepass.emplace_back<pipeline_t, render_data_t>(sortKey, std::move(renderData));
 		}
 
@@ -79,42 +229,55 @@ namespace era_engine
 		depth_prepass_render_command_buffer<uint64> depthPrepass;
 	};
 
-	struct transparent_render_pass
+	struct transparent_render_pass : parallel_recording_pass<transparent_render_pass>
 	{
 		void sort()
 		{
 			CPU_PROFILE_BLOCK("Sort transparent render pass");
 
-			pass.sort();
+			pass.sort(render_sort_key::TRANSPARENT_PIPELINE_STATE_MASK);
 		}
 
 		void reset()
 		{
 			pass.clear();
+			reset_recording();
+		}
+
+		void append(transparent_render_pass& other)
+		{
+			pass.append(other.pass);
 		}
 
+		NODISCARD int32 getNumStateChangesAvoided() const
+		{
+			return pass.getNumStateChangesAvoided();
+		}
+
+		// 'depth' is the distance to the camera, used to draw back to front.
 		template <typename pipeline_t, typename render_data_t>
-		void renderObject(const render_data_t& data)
+		void renderObject(const render_data_t& data, float depth = 0.f, uint32 layer = 0)
 		{
-			float depth = 0.f; // TODO
-			pass.emplace_back<pipeline_t, render_data_t>(-depth, data); // Negative depth -> sort from back to front.
+			uint64 sortKey = render_sort_key::transparent(layer, render_sort_key::pipelineID<pipeline_t>(), render_sort_key::materialID(data), depth);
+			pass.emplace_back<pipeline_t, render_data_t>(sortKey, data);
 		}
 
 		template <typename pipeline_t, typename render_data_t>
 		void renderParticles(const dx_vertex_buffer_group_view& vertexBuffer,
 			const dx_index_buffer_view& indexBuffer,
 			const particle_draw_info& drawInfo,
-			const render_data_t& data)
+			const render_data_t& data,
+			float depth = 0.f, uint32 layer = 0)
 		{
-			float depth = 0.f; // TODO
-			auto& command = pass.emplace_back<pipeline_t, particle_render_command<render_data_t>>(-depth); // Negative depth -> sort from back to front.
+			uint64 sortKey = render_sort_key::transparent(layer, render_sort_key::pipelineID<pipeline_t>(), 0, depth);
+			auto& command = pass.emplace_back<pipeline_t, particle_render_command<render_data_t>>(sortKey);
 			command.vertexBuffer = vertexBuffer;
 			command.indexBuffer = indexBuffer;
 			command.drawInfo = drawInfo;
 			command.data = data;
 		}
 
-		default_render_command_buffer<float> pass;
+		default_render_command_buffer<uint64> pass;
 	};
 
 	struct ldr_render_pass
@@ -123,9 +286,9 @@ namespace era_engine
 		{
 			CPU_PROFILE_BLOCK("Sort LDR render passes");
 
-			ldrPass.sort();
-			overlays.sort();
-			outlines.sort();
+			ldrPass.sort(render_sort_key::OPAQUE_PIPELINE_STATE_MASK);
+			overlays.sort(render_sort_key::OPAQUE_PIPELINE_STATE_MASK);
+			outlines.sort(render_sort_key::OPAQUE_PIPELINE_STATE_MASK);
 		}
 
 		void reset()
@@ -138,7 +301,7 @@ namespace era_engine
 		template <typename pipeline_t, typename render_data_t>
 		void renderObject(const render_data_t& data)
 		{
-			uint64 sortKey = (uint64)pipeline_t::setup;
+			uint64 sortKey = render_sort_key::opaque(0, render_sort_key::pipelineID<pipeline_t>(), 0, 0.f);
 			ldrPass.emplace_back<pipeline_t, render_data_t>(sortKey, data);
 		}
 
@@ -146,14 +309,14 @@ namespace era_engine
 			class = typename std::enable_if_t<!std::is_lvalue_reference_v<render_data_t>>>
 		void renderObject(render_data_t&& data)
 		{
-			uint64 sortKey = (uint64)pipeline_t::setup;
+			uint64 sortKey = render_sort_key::opaque(0, render_sort_key::pipelineID<pipeline_t>(), 0, 0.f);
 			ldrPass.emplace_back<pipeline_t, render_data_t>(sortKey, std::move(data));
 		}
 
 		template <typename pipeline_t, typename render_data_t>
 		void renderOverlay(const render_data_t& data)
 		{
-			uint64 sortKey = (uint64)pipeline_t::setup;
+			uint64 sortKey = render_sort_key::opaque(0, render_sort_key::pipelineID<pipeline_t>(), 0, 0.f);
 			overlays.emplace_back<pipeline_t, render_data_t>(sortKey, data);
 		}
 
@@ -161,14 +324,14 @@ namespace era_engine
 			class = typename std::enable_if_t<!std::is_lvalue_reference_v<render_data_t>>>
 		void renderOverlay(render_data_t&& data)
 		{
-			uint64 sortKey = (uint64)pipeline_t::setup;
+			uint64 sortKey = render_sort_key::opaque(0, render_sort_key::pipelineID<pipeline_t>(), 0, 0.f);
 			overlays.emplace_back<pipeline_t, render_data_t>(sortKey, std::move(data));
 		}
 
 		template <typename pipeline_t, typename render_data_t>
 		void renderOutline(const render_data_t& data)
 		{
-			uint64 sortKey = (uint64)pipeline_t::setup;
+			uint64 sortKey = render_sort_key::opaque(0, render_sort_key::pipelineID<pipeline_t>(), 0, 0.f);
 			outlines.emplace_back<pipeline_t, render_data_t>(sortKey, data);
 		}
 
@@ -176,7 +339,7 @@ namespace era_engine
 			class = typename std::enable_if_t<!std::is_lvalue_reference_v<render_data_t>>>
 		void renderOutline(render_data_t&& data)
 		{
-			uint64 sortKey = (uint64)pipeline_t::setup;
+			uint64 sortKey = render_sort_key::opaque(0, render_sort_key::pipelineID<pipeline_t>(), 0, 0.f);
 			outlines.emplace_back<pipeline_t, render_data_t>(sortKey, std::move(data));
 		}
 
@@ -185,24 +348,36 @@ namespace era_engine
 		default_render_command_buffer<uint64> outlines;
 	};
 
-	struct shadow_render_pass_base
+	struct shadow_render_pass_base : parallel_recording_pass<shadow_render_pass_base>
 	{
 		void sort()
 		{
-			staticPass.sort();
-			dynamicPass.sort();
+			staticPass.sort(render_sort_key::OPAQUE_PIPELINE_STATE_MASK);
+			dynamicPass.sort(render_sort_key::OPAQUE_PIPELINE_STATE_MASK);
 		}
 
 		void reset()
 		{
 			staticPass.clear();
 			dynamicPass.clear();
+			reset_recording();
+		}
+
+		void append(shadow_render_pass_base& other)
+		{
+			staticPass.append(other.staticPass);
+			dynamicPass.append(other.dynamicPass);
+		}
+
+		NODISCARD int32 getNumStateChangesAvoided() const
+		{
+			return staticPass.getNumStateChangesAvoided() + dynamicPass.getNumStateChangesAvoided();
 		}
 
 		template <typename pipeline_t, typename render_data_t>
 		void renderStaticObject(const render_data_t& renderData)
 		{
-			uint64 sortKey = (uint64)pipeline_t::setup;
+			uint64 sortKey = render_sort_key::opaque(0, render_sort_key::pipelineID<pipeline_t>(), 0, 0.f);
 			staticPass.emplace_back<pipeline_t, render_data_t>(sortKey, renderData);
 		}
 
@@ -210,14 +385,14 @@ namespace era_engine
 			class = typename std::enable_if_t<!std::is_lvalue_reference_v<render_data_t>>>
 		void renderStaticObject(render_data_t&& renderData)
 		{
-			uint64 sortKey = (uint64)pipeline_t::setup;
+			uint64 sortKey = render_sort_key::opaque(0, render_sort_key::pipelineID<pipeline_t>(), 0, 0.f);
 			staticPass.emplace_back<pipeline_t, render_data_t>(sortKey, std::move(renderData));
 		}
 
 		template <typename pipeline_t, typename render_data_t>
 		void renderDynamicObject(const render_data_t& renderData)
 		{
-			uint64 sortKey = (uint64)pipeline_t::setup;
+			uint64 sortKey = render_sort_key::opaque(0, render_sort_key::pipelineID<pipeline_t>(), 0, 0.f);
 			dynamicPass.emplace_back<pipeline_t, render_data_t>(sortKey, renderData);
 		}
 
@@ -225,7 +400,7 @@ namespace era_engine
 			class = typename std::enable_if_t<!std::is_lvalue_reference_v<render_data_t>>>
 		void renderDynamicObject(render_data_t&& renderData)
 		{
-			uint64 sortKey = (uint64)pipeline_t::setup;
+			uint64 sortKey = render_sort_key::opaque(0, render_sort_key::pipelineID<pipeline_t>(), 0, 0.f);
 			dynamicPass.emplace_back<pipeline_t, render_data_t>(sortKey, std::move(renderData));
 		}
 
@@ -0,0 +1,586 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#include "rendering/shadow_atlas.h"
+
+namespace era_engine
+{
+	static constexpr uint32 SHADOW_ATLAS_NULL_NODE = (uint32)-1;
+
+	void shadow_atlas::initialize(uint32 _width, uint32 _height, uint32 _maximumSize, uint32 minimumSize)
+	{
+		ASSERT(is_power_of_two(_maximumSize));
+		ASSERT(is_power_of_two(minimumSize));
+		ASSERT(minimumSize <= _maximumSize);
+		ASSERT(_width % _maximumSize == 0);
+		ASSERT(_height % _maximumSize == 0);
+
+		width = _width;
+		height = _height;
+		maximumSize = _maximumSize;
+		numLevels = index_of_least_significant_set_bit(maximumSize) - index_of_least_significant_set_bit(minimumSize) + 1;
+
+		levelOffsets.resize(numLevels);
+		levelColumns.resize(numLevels);
+
+		uint32 numNodes = 0;
+		for (uint32 level = 0; level < numLevels; ++level)
+		{
+			uint32 size = maximumSize >> level;
+			levelOffsets[level] = numNodes;
+			levelColumns[level] = width / size;
+			numNodes += (width / size) * (height / size);
+		}
+
+		states.assign(numNodes, node_state_none);
+		owners.assign(numNodes, 0);
+		for (uint32 node = 0; node < getLevelEnd(0); ++node)
+		{
+			states[node] = node_state_free;
+		}
+
+		entries.clear();
+		frame = 0;
+		allocatedTexels = 0;
+		fragmentedLevel = (uint32)-1;
+		stats = {};
+	}
+
+	uint32 shadow_atlas::getNodeIndex(uint32 level, uint32 x, uint32 y) const
+	{
+		return levelOffsets[level] + y * levelColumns[level] + x;
+	}
+
+	uint32 shadow_atlas::getLevelEnd(uint32 level) const
+	{
+		return (level + 1 < numLevels) ? levelOffsets[level + 1] : (uint32)states.size();
+	}
+
+	uint32 shadow_atlas::getLevel(uint32 size) const
+	{
+		return index_of_least_significant_set_bit(maximumSize) - index_of_least_significant_set_bit(size);
+	}
+
+	uint32 shadow_atlas::getAncestor(uint32 level, uint32 node, uint32 ancestorLevel) const
+	{
+		uint32 local = node - levelOffsets[level];
+		uint32 shift = level - ancestorLevel;
+		return getNodeIndex(ancestorLevel, (local % levelColumns[level]) >> shift, (local / levelColumns[level]) >> shift);
+	}
+
+	uint32 shadow_atlas::getParent(uint32 level, uint32 node) const
+	{
+		return getAncestor(level, node, level - 1);
+	}
+
+	void shadow_atlas::getChildren(uint32 level, uint32 node, uint32 outChildren[4]) const
+	{
+		uint32 local = node - levelOffsets[level];
+		uint32 x = (local % levelColumns[level]) * 2;
+		uint32 y = (local / levelColumns[level]) * 2;
+		outChildren[0] = getNodeIndex(level + 1, x, y);
+		outChildren[1] = getNodeIndex(level + 1, x + 1, y);
+		outChildren[2] = getNodeIndex(level + 1, x, y + 1);
+		outChildren[3] = getNodeIndex(level + 1, x + 1, y + 1);
+	}
+
+	uint32 shadow_atlas::getNumFreeChildren(uint32 level, uint32 parent) const
+	{
+		uint32 children[4];
+		getChildren(level, parent, children);
+
+		uint32 result = 0;
+		for (uint32 child : children)
+		{
+			result += (states[child] == node_state_free);
+		}
+		return result;
+	}
+
+	shadow_map_viewport shadow_atlas::getViewport(uint32 level, uint32 node) const
+	{
+		uint32 local = node - levelOffsets[level];
+		uint32 size = maximumSize >> level;
+		return { (uint16)((local % levelColumns[level]) * size), (uint16)((local / levelColumns[level]) * size), (uint16)size };
+	}
+
+	uint32 shadow_atlas::findFreeNode(uint32 level) const
+	{
+		uint32 result = SHADOW_ATLAS_NULL_NODE;
+		uint32 resultFreeSiblings = 4;
+		for (uint32 node = levelOffsets[level]; node < getLevelEnd(level); ++node)
+		{
+			if (states[node] != node_state_free)
+			{
+				continue;
+			}
+
+			if (level == 0)
+			{
+				return node;
+			}
+
+			// Counts the node itself, too.
+			uint32 freeSiblings = getNumFreeChildren(level - 1, getParent(level, node));
+			if (freeSiblings < resultFreeSiblings)
+			{
+				result = node;
+				resultFreeSiblings = freeSiblings;
+			}
+		}
+		return result;
+	}
+
+	uint32 shadow_atlas::allocateNode(uint32 level)
+	{
+		uint32 node = findFreeNode(level);
+		if (node == SHADOW_ATLAS_NULL_NODE)
+		{
+			// Split the smallest free node above.
+			uint32 splitLevel = level;
+			while (splitLevel > 0 && node == SHADOW_ATLAS_NULL_NODE)
+			{
+				node = findFreeNode(--splitLevel);
+			}
+
+			if (node == SHADOW_ATLAS_NULL_NODE)
+			{
+				return SHADOW_ATLAS_NULL_NODE;
+			}
+
+			node = splitNode(splitLevel, node, level);
+		}
+
+		states[node] = node_state_allocated;
+
+		// Whoever failed at this size got its node, or will have to report it again.
+		if (level <= fragmentedLevel)
+		{
+			fragmentedLevel = (uint32)-1;
+		}
+		return node;
+	}
+
+	uint32 shadow_atlas::splitNode(uint32 level, uint32 node, uint32 targetLevel)
+	{
+		for (; level < targetLevel; ++level)
+		{
+			uint32 children[4];
+			getChildren(level, node, children);
+
+			states[node] = node_state_split;
+			for (uint32 child : children)
+			{
+				states[child] = node_state_free;
+			}
+			node = children[0];
+		}
+		return node;
+	}
+
+	void shadow_atlas::freeNode(uint32 level, uint32 node)
+	{
+		states[node] = node_state_free;
+
+		// Merge free siblings into their parent.
+		while (level > 0)
+		{
+			uint32 parent = getParent(level, node);
+			if (getNumFreeChildren(level - 1, parent) < 4)
+			{
+				break;
+			}
+
+			uint32 children[4];
+			getChildren(level - 1, parent, children);
+			for (uint32 child : children)
+			{
+				states[child] = node_state_none;
+			}
+
+			states[parent] = node_state_free;
+			node = parent;
+			--level;
+		}
+	}
+
+	float shadow_atlas::getEvictionCost(const entry& e) const
+	{
+		if (e.lastUsedFrame == frame)
+		{
+			return FLT_MAX;
+		}
+		return e.priority / (float)(1 + (frame - e.lastUsedFrame));
+	}
+
+	float shadow_atlas::getEvictionCost(uint32 level, uint32 node) const
+	{
+		switch (states[node])
+		{
+			case node_state_allocated:
+				return getEvictionCost(entries.at(owners[node]));
+
+			case node_state_split:
+			{
+				uint32 children[4];
+				getChildren(level, node, children);
+
+				float result = 0.f;
+				for (uint32 child : children)
+				{
+					float cost = getEvictionCost(level + 1, child);
+					if (cost == FLT_MAX)
+					{
+						return FLT_MAX;
+					}
+					result += cost;
+				}
+				return result;
+			}
+
+			default:
+				return 0.f;
+		}
+	}
+
+	void shadow_atlas::findEvictionCandidate(uint32 level, uint32 node, uint32 targetLevel, float& bestCost, uint32& outLevel, uint32& outNode) const
+	{
+		if (states[node] == node_state_free || states[node] == node_state_none)
+		{
+			return;
+		}
+
+		// A single allocation of at least the target size, or everything inside a node of exactly the target size.
+		if (states[node] == node_state_allocated || level == targetLevel)
+		{
+			float cost = getEvictionCost(level, node);
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				outLevel = level;
+				outNode = node;
+			}
+			return;
+		}
+
+		uint32 children[4];
+		getChildren(level, node, children);
+		for (uint32 child : children)
+		{
+			findEvictionCandidate(level + 1, child, targetLevel, bestCost, outLevel, outNode);
+		}
+	}
+
+	void shadow_atlas::evictSubtree(uint32 level, uint32 node)
+	{
+		if (states[node] == node_state_allocated)
+		{
+			freeEntry(owners[node]);
+			++stats.numEvictions;
+		}
+		else if (states[node] == node_state_split)
+		{
+			uint32 children[4];
+			getChildren(level, node, children);
+			for (uint32 child : children)
+			{
+				evictSubtree(level + 1, child);
+			}
+		}
+	}
+
+	void shadow_atlas::freeEntry(uint64 lightID)
+	{
+		auto it = entries.find(lightID);
+		ASSERT(it != entries.end());
+
+		uint64 size = maximumSize >> it->second.level;
+		allocatedTexels -= size * size;
+
+		freeNode(it->second.level, it->second.node);
+		entries.erase(it);
+	}
+
+	uint32 shadow_atlas::allocate(uint32 level, float priority)
+	{
+		uint32 node = allocateNode(level);
+		if (node != SHADOW_ATLAS_NULL_NODE)
+		{
+			return node;
+		}
+
+		uint64 size = maximumSize >> level;
+		if ((uint64)width * height - allocatedTexels >= size * size)
+		{
+			fragmentedLevel = min(fragmentedLevel, level);
+		}
+
+		float cost = FLT_MAX;
+		uint32 candidateLevel = 0;
+		uint32 candidate = SHADOW_ATLAS_NULL_NODE;
+		for (uint32 root = 0; root < getLevelEnd(0); ++root)
+		{
+			findEvictionCandidate(0, root, level, cost, candidateLevel, candidate);
+		}
+
+		if (candidate == SHADOW_ATLAS_NULL_NODE || cost >= priority)
+		{
+			return SHADOW_ATLAS_NULL_NODE;
+		}
+
+		evictSubtree(candidateLevel, candidate);
+		return allocateNode(level);
+	}
+
+	shadow_atlas_allocation shadow_atlas::request(uint64 lightID, uint64 lightMovementHash, uint32 size, float priority)
+	{
+		ASSERT(numLevels > 0);
+
+		++stats.numRequests;
+
+		uint32 minimumSize = maximumSize >> (numLevels - 1);
+		size = min(max(align_to_power_of_two(size), minimumSize), maximumSize);
+		uint32 level = getLevel(size);
+
+		auto it = entries.find(lightID);
+		if (it != entries.end())
+		{
+			entry& e = it->second;
+			if (e.requestedLevel == level)
+			{
+				e.lastUsedFrame = frame;
+				e.priority = priority;
+
+				// Downsized allocations grow back once there is space, without evicting anything for it.
+				if (e.level > level)
+				{
+					uint32 node = allocateNode(level);
+					if (node != SHADOW_ATLAS_NULL_NODE)
+					{
+						uint64 oldSize = maximumSize >> e.level;
+						allocatedTexels += (uint64)size * size - oldSize * oldSize;
+
+						freeNode(e.level, e.node);
+						owners[node] = lightID;
+						e.node = node;
+						e.level = level;
+						e.contentValid = false;
+					}
+				}
+
+				bool cacheHit = e.contentValid && e.lightMovementHash == lightMovementHash;
+				e.lightMovementHash = lightMovementHash;
+				e.contentValid = true;
+
+				stats.numCacheHits += cacheHit;
+				return { getViewport(e.level, e.node), cacheHit };
+			}
+
+			freeEntry(lightID);
+		}
+
+		uint32 allocatedLevel = level;
+		uint32 node = SHADOW_ATLAS_NULL_NODE;
+		for (; allocatedLevel < numLevels && node == SHADOW_ATLAS_NULL_NODE; ++allocatedLevel)
+		{
+			node = allocate(allocatedLevel, priority);
+		}
+		--allocatedLevel;
+
+		if (node == SHADOW_ATLAS_NULL_NODE)
+		{
+			// The minimum size, whatever the eviction costs. Only allocations used in this frame are kept.
+			node = allocate(allocatedLevel, FLT_MAX);
+		}
+
+		if (node == SHADOW_ATLAS_NULL_NODE)
+		{
+			++stats.numFailed;
+			return { { 0, 0, 0 }, false };
+		}
+
+		stats.numDownsized += (allocatedLevel != level);
+
+		uint64 allocatedSize = maximumSize >> allocatedLevel;
+		allocatedTexels += allocatedSize * allocatedSize;
+
+		owners[node] = lightID;
+		entries[lightID] = { node, allocatedLevel, level, lightMovementHash, frame, priority, true };
+
+		return { getViewport(allocatedLevel, node), false };
+	}
+
+	void shadow_atlas::release(uint64 lightID)
+	{
+		if (entries.find(lightID) != entries.end())
+		{
+			freeEntry(lightID);
+		}
+	}
+
+	bool shadow_atlas::relocateOne(uint32 regionLevel)
+	{
+		// Regions are the nodes of the size which could not be allocated. Allocations move out of the emptiest regions into
+		// holes of the fullest ones, until one region is empty. Every move makes the occupancy of the regions more uneven,
+		// so allocations never move back and forth.
+		uint32 regionBegin = levelOffsets[regionLevel];
+		std::vector<uint64> occupancy(getLevelEnd(regionLevel) - regionBegin, 0);
+		for (const auto& [lightID, e] : entries)
+		{
+			if (e.level >= regionLevel)
+			{
+				uint64 size = maximumSize >> e.level;
+				occupancy[getAncestor(e.level, e.node, regionLevel) - regionBegin] += size * size;
+			}
+		}
+
+		// Per level, the free node in the fullest region. Ties go to the lower region index.
+		std::vector<uint32> targets(numLevels, SHADOW_ATLAS_NULL_NODE);
+		std::vector<uint32> targetRegions(numLevels, 0);
+		for (uint32 level = regionLevel; level < numLevels; ++level)
+		{
+			for (uint32 node = levelOffsets[level]; node < getLevelEnd(level); ++node)
+			{
+				if (states[node] != node_state_free)
+				{
+					continue;
+				}
+
+				uint32 region = getAncestor(level, node, regionLevel) - regionBegin;
+				uint32 best = targetRegions[level];
+				if (targets[level] == SHADOW_ATLAS_NULL_NODE || occupancy[region] > occupancy[best] || (occupancy[region] == occupancy[best] && region < best))
+				{
+					targets[level] = node;
+					targetRegions[level] = region;
+				}
+			}
+		}
+
+		uint64 sourceID = 0;
+		uint32 sourceRegion = 0;
+		uint32 target = SHADOW_ATLAS_NULL_NODE;
+		uint32 targetLevel = 0;
+
+		for (const auto& [lightID, e] : entries)
+		{
+			if (e.level <= regionLevel || e.lastUsedFrame == frame)
+			{
+				continue;
+			}
+
+			// Fullest region with a large enough hole, and the smallest such hole in it.
+			uint32 t = SHADOW_ATLAS_NULL_NODE;
+			uint32 tLevel = 0;
+			uint32 tRegion = 0;
+			for (uint32 level = regionLevel; level <= e.level; ++level)
+			{
+				uint32 region = targetRegions[level];
+				if (targets[level] != SHADOW_ATLAS_NULL_NODE
+					&& (t == SHADOW_ATLAS_NULL_NODE || occupancy[region] > occupancy[tRegion] || (occupancy[region] == occupancy[tRegion] && region <= tRegion)))
+				{
+					t = targets[level];
+					tLevel = level;
+					tRegion = region;
+				}
+			}
+
+			uint32 region = getAncestor(e.level, e.node, regionLevel) - regionBegin;
+			if (t == SHADOW_ATLAS_NULL_NODE || tRegion == region
+				|| occupancy[tRegion] < occupancy[region] || (occupancy[tRegion] == occupancy[region] && tRegion > region))
+			{
+				continue;
+			}
+
+			// From the emptiest region. Ties go to the higher region index.
+			if (target == SHADOW_ATLAS_NULL_NODE || occupancy[region] < occupancy[sourceRegion] || (occupancy[region] == occupancy[sourceRegion] && region > sourceRegion))
+			{
+				sourceID = lightID;
+				sourceRegion = region;
+				target = t;
+				targetLevel = tLevel;
+			}
+		}
+
+		if (target == SHADOW_ATLAS_NULL_NODE)
+		{
+			return false;
+		}
+
+		entry& e = entries.at(sourceID);
+		uint32 node = splitNode(targetLevel, target, e.level);
+		states[node] = node_state_allocated;
+		owners[node] = sourceID;
+
+		freeNode(e.level, e.node);
+		e.node = node;
+		e.contentValid = false;
+
+		++stats.numRelocations;
+		return true;
+	}
+
+	void shadow_atlas::beginFrame()
+	{
+		++frame;
+
+		if (fragmentedLevel == (uint32)-1)
+		{
+			return;
+		}
+
+		for (uint32 i = 0; i < maxRelocationsPerFrame; ++i)
+		{
+			bool resolved = false;
+			for (uint32 level = 0; level <= fragmentedLevel && !resolved; ++level)
+			{
+				resolved = (findFreeNode(level) != SHADOW_ATLAS_NULL_NODE);
+			}
+
+			if (resolved || !relocateOne(fragmentedLevel))
+			{
+				fragmentedLevel = (uint32)-1;
+				break;
+			}
+		}
+	}
+
+	shadow_atlas_stats shadow_atlas::getStats() const
+	{
+		shadow_atlas_stats result = stats;
+		result.numAllocations = (uint32)entries.size();
+		result.allocatedTexels = allocatedTexels;
+		result.totalTexels = (uint64)width * height;
+		result.largestFreeSize = 0;
+		for (uint32 level = 0; level < numLevels; ++level)
+		{
+			if (findFreeNode(level) != SHADOW_ATLAS_NULL_NODE)
+			{
+				result.largestFreeSize = maximumSize >> level;
+				break;
+			}
+		}
+		return result;
+	}
+
+	void shadow_atlas::resetStats()
+	{
+		stats = {};
+	}
+
+	void shadow_atlas::getViewports(std::vector<shadow_map_viewport>& outFree, std::vector<shadow_map_viewport>& outAllocated) const
+	{
+		for (uint32 level = 0; level < numLevels; ++level)
+		{
+			for (uint32 node = levelOffsets[level]; node < getLevelEnd(level); ++node)
+			{
+				if (states[node] == node_state_free)
+				{
+					outFree.push_back(getViewport(level, node));
+				}
+				else if (states[node] == node_state_allocated)
+				{
+					outAllocated.push_back(getViewport(level, node));
+				}
+			}
+		}
+	}
+}
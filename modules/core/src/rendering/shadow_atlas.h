@@ -0,0 +1,151 @@
+// Copyright (c) 2023-present Eldar Muradov. All rights reserved.
+
+#pragma once
+
+#include "core_api.h"
+
+#include "core/math.h"
+
+#include <unordered_map>
+
+namespace era_engine
+{
+	struct shadow_map_viewport
+	{
+		uint16 x, y;
+		uint16 size;
+	};
+
+	// Result of a request. The viewport has size 0 if nothing could be allocated.
+	struct shadow_atlas_allocation
+	{
+		shadow_map_viewport viewport;
+
+		// The static geometry rendered into this viewport on a previous frame is still valid.
+		bool cacheHit;
+	};
+
+	struct shadow_atlas_stats
+	{
+		NODISCARD float occupancy() const { return totalTexels ? (float)allocatedTexels / totalTexels : 0.f; }
+		NODISCARD float cacheHitRate() const { return numRequests ? (float)numCacheHits / numRequests : 0.f; }
+
+		// Current state.
+		uint32 numAllocations;
+		uint64 allocatedTexels;
+		uint64 totalTexels;
+		uint32 largestFreeSize; // 0 if full.
+
+		// Since initialize or resetStats.
+		uint64 numRequests;
+		uint64 numCacheHits;
+		uint64 numEvictions;
+		uint64 numRelocations; // By defragmentation.
+		uint64 numDownsized; // Allocated smaller than requested.
+		uint64 numFailed;
+	};
+
+	// Allocator for square, power of two sized shadow map viewports in one atlas texture. The atlas is split into tiles of
+	// the maximum size, each of which is the root of a quadtree down to the minimum size. Free siblings merge back into
+	// their parent. New allocations go into the free node of the requested size whose parent has the fewest other free
+	// children, so that partially used nodes fill up first.
+	//
+	// Allocations are cached per light ID across frames, so that a light which did not move may reuse the static geometry
+	// rendered into its viewport. Allocations of lights which were not requested in the current frame are evicted when
+	// space runs out, cheapest first. An allocation's cost is its light's priority, e.g. scaled by its screen coverage,
+	// over the number of frames since it was last used. If the cheapest set of allocations which frees a large enough node
+	// costs more than the requesting light's priority, a smaller size is tried first.
+	//
+	// When a request fails because free space is scattered over small nodes, the following frames move a few allocations
+	// of partially free nodes into holes of fuller ones, until a node of the failed size is free again. Moved allocations
+	// report a cache miss once.
+	struct ERA_CORE_API shadow_atlas
+	{
+		// Sizes must be powers of two, and the atlas dimensions multiples of the maximum size.
+		void initialize(uint32 width, uint32 height, uint32 maximumSize, uint32 minimumSize);
+
+		// Allocations requested in the current frame are never evicted or moved. Runs the defragmentation steps.
+		void beginFrame();
+
+		// 'size' is rounded up to a power of two and clamped to the atlas' size range. The same light must pass the same
+		// movement hash for as long as its static geometry is unchanged.
+		shadow_atlas_allocation request(uint64 lightID, uint64 lightMovementHash, uint32 size, float priority);
+
+		void release(uint64 lightID);
+
+		NODISCARD shadow_atlas_stats getStats() const;
+		void resetStats();
+
+		// For visualization.
+		void getViewports(std::vector<shadow_map_viewport>& outFree, std::vector<shadow_map_viewport>& outAllocated) const;
+
+		uint32 maxRelocationsPerFrame = 2;
+
+	private:
+		enum node_state : uint8
+		{
+			node_state_none, // Part of a free or allocated ancestor.
+			node_state_free,
+			node_state_split,
+			node_state_allocated,
+		};
+
+		struct entry
+		{
+			uint32 node;
+			uint32 level;
+			uint32 requestedLevel;
+			uint64 lightMovementHash;
+			uint64 lastUsedFrame;
+			float priority;
+			bool contentValid;
+		};
+
+		NODISCARD uint32 getNodeIndex(uint32 level, uint32 x, uint32 y) const;
+		NODISCARD uint32 getLevelEnd(uint32 level) const;
+		NODISCARD uint32 getLevel(uint32 size) const;
+		NODISCARD uint32 getAncestor(uint32 level, uint32 node, uint32 ancestorLevel) const;
+		NODISCARD uint32 getParent(uint32 level, uint32 node) const;
+		void getChildren(uint32 level, uint32 node, uint32 outChildren[4]) const;
+		NODISCARD uint32 getNumFreeChildren(uint32 level, uint32 parent) const;
+		NODISCARD shadow_map_viewport getViewport(uint32 level, uint32 node) const;
+
+		uint32 findFreeNode(uint32 level) const;
+		uint32 splitNode(uint32 level, uint32 node, uint32 targetLevel);
+		uint32 allocateNode(uint32 level);
+		void freeNode(uint32 level, uint32 node);
+
+		uint32 allocate(uint32 level, float priority);
+		void freeEntry(uint64 lightID);
+
+		NODISCARD float getEvictionCost(const entry& e) const;
+		NODISCARD float getEvictionCost(uint32 level, uint32 node) const;
+		void findEvictionCandidate(uint32 level, uint32 node, uint32 targetLevel, float& bestCost, uint32& outLevel, uint32& outNode) const;
+		void evictSubtree(uint32 level, uint32 node);
+
+		bool relocateOne(uint32 regionLevel);
+
+		uint32 width = 0;
+		uint32 height = 0;
+		uint32 maximumSize = 0;
+		uint32 numLevels = 0;
+
+		// Per level.
+		std::vector<uint32> levelOffsets;
+		std::vector<uint32> levelColumns;
+
+		// Per node.
+		std::vector<node_state> states;
+		std::vector<uint64> owners;
+
+		std::unordered_map<uint64, entry> entries;
+
+		uint64 frame = 0;
+		uint64 allocatedTexels = 0;
+
+		// Coarsest level at which a request found no free node despite enough free texels, or -1.
+		uint32 fragmentedLevel = (uint32)-1;
+
+		shadow_atlas_stats stats = {};
+	};
+}
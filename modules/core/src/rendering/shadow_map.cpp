@@ -32,7 +32,7 @@ namespace era_engine
 		return result;
 	}
 
-	std::pair<shadow_render_command, spot_shadow_info> determineSpotShadowInfo(const spot_light_cb& spotLight, uint32 lightID, uint32 resolution, bool invalidateCache)
+	std::pair<shadow_render_command, spot_shadow_info> determineSpotShadowInfo(const spot_light_cb& spotLight, uint32 lightID, uint32 resolution, float priority, bool invalidateCache)
 	{
 		uint64 uniqueID = ((uint64)(lightID + 1) << 32);
 
@@ -40,7 +40,7 @@ namespace era_engine
 
 		shadow_render_command result{};
 
-		auto [vp, staticCacheAvailable] = assignShadowMapViewport(uniqueID, movementHash, resolution);
+		auto [vp, staticCacheAvailable] = assignShadowMapViewport(uniqueID, movementHash, resolution, priority);
 		result.viewports[0] = vp;
 
 		result.renderStaticGeometry = !staticCacheAvailable || invalidateCache;
@@ -53,7 +53,7 @@ namespace era_engine
 		return { result, si };
 	}
 
-	std::pair<shadow_render_command, point_shadow_info> determinePointShadowInfo(const point_light_cb& pointLight, uint32 lightID, uint32 resolution, bool invalidateCache)
+	std::pair<shadow_render_command, point_shadow_info> determinePointShadowInfo(const point_light_cb& pointLight, uint32 lightID, uint32 resolution, float priority, bool invalidateCache)
 	{
 		uint64 uniqueID = ((uint64)(lightID + 1) << 32);
 
@@ -61,8 +61,18 @@ namespace era_engine
 
 		shadow_render_command result{};
 
-		auto [vp0, staticCacheAvailable0] = assignShadowMapViewport(uniqueID, movementHash, resolution);
-		auto [vp1, staticCacheAvailable1] = assignShadowMapViewport(uniqueID + 1, movementHash, resolution);
+		auto [vp0, staticCacheAvailable0] = assignShadowMapViewport(uniqueID, movementHash, resolution, priority);
+		auto [vp1, staticCacheAvailable1] = assignShadowMapViewport(uniqueID + 1, movementHash, resolution, priority);
+
+		// The light is skipped unless both faces fit, so a face which did get space must not keep it.
+		if (vp0.size == 0 || vp1.size == 0)
+		{
+			releaseShadowMapViewport(uniqueID);
+			releaseShadowMapViewport(uniqueID + 1);
+			vp0 = {};
+			vp1 = {};
+		}
+
 		result.viewports[0] = vp0;
 		result.viewports[1] = vp1;
 
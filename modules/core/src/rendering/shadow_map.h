@@ -16,8 +16,10 @@ namespace era_engine
 	};
 
 	shadow_render_command determineSunShadowInfo(directional_light& sun, bool invalidateCache);
-	std::pair<shadow_render_command, spot_shadow_info> determineSpotShadowInfo(const spot_light_cb& spotLight, uint32 lightID, uint32 resolution, bool invalidateCache);
-	std::pair<shadow_render_command, point_shadow_info> determinePointShadowInfo(const point_light_cb& pointLight, uint32 lightID, uint32 resolution, bool invalidateCache);
+
+	// The viewports have size 0 if the shadow map atlas is full. See getShadowMapPriority for the priority.
+	std::pair<shadow_render_command, spot_shadow_info> determineSpotShadowInfo(const spot_light_cb& spotLight, uint32 lightID, uint32 resolution, float priority, bool invalidateCache);
+	std::pair<shadow_render_command, point_shadow_info> determinePointShadowInfo(const point_light_cb& pointLight, uint32 lightID, uint32 resolution, float priority, bool invalidateCache);
 
 	struct shadow_render_data
 	{
@@ -24,146 +24,24 @@ namespace era_engine
 	static_assert(is_power_of_two(maximumSize), "");
 	static_assert(is_power_of_two(minimumSize), "");
 
-	static constexpr uint32 numBuckets = index_of_least_significant_set_bit(maximumSize) - index_of_least_significant_set_bit(minimumSize) + 1;
-	static std::vector<shadow_map_viewport> nodes[numBuckets];
-
-	struct shadow_map_cache
-	{
-		shadow_map_viewport viewport;
-		uint64 lightMovementHash;
-	};
-
-	static std::unordered_map<uint64, shadow_map_cache> cachedAllocations;
+	static shadow_atlas atlas;
 
 	static ref<dx_texture> visTexture;
 
-	static void initialize()
-	{
-		for (uint32 y = 0; y < SHADOW_MAP_HEIGHT / maximumSize; ++y)
-		{
-			for (uint32 x = 0; x < SHADOW_MAP_WIDTH / maximumSize; ++x)
-			{
-				nodes[0].push_back({ (uint16)(x * maximumSize), (uint16)(y * maximumSize), maximumSize });
-			}
-		}
-	}
-
-	NODISCARD static uint32 getIndex(uint32 size)
-	{
-		uint32 index = index_of_least_significant_set_bit(size) - index_of_least_significant_set_bit(minimumSize);
-		index = numBuckets - index - 1;
-		return index;
-	}
-
-	NODISCARD static shadow_map_viewport allocateShadowViewport(uint32 size)
-	{
-		ASSERT(size <= maximumSize);
-		ASSERT(size >= minimumSize);
-		ASSERT(is_power_of_two(size));
-
-		uint32 index = getIndex(size);
-
-		uint32 insertIndex = index;
-		for (; insertIndex != -1 && nodes[insertIndex].size() == 0; --insertIndex);
-
-		ASSERT(insertIndex != -1); // TODO: Handle error
-		ASSERT(nodes[insertIndex].size() > 0);
-
-		for (uint32 i = insertIndex; i < index; ++i)
-		{
-			uint16 nodeSize = 1u << (index_of_least_significant_set_bit(maximumSize) - i);
-			uint16 halfSize = nodeSize / 2;
-
-			shadow_map_viewport n = nodes[i].back();
-			nodes[i].pop_back();
-
-			nodes[i + 1].push_back({ n.x, n.y, halfSize });
-			nodes[i + 1].push_back({ (uint16)(n.x + halfSize), n.y, halfSize });
-			nodes[i + 1].push_back({ n.x, (uint16)(n.y + halfSize), halfSize });
-			nodes[i + 1].push_back({ (uint16)(n.x + halfSize), (uint16)(n.y + halfSize), halfSize });
-		}
-
-		shadow_map_viewport result = nodes[index].back();
-		nodes[index].pop_back();
-		return result;
-	}
-
-	static void freeShadowViewport(shadow_map_viewport remove)
-	{
-		if (remove.size == maximumSize)
-		{
-			nodes[0].push_back(remove);
-			return;
-		}
-
-		uint32 index = getIndex(remove.size);
-		std::vector<shadow_map_viewport>& list = nodes[index];
-		if (list.size() == 0)
-		{
-			list.push_back(remove);
-			return;
-		}
-
-		uint32 doubleSize = remove.size * 2;
-		uint32 shift = index_of_least_significant_set_bit(doubleSize);
-
-		uint32 parentX = remove.x >> shift;
-		uint32 parentY = remove.y >> shift;
-		uint32 parentWidth = SHADOW_MAP_WIDTH >> shift;
-		uint32 parentIndex = parentY * parentWidth + parentX;
-
-		uint32 nodesWithThisParent = 0;
-		auto insertIt = list.end();
-
-		for (auto it = list.begin(); it != list.end(); ++it)
-		{
-			shadow_map_viewport node = *it;
-
-			uint32 pX = node.x >> shift;
-			uint32 pY = node.y >> shift;
-			uint32 pi = pY * parentWidth + pX;
-
-			if (pi == parentIndex)
-			{
-				++nodesWithThisParent;
-			}
-			else if (pi > parentIndex)
-			{
-				insertIt = it;
-				break;
-			}
-		}
-
-		ASSERT(nodesWithThisParent < 4);
-
-		if (nodesWithThisParent == 3)
-		{
-			auto eraseIt = insertIt - 3;
-			list.erase(eraseIt, insertIt);
-			freeShadowViewport(shadow_map_viewport{ (uint16)(parentX * doubleSize), (uint16)(parentY * doubleSize), (uint16)doubleSize });
-		}
-		else
-		{
-			list.insert(insertIt, remove);
-		}
-	}
-
 	static void visualize(dx_command_list* cl, ref<dx_texture> texture)
 	{
-		for (uint32 i = 0; i < numBuckets; ++i)
-		{
-			std::vector<shadow_map_viewport>& nodesInLevel = nodes[i];
+		std::vector<shadow_map_viewport> freeViewports;
+		std::vector<shadow_map_viewport> allocatedViewports;
+		atlas.getViewports(freeViewports, allocatedViewports);
 
-			for (shadow_map_viewport vp : nodesInLevel)
-			{
-				clear_rect rect = { vp.x, vp.y, vp.size, vp.size };
-				cl->clearRTV(texture, 0.f, 1.f, 0.f, 1.f, &rect, 1);
-			}
+		for (shadow_map_viewport vp : freeViewports)
+		{
+			clear_rect rect = { vp.x, vp.y, vp.size, vp.size };
+			cl->clearRTV(texture, 0.f, 1.f, 0.f, 1.f, &rect, 1);
 		}
 
-		for (auto a : cachedAllocations)
+		for (shadow_map_viewport vp : allocatedViewports)
 		{
-			auto vp = a.second.viewport;
 			clear_rect rect = { vp.x, vp.y, vp.size, vp.size };
 			cl->clearRTV(texture, 1.f, 0.f, 0.f, 1.f, &rect, 1);
 		}
@@ -171,52 +49,56 @@ namespace era_engine
 
 	static bool init = false;
 
-	NODISCARD std::pair<shadow_map_viewport, bool> assignShadowMapViewport(uint64 uniqueLightID, uint64 lightMovementHash, uint32 size)
+	static void initializeIfNecessary()
 	{
 		if (!init)
 		{
-			initialize();
+			atlas.initialize(SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT, maximumSize, minimumSize);
 #if DEBUG_VISUALIZATION
 			visTexture = createTexture(0, SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT, DXGI_FORMAT_R8G8B8A8_UNORM, false, true, false);
 #endif
 			init = true;
 		}
+	}
 
-		bool staticCacheAvailable = false;
-		shadow_map_viewport vp;
+	void beginShadowMapAllocationFrame()
+	{
+		initializeIfNecessary();
+		atlas.beginFrame();
+	}
 
-		auto it = cachedAllocations.find(uniqueLightID);
-		if (it == cachedAllocations.end())
-		{
-			// New light
-			vp = allocateShadowViewport(size);
-			it = cachedAllocations.insert({ uniqueLightID, { vp, lightMovementHash } }).first;
-		}
-		else
-		{
-			if (it->second.viewport.size != size)
-			{
-				// Reallocate
-				freeShadowViewport(it->second.viewport);
-				vp = allocateShadowViewport(size);
-				it->second.viewport = vp;
-			}
-			else
-			{
-				if (it->second.lightMovementHash == lightMovementHash)
-				{
-					staticCacheAvailable = true;
-				}
+	NODISCARD std::pair<shadow_map_viewport, bool> assignShadowMapViewport(uint64 uniqueLightID, uint64 lightMovementHash, uint32 size, float priority)
+	{
+		initializeIfNecessary();
+
+		shadow_atlas_allocation allocation = atlas.request(uniqueLightID, lightMovementHash, size, priority);
+		return { allocation.viewport, allocation.cacheHit && enableStaticShadowMapCaching };
+	}
 
-				vp = it->second.viewport;
-			}
+	void releaseShadowMapViewport(uint64 uniqueLightID)
+	{
+		initializeIfNecessary();
+		atlas.release(uniqueLightID);
+	}
 
-			it->second.lightMovementHash = lightMovementHash;
+	NODISCARD float getShadowMapPriority(const render_camera& camera, vec3 position, float radius, float lightPriority)
+	{
+		// Fraction of the screen covered by the light's sphere of influence, ignoring the screen's borders.
+		float distance = length(position - camera.position);
+		if (distance <= radius)
+		{
+			return lightPriority;
 		}
 
-		staticCacheAvailable &= enableStaticShadowMapCaching;
+		float ndcRadius = radius / (sqrt(distance * distance - radius * radius) * tan(camera.verticalFOV * 0.5f));
+		float coverage = min(M_PI * ndcRadius * ndcRadius / (4.f * camera.aspect), 1.f);
+		return lightPriority * coverage;
+	}
 
-		return { vp, staticCacheAvailable };
+	NODISCARD shadow_atlas_stats getShadowMapAllocationStats()
+	{
+		initializeIfNecessary();
+		return atlas.getStats();
 	}
 
 	NODISCARD uint64 getLightMovementHash(const directional_light& dl)
@@ -256,8 +138,14 @@ namespace era_engine
 			visualize(cl, visTexture);
 			dxContext.executeCommandList(cl);
 
+			shadow_atlas_stats stats = atlas.getStats();
+
 			ImGui::Begin("Settings");
 			ImGui::Image(visTexture, 512, 512);
+			ImGui::Text("Occupancy: %.1f%%, largest free: %u", stats.occupancy() * 100.f, stats.largestFreeSize);
+			ImGui::Text("Cache hit rate: %.1f%%", stats.cacheHitRate() * 100.f);
+			ImGui::Text("Evictions: %llu, relocations: %llu, downsized: %llu, failed: %llu",
+				stats.numEvictions, stats.numRelocations, stats.numDownsized, stats.numFailed);
 			ImGui::End();
 		}
 #endif
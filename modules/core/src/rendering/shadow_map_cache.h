@@ -4,18 +4,15 @@
 
 #include "core/math.h"
 
+#include "rendering/shadow_atlas.h"
+
 struct spot_light_cb;
 struct point_light_cb;
 
 namespace era_engine
 {
 	class directional_light;
-
-	struct shadow_map_viewport
-	{
-		uint16 x, y;
-		uint16 size;
-	};
+	struct render_camera;
 
 	extern bool enableStaticShadowMapCaching;
 
@@ -24,7 +21,20 @@ namespace era_engine
 	NODISCARD uint64 getLightMovementHash(const spot_light_cb& sl);
 	NODISCARD uint64 getLightMovementHash(const point_light_cb& pl);
 
-	// Returns true, if static cache is available.
-	NODISCARD std::pair<shadow_map_viewport, bool> assignShadowMapViewport(uint64 uniqueLightID, uint64 lightMovementHash, uint32 size);
+	// Call once per frame, before any viewports are assigned.
+	void beginShadowMapAllocationFrame();
+
+	// Returns true, if static cache is available. When the atlas is full, cached viewports of lights with the lowest
+	// priority, which were not assigned in this frame, are evicted first. See shadow_atlas. The viewport may be smaller
+	// than requested, or have size 0 if there is no space left at all.
+	NODISCARD std::pair<shadow_map_viewport, bool> assignShadowMapViewport(uint64 uniqueLightID, uint64 lightMovementHash, uint32 size, float priority = FLT_MAX);
+
+	// Frees the light's viewport right away, e.g. when a light needs several viewports and not all of them could be assigned.
+	void releaseShadowMapViewport(uint64 uniqueLightID);
+
+	// The light's own priority, scaled by the fraction of the screen its sphere of influence covers.
+	NODISCARD float getShadowMapPriority(const render_camera& camera, vec3 position, float radius, float lightPriority);
+
+	NODISCARD shadow_atlas_stats getShadowMapAllocationStats();
 	void updateShadowMapAllocationVisualization();
 }
\ No newline at end of file
@@ -232,16 +232,31 @@ namespace era_engine
 
         float scale = 1.f / (boundingBox.maxCorner.y - boundingBox.minCorner.y);
 
+        std::vector<vec3> queries;
         for (auto& sub : submeshes)
         {
             for (uint32 i = 0; i < sub.info.numVertices; ++i)
+            {
+                queries.push_back(positions[i + sub.info.baseVertex]);
+            }
+        }
+
+        std::vector<NearestNeighborQueryResult> trunkNeighbors(queries.size());
+        std::vector<NearestNeighborQueryResult> branchNeighbors(queries.size());
+        trunkPC.nearest_neighbor_batch(queries.data(), (uint32)queries.size(), trunkNeighbors.data());
+        branchPC.nearest_neighbor_batch(queries.data(), (uint32)queries.size(), branchNeighbors.data());
+
+        uint32 queryIndex = 0;
+        for (auto& sub : submeshes)
+        {
+            for (uint32 i = 0; i < sub.info.numVertices; ++i, ++queryIndex)
             {
                 uint32 vertexID = i + sub.info.baseVertex;
 
-                vec3 query = positions[vertexID];
+                vec3 query = queries[queryIndex];
 
-                float distanceToTrunk = sqrt(trunkPC.nearest_neighbor_index(query).squared_distance);
-                float distanceToBranch = sqrt(branchPC.nearest_neighbor_index(query).squared_distance);
+                float distanceToTrunk = sqrt(trunkNeighbors[queryIndex].squared_distance);
+                float distanceToBranch = sqrt(branchNeighbors[queryIndex].squared_distance);
 
                 distanceToBranch = min(distanceToTrunk, distanceToBranch);
 
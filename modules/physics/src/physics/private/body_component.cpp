@@ -114,6 +114,7 @@ namespace era_engine::physics
 
 		TransformComponent* transform = entity.get_component_if_exists<TransformComponent>();
 		transform->type = TransformComponent::DYNAMIC;
+		entity.patch_component<TransformComponent>();
 		const vec3& pos = transform->transform.position;
 		PxVec3 pospx = create_PxVec3(pos);
 
@@ -1,17 +1,33 @@
 import argparse
 import subprocess
+import sys
 
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(prog='AssetsCompiler')
-    parser.add_argument('-p', '--path')
+    parser.add_argument('-p', '--path', help='Compile a single asset')
+    parser.add_argument('-d', '--dir', help='Compile all models in a directory tree')
+    parser.add_argument('-m', '--manifest', help='Compile all assets listed in a file, one path per line')
+    parser.add_argument('--cache', help='Asset cache directory')
+    parser.add_argument('--db', help='Dependency database (default: <cache>/dependencies.yaml)')
+    parser.add_argument('-f', '--force', action='store_true', help='Rebuild all assets, even if they are up to date')
     parser.add_argument('-v', '--verbose', action='store_true')
     parser.add_argument('-c', '--compiler')
     args = parser.parse_args()
 
-    startline = [f'{args.compiler}', f'--verbose={int(args.verbose)}', '--path', f'{args.path}']
-    proc = subprocess.Popen(startline, stdout=subprocess.PIPE)
+    if not (args.path or args.dir or args.manifest):
+        parser.error('one of --path, --dir or --manifest is required')
+
+    startline = [f'{args.compiler}', f'--verbose={int(args.verbose)}', f'--force={int(args.force)}']
+    for option in ('path', 'dir', 'manifest', 'cache', 'db'):
+        value = getattr(args, option)
+        if value:
+            startline += [f'--{option}', f'{value}']
+
+    # The compiler prints one line per asset and a summary, so pass its output through.
+    proc = subprocess.Popen(startline, stdout=sys.stdout, stderr=sys.stderr)
     proc.wait()
     if proc.returncode == 0:
         print("Compiled successfuly")
     else:
-        print("Failed to compile asset!")
+        print("Failed to compile assets!")
+    sys.exit(proc.returncode)